@@ -0,0 +1,217 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "bandIO.h"
+
+/* BandHelper
+ * ----------
+ * Persistent thread running the transfers started by a single thread, in the
+ * order they were started.
+ */
+typedef struct BandHelper {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t queued; // Signalled when a transfer is queued, or on stop
+    pthread_cond_t finished; // Signalled when a transfer completes
+    BandTransfer* head;
+    BandTransfer* tail;
+    bool stop;
+} BandHelper;
+
+// Each thread starting transfers has its own helper, created on first use and
+// stopped when the thread exits. Creation is only attempted once per thread.
+static thread_local BandHelper* boundHelper = NULL;
+static thread_local bool helperAttempted = false;
+
+static pthread_key_t helperKey;
+static pthread_once_t helperKeyOnce = PTHREAD_ONCE_INIT;
+static bool helperKeyCreated = false;
+
+static void run_band_transfer(BandTransfer* transfer)
+{
+    if (transfer->file != NULL) {
+        transfer->transferred
+                = fread(transfer->buffer, 1, transfer->length, transfer->file);
+        return;
+    }
+
+    const unsigned char* data = transfer->buffer;
+    size_t remaining = transfer->length;
+
+    while (remaining) {
+        const ssize_t written = write(transfer->fd, data, remaining);
+
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        data += written;
+        remaining -= (size_t)written;
+    }
+
+    transfer->transferred = transfer->length - remaining;
+}
+
+static void* run_band_helper(void* arg)
+{
+    BandHelper* helper = (BandHelper*)arg;
+
+    pthread_mutex_lock(&(helper->lock));
+
+    while (1) {
+        while ((helper->head == NULL) && !(helper->stop)) {
+            pthread_cond_wait(&(helper->queued), &(helper->lock));
+        }
+
+        // Queued transfers are completed before stopping
+        BandTransfer* transfer = helper->head;
+        if (transfer == NULL) {
+            break;
+        }
+
+        helper->head = transfer->next;
+        if (helper->head == NULL) {
+            helper->tail = NULL;
+        }
+
+        pthread_mutex_unlock(&(helper->lock));
+        run_band_transfer(transfer);
+        pthread_mutex_lock(&(helper->lock));
+
+        transfer->done = true;
+        pthread_cond_broadcast(&(helper->finished));
+    }
+
+    pthread_mutex_unlock(&(helper->lock));
+    return NULL;
+}
+
+static void destroy_band_helper(BandHelper* helper)
+{
+    pthread_mutex_destroy(&(helper->lock));
+    pthread_cond_destroy(&(helper->queued));
+    pthread_cond_destroy(&(helper->finished));
+    free(helper);
+}
+
+// Destructor of helperKey, run when a thread with a helper exits
+static void stop_band_helper(void* arg)
+{
+    BandHelper* helper = (BandHelper*)arg;
+
+    pthread_mutex_lock(&(helper->lock));
+    helper->stop = true;
+    pthread_cond_signal(&(helper->queued));
+    pthread_mutex_unlock(&(helper->lock));
+
+    pthread_join(helper->thread, NULL);
+    destroy_band_helper(helper);
+}
+
+static void create_helper_key(void)
+{
+    helperKeyCreated = (pthread_key_create(&helperKey, stop_band_helper) == 0);
+}
+
+/* band_helper()
+ * -------------
+ * Returns: The helper of the calling thread, creating it on first use, or NULL
+ * if it could not be created.
+ */
+static BandHelper* band_helper(void)
+{
+    if (helperAttempted) {
+        return boundHelper;
+    }
+    helperAttempted = true;
+
+    pthread_once(&helperKeyOnce, create_helper_key);
+    if (!helperKeyCreated) {
+        return NULL;
+    }
+
+    BandHelper* helper = malloc(sizeof(BandHelper));
+    if (helper == NULL) {
+        return NULL;
+    }
+
+    *helper = (BandHelper){0};
+    pthread_mutex_init(&(helper->lock), NULL);
+    pthread_cond_init(&(helper->queued), NULL);
+    pthread_cond_init(&(helper->finished), NULL);
+
+    if (pthread_create(&(helper->thread), NULL, run_band_helper, helper)
+            != 0) {
+        destroy_band_helper(helper);
+        return NULL;
+    }
+
+    pthread_setspecific(helperKey, helper);
+    boundHelper = helper;
+    return helper;
+}
+
+/* start_band_transfer()
+ * ---------------------
+ * Queues the transfer for the helper of the calling thread, or runs it
+ * immediately if there is no helper.
+ */
+static void start_band_transfer(BandTransfer* transfer)
+{
+    BandHelper* helper = band_helper();
+
+    if (helper == NULL) {
+        run_band_transfer(transfer);
+        return;
+    }
+
+    transfer->helper = helper;
+
+    pthread_mutex_lock(&(helper->lock));
+
+    if (helper->tail) {
+        helper->tail->next = transfer;
+    } else {
+        helper->head = transfer;
+    }
+    helper->tail = transfer;
+
+    pthread_cond_signal(&(helper->queued));
+    pthread_mutex_unlock(&(helper->lock));
+}
+
+void start_band_read(BandTransfer* transfer, FILE* file, void* buffer,
+        const size_t length)
+{
+    *transfer = (BandTransfer){
+            .file = file, .fd = -1, .buffer = buffer, .length = length};
+    start_band_transfer(transfer);
+}
+
+void start_band_write(BandTransfer* transfer, const int fd, const void* buffer,
+        const size_t length)
+{
+    *transfer = (BandTransfer){
+            .fd = fd, .buffer = (void*)buffer, .length = length};
+    start_band_transfer(transfer);
+}
+
+size_t finish_band_transfer(BandTransfer* transfer)
+{
+    BandHelper* helper = transfer->helper;
+
+    if (helper != NULL) {
+        pthread_mutex_lock(&(helper->lock));
+        while (!(transfer->done)) {
+            pthread_cond_wait(&(helper->finished), &(helper->lock));
+        }
+        pthread_mutex_unlock(&(helper->lock));
+
+        transfer->helper = NULL;
+    }
+
+    return transfer->transferred;
+}
@@ -0,0 +1,69 @@
+#ifndef BAND_IO_H
+#define BAND_IO_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <pthread.h>
+
+// Pixel data is read and written in bands of around this many bytes
+#define BAND_BYTES (4 * 1024 * 1024)
+
+/* BandTransfer
+ * ------------
+ * A single read or write of a band of pixel data, queued for a helper thread
+ * so that the caller can decode or encode the previous band in the meantime.
+ * Each thread starting transfers has one persistent helper, which runs its
+ * transfers in order and exits along with it.
+ *
+ * Loading and writing double buffer through a transfer, so throughput is
+ * bounded by the slower of I/O and conversion, rather than their sum.
+ */
+typedef struct BandTransfer {
+    struct BandHelper* helper; // Helper running the transfer, NULL once done
+    struct BandTransfer* next; // Next transfer queued for the helper
+    bool done;
+    FILE* file; // Source of a read, otherwise NULL
+    int fd; // Destination of a write
+    void* buffer;
+    size_t length;
+    size_t transferred;
+} BandTransfer;
+
+/* start_band_read()
+ * -----------------
+ * Begins reading from the current position of the file into the buffer. The
+ * file and buffer must not be used until finish_band_transfer() returns.
+ * Falls back to reading synchronously if the helper cannot be created.
+ *
+ * transfer: Transfer to start, which must not already be in progress.
+ * file: File to read from.
+ * buffer: Destination for the band.
+ * length: Number of bytes to read.
+ */
+void start_band_read(BandTransfer* transfer, FILE* file, void* buffer,
+        const size_t length);
+
+/* start_band_write()
+ * ------------------
+ * Begins writing the buffer to a file descriptor, resuming partial writes. The
+ * buffer must not be modified until finish_band_transfer() returns.
+ *
+ * transfer: Transfer to start, which must not already be in progress.
+ * fd: File descriptor to write to.
+ * buffer: Band to write.
+ * length: Number of bytes to write.
+ */
+void start_band_write(BandTransfer* transfer, const int fd, const void* buffer,
+        const size_t length);
+
+/* finish_band_transfer()
+ * ----------------------
+ * Waits for a transfer to complete. Every transfer started must be finished
+ * before its struct goes out of scope.
+ *
+ * Returns: The number of bytes transferred, which is less than the length
+ * requested if an error or end of file occurred.
+ */
+size_t finish_band_transfer(BandTransfer* transfer);
+
+#endif
@@ -0,0 +1,605 @@
+// copy_file_range(), futimens(), mkstemp() and mmap() are not declared in
+// strict C23 mode
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "cache.h"
+#include "bandIO.h"
+#include "imageEditing.h"
+#include "tiles.h"
+
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
+
+// Primes of XXH64
+constexpr uint64_t prime1 = 0x9E3779B185EBCA87u;
+constexpr uint64_t prime2 = 0xC2B2AE3D27D4EB4Fu;
+constexpr uint64_t prime3 = 0x165667B19E3779F9u;
+constexpr uint64_t prime4 = 0x85EBCA77C2B2AE63u;
+constexpr uint64_t prime5 = 0x27D4EB2F165667C5u;
+
+// Bytes consumed by each round of the four accumulators
+constexpr size_t stripeLength = 32;
+
+// Entries are named by their key in hexadecimal, followed by a suffix
+constexpr char outputSuffix[] = ".out";
+constexpr char imageSuffix[] = ".sig";
+constexpr size_t entryNameLength = 20;
+
+// Temporary files are hidden, so are never mistaken for entries
+constexpr char temporaryName[] = ".tmp-XXXXXX";
+
+// Marks the headers which follow the tiles of a cached image
+constexpr char headersMagic[] = "SIGC";
+
+/* CachedHeaders
+ * -------------
+ * Headers of a cached image, along with its layout, appended to the tiled
+ * file holding its pixels, which are located through the index of the file.
+ */
+typedef struct {
+    BmpHeader bmpHeader;
+    BmpInfoHeader infoHeader;
+    uint32_t layout;
+    char magic[sizeof(headersMagic) - 1];
+} CachedHeaders;
+
+static inline uint64_t rotate_left(const uint64_t value, const int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline uint64_t read_u64(const uint8_t* src)
+{
+    uint64_t value;
+    memcpy(&value, src, sizeof(value));
+    return value;
+}
+
+static inline uint32_t read_u32(const uint8_t* src)
+{
+    uint32_t value;
+    memcpy(&value, src, sizeof(value));
+    return value;
+}
+
+static inline uint64_t hash_round(uint64_t acc, const uint64_t input)
+{
+    acc += input * prime2;
+    return rotate_left(acc, 31) * prime1;
+}
+
+static inline uint64_t merge_round(uint64_t acc, const uint64_t value)
+{
+    acc ^= hash_round(0, value);
+    return (acc * prime1) + prime4;
+}
+
+uint64_t hash_bytes(const void* data, const size_t length, const uint64_t seed)
+{
+    const uint8_t* src = data;
+    const uint8_t* const end = src + length;
+    uint64_t hash;
+
+    if (length >= stripeLength) {
+        uint64_t acc[4] = {seed + prime1 + prime2, seed + prime2, seed,
+                seed - prime1};
+
+        for (; src + stripeLength <= end; src += stripeLength) {
+            for (size_t i = 0; i < 4; i++) {
+                acc[i] = hash_round(acc[i], read_u64(src + (i * 8)));
+            }
+        }
+
+        hash = rotate_left(acc[0], 1) + rotate_left(acc[1], 7)
+                + rotate_left(acc[2], 12) + rotate_left(acc[3], 18);
+
+        for (size_t i = 0; i < 4; i++) {
+            hash = merge_round(hash, acc[i]);
+        }
+    } else {
+        hash = seed + prime5;
+    }
+
+    hash += length;
+
+    for (; src + 8 <= end; src += 8) {
+        hash ^= hash_round(0, read_u64(src));
+        hash = (rotate_left(hash, 27) * prime1) + prime4;
+    }
+
+    if (src + 4 <= end) {
+        hash ^= (uint64_t)read_u32(src) * prime1;
+        hash = (rotate_left(hash, 23) * prime2) + prime3;
+        src += 4;
+    }
+
+    for (; src < end; src++) {
+        hash ^= *src * prime5;
+        hash = rotate_left(hash, 11) * prime1;
+    }
+
+    // Avalanche
+    hash ^= hash >> 33;
+    hash *= prime2;
+    hash ^= hash >> 29;
+    hash *= prime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+/* read_fully()
+ * ------------
+ * Reads length bytes from the offset, resuming partial reads.
+ *
+ * Returns: 0 on success, -1 on error or end of file.
+ */
+static int read_fully(
+        const int fd, uint8_t* buffer, const size_t length, const off_t offset)
+{
+    size_t done = 0;
+
+    while (done < length) {
+        const ssize_t nRead = pread(
+                fd, buffer + done, length - done, offset + (off_t)done);
+
+        if ((nRead < 0) && (errno == EINTR)) {
+            continue;
+        }
+
+        if (nRead <= 0) {
+            return -1;
+        }
+        done += (size_t)nRead;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int hash_file(const int fd, uint64_t* hash)
+{
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        return -1;
+    }
+
+    // Each band is hashed separately, then the hashes of the bands together
+    const size_t length = (size_t)info.st_size;
+    const size_t nBands = (length + BAND_BYTES - 1) / BAND_BYTES;
+    uint64_t* hashes = malloc((nBands + 1) * sizeof(uint64_t));
+    if (hashes == NULL) {
+        return -1;
+    }
+
+    uint8_t* data = (length)
+            ? mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0)
+            : MAP_FAILED;
+    int result = EXIT_SUCCESS;
+
+    if (data != MAP_FAILED) {
+#pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < nBands; i++) {
+            const size_t start = i * BAND_BYTES;
+            const size_t n = ((length - start) < BAND_BYTES) ? (length - start)
+                                                             : BAND_BYTES;
+            hashes[i] = hash_bytes(data + start, n, i);
+        }
+        munmap(data, length);
+
+    } else if (nBands) {
+        uint8_t* buffer = malloc(BAND_BYTES);
+        result = (buffer == NULL) ? -1 : EXIT_SUCCESS;
+
+        for (size_t i = 0; (i < nBands) && (result == EXIT_SUCCESS); i++) {
+            const size_t start = i * BAND_BYTES;
+            const size_t n = ((length - start) < BAND_BYTES) ? (length - start)
+                                                             : BAND_BYTES;
+
+            result = read_fully(fd, buffer, n, (off_t)start);
+            hashes[i] = hash_bytes(buffer, n, i);
+        }
+        free(buffer);
+    }
+
+    *hash = hash_bytes(hashes, nBands * sizeof(uint64_t), length);
+    free(hashes);
+    return result;
+}
+
+int hash_path(const char* filePath, uint64_t* hash)
+{
+    const int fd = open(filePath, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    const int result = hash_file(fd, hash);
+    close(fd);
+    return result;
+}
+
+int create_cache_directory(const char* directory)
+{
+    struct stat info;
+
+    if ((mkdir(directory, 0777) != 0) && (errno != EEXIST)) {
+        return -1;
+    }
+
+    return ((stat(directory, &info) == 0) && S_ISDIR(info.st_mode))
+            ? EXIT_SUCCESS
+            : -1;
+}
+
+/* entry_path()
+ * ------------
+ * Formats the path of the entry with the key and suffix.
+ *
+ * Returns: 0 on success, -1 if the path is too long.
+ */
+static int entry_path(char (*path)[PATH_MAX], const ResultCache* cache,
+        const uint64_t key, const char* suffix)
+{
+    const int length = snprintf(*path, sizeof(*path), "%s/%016" PRIx64 "%s",
+            cache->directory, key, suffix);
+
+    return ((length > 0) && ((size_t)length < sizeof(*path))) ? EXIT_SUCCESS
+                                                              : -1;
+}
+
+/* create_temporary()
+ * ------------------
+ * Creates a uniquely named hidden file in the cache directory, to be renamed
+ * into place once complete.
+ *
+ * Returns: The file descriptor, or -1 on error.
+ */
+static int create_temporary(char (*path)[PATH_MAX], const ResultCache* cache)
+{
+    const int length = snprintf(
+            *path, sizeof(*path), "%s/%s", cache->directory, temporaryName);
+
+    if ((length < 0) || ((size_t)length >= sizeof(*path))) {
+        return -1;
+    }
+
+    return mkstemp(*path);
+}
+
+/* copy_file()
+ * -----------
+ * Copies the remainder of one file to another, by cloning its extents where
+ * the file system supports it, then within the kernel, falling back to reads
+ * and writes (such as for pipes).
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+static int copy_file(const int src, const int dest)
+{
+#ifdef FICLONE
+    // Clones replace the entire destination
+    if ((lseek(dest, 0, SEEK_CUR) == 0) && (ioctl(dest, FICLONE, src) == 0)) {
+        return EXIT_SUCCESS;
+    }
+#endif
+
+    while (1) {
+        const ssize_t copied
+                = copy_file_range(src, NULL, dest, NULL, BAND_BYTES, 0);
+
+        if (copied == 0) {
+            return EXIT_SUCCESS;
+        }
+
+        if (copied < 0) {
+            break;
+        }
+    }
+
+    uint8_t* buffer = malloc(BAND_BYTES);
+    if (buffer == NULL) {
+        return -1;
+    }
+
+    int result = EXIT_SUCCESS;
+    while (1) {
+        const ssize_t nRead = read(src, buffer, BAND_BYTES);
+
+        if ((nRead < 0) && (errno == EINTR)) {
+            continue;
+        }
+
+        if (nRead <= 0) {
+            result = (nRead < 0) ? -1 : EXIT_SUCCESS;
+            break;
+        }
+
+        BandTransfer transfer;
+        start_band_write(&transfer, dest, buffer, (size_t)nRead);
+        if (finish_band_transfer(&transfer) != (size_t)nRead) {
+            result = -1;
+            break;
+        }
+    }
+
+    free(buffer);
+    return result;
+}
+
+/* CacheEntry
+ * ----------
+ * Name, size and time of last use of an entry, when trimming the cache.
+ */
+typedef struct {
+    char name[entryNameLength + 1];
+    off_t size;
+    struct timespec used;
+} CacheEntry;
+
+static int compare_use(const void* a, const void* b)
+{
+    const struct timespec* first = &(((const CacheEntry*)a)->used);
+    const struct timespec* second = &(((const CacheEntry*)b)->used);
+
+    if (first->tv_sec != second->tv_sec) {
+        return (first->tv_sec < second->tv_sec) ? -1 : 1;
+    }
+
+    if (first->tv_nsec != second->tv_nsec) {
+        return (first->tv_nsec < second->tv_nsec) ? -1 : 1;
+    }
+    return 0;
+}
+
+/* is_entry_name()
+ * ---------------
+ * Returns: true if the file name is that of an entry, rather than a temporary
+ * or unrelated file.
+ */
+static bool is_entry_name(const char* name)
+{
+    const size_t length = strlen(name);
+
+    return (length == entryNameLength) && (name[0] != '.')
+            && (!strcmp(name + length - strlen(outputSuffix), outputSuffix)
+                    || !strcmp(name + length - strlen(imageSuffix),
+                            imageSuffix));
+}
+
+/* trim_cache()
+ * ------------
+ * Removes the least recently used entries until the cache is within its limit.
+ * Entries are marked as used by their modification time, which is updated on
+ * each hit, as access times are often not recorded.
+ */
+static void trim_cache(const ResultCache* cache)
+{
+    DIR* dir = opendir(cache->directory);
+    if (dir == NULL) {
+        return;
+    }
+
+    CacheEntry* entries = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    size_t total = 0;
+    struct dirent* file;
+
+    while ((file = readdir(dir)) != NULL) {
+        struct stat info;
+
+        if (!is_entry_name(file->d_name)
+                || (fstatat(dirfd(dir), file->d_name, &info, 0) != 0)
+                || !S_ISREG(info.st_mode)) {
+            continue;
+        }
+
+        if (count == capacity) {
+            capacity = (capacity) ? (capacity * 2) : 64;
+            CacheEntry* resized = realloc(entries, capacity * sizeof(*entries));
+
+            if (resized == NULL) {
+                break;
+            }
+            entries = resized;
+        }
+
+        CacheEntry* entry = &(entries[count++]);
+        memcpy(entry->name, file->d_name, entryNameLength + 1);
+        entry->size = info.st_size;
+        entry->used = info.st_mtim;
+        total += (size_t)info.st_size;
+    }
+
+    if (total > cache->limit) {
+        qsort(entries, count, sizeof(*entries), compare_use);
+
+        for (size_t i = 0; (i < count) && (total > cache->limit); i++) {
+            // Entries removed by another process no longer count either way
+            (void)unlinkat(dirfd(dir), entries[i].name, 0);
+            total -= (size_t)entries[i].size;
+        }
+    }
+
+    free(entries);
+    closedir(dir);
+}
+
+/* add_entry()
+ * -----------
+ * Renames a completed temporary file into place as an entry, replacing any
+ * entry of the same name, then trims the cache. The temporary file is removed
+ * if it is incomplete.
+ */
+static void add_entry(const ResultCache* cache, const char* temporary,
+        const uint64_t key, const char* suffix, const bool complete)
+{
+    char path[PATH_MAX];
+
+    if (!complete || (entry_path(&path, cache, key, suffix) == -1)
+            || (rename(temporary, path) != 0)) {
+        unlink(temporary);
+        return;
+    }
+
+    trim_cache(cache);
+}
+
+int fetch_cached_output(
+        const ResultCache* cache, const uint64_t key, const char* filePath)
+{
+    char path[PATH_MAX];
+    if (entry_path(&path, cache, key, outputSuffix) == -1) {
+        return -1;
+    }
+
+    const int src = open(path, O_RDONLY);
+    if (src < 0) {
+        return -1;
+    }
+
+    const int dest = open_output(filePath);
+    int result = (dest < 0) ? -1 : copy_file(src, dest);
+
+    if ((dest >= 0) && (close(dest) != 0)) {
+        result = -1;
+    }
+
+    // Hits are the most recently used entries
+    if (result == EXIT_SUCCESS) {
+        (void)futimens(src, NULL);
+    }
+
+    close(src);
+    return result;
+}
+
+void store_cached_output(
+        const ResultCache* cache, const uint64_t key, const char* filePath)
+{
+    // Output written to stdout cannot be read back
+    if (is_stream_path(filePath)) {
+        return;
+    }
+
+    const int src = open(filePath, O_RDONLY);
+    if (src < 0) {
+        return;
+    }
+
+    char temporary[PATH_MAX];
+    const int dest = create_temporary(&temporary, cache);
+    if (dest < 0) {
+        close(src);
+        return;
+    }
+
+    bool complete = (copy_file(src, dest) == EXIT_SUCCESS);
+    complete = (close(dest) == 0) && complete;
+    close(src);
+
+    add_entry(cache, temporary, key, outputSuffix, complete);
+}
+
+int fetch_cached_image(
+        const ResultCache* cache, const uint64_t key, BMP* bmpImage)
+{
+    char path[PATH_MAX];
+    if (entry_path(&path, cache, key, imageSuffix) == -1) {
+        return -1;
+    }
+
+    BMP cached;
+    initialise_bmp(&cached);
+    cached.format = FORMAT_SIG;
+    cached.file = fopen(path, "rb");
+    if (cached.file == NULL) {
+        return -1;
+    }
+
+    CachedHeaders headers;
+    bool loaded = (fseek(cached.file, -(long)sizeof(headers), SEEK_END) == 0)
+            && (fread(&headers, sizeof(headers), 1, cached.file) == 1)
+            && !memcmp(headers.magic, headersMagic, sizeof(headers.magic))
+            && (headers.layout != LAYOUT_INDEX8);
+
+    if (loaded) {
+        rewind(cached.file);
+        cached.layout = (PixelLayout)headers.layout;
+        loaded = (read_tiled_header(&cached) == EXIT_SUCCESS)
+                && ((cached.image = load_tiles(&cached, NULL)) != NULL)
+                && (convert_image_layout(cached.image, cached.layout)
+                        == EXIT_SUCCESS);
+    }
+
+    if (!loaded) {
+        free_image_resources(&cached);
+        return -1;
+    }
+
+    // Hits are the most recently used entries
+    (void)futimens(fileno(cached.file), NULL);
+
+    free_image(&(bmpImage->image));
+    free_image(&(bmpImage->base));
+    bmpImage->image = cached.image;
+    bmpImage->bmpHeader = headers.bmpHeader;
+    bmpImage->infoHeader = headers.infoHeader;
+
+    cached.image = NULL;
+    free_image_resources(&cached);
+    return EXIT_SUCCESS;
+}
+
+void store_cached_image(
+        const ResultCache* cache, const uint64_t key, const BMP* bmpImage)
+{
+    const Image* image = bmpImage->image;
+    if (image->layout == LAYOUT_INDEX8) {
+        return;
+    }
+
+    char temporary[PATH_MAX];
+    const int fd = create_temporary(&temporary, cache);
+    if (fd < 0) {
+        return;
+    }
+    close(fd);
+
+    // Padded pixels keep their alpha, even if the file they were read from has
+    // none, and rows are tiled in the order they are held in memory
+    BMP stored = *bmpImage;
+    (stored.infoHeader).bitsPerPixel = (image->layout == LAYOUT_BGRX) ? 32 : 24;
+    (stored.infoHeader).bitmapHeight = (int32_t)image->height;
+
+    CachedHeaders headers = {
+            .bmpHeader = bmpImage->bmpHeader,
+            .infoHeader = bmpImage->infoHeader,
+            .layout = image->layout,
+    };
+    memcpy(headers.magic, headersMagic, sizeof(headers.magic));
+
+    bool complete = (write_tiles(&stored, temporary) == EXIT_SUCCESS);
+
+    FILE* file = (complete) ? fopen(temporary, "ab") : NULL;
+    complete = (file != NULL)
+            && (fwrite(&headers, sizeof(headers), 1, file) == 1);
+
+    if ((file != NULL) && (fclose(file) != 0)) {
+        complete = false;
+    }
+
+    add_entry(cache, temporary, key, imageSuffix, complete);
+}
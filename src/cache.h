@@ -0,0 +1,97 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "fileParsing.h"
+
+// Size the cache is trimmed to after each entry is added, unless given
+#define CACHE_DEFAULT_LIMIT_MB 1024
+
+/* ResultCache
+ * -----------
+ * Directory of results keyed by the hash of everything that produced them:
+ * the contents of the input files, along with the commands and parameters.
+ * Entries are shared between runs and threads, as each is written to a
+ * temporary file then renamed into place. The least recently used entries
+ * are removed once the directory exceeds its limit.
+ */
+typedef struct {
+    const char* directory;
+    size_t limit; // Bytes
+} ResultCache;
+
+/* hash_bytes()
+ * ------------
+ * Hashes a block of memory with XXH64.
+ *
+ * Returns: The 64-bit hash.
+ */
+uint64_t hash_bytes(const void* data, const size_t length, const uint64_t seed);
+
+/* hash_file()
+ * -----------
+ * Hashes the entire contents of an open file, regardless of its position,
+ * which is left unchanged. The file is mapped into memory where possible, and
+ * hashed in chunks in parallel.
+ *
+ * fd: File descriptor of the file to hash.
+ * hash: Destination for the hash.
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+[[nodiscard]] int hash_file(const int fd, uint64_t* hash);
+
+/* hash_path()
+ * -----------
+ * Hashes the entire contents of the file at the path (see hash_file()).
+ *
+ * Returns: 0 on success, -1 if the file could not be read.
+ */
+[[nodiscard]] int hash_path(const char* filePath, uint64_t* hash);
+
+/* create_cache_directory()
+ * ------------------------
+ * Creates the directory of a cache, unless it already exists.
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+[[nodiscard]] int create_cache_directory(const char* directory);
+
+/* fetch_cached_output()
+ * ---------------------
+ * Copies a cached output file to the path, cloning its extents where the file
+ * system allows.
+ *
+ * Returns: 0 on a hit, or -1 if there is no entry or it could not be copied.
+ */
+[[nodiscard]] int fetch_cached_output(
+        const ResultCache* cache, const uint64_t key, const char* filePath);
+
+/* store_cached_output()
+ * ---------------------
+ * Adds a copy of a written output file to the cache. Failure only means that
+ * the result is not cached.
+ */
+void store_cached_output(
+        const ResultCache* cache, const uint64_t key, const char* filePath);
+
+/* fetch_cached_image()
+ * --------------------
+ * Loads an intermediate image from the cache, replacing the image and headers
+ * of the BMP.
+ *
+ * Returns: 0 on a hit, or -1 if there is no entry or it could not be loaded.
+ */
+[[nodiscard]] int fetch_cached_image(
+        const ResultCache* cache, const uint64_t key, BMP* bmpImage);
+
+/* store_cached_image()
+ * --------------------
+ * Adds an intermediate image to the cache as a tiled file (see tiles.h), along
+ * with its headers. Indexed images are not cached.
+ */
+void store_cached_image(
+        const ResultCache* cache, const uint64_t key, const BMP* bmpImage);
+
+#endif
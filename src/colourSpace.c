@@ -0,0 +1,303 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "colourSpace.h"
+
+// Pixels converted at a time, so that a block of each row stays in L1 cache
+// across every adjustment of a chain
+constexpr size_t blockPixels = 256;
+
+// Luma and chroma are held with 8 fractional bits, as converted from RGB with
+// 16 bit BT.601 (full range) coefficients
+constexpr int32_t forwardShift = 8;
+constexpr int32_t forwardHalf = 1 << (forwardShift - 1);
+
+constexpr int32_t yRed = 19595; // 0.299
+constexpr int32_t yGreen = 38470; // 0.587
+constexpr int32_t yBlue = 7471; // 0.114
+constexpr int32_t cbRed = -11059; // -0.168736
+constexpr int32_t cbGreen = -21709; // -0.331264
+constexpr int32_t cbBlue = 32768; // 0.5
+constexpr int32_t crRed = 32768; // 0.5
+constexpr int32_t crGreen = -27439; // -0.418688
+constexpr int32_t crBlue = -5329; // -0.081312
+
+// Converted back with 12 bit coefficients, removing the fractional bits too
+constexpr int32_t inverseBits = 12;
+constexpr int32_t inverseShift = inverseBits + 8;
+constexpr int32_t inverseHalf = 1 << (inverseShift - 1);
+
+constexpr int32_t redCr = 5743; // 1.402
+constexpr int32_t greenCb = -1410; // -0.344136
+constexpr int32_t greenCr = -2925; // -0.714136
+constexpr int32_t blueCb = 7258; // 1.772
+
+// Largest luma, and the chroma magnitude kept between adjustments, which
+// bounds every product below to 31 bits
+constexpr int32_t lumaMax = 255 << 8;
+constexpr int32_t chromaLimit = 255 << 8;
+
+// Fractional bits of the parameters of each adjustment
+constexpr int32_t rotationShift = 14;
+constexpr int32_t factorShift = 10;
+constexpr int32_t weightShift = 12;
+
+/* StepKernel
+ * ----------
+ * Fixed-point parameters of an adjustment, computed once per image.
+ */
+typedef struct {
+    ColourOp op;
+    int32_t scale; // Cosine, saturation factor or lightness weight
+    int32_t term; // Sine, or the luma added by lightness
+} StepKernel;
+
+/* rotation()
+ * ----------
+ * Finds the cosine and sine of an angle in degrees, in fixed point. The
+ * angle is reduced to within half a turn, where their series converge in a
+ * few terms.
+ */
+static void rotation(const float degrees, int32_t* cosine, int32_t* sine)
+{
+    constexpr double pi = 3.14159265358979323846;
+    constexpr int terms = 24;
+
+    double turns = (double)degrees / 360.0;
+    turns -= (double)(long long)turns;
+    if (turns > 0.5) {
+        turns -= 1.0;
+    } else if (turns < -0.5) {
+        turns += 1.0;
+    }
+
+    const double x = 2.0 * pi * turns;
+    double cosSum = 0.0;
+    double sinSum = 0.0;
+    double term = 1.0; // x^n / n!
+
+    for (int n = 0; n < terms; n++) {
+        switch (n & 3) {
+        case 0:
+            cosSum += term;
+            break;
+        case 1:
+            sinSum += term;
+            break;
+        case 2:
+            cosSum -= term;
+            break;
+        default:
+            sinSum -= term;
+            break;
+        }
+        term *= x / (double)(n + 1);
+    }
+
+    const double one = (double)(1 << rotationShift);
+    *cosine = (int32_t)((cosSum * one) + ((cosSum < 0) ? -0.5 : 0.5));
+    *sine = (int32_t)((sinSum * one) + ((sinSum < 0) ? -0.5 : 0.5));
+}
+
+/* make_kernel()
+ * -------------
+ * Returns: The fixed-point parameters of the adjustment.
+ */
+static StepKernel make_kernel(const ColourStep* step)
+{
+    StepKernel kernel = {.op = step->op};
+
+    switch (step->op) {
+    case COLOUR_HUE_ROTATE:
+        rotation(step->amount, &(kernel.scale), &(kernel.term));
+        break;
+
+    case COLOUR_SATURATION:
+        kernel.scale = (int32_t)((step->amount * (1 << factorShift)) + 0.5f);
+        break;
+
+    case COLOUR_LIGHTNESS: {
+        // Positive amounts blend towards white, negative towards black
+        const float blend = step->amount / LIGHTNESS_MAX;
+        const float magnitude = (blend < 0) ? -blend : blend;
+        const int32_t weight = (int32_t)(magnitude * (1 << weightShift) + 0.5f);
+
+        kernel.scale = (1 << weightShift) - weight;
+        kernel.term = (blend > 0) ? (weight * lumaMax) : 0;
+        break;
+    }
+    }
+
+    return kernel;
+}
+
+static inline int32_t clamp_chroma(const int32_t value)
+{
+    return (value > chromaLimit) ? chromaLimit
+            : (value < -chromaLimit) ? -chromaLimit
+                                     : value;
+}
+
+static inline uint8_t clamp_channel(const int32_t value)
+{
+    return (uint8_t)((value > UINT8_MAX) ? UINT8_MAX
+                    : (value < 0)        ? 0
+                                         : value);
+}
+
+/* load_block()
+ * ------------
+ * Converts a block of BGR or BGRX pixels to luma and chroma.
+ */
+static inline void load_block(const uint8_t* restrict src,
+        const size_t pixelBytes, const size_t n, int32_t* restrict luma,
+        int32_t* restrict cb, int32_t* restrict cr)
+{
+#pragma omp simd
+    for (size_t i = 0; i < n; i++) {
+        const int32_t blue = src[i * pixelBytes];
+        const int32_t green = src[(i * pixelBytes) + 1];
+        const int32_t red = src[(i * pixelBytes) + 2];
+
+        luma[i] = ((yRed * red) + (yGreen * green) + (yBlue * blue)
+                          + forwardHalf)
+                >> forwardShift;
+        cb[i] = ((cbRed * red) + (cbGreen * green) + (cbBlue * blue)
+                        + forwardHalf)
+                >> forwardShift;
+        cr[i] = ((crRed * red) + (crGreen * green) + (crBlue * blue)
+                        + forwardHalf)
+                >> forwardShift;
+    }
+}
+
+/* store_block()
+ * -------------
+ * Converts a block of luma and chroma back to BGR or BGRX pixels, leaving any
+ * alpha unchanged.
+ */
+static inline void store_block(uint8_t* restrict dest, const size_t pixelBytes,
+        const size_t n, const int32_t* restrict luma,
+        const int32_t* restrict cb, const int32_t* restrict cr)
+{
+#pragma omp simd
+    for (size_t i = 0; i < n; i++) {
+        const int32_t base = (luma[i] << inverseBits) + inverseHalf;
+
+        dest[i * pixelBytes] = clamp_channel(
+                (base + (blueCb * cb[i])) >> inverseShift);
+        dest[(i * pixelBytes) + 1] = clamp_channel(
+                (base + (greenCb * cb[i]) + (greenCr * cr[i]))
+                >> inverseShift);
+        dest[(i * pixelBytes) + 2] = clamp_channel(
+                (base + (redCr * cr[i])) >> inverseShift);
+    }
+}
+
+/* adjust_block()
+ * --------------
+ * Applies each adjustment of the chain to a block of luma and chroma.
+ */
+static void adjust_block(const size_t n, int32_t* restrict luma,
+        int32_t* restrict cb, int32_t* restrict cr,
+        const StepKernel* kernels, const size_t count)
+{
+    for (size_t k = 0; k < count; k++) {
+        const int32_t scale = kernels[k].scale;
+        const int32_t term = kernels[k].term;
+
+        switch (kernels[k].op) {
+        case COLOUR_HUE_ROTATE:
+#pragma omp simd
+            for (size_t i = 0; i < n; i++) {
+                const int32_t blue = cb[i];
+                const int32_t red = cr[i];
+                cb[i] = clamp_chroma(
+                        ((blue * scale) - (red * term)
+                                + (1 << (rotationShift - 1)))
+                        >> rotationShift);
+                cr[i] = clamp_chroma(
+                        ((blue * term) + (red * scale)
+                                + (1 << (rotationShift - 1)))
+                        >> rotationShift);
+            }
+            break;
+
+        case COLOUR_SATURATION:
+#pragma omp simd
+            for (size_t i = 0; i < n; i++) {
+                cb[i] = clamp_chroma(((cb[i] * scale)
+                                             + (1 << (factorShift - 1)))
+                        >> factorShift);
+                cr[i] = clamp_chroma(((cr[i] * scale)
+                                             + (1 << (factorShift - 1)))
+                        >> factorShift);
+            }
+            break;
+
+        case COLOUR_LIGHTNESS:
+#pragma omp simd
+            for (size_t i = 0; i < n; i++) {
+                luma[i] = ((luma[i] * scale) + term
+                                  + (1 << (weightShift - 1)))
+                        >> weightShift;
+                cb[i] = ((cb[i] * scale) + (1 << (weightShift - 1)))
+                        >> weightShift;
+                cr[i] = ((cr[i] * scale) + (1 << (weightShift - 1)))
+                        >> weightShift;
+            }
+            break;
+        }
+    }
+}
+
+/* adjust_rows()
+ * -------------
+ * Adjusts every row of a BGR or BGRX image, a block at a time.
+ */
+static void adjust_rows(
+        Image* image, const StepKernel* kernels, const size_t count)
+{
+    const size_t width = image->width;
+
+#pragma omp parallel for schedule(static)
+    for (size_t y = 0; y < image->height; y++) {
+        int32_t luma[blockPixels];
+        int32_t cb[blockPixels];
+        int32_t cr[blockPixels];
+        uint8_t* row = image_row(image, y);
+
+        for (size_t x = 0; x < width; x += blockPixels) {
+            const size_t n = ((width - x) < blockPixels) ? (width - x)
+                                                         : blockPixels;
+            PIXEL_SIZE_TEMPLATE(image->layout, pixelBytes, {
+                uint8_t* block = row + (x * pixelBytes);
+                load_block(block, pixelBytes, n, luma, cb, cr);
+                adjust_block(n, luma, cb, cr, kernels, count);
+                store_block(block, pixelBytes, n, luma, cb, cr);
+            });
+        }
+    }
+}
+
+void adjust_colours(
+        Image* image, const ColourStep* steps, const size_t count)
+{
+    // Chains are short, as they are fused from consecutive commands
+    constexpr size_t maxKernels = 64;
+    StepKernel kernels[maxKernels];
+
+    for (size_t first = 0; first < count; first += maxKernels) {
+        const size_t n = ((count - first) < maxKernels) ? (count - first)
+                                                        : maxKernels;
+        for (size_t k = 0; k < n; k++) {
+            kernels[k] = make_kernel(&(steps[first + k]));
+        }
+
+        if (image->layout == LAYOUT_INDEX8) {
+            Image palette = palette_image(image);
+            adjust_rows(&palette, kernels, n);
+        } else {
+            adjust_rows(image, kernels, n);
+        }
+    }
+}
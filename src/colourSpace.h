@@ -0,0 +1,44 @@
+#ifndef COLOUR_SPACE_H
+#define COLOUR_SPACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "pixels.h"
+
+// Limits of the parameters of each adjustment
+#define SATURATION_MAX 16.0f
+#define LIGHTNESS_MAX 100.0f
+
+// Adjustments made in YCbCr, where luma and chroma are separate
+typedef enum {
+    COLOUR_HUE_ROTATE, // Rotates chroma by an angle in degrees
+    COLOUR_SATURATION, // Scales chroma, from 0 (gray) up to SATURATION_MAX
+    COLOUR_LIGHTNESS, // Blends towards white (positive) or black (negative),
+                      // by a percentage
+} ColourOp;
+
+/* ColourStep
+ * ----------
+ * A single colour space adjustment, as given on the command line.
+ */
+typedef struct {
+    ColourOp op;
+    float amount;
+} ColourStep;
+
+/* adjust_colours()
+ * ----------------
+ * Applies a chain of colour space adjustments to the image, in order. Each
+ * row is converted to fixed-point YCbCr a block of pixels at a time, every
+ * adjustment is applied to the block, then it is converted back, so that a
+ * chain costs a single round trip. Rows are adjusted in parallel, and indexed
+ * images only have their palette adjusted.
+ *
+ * image: Pointer to struct containing the pixel data.
+ * steps: Adjustments to apply, in order.
+ * count: Number of adjustments.
+ */
+void adjust_colours(
+        Image* image, const ColourStep* steps, const size_t count);
+
+#endif
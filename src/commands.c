@@ -2,13 +2,22 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <ctype.h>
 #include <limits.h>
 #include <getopt.h>
+#include <time.h>
 #include "commands.h"
 #include "utils.h"
 #include "fileParsing.h"
 #include "filters.h"
+#include "colourSpace.h"
+#include "lut3d.h"
+#include "histogram.h"
 #include "imageEditing.h"
+#include "imagePool.h"
+#include "interchange.h"
+#include "tiles.h"
+#include "cache.h"
 #include "errors.h"
 
 // Allows for terminal rendering via SDL
@@ -16,7 +25,8 @@
 #include "renderSDL.h"
 #endif
 
-// These should be reordered for performance once finalised
+// These should be reordered for performance once finalised. Parameters of
+// individual commands are stored per stage instead (see Params).
 typedef struct {
     bool input;
     char* inputFilePath;
@@ -25,71 +35,32 @@ typedef struct {
     bool help;
     bool header;
     bool print;
-    bool invert;
-    uint8_t filters;
-
-    // Hue
-    bool hue;
-    int hueRed;
-    int hueBlue;
-    int hueGreen;
-
-    bool grayscale;
-    bool flip;
-    uint8_t cutoff;
-    bool combine;
-    char* combineFilePath;
-    size_t glitch;
-    uint8_t average;
-    bool contrast;
-    float contrastFactor;
-    bool swap;
-    long rotations;
-    bool reverse;
-    bool melt;
-    int32_t meltOffset;
-
-    // Scale
-    bool scale;
-    float scaleRed;
-    float scaleGreen;
-    float scaleBlue;
-
-    // Scale Strict
-    bool scaleStrict;
-    float strictRed;
-    float strictGreen;
-    float strictBlue;
-
-    bool merge;
-    char* mergeFilePath;
-    size_t blur;
     bool encode;
     char* encodeFilePath;
+    uint32_t encodeBits; // Bits per colour channel, or 0 for row padding
+    bool decode;
+    char* decodeFilePath;
     bool experimental;
-    bool transpose;
+    bool hugePages;
+    PixelLayout layout;
+    FileFormat inputFormat; // Set for raw input, otherwise detected
+    size_t rawWidth;
+    size_t rawHeight;
+    bool convert; // Whether the output format differs from the input
+    FileFormat outputFormat;
+    ResultCache cache; // Disabled unless a directory is given
+    AnomalyPolicy onAnomaly;
+    char* extractFilePath; // Extracted padding is written to stdout if NULL
+    bool histogram; // Any stage writes a histogram, so every stage must run
+    bool histogramToStdout;
 } UserInput;
 
-// Initialise global instance and ptr to data
-static UserInput store = {0};
-static UserInput* userInput = &store;
-
-// Probably move this is the utils file and separate the error messages
-int check_valid_file_type(const char* const type, const char* filePath)
-{
-    // Check path ends with expected file type string
-    if (!ends_with(type, filePath)) {
-
-        // Prints error message to stderr
-        fprintf(stderr, fileTypeMessage, type);
-        fprintf(stderr, unexpectedArgMessage, filePath, type);
-        return -1;
-    }
-
-    return EXIT_SUCCESS;
-}
+// Initialise instance and ptr to data, each thread parses and runs its own
+// set of commands (see server.c)
+static thread_local UserInput store = {0};
+static thread_local UserInput* userInput = NULL;
 
-int status;
+thread_local int status;
 
 typedef enum {
     INVALID = -1,
@@ -102,6 +73,15 @@ typedef enum {
     DUMP = 'd',
     PRINT = 'p',
     ENCODE = 'e',
+    DECODE = 'D',
+    PIPELINE = 'P',
+    HUGE_PAGES = 'H',
+    LAYOUT = 'L',
+    RAW = 'x',
+    FORMAT = 'O',
+    CACHE = 'k',
+    ON_ANOMALY = 'A',
+    HISTOGRAM = 'Y',
 
     // Colours & Channels:
     FILTERS = 'f',
@@ -110,17 +90,25 @@ typedef enum {
     AVERAGE = 'a',
     INVERT = 'v',
     SWAP = 's',
+    HUE_ROTATE = 'u',
+    SATURATION = 'U',
+    LUT3D = 'Q',
 
     // Geometry & Orientation:
     ROTATE = 'r',
     TRANSPOSE = 't',
     REVERSE = 'R',
     FLIP = 'F',
+    CROP = 'K',
+    ROI = 'I',
 
     // Brightness & Contrast:
     CONTRAST = 'C',
     BRIGHTNESS_CUT = 'b',
     SCALE_STRICT = 'T',
+    LIGHTNESS = 'l',
+    EQUALIZE = 'q',
+    AUTO_LEVELS = 'w',
 
     // Advanced Effects:
     MELT = 'M',
@@ -131,8 +119,9 @@ typedef enum {
     EXPERIMENTAL = 'E',
 } Flag;
 
-constexpr char optstring[]
-        = "i:o:m:c:e:f:h:r:C:b:T:M:G:S:B:dpgavstRFE"; // Defined program flags
+// Defined program flags
+constexpr char optstring[] = "i:o:m:c:e:D:P:L:x:O:k:A:Y:"
+                             "f:h:u:U:Q:l:r:K:I:C:b:T:w::M:G:S:B:dpgavstRFEHq";
 
 static struct option const longOptions[] = {
         {"input", required_argument, NULL, INPUT},
@@ -141,6 +130,10 @@ static struct option const longOptions[] = {
         {"print", no_argument, NULL, PRINT},
         {"filter", required_argument, NULL, FILTERS},
         {"hue", required_argument, NULL, HUE},
+        {"hue-rotate", required_argument, NULL, HUE_ROTATE},
+        {"saturation", required_argument, NULL, SATURATION},
+        {"lut3d", required_argument, NULL, LUT3D},
+        {"lightness", required_argument, NULL, LIGHTNESS},
         {"grayscale", no_argument, NULL, GRAYSCALE},
         {"invert", no_argument, NULL, INVERT},
         {"flip", no_argument, NULL, FLIP},
@@ -149,6 +142,8 @@ static struct option const longOptions[] = {
         {"glitch", required_argument, NULL, GLITCH},
         {"average", no_argument, NULL, AVERAGE},
         {"contrast", required_argument, NULL, CONTRAST},
+        {"equalize", no_argument, NULL, EQUALIZE},
+        {"auto-levels", optional_argument, NULL, AUTO_LEVELS},
         {"swap", no_argument, NULL, SWAP},
         {"rotate", required_argument, NULL, ROTATE},
         {"transpose", no_argument, NULL, TRANSPOSE},
@@ -159,7 +154,18 @@ static struct option const longOptions[] = {
         {"merge", required_argument, NULL, MERGE},
         {"blur", required_argument, NULL, BLUR},
         {"encode", required_argument, NULL, ENCODE},
+        {"decode", required_argument, NULL, DECODE},
         {"experimental", no_argument, NULL, EXPERIMENTAL},
+        {"pipeline", required_argument, NULL, PIPELINE},
+        {"hugepages", no_argument, NULL, HUGE_PAGES},
+        {"layout", required_argument, NULL, LAYOUT},
+        {"raw", required_argument, NULL, RAW},
+        {"format", required_argument, NULL, FORMAT},
+        {"cache", required_argument, NULL, CACHE},
+        {"on-anomaly", required_argument, NULL, ON_ANOMALY},
+        {"histogram", required_argument, NULL, HISTOGRAM},
+        {"crop", required_argument, NULL, CROP},
+        {"roi", required_argument, NULL, ROI},
         {NULL, 0, NULL, 0},
 };
 
@@ -171,10 +177,55 @@ typedef struct {
     const char* const examples;
 } GetHelp;
 
+// Parameters of a single command, stored per stage so that repeated commands
+// may each use different values
+typedef union {
+    char* filePath;
+    uint8_t filters;
+    uint8_t cutoff;
+    size_t glitch;
+    size_t blur;
+    float contrastFactor;
+    float clipPercent;
+    long rotations;
+    int32_t meltOffset;
+    struct {
+        int red;
+        int green;
+        int blue;
+    } hue;
+    struct {
+        float red;
+        float green;
+        float blue;
+    } scale;
+    Region region; // Rows counted from the top of the image
+    struct {
+        char* filePath; // Aliases filePath, so that the file is hashed
+        uint32_t size; // Nodes along each axis to bake to, or 0 to keep
+    } lut;
+    struct {
+        char* filePath; // Written to stdout if NULL
+        HistogramFormat format;
+    } histogram;
+    ColourStep colour;
+    struct {
+        const ColourStep* steps;
+        uint32_t count;
+    } chain; // Consecutive colour space stages, fused by run_commands()
+} Params;
+
+// Size of the member of Params used by a command. Members have no internal
+// padding, so this covers exactly the bytes set by its verify function.
+#define PARAM_SIZE(member) sizeof(((Params*)NULL)->member)
+
 typedef struct {
-    int (*verify)(void);
-    int (*run)(void*);
+    int (*verify)(Params* params, char* arg);
+    int (*run)(void* obj, const Params* params);
     const GetHelp help;
+    bool truecolour; // Requires colour pixels, rather than palette indices
+    bool checkpoint; // Result is cached when running with --cache
+    size_t keySize; // Bytes of Params hashed for --cache (see PARAM_SIZE())
 } Command;
 
 typedef struct {
@@ -183,9 +234,37 @@ typedef struct {
     const Command cmd;
 } Entry;
 
-static uint64_t activeCommands = 0;
-static int32_t cmdOrder[64] = {INVALID};
-static uint32_t cmdCount = 0;
+// A single command to run, in the order specified by the user
+typedef struct {
+    int32_t entry; // Index into CmdRegistry
+    Params params;
+#ifdef ENABLE_SDL
+    Image* snapshot; // Input to this stage, cached for the preview
+    BmpInfoHeader infoHeader;
+#endif
+} Stage;
+
+constexpr uint32_t initialStageCapacity = 16;
+constexpr uint32_t maxFusedSteps = 64;
+constexpr size_t maxPipelineSize = 1 << 20;
+
+// Commands which may only be specified once
+static thread_local uint64_t activeCommands = 0;
+
+static thread_local Stage* stages = NULL;
+static thread_local uint32_t stageCount = 0;
+static thread_local uint32_t stageCapacity = 0;
+
+// Contents of the pipeline file, which stages may hold pointers into
+static thread_local char* pipelineText = NULL;
+
+// Keys of the image after each stage, when running with --cache (see
+// cache_keys())
+static thread_local const uint64_t* cacheKeys = NULL;
+
+#ifdef ENABLE_SDL
+static int run_preview(BMP* bmpImage);
+#endif
 
 ///////////////////////////////////////////////////////////////////////////////
 //
@@ -193,37 +272,58 @@ static uint32_t cmdCount = 0;
 //
 ///////////////////////////////////////////////////////////////////////////////
 
-static int verify_dump(void)
+static int verify_dump(Params* params, char* arg)
 {
+    (void)params;
+    (void)arg;
     userInput->header = true;
     return 0;
 }
 
-static int verify_print(void)
+static int verify_print(Params* params, char* arg)
 {
+    (void)params;
+    (void)arg;
     userInput->print = true;
     return 0;
 }
 
-static int verify_input(void)
+static int verify_input(Params* params, char* arg)
 {
+    (void)params;
     userInput->input = true;
-    userInput->inputFilePath = optarg;
+    userInput->inputFilePath = arg;
     return 0;
 }
 
-static int verify_output(void)
+static int verify_output(Params* params, char* arg)
 {
+    (void)params;
     userInput->output = true;
-    userInput->outputFilePath = optarg;
+    userInput->outputFilePath = arg;
+    return 0;
+}
+
+// Commands without arguments have nothing to verify
+static int verify_no_argument(Params* params, char* arg)
+{
+    (void)params;
+    (void)arg;
+    return 0;
+}
+
+// Commands reading a second image store its path
+static int verify_file_path(Params* params, char* arg)
+{
+    params->filePath = arg;
     return 0;
 }
 
-static int verify_filter(void)
+static int verify_filter(Params* params, char* arg)
 {
     uint8_t colourBitVect = 0;
 
-    for (const char* s = optarg; *s != '\0'; s++) {
+    for (const char* s = arg; *s != '\0'; s++) {
 
         // Sets bit in bit vector to indicate presence of colour to
         // filter. Both 'r' and 'R' are represented by the same bit.
@@ -244,218 +344,508 @@ static int verify_filter(void)
             break;
 
         default:
-            userInput->filters = 0;
+            params->filters = 0;
             status = EXIT_INVALID_PARAMETER;
             goto esc;
         }
     }
 esc:
     if (status) {
-        fprintf(stderr, invalidFilterColourMessage, optarg);
+        fprintf(stderr, invalidFilterColourMessage, arg);
         printf("See \'signals help filter\'\n");
     } else {
-        userInput->filters = colourBitVect;
+        params->filters = colourBitVect;
     }
 
     return status;
 }
 
-static int verify_hue(void)
+static int verify_hue(Params* params, char* arg)
 {
-    int* hueScales = separate_to_int_array(optarg, ',', 3);
+    int* hueScales = separate_to_int_array(arg, ',', 3);
     if (hueScales == NULL) {
-        fprintf(stderr, invalidVal, optarg);
+        fprintf(stderr, invalidVal, arg);
         printf("See \'signals help hue\'\n");
         return EXIT_INVALID_PARAMETER;
     }
 
-    userInput->hue = true;
-    userInput->hueRed = hueScales[0];
-    userInput->hueGreen = hueScales[1];
-    userInput->hueBlue = hueScales[2];
+    (params->hue).red = hueScales[0];
+    (params->hue).green = hueScales[1];
+    (params->hue).blue = hueScales[2];
     free(hueScales);
 
     return 0;
 }
 
-static int verify_grayscale(void)
+/* verify_colour_step()
+ * --------------------
+ * Parses the single parameter of a colour space adjustment, which must lie
+ * between the limits given.
+ */
+static int verify_colour_step(Params* params, char* arg, const ColourOp op,
+        const float min, const float max, const char* name)
 {
-    userInput->grayscale = true;
+    float* amount = separate_to_float_array(arg, ',', 1);
+    if ((amount == NULL) || !(amount[0] >= min) || !(amount[0] <= max)) {
+        free(amount);
+        fprintf(stderr, invalidVal, arg);
+        printf("See \'signals help %s\'\n", name);
+        return EXIT_INVALID_PARAMETER;
+    }
+
+    params->colour = (ColourStep){.op = op, .amount = amount[0]};
+    free(amount);
     return 0;
 }
 
-static int verify_invert(void)
+static int verify_hue_rotate(Params* params, char* arg)
 {
-    userInput->invert = true;
-    return 0;
+    // Angles beyond a turn are reduced when run
+    return verify_colour_step(params, arg, COLOUR_HUE_ROTATE, -1e6f, 1e6f,
+            "hue-rotate");
 }
 
-static int verify_flip(void)
+static int verify_saturation(Params* params, char* arg)
 {
-    userInput->flip = true;
-    return 0;
+    return verify_colour_step(params, arg, COLOUR_SATURATION, 0.0f,
+            SATURATION_MAX, "saturation");
 }
 
-static int verify_transpose(void)
+static int verify_lightness(Params* params, char* arg)
 {
-    userInput->transpose = true;
-    return 0;
+    return verify_colour_step(params, arg, COLOUR_LIGHTNESS, -LIGHTNESS_MAX,
+            LIGHTNESS_MAX, "lightness");
 }
 
-static int verify_brightness_cut(void)
+/* verify_lut3d()
+ * --------------
+ * Parses the .cube file to apply, optionally followed by the number of nodes
+ * along each axis to bake it to, given as "file" or "file, size".
+ */
+static int verify_lut3d(Params* params, char* arg)
 {
-    if (!(vlongB(&(userInput->cutoff), optarg, 0, UINT8_MAX, uint8_t))) {
-        fprintf(stderr, invalidVal, optarg);
-        printf("See \'signals help brightness-cut\'\n");
-        return EXIT_INVALID_PARAMETER;
+    (params->lut).size = 0;
+
+    // Paths may contain commas, so only a numeric suffix gives the size
+    char* separator = strrchr(arg, ',');
+    if (separator != NULL) {
+        char* end;
+        const long size = strtol(separator + 1, &end, 10);
+
+        if ((end != separator + 1) && (*end == '\0')) {
+            if ((size < LUT3D_MIN_SIZE) || (size > LUT3D_MAX_SIZE)) {
+                fprintf(stderr, invalidVal, separator + 1);
+                printf("See \'signals help lut3d\'\n");
+                return EXIT_INVALID_PARAMETER;
+            }
+            (params->lut).size = (uint32_t)size;
+            *separator = '\0';
+        }
     }
+
+    (params->lut).filePath = arg;
     return 0;
 }
 
-static int verify_combine(void)
+static int verify_brightness_cut(Params* params, char* arg)
 {
-    userInput->combine = true;
-    userInput->combineFilePath = optarg;
+    if (!(vlongB(&(params->cutoff), arg, 0, UINT8_MAX, uint8_t))) {
+        fprintf(stderr, invalidVal, arg);
+        printf("See \'signals help brightness-cut\'\n");
+        return EXIT_INVALID_PARAMETER;
+    }
     return 0;
 }
 
-static int verify_merge(void)
+/* verify_encode()
+ * ---------------
+ * Parses the file to embed, optionally followed by the number of low bits of
+ * each colour channel to embed it in, given as "file" or "file, bits".
+ */
+static int verify_encode(Params* params, char* arg)
 {
-    userInput->merge = true;
-    userInput->mergeFilePath = optarg;
+    (void)params;
+    userInput->encodeBits = 0;
+
+    // Paths may contain commas, so only a numeric suffix gives the bits
+    char* separator = strrchr(arg, ',');
+    if (separator != NULL) {
+        char* end;
+        const long bits = strtol(separator + 1, &end, 10);
+
+        if ((end != separator + 1) && (*end == '\0')) {
+            if ((bits < 0) || (bits > STEGO_MAX_BITS)) {
+                fprintf(stderr, invalidVal, separator + 1);
+                printf("See \'signals help encode\'\n");
+                return EXIT_INVALID_PARAMETER;
+            }
+            userInput->encodeBits = (uint32_t)bits;
+            *separator = '\0';
+        }
+    }
+
+    userInput->encode = true;
+    userInput->encodeFilePath = arg;
     return 0;
 }
 
-static int verify_encode(void)
+/* verify_decode()
+ * ---------------
+ * Sets the file to write an extracted payload to, or "-" for stdout.
+ */
+static int verify_decode(Params* params, char* arg)
 {
-    userInput->encode = true;
-    userInput->encodeFilePath = optarg;
+    (void)params;
+    userInput->decode = true;
+    userInput->decodeFilePath = arg;
     return 0;
 }
 
-static int verify_glitch(void)
+static int verify_glitch(Params* params, char* arg)
 {
-    if (!(vlongB(&(userInput->glitch), optarg, 1, INT32_MAX, size_t))) {
-        fprintf(stderr, invalidVal, optarg);
+    if (!(vlongB(&(params->glitch), arg, 1, INT32_MAX, size_t))) {
+        fprintf(stderr, invalidVal, arg);
         printf("See \'signals help glitch\'\n");
         return EXIT_INVALID_PARAMETER;
     }
     return 0;
 }
 
-static int verify_average(void)
-{
-    userInput->average = true;
-    return 0;
-}
-
-static int verify_contrast(void)
+static int verify_contrast(Params* params, char* arg)
 {
-    float* arg = separate_to_float_array(optarg, ',', 1);
-    if (!arg) {
-        fprintf(stderr, invalidVal, optarg);
+    float* factor = separate_to_float_array(arg, ',', 1);
+    if (!factor) {
+        fprintf(stderr, invalidVal, arg);
         printf("See \'signals help contrast\'\n");
         return EXIT_INVALID_PARAMETER;
     }
 
-    userInput->contrast = true;
-    userInput->contrastFactor = arg[0];
-    free(arg);
+    params->contrastFactor = factor[0];
+    free(factor);
     return 0;
 }
 
-static int verify_swap(void)
+/* verify_auto_levels()
+ * --------------------
+ * Parses the percentage of values which may be clipped at each end, or 0 if
+ * none is given.
+ */
+static int verify_auto_levels(Params* params, char* arg)
 {
-    userInput->swap = true;
-    return 0;
-}
+    params->clipPercent = 0.0f;
+    if (arg == NULL) {
+        return 0;
+    }
 
-static int verify_rotate(void)
-{
-    if (!(vlongB(&(userInput->rotations), optarg, LONG_MIN, LONG_MAX, long))) {
-        fprintf(stderr, invalidVal, optarg);
-        printf("See \'signals help rotate\'\n");
+    float* clip = separate_to_float_array(arg, ',', 1);
+    if ((clip == NULL) || !(clip[0] >= 0.0f)
+            || !(clip[0] < AUTO_LEVELS_MAX_CLIP)) {
+        free(clip);
+        fprintf(stderr, invalidVal, arg);
+        printf("See \'signals help auto-levels\'\n");
         return EXIT_INVALID_PARAMETER;
     }
+
+    params->clipPercent = clip[0];
+    free(clip);
     return 0;
 }
 
-static int verify_reverse(void)
+static int verify_rotate(Params* params, char* arg)
 {
-    userInput->reverse = true;
+    if (!(vlongB(&(params->rotations), arg, LONG_MIN, LONG_MAX, long))) {
+        fprintf(stderr, invalidVal, arg);
+        printf("See \'signals help rotate\'\n");
+        return EXIT_INVALID_PARAMETER;
+    }
     return 0;
 }
 
-static int verify_melt(void)
+static int verify_melt(Params* params, char* arg)
 {
     bool success = true;
 
-    if (!(vlongB(&(userInput->meltOffset), optarg, INT32_MIN, INT32_MAX,
+    if (!(vlongB(&(params->meltOffset), arg, INT32_MIN, INT32_MAX,
                 int32_t))) {
         success = false;
     }
 
     // Could remove since this would have no effect if activated
-    if (userInput->meltOffset == 0) {
+    if (params->meltOffset == 0) {
         success = false;
     }
 
     if (success == false) {
-        fprintf(stderr, invalidVal, optarg);
+        fprintf(stderr, invalidVal, arg);
         printf("See \'signals help melt\'\n");
         return EXIT_INVALID_PARAMETER;
     }
     return 0;
 }
 
-static int verify_scale(void)
+static int verify_scale(Params* params, char* arg)
 {
-    float* scaleArgs = separate_to_float_array(optarg, ',', 3);
+    float* scaleArgs = separate_to_float_array(arg, ',', 3);
     if (!scaleArgs) {
-        fprintf(stderr, invalidVal, optarg);
+        fprintf(stderr, invalidVal, arg);
         printf("See \'signals help scale\'\n");
         return EXIT_INVALID_PARAMETER;
     }
 
-    userInput->scale = true;
-    userInput->scaleRed = scaleArgs[0];
-    userInput->scaleGreen = scaleArgs[1];
-    userInput->scaleBlue = scaleArgs[2];
+    (params->scale).red = scaleArgs[0];
+    (params->scale).green = scaleArgs[1];
+    (params->scale).blue = scaleArgs[2];
     free(scaleArgs);
 
     return 0;
 }
 
-static int verify_scale_strict(void)
+static int verify_scale_strict(Params* params, char* arg)
 {
-    float* scaleStrictArgs = separate_to_float_array(optarg, ',', 3);
+    float* scaleStrictArgs = separate_to_float_array(arg, ',', 3);
     if (!scaleStrictArgs) {
-        fprintf(stderr, invalidVal, optarg);
+        fprintf(stderr, invalidVal, arg);
         printf("See \'signals help scale-strict\'\n");
         return EXIT_INVALID_PARAMETER;
     }
 
-    userInput->scaleStrict = true;
-    userInput->strictRed = scaleStrictArgs[0];
-    userInput->strictGreen = scaleStrictArgs[1];
-    userInput->strictBlue = scaleStrictArgs[2];
+    (params->scale).red = scaleStrictArgs[0];
+    (params->scale).green = scaleStrictArgs[1];
+    (params->scale).blue = scaleStrictArgs[2];
     free(scaleStrictArgs);
 
     return 0;
 }
 
-static int verify_blur(void)
+static int verify_blur(Params* params, char* arg)
 {
-    if (!(vlongB(&(userInput->blur), optarg, 1, INT32_MAX, size_t))) {
-        fprintf(stderr, invalidVal, optarg);
+    if (!(vlongB(&(params->blur), arg, 1, INT32_MAX, size_t))) {
+        fprintf(stderr, invalidVal, arg);
         printf("See \'signals help blur\'\n");
         return EXIT_INVALID_PARAMETER;
     }
     return 0;
 }
 
-static int verify_experimental(void)
+/* verify_region()
+ * ---------------
+ * Parses a region given as "x,y,w,h", with a non-zero width and height.
+ */
+static int verify_region(Params* params, char* arg, const char* name)
+{
+    int* values = separate_to_int_array(arg, ',', 4);
+
+    if ((values == NULL) || (values[0] < 0) || (values[1] < 0)
+            || (values[2] < 1) || (values[3] < 1)) {
+        free(values);
+        fprintf(stderr, invalidVal, arg);
+        printf("See \'signals help %s\'\n", name);
+        return EXIT_INVALID_PARAMETER;
+    }
+
+    params->region = (Region){
+            .x = (size_t)values[0],
+            .y = (size_t)values[1],
+            .width = (size_t)values[2],
+            .height = (size_t)values[3],
+    };
+    free(values);
+
+    return 0;
+}
+
+static int verify_crop(Params* params, char* arg)
+{
+    return verify_region(params, arg, "crop");
+}
+
+static int verify_roi(Params* params, char* arg)
+{
+    return verify_region(params, arg, "roi");
+}
+
+static int verify_huge_pages(Params* params, char* arg)
+{
+    (void)params;
+    (void)arg;
+    userInput->hugePages = true;
+    return 0;
+}
+
+static int verify_layout(Params* params, char* arg)
+{
+    (void)params;
+
+    if (!strcmp(arg, "bgr")) {
+        userInput->layout = LAYOUT_BGR;
+    } else if (!strcmp(arg, "bgrx")) {
+        userInput->layout = LAYOUT_BGRX;
+    } else {
+        fprintf(stderr, invalidVal, arg);
+        printf("See \'signals help layout\'\n");
+        return EXIT_INVALID_PARAMETER;
+    }
+    return 0;
+}
+
+/* verify_raw()
+ * ------------
+ * Parses the channel order and dimensions of headerless input, given as
+ * "order, w, h".
+ */
+static int verify_raw(Params* params, char* arg)
+{
+    (void)params;
+    int* dimensions = NULL;
+
+    if (!strncmp(arg, "rgb,", 4)) {
+        userInput->inputFormat = FORMAT_RGB;
+        dimensions = separate_to_int_array(arg + 4, ',', 2);
+    } else if (!strncmp(arg, "bgr,", 4)) {
+        userInput->inputFormat = FORMAT_BGR;
+        dimensions = separate_to_int_array(arg + 4, ',', 2);
+    }
+
+    if ((dimensions == NULL) || (dimensions[0] < 1) || (dimensions[1] < 1)) {
+        free(dimensions);
+        fprintf(stderr, invalidVal, arg);
+        printf("See \'signals help raw\'\n");
+        return EXIT_INVALID_PARAMETER;
+    }
+
+    userInput->rawWidth = (size_t)dimensions[0];
+    userInput->rawHeight = (size_t)dimensions[1];
+    free(dimensions);
+    return 0;
+}
+
+static int verify_format(Params* params, char* arg)
+{
+    (void)params;
+    static const char* const names[]
+            = {"bmp", "ppm", "pam", "rgb", "bgr", "sig"};
+    static const FileFormat formats[] = {FORMAT_BMP, FORMAT_PPM, FORMAT_PAM,
+            FORMAT_RGB, FORMAT_BGR, FORMAT_SIG};
+
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (!strcmp(arg, names[i])) {
+            userInput->convert = true;
+            userInput->outputFormat = formats[i];
+            return 0;
+        }
+    }
+
+    fprintf(stderr, invalidVal, arg);
+    printf("See \'signals help format\'\n");
+    return EXIT_INVALID_PARAMETER;
+}
+
+/* verify_cache()
+ * --------------
+ * Parses the directory of the result cache, optionally followed by its limit
+ * in MiB, given as "dir" or "dir, limit". The directory is created if missing.
+ */
+static int verify_cache(Params* params, char* arg)
+{
+    (void)params;
+    size_t limit = CACHE_DEFAULT_LIMIT_MB;
+
+    // Directories may contain commas, so only a numeric suffix is the limit
+    char* separator = strrchr(arg, ',');
+    if (separator != NULL) {
+        char* end;
+        const long value = strtol(separator + 1, &end, 10);
+
+        if ((end != separator + 1) && (*end == '\0') && (value > 0)) {
+            limit = (size_t)value;
+            *separator = '\0';
+        }
+    }
+
+    if ((*arg == '\0') || (create_cache_directory(arg) == -1)) {
+        fprintf(stderr, invalidVal, arg);
+        printf("See \'signals help cache\'\n");
+        return EXIT_INVALID_PARAMETER;
+    }
+
+    userInput->cache.directory = arg;
+    userInput->cache.limit = limit * 1024 * 1024;
+    return 0;
+}
+
+/* verify_on_anomaly()
+ * -------------------
+ * Parses the policy for anomalies found in BMP input, given as "fail",
+ * "ignore", "extract", or "extract, file" to write the extracted padding to a
+ * file rather than stdout.
+ */
+static int verify_on_anomaly(Params* params, char* arg)
+{
+    (void)params;
+    userInput->extractFilePath = NULL;
+
+    if (!strcmp(arg, "fail")) {
+        userInput->onAnomaly = ANOMALY_FAIL;
+        return 0;
+    }
+
+    if (!strcmp(arg, "ignore")) {
+        userInput->onAnomaly = ANOMALY_IGNORE;
+        return 0;
+    }
+
+    if (!strncmp(arg, "extract", 7) && ((arg[7] == '\0') || (arg[7] == ','))) {
+        char* filePath = arg + 7 + (arg[7] == ',');
+        while (isspace((unsigned char)*filePath)) {
+            filePath++;
+        }
+
+        if ((arg[7] == '\0') || (*filePath != '\0')) {
+            userInput->onAnomaly = ANOMALY_EXTRACT;
+            userInput->extractFilePath = (*filePath) ? filePath : NULL;
+            return 0;
+        }
+    }
+
+    fprintf(stderr, invalidVal, arg);
+    printf("See \'signals help on-anomaly\'\n");
+    return EXIT_INVALID_PARAMETER;
+}
+
+/* verify_histogram()
+ * ------------------
+ * Parses the format of the histogram, given as "text" or "json", optionally
+ * followed by the file to append it to rather than writing it to stdout.
+ */
+static int verify_histogram(Params* params, char* arg)
+{
+    const size_t length = strcspn(arg, ",");
+    char* filePath = (arg[length] == ',') ? (arg + length + 1) : NULL;
+    while ((filePath != NULL) && isspace((unsigned char)*filePath)) {
+        filePath++;
+    }
+
+    const bool text = (length == 4) && !strncmp(arg, "text", length);
+    const bool json = (length == 4) && !strncmp(arg, "json", length);
+    if (!(text || json) || ((filePath != NULL) && (*filePath == '\0'))) {
+        fprintf(stderr, invalidVal, arg);
+        printf("See \'signals help histogram\'\n");
+        return EXIT_INVALID_PARAMETER;
+    }
+
+    (params->histogram).format = (json) ? HISTOGRAM_JSON : HISTOGRAM_TEXT;
+    (params->histogram).filePath = filePath;
+    userInput->histogram = true;
+    if ((filePath == NULL) || is_stream_path(filePath)) {
+        userInput->histogramToStdout = true;
+    }
+    return 0;
+}
+
+static int verify_experimental(Params* params, char* arg)
 {
+    (void)params;
+    (void)arg;
     userInput->experimental = true;
     return 0;
 }
@@ -466,22 +856,47 @@ static int verify_experimental(void)
 //
 ///////////////////////////////////////////////////////////////////////////////
 
-static int run_input(void* obj)
+static int run_input(void* obj, const Params* params)
 {
+    (void)params;
     (void)obj;
     return EXIT_SUCCESS;
 }
 
-static int run_output(void* obj)
+static int run_output(void* obj, const Params* params)
 {
+    (void)params;
     BMP* bmpImage = (BMP*)obj;
 
-    if (userInput->encode) {
-        if (write_bmp_with_header_provided(bmpImage, userInput->outputFilePath,
-                    userInput->encodeFilePath)
+    // Images are written in the format they were read, unless converted
+    const FileFormat format
+            = (userInput->convert) ? userInput->outputFormat : bmpImage->format;
+
+    if ((format != FORMAT_BMP) && userInput->encode) {
+        fputs(encodeFormatMessage, stderr);
+        status = EXIT_INVALID_FILE_TYPE;
+    } else if (format == FORMAT_SIG) {
+        if (write_tiles(bmpImage, userInput->outputFilePath) == -1) {
+            status = EXIT_OUTPUT_FILE_ERROR;
+        }
+    } else if (format != FORMAT_BMP) {
+        if (write_interchange(bmpImage, userInput->outputFilePath, format)
+                == -1) {
+            status = EXIT_OUTPUT_FILE_ERROR;
+        }
+    } else if (userInput->encode) {
+        Secret secret;
+
+        if (read_secret(&secret, userInput->encodeFilePath,
+                    userInput->encodeBits)
+                == -1) {
+            status = EXIT_FILE_CANNOT_BE_READ;
+        } else if (write_bmp_with_header_provided(
+                           bmpImage, userInput->outputFilePath, &secret)
                 == -1) {
             status = EXIT_OUTPUT_FILE_ERROR;
         }
+        free_secret(&secret);
     } else {
         if (write_bmp_with_header_provided(
                     bmpImage, userInput->outputFilePath, NULL)
@@ -492,17 +907,12 @@ static int run_output(void* obj)
     return status;
 }
 
-static int run_merge(void* obj)
+static int run_merge(void* obj, const Params* params)
 {
     BMP* bmpImage = (BMP*)obj;
 
-    if (check_valid_file_type(fileType, userInput->mergeFilePath) == -1) {
-        status = EXIT_INVALID_FILE_TYPE;
-        goto failure;
-    }
-
     // Exit if input and merge file paths match
-    if (!strcmp(userInput->inputFilePath, userInput->mergeFilePath)) {
+    if (!strcmp(userInput->inputFilePath, params->filePath)) {
         fputs(nonUniquePathsMessage, stderr);
         status = EXIT_SAME_FILE;
         goto failure;
@@ -510,9 +920,10 @@ static int run_merge(void* obj)
 
     BMP mergedImage;
     initialise_bmp(&mergedImage);
+    mergedImage.layout = (bmpImage->image)->layout;
 
     while (1) {
-        status = open_bmp(&mergedImage, userInput->mergeFilePath);
+        status = open_bmp(&mergedImage, params->filePath);
         if (status != EXIT_SUCCESS) {
             break;
         }
@@ -522,6 +933,17 @@ static int run_merge(void* obj)
             break;
         }
 
+        // Indexed images are expanded, and 32-bit images are loaded with
+        // alpha, which the input then gains
+        if ((convert_image_layout(mergedImage.image, (bmpImage->image)->layout)
+                    == -1)
+                || (convert_image_layout(
+                            bmpImage->image, (mergedImage.image)->layout)
+                        == -1)) {
+            status = EXIT_LAYOUT_FAILURE;
+            break;
+        }
+
         status = merge_images(bmpImage->image, mergedImage.image);
         break;
     }
@@ -538,17 +960,12 @@ failure:
     return status;
 }
 
-static int run_combine(void* obj)
+static int run_combine(void* obj, const Params* params)
 {
     BMP* bmpImage = (BMP*)obj;
 
-    if (check_valid_file_type(fileType, userInput->combineFilePath) == -1) {
-        status = EXIT_INVALID_FILE_TYPE;
-        goto failure;
-    }
-
     // Exit if input and combine file paths match
-    if (!strcmp(userInput->inputFilePath, userInput->combineFilePath)) {
+    if (!strcmp(userInput->inputFilePath, params->filePath)) {
         fputs(nonUniquePathsMessage, stderr);
         status = EXIT_SAME_FILE;
         goto failure;
@@ -556,9 +973,10 @@ static int run_combine(void* obj)
 
     BMP combinedImage;
     initialise_bmp(&combinedImage);
+    combinedImage.layout = (bmpImage->image)->layout;
 
     while (1) {
-        status = open_bmp(&combinedImage, userInput->combineFilePath);
+        status = open_bmp(&combinedImage, params->filePath);
         if (status != EXIT_SUCCESS) {
             break;
         }
@@ -568,6 +986,18 @@ static int run_combine(void* obj)
             break;
         }
 
+        // Indexed images are expanded, and 32-bit images are loaded with
+        // alpha, which the input then gains
+        if ((convert_image_layout(
+                     combinedImage.image, (bmpImage->image)->layout)
+                    == -1)
+                || (convert_image_layout(
+                            bmpImage->image, (combinedImage.image)->layout)
+                        == -1)) {
+            status = EXIT_LAYOUT_FAILURE;
+            break;
+        }
+
         status = combine_images(bmpImage->image, combinedImage.image);
         break;
     }
@@ -584,42 +1014,51 @@ failure:
     return status;
 }
 
-static int run_dump(void* obj)
+static int run_dump(void* obj, const Params* params)
 {
+    (void)params;
     BMP* bmpImage = (BMP*)obj;
     dump_headers(bmpImage);
     return EXIT_SUCCESS;
 }
 
-static int run_print(void* obj)
+static int run_print(void* obj, const Params* params)
 {
+    (void)params;
     BMP* bmpImage = (BMP*)obj;
 
-    if (flip_image(bmpImage->image) == -1) {
-        status = EXIT_FLIP_FAILURE;
+    if (convert_image_layout(bmpImage->image, LAYOUT_BGR) == -1) {
+        status = EXIT_LAYOUT_FAILURE;
         return status;
     }
 
 #ifdef ENABLE_SDL
-    status = render_image(bmpImage->image);
+    status = run_preview(bmpImage);
     return status;
 #endif
+
+    if (flip_image(bmpImage->image) == -1) {
+        status = EXIT_FLIP_FAILURE;
+        return status;
+    }
+
     print_image_to_terminal(bmpImage->image);
     return EXIT_SUCCESS;
 }
 
 // Encoding logic is currently handled inside "run_output"
-static int run_encode(void* obj)
+static int run_encode(void* obj, const Params* params)
 {
+    (void)params;
     (void)obj;
     return EXIT_SUCCESS;
 }
 
-static int run_filter(void* obj)
+static int run_filter(void* obj, const Params* params)
 {
     BMP* bmpImage = (BMP*)obj;
 
-    const uint8_t index = userInput->filters & 0x07;
+    const uint8_t index = params->filters & 0x07;
 
     typedef void (*Function)(void);
     static const Function filterMap[8] = {
@@ -641,68 +1080,161 @@ static int run_filter(void* obj)
     return EXIT_SUCCESS;
 }
 
-static int run_hue(void* obj)
+static int run_hue(void* obj, const Params* params)
+{
+    BMP* bmpImage = (BMP*)obj;
+    apply_hue(bmpImage->image, (params->hue).red, (params->hue).green,
+            (params->hue).blue);
+    return EXIT_SUCCESS;
+}
+
+static int run_colour_step(void* obj, const Params* params)
+{
+    BMP* bmpImage = (BMP*)obj;
+    adjust_colours(bmpImage->image, &(params->colour), 1);
+    return EXIT_SUCCESS;
+}
+
+static int run_colour_chain(void* obj, const Params* params)
 {
     BMP* bmpImage = (BMP*)obj;
-    apply_hue(bmpImage->image, userInput->hueRed, userInput->hueGreen,
-            userInput->hueBlue);
+    adjust_colours(
+            bmpImage->image, (params->chain).steps, (params->chain).count);
     return EXIT_SUCCESS;
 }
 
-static int run_grayscale(void* obj)
+static int run_lut3d(void* obj, const Params* params)
+{
+    BMP* bmpImage = (BMP*)obj;
+
+    Lut3D lut;
+    if (load_cube(&lut, (params->lut).filePath) == -1) {
+        status = EXIT_FILE_CANNOT_BE_READ;
+        return status;
+    }
+
+    if ((((params->lut).size != 0)
+                && (bake_lut3d(&lut, (params->lut).size) == -1))
+            || (apply_lut3d(bmpImage->image, &lut) == -1)) {
+        status = EXIT_LUT_FAILURE;
+    } else {
+        status = EXIT_SUCCESS;
+    }
+
+    free_lut3d(&lut);
+    return status;
+}
+
+/* run_histogram()
+ * ---------------
+ * Writes the histogram of the image as it is at this stage, leaving the image
+ * unchanged.
+ */
+static int run_histogram(void* obj, const Params* params)
+{
+    BMP* bmpImage = (BMP*)obj;
+    const char* filePath = (params->histogram).filePath;
+
+    Histogram histogram;
+    compute_histogram(&histogram, bmpImage->image);
+
+    if ((filePath == NULL) || is_stream_path(filePath)) {
+        status = (write_histogram(stdout, &histogram,
+                          (params->histogram).format)
+                         == -1)
+                ? EXIT_OUTPUT_FILE_ERROR
+                : EXIT_SUCCESS;
+        return status;
+    }
+
+    // Appended, so that each stage and run adds to the file
+    FILE* file = fopen(filePath, "a");
+    if (file == NULL) {
+        fprintf(stderr, "Error opening file \"%s\" for writing.\n", filePath);
+        status = EXIT_OUTPUT_FILE_ERROR;
+        return status;
+    }
+
+    const int written
+            = write_histogram(file, &histogram, (params->histogram).format);
+    status = ((fclose(file) == 0) && (written != -1)) ? EXIT_SUCCESS
+                                                      : EXIT_OUTPUT_FILE_ERROR;
+    return status;
+}
+
+static int run_grayscale(void* obj, const Params* params)
 {
+    (void)params;
     BMP* bmpImage = (BMP*)obj;
     gray_filter(bmpImage->image);
     return EXIT_SUCCESS;
 }
 
-static int run_average(void* obj)
+static int run_average(void* obj, const Params* params)
 {
+    (void)params;
     BMP* bmpImage = (BMP*)obj;
     average_pixels(bmpImage->image);
     return EXIT_SUCCESS;
 }
 
-static int run_invert(void* obj)
+static int run_invert(void* obj, const Params* params)
 {
+    (void)params;
     BMP* bmpImage = (BMP*)obj;
     invert_colours(bmpImage->image);
     return EXIT_SUCCESS;
 }
 
-static int run_swap(void* obj)
+static int run_swap(void* obj, const Params* params)
 {
+    (void)params;
     BMP* bmpImage = (BMP*)obj;
     swap_red_blue(bmpImage->image);
     return EXIT_SUCCESS;
 }
 
-static int run_contrast(void* obj)
+static int run_contrast(void* obj, const Params* params)
+{
+    BMP* bmpImage = (BMP*)obj;
+    contrast_effect(bmpImage->image, params->contrastFactor);
+    return EXIT_SUCCESS;
+}
+
+static int run_equalize(void* obj, const Params* params)
+{
+    (void)params;
+    BMP* bmpImage = (BMP*)obj;
+    equalize_histogram(bmpImage->image);
+    return EXIT_SUCCESS;
+}
+
+static int run_auto_levels(void* obj, const Params* params)
 {
     BMP* bmpImage = (BMP*)obj;
-    contrast_effect(bmpImage->image, userInput->contrastFactor);
+    auto_levels(bmpImage->image, params->clipPercent);
     return EXIT_SUCCESS;
 }
 
-static int run_brightness_cut(void* obj)
+static int run_brightness_cut(void* obj, const Params* params)
 {
     BMP* bmpImage = (BMP*)obj;
-    brightness_cut_filter(bmpImage->image, userInput->cutoff);
+    brightness_cut_filter(bmpImage->image, params->cutoff);
     return EXIT_SUCCESS;
 }
 
-static int run_scale_strict(void* obj)
+static int run_scale_strict(void* obj, const Params* params)
 {
     BMP* bmpImage = (BMP*)obj;
-    colour_scaler_strict(bmpImage->image, userInput->strictRed,
-            userInput->strictGreen, userInput->strictBlue);
+    colour_scaler_strict(bmpImage->image, (params->scale).red,
+            (params->scale).green, (params->scale).blue);
     return EXIT_SUCCESS;
 }
 
-static int run_melt(void* obj)
+static int run_melt(void* obj, const Params* params)
 {
     BMP* bmpImage = (BMP*)obj;
-    if (melt(bmpImage, userInput->meltOffset) == -1) {
+    if (melt(bmpImage, params->meltOffset) == -1) {
         fprintf(stderr, "Melt failed\n");
         status = EXIT_MELT_FAILURE;
         return status;
@@ -710,48 +1242,43 @@ static int run_melt(void* obj)
     return EXIT_SUCCESS;
 }
 
-static int run_glitch(void* obj)
+static int run_glitch(void* obj, const Params* params)
 {
     BMP* bmpImage = (BMP*)obj;
-    if (glitch_effect(bmpImage->image, userInput->glitch) == -1) {
+    if (glitch_effect(bmpImage->image, params->glitch) == -1) {
         status = EXIT_OUT_OF_BOUNDS;
         return status;
     }
     return EXIT_SUCCESS;
 }
 
-static int run_scale(void* obj)
+static int run_scale(void* obj, const Params* params)
 {
     BMP* bmpImage = (BMP*)obj;
-    colour_scaler(bmpImage->image, userInput->scaleRed, userInput->scaleGreen,
-            userInput->scaleBlue);
+    colour_scaler(bmpImage->image, (params->scale).red,
+            (params->scale).green, (params->scale).blue);
     return EXIT_SUCCESS;
 }
 
-static int run_blur(void* obj)
+static int run_blur(void* obj, const Params* params)
 {
     BMP* bmpImage = (BMP*)obj;
-    Image* blurred = even_faster_image_blur(bmpImage->image, userInput->blur);
-
-    if (blurred == NULL) {
+    if (even_faster_image_blur(bmpImage->image, params->blur) == -1) {
         fprintf(stderr, "Blurring failed\n");
         status = EXIT_BLUR_FAILURE;
         return status;
     }
-
-    free_image(&(bmpImage->image));
-    bmpImage->image = blurred;
     return EXIT_SUCCESS;
 }
 
-static int run_rotate(void* obj)
+static int run_rotate(void* obj, const Params* params)
 {
     BMP* bmpImage = (BMP*)obj;
 
     Image* output = NULL;
 
     // Uses bit magic with mod 4
-    const uint8_t mode = (uint8_t)(userInput->rotations & 3);
+    const uint8_t mode = (uint8_t)(params->rotations & 3);
 
     switch (mode) {
     case 0:
@@ -790,7 +1317,7 @@ static int run_rotate(void* obj)
     }
 
     // If number of rotations is odd
-    if (userInput->rotations & 1) {
+    if (params->rotations & 1) {
         const int32_t temp = (bmpImage->infoHeader).bitmapWidth;
         (bmpImage->infoHeader).bitmapWidth
                 = (bmpImage->infoHeader).bitmapHeight;
@@ -799,8 +1326,9 @@ static int run_rotate(void* obj)
     return EXIT_SUCCESS;
 }
 
-static int run_transpose(void* obj)
+static int run_transpose(void* obj, const Params* params)
 {
+    (void)params;
     BMP* bmpImage = (BMP*)obj;
     Image* transpose = transpose_image(bmpImage->image);
 
@@ -815,15 +1343,17 @@ static int run_transpose(void* obj)
     return EXIT_SUCCESS;
 }
 
-static int run_reverse(void* obj)
+static int run_reverse(void* obj, const Params* params)
 {
+    (void)params;
     BMP* bmpImage = (BMP*)obj;
     reverse_image(bmpImage->image);
     return EXIT_SUCCESS;
 }
 
-static int run_flip(void* obj)
+static int run_flip(void* obj, const Params* params)
 {
+    (void)params;
     BMP* bmpImage = (BMP*)obj;
     if (flip_image(bmpImage->image) == -1) {
         fprintf(stderr, "Flip failed.\n");
@@ -833,29 +1363,111 @@ static int run_flip(void* obj)
     return EXIT_SUCCESS;
 }
 
-// Placeholder
-static int run_experimental(void* obj)
+/* stored_region()
+ * ---------------
+ * Converts a region, with rows counted from the top of the image, into one with
+ * rows counted in the order they are stored. BMP rows are stored bottom-up
+ * unless the height in the header is negative.
+ *
+ * Returns: 0 on success, -1 if the region is not within the image.
+ */
+static int stored_region(
+        const BMP* bmpImage, const Region* region, Region* stored)
 {
-    (void)obj;
-    return EXIT_SUCCESS;
+    const BmpInfoHeader* info = &(bmpImage->infoHeader);
+    const size_t width = (size_t)abs(info->bitmapWidth);
+    const size_t height = (size_t)abs(info->bitmapHeight);
+
+    if ((region->x >= width) || (region->width > width - region->x)
+            || (region->y >= height) || (region->height > height - region->y)) {
+        fprintf(stderr, regionBoundsMessage, region->x, region->y,
+                region->width, region->height, width, height);
+        return -1;
+    }
+
+    *stored = *region;
+    if (info->bitmapHeight > 0) {
+        stored->y = height - region->y - region->height;
+    }
+
+    return 0;
 }
 
-///////////////////////////////////////////////////////////////////////////////
-//
-//			INITIALISE ALL COMMANDS
-//
-///////////////////////////////////////////////////////////////////////////////
+static void set_header_dimensions(
+        BmpInfoHeader* info, const size_t width, const size_t height)
+{
+    info->bitmapWidth = (int32_t)width;
+    info->bitmapHeight = (info->bitmapHeight < 0) ? -(int32_t)height
+                                                  : (int32_t)height;
+}
 
-static const Command Input = {
-    .verify = verify_input,
-    .run = run_input,
-    .help = {
-	.code = 'i',
+static int run_crop(void* obj, const Params* params)
+{
+    BMP* bmpImage = (BMP*)obj;
+    Region stored;
+
+    if (stored_region(bmpImage, &(params->region), &stored) == -1) {
+        status = EXIT_OUT_OF_BOUNDS;
+        return status;
+    }
+
+    // Only the region was loaded if the crop is the first command (see
+    // leading_crop()), in which case the header is yet to be updated
+    if (bmpImage->regionLoaded) {
+        bmpImage->regionLoaded = false;
+        set_header_dimensions(
+                &(bmpImage->infoHeader), stored.width, stored.height);
+        return EXIT_SUCCESS;
+    }
+
+    Image* view = create_view(
+            bmpImage->image, stored.x, stored.y, stored.width, stored.height);
+
+    if (view == NULL) {
+        fprintf(stderr, "Crop failed\n");
+        status = EXIT_REGION_FAILURE;
+        return status;
+    }
+
+    // The cropped image refers to the pixel data of the original image, which
+    // is kept until it is no longer viewed
+    if (bmpImage->image->isView) {
+        free_image(&(bmpImage->image));
+    } else {
+        free_image(&(bmpImage->base));
+        bmpImage->base = bmpImage->image;
+    }
+
+    bmpImage->image = view;
+    set_header_dimensions(&(bmpImage->infoHeader), stored.width, stored.height);
+    return EXIT_SUCCESS;
+}
+
+// Placeholder
+static int run_experimental(void* obj, const Params* params)
+{
+    (void)params;
+    (void)obj;
+    return EXIT_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//			INITIALISE ALL COMMANDS
+//
+///////////////////////////////////////////////////////////////////////////////
+
+static const Command Input = {
+    .verify = verify_input,
+    .run = run_input,
+    .help = {
+	.code = 'i',
 	.name = "input",
 	.usage = "--input <file>",
-	.desc = "Specifies the source BMP image file to be "
-		"processed.\n\tFilename "
-		"must end in \'.bmp\'.",
+	.desc = "Specifies the source image file to be "
+		"processed.\n\tBMP, PPM (P6) and PAM (P7) files are "
+		"recognised by their contents,\n\tregardless of the "
+		"filename. A path of '-' reads the image from stdin.",
 	.examples = "signals -i images/beach.bmp",
     },
 };
@@ -867,14 +1479,17 @@ static const Command Output = {
         .code = 'o',
 	.name = "output",
 	.usage = "-i <file> --output <file>",
-	.desc = "Specifies the destination path"
-		"where the processed BMP will be saved.",
-	.examples = "signals -i in.bmp -o out.bmp",
+	.desc = "Specifies the destination path "
+		"where the processed image will be saved.\n\tImages are "
+		"saved in the format of the input (see --format).\n\tA "
+		"path of '-' writes the image to stdout, so that "
+		"processes\n\tcan be chained.",
+	.examples = "signals -i in.bmp -o - -g | signals -i - -o out.bmp",
     },
 };
 
 static const Command Merge = {
-    .verify = verify_merge,
+    .verify = verify_file_path,
     .run = run_merge,
     .help = {
 	.code = 'm',
@@ -884,10 +1499,11 @@ static const Command Merge = {
 		"\n\tInput and merge paths must be unique.",
 	.examples = "signals -i face1.bmp -m face2.bmp -o morph.bmp",
     },
+    .truecolour = true,
 };
 
 static const Command Combine = {
-    .verify = verify_combine,
+    .verify = verify_file_path,
     .run = run_combine,
     .help = {
         .code = 'c',
@@ -898,6 +1514,7 @@ static const Command Combine = {
 		"must be unique.",
         .examples = "signals -i back.bmp -c front.bmp -o combined.bmp",
     },
+    .truecolour = true,
 };
 
 static const Command Dump = {
@@ -934,10 +1551,167 @@ static const Command Encode = {
     .help = {
         .code = 'e',
         .name = "encode",
-        .usage = "-i <file> --encode <secrets>",
-        .desc = "Reads an input file and hides the contents within the "
-		"output image.",
-        .examples = "signals -i cover.bmp --encode secret.txt -o cover.bmp",
+        .usage = "-i <file> -o <file> --encode <secrets>[, <bits>]",
+        .desc = "Hides the contents of a file within the output image, "
+		"along with its length\n\tand checksum. By default it is "
+		"hidden in the padding of each row,\n\tleaving the pixels "
+		"unchanged, though rows whose size is a multiple\n\tof 4 "
+		"bytes have none. Otherwise the low 1 to 4 bits of each "
+		"colour\n\tchannel are replaced, holding up to half of the "
+		"image. Fails if the\n\tfile does not fit, giving the "
+		"capacity.",
+        .examples = "signals -i cover.bmp -o out.bmp --encode "
+		"\"secret.txt, 2\"",
+    },
+};
+
+// Decoding is handled inside "handle_commands", before the image is loaded
+static const Command Decode = {
+    .verify = verify_decode,
+    .run = run_input,
+    .help = {
+        .code = 'D',
+        .name = "decode",
+        .usage = "-i <file> --decode <file>",
+        .desc = "Extracts a file hidden by --encode, finding it in the "
+		"row padding or the\n\tlow bits of each colour channel, and "
+		"writes it to the file given, or\n\tstdout for '-'. Fails "
+		"if no payload is found, or its checksum does not\n\tmatch. "
+		"The pixel data is read directly, so the image is only "
+		"loaded if\n\tother commands use it.",
+        .examples = "signals -i out.bmp --decode secret.txt",
+    },
+};
+
+static const Command HistogramCmd = {
+    .verify = verify_histogram,
+    .run = run_histogram,
+    .help = {
+        .code = 'Y',
+        .name = "histogram",
+        .usage = "-i <file> --histogram <text|json>[, <file>]",
+        .desc = "Counts the red, green, blue and luma values of the image "
+		"as it is at that\n\tstage, and writes them to stdout, or "
+		"appends them to the file given.\n\tJSON is written as a "
+		"single line per histogram. The image is unchanged,\n\tso "
+		"it may be given between other commands, or after --roi to "
+		"count a\n\tregion.",
+        .examples = "signals -i in.bmp --histogram json --contrast 150 "
+		"--histogram json",
+    },
+};
+
+// Stages are added directly by load_pipeline(), so this is never run
+static const Command Pipeline = {
+    .verify = verify_no_argument,
+    .run = run_input,
+    .help = {
+        .code = 'P',
+        .name = "pipeline",
+        .usage = "-i <file> --pipeline <file>",
+        .desc = "Runs the commands listed in a pipeline file, one per "
+		"line as '<command> [argument]'.\n\tCommands may be "
+		"repeated, and run in the order listed. Blank lines and "
+		"lines starting with '#' are ignored.",
+        .examples = "signals -i in.bmp -o out.bmp --pipeline glow.txt",
+    },
+};
+
+static const Command HugePages = {
+    .verify = verify_huge_pages,
+    .run = run_input,
+    .help = {
+        .code = 'H',
+        .name = "hugepages",
+        .usage = "-i <file> --hugepages",
+        .desc = "Backs large images with 2 MB transparent huge pages, "
+		"reducing TLB misses\n\twhen transposing, rotating and "
+		"melting very large images.\n\tFalls back to regular "
+		"pages if unsupported by the kernel.",
+        .examples = "signals -i huge.bmp -o out.bmp --hugepages -r 1",
+    },
+};
+
+static const Command Layout = {
+    .verify = verify_layout,
+    .run = run_input,
+    .help = {
+        .code = 'L',
+        .name = "layout",
+        .usage = "-i <file> --layout <bgr|bgrx>",
+        .desc = "Sets the in-memory pixel layout. 'bgrx' pads each pixel "
+		"to 4 bytes,\n\tso that filters, blurs and blends operate "
+		"on aligned 32-bit lanes.\n\t32-bit files are always "
+		"loaded as 'bgrx', retaining alpha. Defaults to 'bgr'.",
+        .examples = "signals -i in.bmp -o out.bmp --layout bgrx -B 8 -C 1.2",
+    },
+};
+
+static const Command Raw = {
+    .verify = verify_raw,
+    .run = run_input,
+    .help = {
+        .code = 'x',
+        .name = "raw",
+        .usage = "-i <file> --raw <rgb|bgr>, <w>, <h>",
+        .desc = "Reads the input as headerless 24-bit pixels in the "
+		"given channel order,\n\twith the top row first. Raw "
+		"input has no header, so its dimensions\n\tmust be given.",
+        .examples = "signals -i in.rgb -o out.rgb --raw \"rgb, 640, 480\" -g",
+    },
+};
+
+static const Command Format = {
+    .verify = verify_format,
+    .run = run_input,
+    .help = {
+        .code = 'O',
+        .name = "format",
+        .usage = "-i <file> -o <file> --format <bmp|ppm|pam|rgb|bgr|sig>",
+        .desc = "Sets the format of the output, which otherwise matches "
+		"the input.\n\tPPM, PAM and raw pixels have no row "
+		"padding, so are quick to\n\tread and write. SIG files are "
+		"split into 256x256 tiles, each\n\tcompressed, so a crop "
+		"only reads the tiles it overlaps.\n\tOnly SIG, PAM and "
+		"BMP retain alpha.",
+        .examples = "signals -i in.bmp -o out.ppm --format ppm",
+    },
+};
+
+static const Command Cache = {
+    .verify = verify_cache,
+    .run = run_input,
+    .help = {
+        .code = 'k',
+        .name = "cache",
+        .usage = "-i <file> -o <file> --cache <dir>[, <MiB>]",
+        .desc = "Caches results in the directory, keyed by a hash of the "
+		"input files,\n\tcommands and parameters. A repeated run "
+		"copies its output from\n\tthe cache, while a run sharing "
+		"its first commands resumes from\n\tthe last blur or melt "
+		"they have in common. The least recently\n\tused results "
+		"are removed beyond the limit, which defaults to "
+		"1024 MiB.",
+        .examples = "signals -i in.bmp -o out.bmp --cache ~/.cache/signals"
+		" -B 20 -g",
+    },
+};
+
+static const Command OnAnomaly = {
+    .verify = verify_on_anomaly,
+    .run = run_input,
+    .help = {
+        .code = 'A',
+        .name = "on-anomaly",
+        .usage = "-i <file> --on-anomaly <fail|ignore|extract>[, <file>]",
+        .desc = "Sets how BMP input with trailing bytes or non-zero row "
+		"padding is handled,\n\teither of which may hide data. "
+		"'fail' rejects the file, while 'ignore'\n\treads it "
+		"regardless. 'extract' also writes the non-zero padding "
+		"bytes\n\tto the file given, or stdout. Defaults to "
+		"'ignore'.",
+        .examples = "signals -i secret.bmp -o out.bmp --on-anomaly "
+		"\"extract, msg.txt\"",
     },
 };
 
@@ -953,6 +1727,7 @@ static const Command Filters = {
 		"removed from the output image.",
         .examples = "signals -i in.bmp -o out.bmp --filter rb",
     },
+    .keySize = PARAM_SIZE(filters),
 };
 
 static const Command Hue = {
@@ -965,10 +1740,11 @@ static const Command Hue = {
         .desc = "Update...", // FIX
         .examples = "signals -i in.bmp -o out.bmp --hue \'0, 0, 100\'",
     },
+    .keySize = PARAM_SIZE(hue),
 };
 
 static const Command Grayscale = {
-    .verify = verify_grayscale,
+    .verify = verify_no_argument,
     .run = run_grayscale,
     .help = {
         .code = 'g',
@@ -981,7 +1757,7 @@ static const Command Grayscale = {
 };
 
 static const Command Average = {
-    .verify = verify_average,
+    .verify = verify_no_argument,
     .run = run_average,
     .help = {
         .code = 'a',
@@ -994,7 +1770,7 @@ static const Command Average = {
 };
 
 static const Command Invert = {
-    .verify = verify_invert,
+    .verify = verify_no_argument,
     .run = run_invert,
     .help = {
         .code = 'v', 
@@ -1006,7 +1782,7 @@ static const Command Invert = {
 };
 
 static const Command Swap = {
-    .verify = verify_swap,
+    .verify = verify_no_argument,
     .run = run_swap,
     .help = {
         .code = 's',
@@ -1017,6 +1793,63 @@ static const Command Swap = {
     },
 };
 
+static const Command HueRotate = {
+    .verify = verify_hue_rotate,
+    .run = run_colour_step,
+    .help = {
+        .code = 'u',
+        .name = "hue-rotate",
+        .usage = "-i <file> --hue-rotate <degrees>",
+        .desc = "Rotates the hue of each pixel by an angle, preserving its "
+		"luma. Colour space\n\tadjustments given one after another "
+		"are applied together, with a\n\tsingle conversion of each "
+		"row to and from YCbCr.",
+        .examples = "signals -i in.bmp -o out.bmp --hue-rotate 120 "
+		"--saturation 1.5",
+    },
+    .keySize = PARAM_SIZE(colour),
+};
+
+static const Command Saturation = {
+    .verify = verify_saturation,
+    .run = run_colour_step,
+    .help = {
+        .code = 'U',
+        .name = "saturation",
+        .usage = "-i <file> --saturation <0-16>",
+        .desc = "Scales the saturation of each pixel, preserving its luma. "
+		"0 removes all\n\tcolour, while 1 leaves the image "
+		"unchanged.",
+        .examples = "signals -i in.bmp -o out.bmp --saturation 0.5",
+    },
+    .keySize = PARAM_SIZE(colour),
+};
+
+static const Command Lut3d = {
+    .verify = verify_lut3d,
+    .run = run_lut3d,
+    .help = {
+        .code = 'Q',
+        .name = "lut3d",
+        .usage = "-i <file> --lut3d <file.cube>[, <size>]",
+        .desc = "Colour grades the image with a 3D LUT from a .cube file, "
+		"interpolating\n\ttetrahedrally between its nodes. The LUT "
+		"may first be resampled to\n\tthe size given, such as 33 or "
+		"65 nodes along each axis. A single LUT\n\tcan replace a "
+		"long chain of colour commands.",
+        .examples = "signals -i in.bmp -o graded.bmp --lut3d \"film.cube, "
+		"33\"",
+    },
+};
+
+// Runs of the colour space stages above, built by run_commands()
+static const Command ColourChain = {
+    .run = run_colour_chain,
+    .help = {
+        .name = "colour adjustments",
+    },
+};
+
 static const Command Contrast = {
     .verify = verify_contrast,
     .run = run_contrast,
@@ -1027,6 +1860,38 @@ static const Command Contrast = {
         .desc = "Increase the contrast of an image.",
         .examples = "signals -i in.bmp -o out.bmp --contrast 150",
     },
+    .keySize = PARAM_SIZE(contrastFactor),
+};
+
+static const Command Equalize = {
+    .verify = verify_no_argument,
+    .run = run_equalize,
+    .help = {
+        .code = 'q',
+        .name = "equalize",
+        .usage = "-i <file> --equalize",
+        .desc = "Spreads the levels of the image evenly over the full "
+		"range, from the\n\thistogram of its luma. The same mapping "
+		"is applied to each colour, so\n\thues are kept.",
+        .examples = "signals -i in.bmp -o out.bmp --equalize",
+    },
+};
+
+static const Command AutoLevels = {
+    .verify = verify_auto_levels,
+    .run = run_auto_levels,
+    .help = {
+        .code = 'w',
+        .name = "auto-levels",
+        .usage = "-i <file> --auto-levels[=<clip%>]",
+        .desc = "Stretches the darkest and brightest levels of the image "
+		"to 0 and 255,\n\tfound from the histogram of every colour "
+		"channel. Up to the percentage\n\tgiven (below 50) of the "
+		"values at each end are clipped, so that a few\n\toutliers "
+		"do not limit the stretch.",
+        .examples = "signals -i in.bmp -o out.bmp --auto-levels=0.5",
+    },
+    .keySize = PARAM_SIZE(clipPercent),
 };
 
 static const Command BrightnessCut = {
@@ -1039,6 +1904,21 @@ static const Command BrightnessCut = {
         .desc = "Sets a pixel channel to 0 if it exceeds the cutoff value.",
         .examples = "signals -i in.bmp -o cut.bmp --brightness-cut 200",
     },
+    .keySize = PARAM_SIZE(cutoff),
+};
+
+static const Command Lightness = {
+    .verify = verify_lightness,
+    .run = run_colour_step,
+    .help = {
+        .code = 'l',
+        .name = "lightness",
+        .usage = "-i <file> --lightness <-100-100>",
+        .desc = "Blends each pixel towards white by a percentage, or "
+		"towards black if\n\tnegative.",
+        .examples = "signals -i in.bmp -o out.bmp --lightness -20",
+    },
+    .keySize = PARAM_SIZE(colour),
 };
 
 static const Command ScaleStrict = {
@@ -1052,6 +1932,7 @@ static const Command ScaleStrict = {
                 "factor.\n\tIntensity is clamped above by UINT8_MAX.",
         .examples = "signals -i in.bmp -o strict.bmp --scale-strict 0.5",
     },
+    .keySize = PARAM_SIZE(scale),
 };
 
 static const Command Melt = {
@@ -1065,6 +1946,9 @@ static const Command Melt = {
 		"values to melt upwards.",
         .examples = "signals -i in.bmp -o melted.bmp --melt 50",
     },
+    .truecolour = true,
+    .checkpoint = true,
+    .keySize = PARAM_SIZE(meltOffset),
 };
 
 static const Command Glitch = {
@@ -1080,6 +1964,8 @@ static const Command Glitch = {
 		"dimensions of the input image.",
         .examples = "signals -i in.bmp -o glitch.bmp --glitch 20",
     },
+    .truecolour = true,
+    .keySize = PARAM_SIZE(glitch),
 };
 
 static const Command Scale = {
@@ -1093,6 +1979,7 @@ static const Command Scale = {
 		"for some very interesting effets :)",
         .examples = "signals -i in.bmp -o trippy.bmp --scale 2.5",
     },
+    .keySize = PARAM_SIZE(scale),
 };
 
 static const Command Blur = {
@@ -1105,6 +1992,9 @@ static const Command Blur = {
         .desc = "Applies a box blur with the specified radius to the image.",
         .examples = "signals -i in.bmp -o blurred.bmp --blur 5",
     },
+    .truecolour = true,
+    .checkpoint = true,
+    .keySize = PARAM_SIZE(blur),
 };
 
 static const Command Rotate = {
@@ -1118,10 +2008,11 @@ static const Command Rotate = {
                 "numbers rotate anti-clockwise.",
         .examples = "signals -i in.bmp -o rotated.bmp --rotate 1",
     },
+    .keySize = PARAM_SIZE(rotations),
 };
 
 static const Command Transpose = {
-    .verify = verify_transpose,
+    .verify = verify_no_argument,
     .run = run_transpose,
     .help = {
         .code = 't',
@@ -1133,7 +2024,7 @@ static const Command Transpose = {
 };
 
 static const Command Reverse = {
-    .verify = verify_reverse,
+    .verify = verify_no_argument,
     .run = run_reverse,
     .help = {
         .code = 'R',
@@ -1145,7 +2036,7 @@ static const Command Reverse = {
 };
 
 static const Command Flip = {
-    .verify = verify_flip,
+    .verify = verify_no_argument,
     .run = run_flip,
     .help = {
         .code = 'F',
@@ -1156,6 +2047,38 @@ static const Command Flip = {
     },
 };
 
+static const Command Crop = {
+    .verify = verify_crop,
+    .run = run_crop,
+    .help = {
+        .code = 'K',
+        .name = "crop",
+        .usage = "-i <file> --crop <x,y,w,h>",
+        .desc = "Crops the image to the w by h pixel rectangle, with its top "
+		"left corner at\n\t(x, y). The crop refers to the original "
+		"pixel data rather than copying\n\tit. If it is the first "
+		"command, only the rectangle is read from the file.",
+        .examples = "signals -i scan.bmp -o patch.bmp --crop 1200,800,256,256",
+    },
+    .keySize = PARAM_SIZE(region),
+};
+
+static const Command Roi = {
+    .verify = verify_roi,
+    .run = run_input,
+    .help = {
+        .code = 'I',
+        .name = "roi",
+        .usage = "-i <file> --roi <x,y,w,h>",
+        .desc = "Restricts the commands following it to the w by h pixel "
+		"rectangle, with\n\tits top left corner at (x, y), until "
+		"the next --roi or --crop. Commands\n\twhich change the "
+		"dimensions of the image cannot be applied to a region.",
+        .examples = "signals -i in.bmp -o out.bmp --roi 0,0,400,300 -B 6",
+    },
+    .keySize = PARAM_SIZE(region),
+};
+
 static const Command Experimental = {
     .verify = verify_experimental,
     .run = run_experimental,
@@ -1166,29 +2089,763 @@ static const Command Experimental = {
         .desc = "Runs a specific experimental chain of effects.",
         .examples = "signals -i in.bmp -o exp.bmp --experimental",
     },
+    .truecolour = true,
 };
 
 static const Entry CmdRegistry[] = {
         {"input", INPUT, Input}, {"output", OUTPUT, Output},
         {"dump", DUMP, Dump}, {"print", PRINT, Print},
         {"filter", FILTERS, Filters}, {"hue", HUE, Hue},
+        {"hue-rotate", HUE_ROTATE, HueRotate},
+        {"saturation", SATURATION, Saturation},
+        {"lightness", LIGHTNESS, Lightness}, {"lut3d", LUT3D, Lut3d},
         {"grayscale", GRAYSCALE, Grayscale}, {"invert", INVERT, Invert},
         {"flip", FLIP, Flip}, {"brightness-cut", BRIGHTNESS_CUT, BrightnessCut},
         {"combine", COMBINE, Combine}, {"glitch", GLITCH, Glitch},
         {"average", AVERAGE, Average}, {"contrast", CONTRAST, Contrast},
+        {"equalize", EQUALIZE, Equalize},
+        {"auto-levels", AUTO_LEVELS, AutoLevels},
         {"swap", SWAP, Swap}, {"rotate", ROTATE, Rotate},
         {"transpose", TRANSPOSE, Transpose}, {"reverse", REVERSE, Reverse},
         {"melt", MELT, Melt}, {"scale", SCALE, Scale},
         {"scale-strict", SCALE_STRICT, ScaleStrict}, {"merge", MERGE, Merge},
         {"blur", BLUR, Blur}, {"encode", ENCODE, Encode},
+        {"decode", DECODE, Decode},
         {"experimental", EXPERIMENTAL, Experimental},
+        {"pipeline", PIPELINE, Pipeline},
+        {"hugepages", HUGE_PAGES, HugePages},
+        {"layout", LAYOUT, Layout},
+        {"raw", RAW, Raw}, {"format", FORMAT, Format},
+        {"cache", CACHE, Cache}, {"on-anomaly", ON_ANOMALY, OnAnomaly},
+        {"histogram", HISTOGRAM, HistogramCmd},
+        {"crop", CROP, Crop}, {"roi", ROI, Roi},
         {NULL, INVALID, {0}}, // INVALID
 };
 
+#ifdef ENABLE_SDL
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//			INTERACTIVE PREVIEW
+//
+///////////////////////////////////////////////////////////////////////////////
+
+constexpr float contrastStep = 0.05f;
+
+// Intermediate images are cached prior to each tunable stage (see Stage), so
+// that changing a parameter only re-runs the commands from that stage onwards.
+typedef struct {
+    BMP* bmp;
+    uint32_t selected;
+} Preview;
+
+static Preview preview = {0};
+
+static bool is_tunable(const uint32_t stage)
+{
+    switch ((CmdRegistry[stages[stage].entry]).code) {
+    case CONTRAST:
+    case BLUR:
+    case GLITCH:
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+/* snapshot_stage()
+ * ----------------
+ * Caches a copy of the image prior to running a tunable stage. Failure to
+ * allocate a snapshot is not fatal, the stage is simply not tunable.
+ */
+static void snapshot_stage(const BMP* bmpImage, const uint32_t stage)
+{
+    free_image(&(stages[stage].snapshot));
+    stages[stage].snapshot = duplicate_image(bmpImage->image);
+
+    if (stages[stage].snapshot == NULL) {
+        fprintf(stderr, "Preview of stage %u disabled (out of memory)\n",
+                stage + 1);
+        return;
+    }
+
+    stages[stage].infoHeader = bmpImage->infoHeader;
+}
+
+static void free_preview(void)
+{
+    for (uint32_t i = 0; i < stageCount; i++) {
+        free_image(&(stages[i].snapshot));
+    }
+}
+
+#endif
+
+/* run_in_region()
+ * ---------------
+ * Runs a command on a view of a region of the image, so that pixels outside of
+ * the region are unaffected. Commands which replace the image rather than
+ * modifying it (such as melt) have the result copied back into the region,
+ * provided its dimensions are unchanged.
+ *
+ * Returns: EXIT_SUCCESS, or the exit code of the command.
+ */
+static int run_in_region(BMP* bmpImage, const Command* cmd,
+        const Params* params, const Region* region)
+{
+    Region stored;
+    if (stored_region(bmpImage, region, &stored) == -1) {
+        status = EXIT_OUT_OF_BOUNDS;
+        return status;
+    }
+
+    BMP regionImage = *bmpImage;
+    regionImage.base = NULL;
+    regionImage.image = create_view(
+            bmpImage->image, stored.x, stored.y, stored.width, stored.height);
+
+    if (regionImage.image == NULL) {
+        perror("malloc failed while creating region");
+        status = EXIT_REGION_FAILURE;
+        return status;
+    }
+    set_header_dimensions(
+            &(regionImage.infoHeader), stored.width, stored.height);
+
+    status = cmd->run(&regionImage, params);
+    Image* result = regionImage.image;
+
+    if ((result != NULL) && result->isView) {
+        free_image(&result);
+        return status;
+    }
+
+    // The command freed the view, replacing it with a new image
+    if ((status == EXIT_SUCCESS)
+            && ((result == NULL) || (result->width != stored.width)
+                    || (result->height != stored.height))) {
+        fprintf(stderr, regionDimensionsMessage, (cmd->help).name);
+        status = EXIT_REGION_FAILURE;
+    }
+
+    // Blending with a 32-bit image gives the region alpha
+    if ((status == EXIT_SUCCESS)
+            && (convert_image_layout(bmpImage->image, result->layout) == -1)) {
+        status = EXIT_LAYOUT_FAILURE;
+    }
+
+    Image* view = NULL;
+    if ((status == EXIT_SUCCESS)
+            && ((view = create_view(bmpImage->image, stored.x, stored.y,
+                         stored.width, stored.height))
+                    == NULL)) {
+        status = EXIT_REGION_FAILURE;
+    }
+
+    if (status == EXIT_SUCCESS) {
+        const size_t rowSize = view->width * pixel_size(view->layout);
+
+        for (size_t y = 0; y < view->height; y++) {
+            memcpy(image_row(view, y), image_row(result, y), rowSize);
+        }
+    }
+
+    free_image(&view);
+    free_image(&result);
+    return status;
+}
+
+/* active_roi()
+ * ------------
+ * Returns: The region set by the last --roi prior to the stage, or NULL if
+ * commands apply to the whole image. A crop ends any region.
+ */
+static const Region* active_roi(const uint32_t stage)
+{
+    const Region* roi = NULL;
+
+    for (uint32_t i = 0; i < stage; i++) {
+        const char code = (CmdRegistry[stages[i].entry]).code;
+
+        if (code == ROI) {
+            roi = &((stages[i].params).region);
+        } else if (code == CROP) {
+            roi = NULL;
+        }
+    }
+
+    return roi;
+}
+
+/* stage_code()
+ * ------------
+ * Returns: The code of the command run by the stage.
+ */
+static inline char stage_code(const uint32_t stage)
+{
+    return (CmdRegistry[stages[stage].entry]).code;
+}
+
+/* is_colour_step()
+ * ----------------
+ * Returns: true if the command is a colour space adjustment, which may be
+ * fused with those either side of it.
+ */
+static inline bool is_colour_step(const char code)
+{
+    return (code == HUE_ROTATE) || (code == SATURATION) || (code == LIGHTNESS);
+}
+
+/* run_commands()
+ * --------------
+ * Runs each parsed command in order, starting from the stage specified.
+ * Consecutive --hue-rotate, --saturation and --lightness stages are fused, and
+ * run together as a single ColourChain stage, so that each row is converted to
+ * and from YCbCr once.
+ *
+ * bmpImage: The loaded BMP to process.
+ * first: Index of the first stage to run.
+ *
+ * Returns: EXIT_SUCCESS, or the exit code of the first command that failed.
+ */
+static int run_commands(BMP* bmpImage, const uint32_t first)
+{
+    const Region* roi = active_roi(first);
+
+    // Consecutive colour space stages are run as a single chain
+    ColourStep chain[maxFusedSteps];
+    Params fused;
+
+    for (uint32_t i = first; i < stageCount; i++) {
+        const Command* cmd = &((CmdRegistry[stages[i].entry]).cmd);
+        const Params* params = &(stages[i].params);
+        const char* const name = (cmd->help).name;
+        const char code = (CmdRegistry[stages[i].entry]).code;
+
+        if (code == ROI) {
+            roi = &((stages[i].params).region);
+            continue;
+        }
+
+        if (code == CROP) {
+            roi = NULL;
+        }
+
+        if (!strcmp(name, "dump") || !strcmp(name, "input")
+                || !strcmp(name, "output") || !strcmp(name, "print")) {
+            if (first == 0) {
+                fprintf(stderr, "Ignoring \'%s\'\n", name);
+            }
+            continue;
+        }
+
+#ifdef ENABLE_SDL
+        // The snapshot of the first stage is unchanged when re-running
+        if (userInput->print && is_tunable(i)
+                && ((i != first) || (stages[i].snapshot == NULL))) {
+            snapshot_stage(bmpImage, i);
+        }
+#endif
+
+        // Indexed images are expanded once a command needs colour pixels, or
+        // before operating on a region, as the palette is shared by the image
+        if ((bmpImage->image->layout == LAYOUT_INDEX8)
+                && (cmd->truecolour || (roi != NULL))
+                && (convert_image_layout(bmpImage->image, userInput->layout)
+                        == -1)) {
+            status = EXIT_LAYOUT_FAILURE;
+            return status;
+        }
+
+        if (is_colour_step(code)) {
+            uint32_t count = 0;
+            while ((count < maxFusedSteps) && (i + count < stageCount)
+                    && is_colour_step(stage_code(i + count))) {
+                chain[count] = (stages[i + count].params).colour;
+                count++;
+            }
+
+            fused.chain.steps = chain;
+            fused.chain.count = count;
+            cmd = &ColourChain;
+            params = &fused;
+            i += count - 1;
+        }
+
+        if (roi != NULL) {
+            status = run_in_region(bmpImage, cmd, params, roi);
+        } else {
+            status = cmd->run(bmpImage, params);
+        }
+
+        if (status != EXIT_SUCCESS) {
+            return status;
+        }
+
+        // Free the original image once the crop viewing it has been replaced
+        if ((bmpImage->base != NULL) && (bmpImage->image != NULL)
+                && !(bmpImage->image->isView)) {
+            free_image(&(bmpImage->base));
+        }
+
+        if (cmd->checkpoint && (cacheKeys != NULL)) {
+            store_cached_image(&(userInput->cache), cacheKeys[i + 1], bmpImage);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+#ifdef ENABLE_SDL
+
+/* select_stage()
+ * --------------
+ * Moves the selection to the next/previous tunable stage with a snapshot,
+ * wrapping around at either end.
+ */
+static void select_stage(const bool forwards)
+{
+    for (uint32_t n = 1; n <= stageCount; n++) {
+        const uint32_t stage = (forwards)
+                ? ((preview.selected + n) % stageCount)
+                : ((preview.selected + stageCount - n) % stageCount);
+
+        if (stages[stage].snapshot != NULL) {
+            preview.selected = stage;
+            return;
+        }
+    }
+}
+
+/* adjust_stage()
+ * --------------
+ * Steps the parameter of the selected stage up or down.
+ *
+ * Returns: true if the parameter changed, false if already at its limit.
+ */
+static bool adjust_stage(const bool increase)
+{
+    Stage* stage = &(stages[preview.selected]);
+    Params* params = &(stage->params);
+    const Image* input = stage->snapshot;
+
+    switch ((CmdRegistry[stage->entry]).code) {
+    case CONTRAST:
+        params->contrastFactor += (increase) ? contrastStep : -contrastStep;
+        return true;
+
+    case BLUR:
+        if (!increase && (params->blur <= 1)) {
+            return false;
+        }
+        params->blur = (increase) ? (params->blur + 1) : (params->blur - 1);
+        return true;
+
+    case GLITCH:
+        if ((increase && (params->glitch + 1 >= input->width))
+                || (!increase && (params->glitch <= 1))) {
+            return false;
+        }
+        params->glitch
+                = (increase) ? (params->glitch + 1) : (params->glitch - 1);
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+/* find_dirty_rows()
+ * -----------------
+ * Finds the smallest range of rows containing every pixel which differs
+ * between two images. Images of differing dimensions are entirely dirty.
+ */
+static void find_dirty_rows(
+        const Image* previous, const Image* current, DirtyRows* dirty)
+{
+    dirty->y0 = 0;
+    dirty->y1 = current->height;
+
+    if ((previous->width != current->width)
+            || (previous->height != current->height)
+            || (previous->layout != current->layout)) {
+        return;
+    }
+
+    const size_t rowSize = current->width * pixel_size(current->layout);
+
+    while ((dirty->y0 < dirty->y1)
+            && !memcmp(image_row(previous, dirty->y0),
+                    image_row(current, dirty->y0), rowSize)) {
+        dirty->y0++;
+    }
+
+    while ((dirty->y1 > dirty->y0)
+            && !memcmp(image_row(previous, dirty->y1 - 1),
+                    image_row(current, dirty->y1 - 1), rowSize)) {
+        dirty->y1--;
+    }
+}
+
+static bool preview_update(
+        void* ctx, const PreviewAction action, DirtyRows* dirty)
+{
+    (void)ctx;
+
+    if (stages[preview.selected].snapshot == NULL) {
+        return false; // Nothing tunable
+    }
+
+    switch (action) {
+    case PREVIEW_NEXT_STAGE:
+    case PREVIEW_PREV_STAGE:
+        select_stage(action == PREVIEW_NEXT_STAGE);
+        return false;
+
+    case PREVIEW_INCREASE:
+    case PREVIEW_DECREASE:
+        if (!adjust_stage(action == PREVIEW_INCREASE)) {
+            return false;
+        }
+        break;
+    }
+
+    BMP* bmpImage = preview.bmp;
+    Image* previous = bmpImage->image;
+    const BmpInfoHeader previousInfo = bmpImage->infoHeader;
+
+    // Restart from the cached input to the selected stage
+    bmpImage->image = duplicate_image(stages[preview.selected].snapshot);
+    bmpImage->infoHeader = stages[preview.selected].infoHeader;
+
+    if ((bmpImage->image == NULL)
+            || (run_commands(bmpImage, preview.selected) != EXIT_SUCCESS)
+            || (convert_image_layout(bmpImage->image, LAYOUT_BGR) == -1)) {
+        free_image(&(bmpImage->image));
+        bmpImage->image = previous;
+        bmpImage->infoHeader = previousInfo;
+        status = EXIT_SUCCESS;
+        return false;
+    }
+
+    find_dirty_rows(previous, bmpImage->image, dirty);
+    free_image(&previous);
+    return true;
+}
+
+static const Image* preview_current(void* ctx)
+{
+    (void)ctx;
+    return preview.bmp->image;
+}
+
+static void preview_title(void* ctx, char* buffer, const size_t len)
+{
+    (void)ctx;
+
+    if (stages[preview.selected].snapshot == NULL) {
+        snprintf(buffer, len, "SIGNALS");
+        return;
+    }
+
+    const uint32_t stage = preview.selected;
+    const Params* params = &(stages[stage].params);
+    const char* const name = (CmdRegistry[stages[stage].entry]).name;
+
+    switch ((CmdRegistry[stages[stage].entry]).code) {
+    case CONTRAST:
+        snprintf(buffer, len, "SIGNALS - [%u] %s %.2f", stage + 1, name,
+                (double)(params->contrastFactor));
+        break;
+
+    case BLUR:
+        snprintf(buffer, len, "SIGNALS - [%u] %s %zu", stage + 1, name,
+                params->blur);
+        break;
+
+    case GLITCH:
+        snprintf(buffer, len, "SIGNALS - [%u] %s %zu", stage + 1, name,
+                params->glitch);
+        break;
+
+    default:
+        snprintf(buffer, len, "SIGNALS");
+        break;
+    }
+}
+
+static int run_preview(BMP* bmpImage)
+{
+    preview.bmp = bmpImage;
+
+    // Select the first tunable stage
+    preview.selected = 0;
+    while ((preview.selected < stageCount)
+            && (stages[preview.selected].snapshot == NULL)) {
+        preview.selected++;
+    }
+
+    if (preview.selected == stageCount) {
+        preview.selected = 0;
+    }
+
+    const PreviewHooks hooks = {
+            .ctx = &preview,
+            .update = preview_update,
+            .image = preview_current,
+            .title = preview_title,
+    };
+
+    return preview_image(&hooks);
+}
+
+#endif
+
+/* is_repeatable()
+ * ---------------
+ * Commands configuring the whole run may only be specified once. All other
+ * commands may be repeated, with each stage using its own parameters.
+ */
+static bool is_repeatable(const char code)
+{
+    switch (code) {
+    case INPUT:
+    case OUTPUT:
+    case DUMP:
+    case PRINT:
+    case ENCODE:
+    case DECODE:
+    case PIPELINE:
+    case HUGE_PAGES:
+    case LAYOUT:
+    case RAW:
+    case FORMAT:
+    case CACHE:
+    case ON_ANOMALY:
+    case EXPERIMENTAL:
+        return false;
+
+    default:
+        return true;
+    }
+}
+
+static int load_pipeline(const char* filePath);
+
+/* add_stage()
+ * -----------
+ * Verifies the argument of a command, and appends it to the stages to run.
+ *
+ * entry: Index into CmdRegistry of the command.
+ * arg: Argument of the command, or NULL if it takes none.
+ *
+ * Returns: EXIT_SUCCESS, or the exit code of the invalid command.
+ */
+static int add_stage(const int32_t entry, char* arg)
+{
+    const Entry* command = &(CmdRegistry[entry]);
+    const uint64_t mask = (uint64_t)1 << entry;
+
+    if (!is_repeatable(command->code)) {
+        if (activeCommands & mask) {
+            fprintf(stderr, repeatedCmdMessage, command->name);
+            return EXIT_REPEATED_CMD;
+        }
+        activeCommands |= mask;
+    }
+
+    if (command->code == PIPELINE) {
+        return load_pipeline(arg);
+    }
+
+    if (stageCount == stageCapacity) {
+        const uint32_t capacity = (stageCapacity) ? (stageCapacity * 2)
+                                                  : initialStageCapacity;
+
+        Stage* resized = realloc(stages, capacity * sizeof(Stage));
+        if (resized == NULL) {
+            perror("realloc failed while parsing commands");
+            return EXIT_FAILURE;
+        }
+
+        stages = resized;
+        stageCapacity = capacity;
+    }
+
+    Stage* stage = &(stages[stageCount]);
+    *stage = (Stage){.entry = entry};
+
+    const int success = (command->cmd).verify(&(stage->params), arg);
+    if (success != 0) {
+        return success;
+    }
+
+    stageCount++;
+    return EXIT_SUCCESS;
+}
+
+/* find_entry()
+ * ------------
+ * Returns: Index into CmdRegistry of the named command, or INVALID.
+ */
+static int32_t find_entry(const char* name)
+{
+    for (int32_t i = 0; (CmdRegistry[i]).name != NULL; i++) {
+        if (!strcmp((CmdRegistry[i]).name, name)) {
+            return i;
+        }
+    }
+    return INVALID;
+}
+
+/* argument_type()
+ * ---------------
+ * Returns: Whether the named command takes no argument, requires one, or has
+ * an optional argument, as given to getopt_long().
+ */
+static int argument_type(const char* name)
+{
+    for (size_t i = 0; longOptions[i].name != NULL; i++) {
+        if (!strcmp(longOptions[i].name, name)) {
+            return longOptions[i].has_arg;
+        }
+    }
+    return no_argument;
+}
+
+/* read_pipeline_file()
+ * --------------------
+ * Reads the entire pipeline file into pipelineText, as a NULL terminated
+ * string.
+ *
+ * Returns: EXIT_SUCCESS, or EXIT_FILE_CANNOT_BE_READ on error.
+ */
+static int read_pipeline_file(const char* filePath)
+{
+    FILE* file = fopen(filePath, "rb");
+    if (check_file_opened(file, filePath) == -1) {
+        return EXIT_FILE_CANNOT_BE_READ;
+    }
+
+    long size = -1;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        size = ftell(file);
+        rewind(file);
+    }
+
+    if ((size < 0) || ((size_t)size > maxPipelineSize)) {
+        fprintf(stderr, "signals: pipeline \'%s\' could not be read.\n",
+                filePath);
+        fclose(file);
+        return EXIT_FILE_CANNOT_BE_READ;
+    }
+
+    pipelineText = malloc((size_t)size + 1);
+    if ((pipelineText == NULL)
+            || (fread(pipelineText, 1, (size_t)size, file) != (size_t)size)) {
+        fprintf(stderr, "signals: pipeline \'%s\' could not be read.\n",
+                filePath);
+        fclose(file);
+        return EXIT_FILE_CANNOT_BE_READ;
+    }
+
+    pipelineText[size] = '\0';
+    fclose(file);
+    return EXIT_SUCCESS;
+}
+
+/* load_pipeline()
+ * ---------------
+ * Adds a stage for each command listed in a pipeline file. Each line holds a
+ * single command by its long name, followed by its argument if required:
+ *
+ *   # Soft glow
+ *   blur 3
+ *   contrast 1.2
+ *   blur 1
+ *
+ * Blank lines and lines starting with '#' are ignored. The stages run after
+ * any commands preceding the --pipeline option, and before any following it.
+ *
+ * filePath: Path to the pipeline file.
+ *
+ * Returns: EXIT_SUCCESS, or the exit code of the first invalid line.
+ */
+static int load_pipeline(const char* filePath)
+{
+    const int result = read_pipeline_file(filePath);
+    if (result != EXIT_SUCCESS) {
+        return result;
+    }
+
+    char* line = pipelineText;
+    for (uint32_t lineNumber = 1; line != NULL; lineNumber++) {
+        char* next = strchr(line, '\n');
+        if (next != NULL) {
+            *(next++) = '\0';
+        }
+
+        // Trim surrounding whitespace, including any '\r' line endings
+        line += strspn(line, " \t\r");
+        size_t len = strlen(line);
+        while ((len > 0) && isspace((unsigned char)line[len - 1])) {
+            line[--len] = '\0';
+        }
+
+        if ((len == 0) || (line[0] == '#')) {
+            line = next;
+            continue;
+        }
+
+        // Separate the command name from its argument
+        char* arg = line + strcspn(line, " \t");
+        if (*arg != '\0') {
+            *(arg++) = '\0';
+            arg += strspn(arg, " \t");
+        }
+
+        const int32_t entry = find_entry(line);
+        const int hasArg = argument_type(line);
+        int success = EXIT_NON_EXISTENT_COMMAND;
+
+        if (entry == INVALID) {
+            fprintf(stderr, invalidCmdMessage, line);
+        } else if ((hasArg != optional_argument)
+                && ((hasArg == required_argument) != (*arg != '\0'))) {
+            fprintf(stderr, pipelineArgMessage, line,
+                    (*arg != '\0') ? "does not take" : "requires");
+            success = EXIT_INVALID_ARG;
+        } else {
+            success = add_stage(entry, (*arg != '\0') ? arg : NULL);
+        }
+
+        if (success != EXIT_SUCCESS) {
+            fprintf(stderr, pipelineLineMessage, filePath, lineNumber);
+            return success;
+        }
+
+        line = next;
+    }
+
+    return EXIT_SUCCESS;
+}
+
 int parse_user_commands(const int argc, char** argv)
 {
     Flag opt;
 
+    // Reset any state from previously parsed commands. The stage array is kept
+    // for reuse by the next set of commands.
+    store = (UserInput){0};
+    userInput = &store;
+    activeCommands = 0;
+    stageCount = 0;
+    status = EXIT_SUCCESS;
+
+    free(pipelineText);
+    pipelineText = NULL;
+
     while ((opt = getopt_long(argc, argv, optstring, longOptions, NULL))
             != -1) {
         int32_t i = 0;
@@ -1206,23 +2863,10 @@ int parse_user_commands(const int argc, char** argv)
             i++;
         }
 
-        const Command* cmd = &((CmdRegistry[i]).cmd);
-        const uint64_t mask = (1 << i);
-
-        if (activeCommands & mask) { // Check if this command has
-                                     // already been parsed
-            return EXIT_REPEATED_CMD;
-        }
-
-        int success = cmd->verify();
-        if (success != 0) {
+        const int success = add_stage(i, optarg);
+        if (success != EXIT_SUCCESS) {
             return success;
         }
-
-        // Set commands to active
-        activeCommands |= mask;
-        cmdOrder[cmdCount] = i;
-        cmdCount++;
     }
 
     if (optind < argc) {
@@ -1234,8 +2878,213 @@ int parse_user_commands(const int argc, char** argv)
     return EXIT_SUCCESS;
 }
 
-int handle_commands(void)
+int verify_daemon_job(void)
+{
+    const char* conflict = NULL;
+
+    if (userInput->input && is_stream_path(userInput->inputFilePath)) {
+        conflict = "input";
+    } else if (userInput->output && is_stream_path(userInput->outputFilePath)) {
+        conflict = "output";
+    } else if (userInput->header) {
+        conflict = "dump";
+    } else if (userInput->print) {
+        conflict = "print";
+    } else if (userInput->decode && is_stream_path(userInput->decodeFilePath)) {
+        conflict = "decode";
+    } else if (userInput->histogramToStdout) {
+        conflict = "histogram";
+    } else if ((userInput->onAnomaly == ANOMALY_EXTRACT)
+            && ((userInput->extractFilePath == NULL)
+                    || is_stream_path(userInput->extractFilePath))) {
+        conflict = "on-anomaly";
+    }
+
+    // Merged and combined images are opened as input files are
+    for (uint32_t i = 0; (conflict == NULL) && (i < stageCount); i++) {
+        const Entry* entry = &(CmdRegistry[stages[i].entry]);
+
+        if (((entry->cmd).verify == verify_file_path)
+                && is_stream_path((stages[i].params).filePath)) {
+            conflict = entry->name;
+        }
+    }
+
+    if (conflict != NULL) {
+        fprintf(stderr, daemonStreamMessage, conflict);
+        return EXIT_INVALID_ARG;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/* elapsed_ms()
+ * ------------
+ * Returns the number of milliseconds elapsed since the start time, and resets
+ * the start time to now.
+ */
+static double elapsed_ms(struct timespec* start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    const double ms = ((double)(now.tv_sec - start->tv_sec) * 1e3)
+            + ((double)(now.tv_nsec - start->tv_nsec) / 1e6);
+
+    *start = now;
+    return ms;
+}
+
+/* leading_crop()
+ * --------------
+ * Returns: The parameters of the crop, if it is the first command to modify the
+ * image, otherwise NULL.
+ */
+static const Params* leading_crop(void)
+{
+    for (uint32_t i = 0; i < stageCount; i++) {
+        const char code = (CmdRegistry[stages[i].entry]).code;
+
+        if (code == CROP) {
+            return &(stages[i].params);
+        }
+
+        if (is_repeatable(code)) {
+            return NULL;
+        }
+    }
+
+    return NULL;
+}
+
+/* cache_keys()
+ * ------------
+ * Hashes everything which determines the result of each stage. The first key
+ * covers the contents of the input file and how it is read, and each stage
+ * extends the key before it with its command and parameters, so that runs
+ * sharing their first stages share their keys. Files read by a stage are
+ * hashed by their contents rather than their path.
+ *
+ * bmpImage: Opened image, whose headers have been read.
+ *
+ * Returns: Keys of the image before the first stage and after each stage,
+ * followed by the key of the output file, or NULL if the run cannot be cached.
+ */
+static uint64_t* cache_keys(const BMP* bmpImage)
+{
+    uint64_t* keys = malloc((stageCount + 2) * sizeof(uint64_t));
+    if (keys == NULL) {
+        return NULL;
+    }
+
+    uint64_t source[] = {0, (uint64_t)userInput->layout,
+            (uint64_t)userInput->inputFormat, userInput->rawWidth,
+            userInput->rawHeight, (uint64_t)userInput->onAnomaly};
+    if (hash_file(fileno(bmpImage->file), &(source[0])) == -1) {
+        goto uncacheable;
+    }
+    keys[0] = hash_bytes(source, sizeof(source), 0);
+
+    for (uint32_t i = 0; i < stageCount; i++) {
+        const Entry* entry = &(CmdRegistry[stages[i].entry]);
+        const Params* params = &(stages[i].params);
+        uint64_t key = keys[i];
+
+        // Options configuring the run are hashed with the input or output,
+        // and histograms leave the image unchanged
+        if ((!is_repeatable(entry->code) && (entry->code != EXPERIMENTAL))
+                || (entry->code == HISTOGRAM)) {
+            keys[i + 1] = key;
+            continue;
+        }
+
+        key = hash_bytes(&(entry->code), sizeof(entry->code), key);
+
+        const bool lut = ((entry->cmd).verify == verify_lut3d);
+        if (((entry->cmd).verify == verify_file_path) || lut) {
+            uint64_t contents;
+            if (is_stream_path(params->filePath)
+                    || (hash_path(params->filePath, &contents) == -1)) {
+                goto uncacheable;
+            }
+            if (lut) {
+                key = hash_bytes(&((params->lut).size),
+                        sizeof((params->lut).size), key);
+            }
+            keys[i + 1] = hash_bytes(&contents, sizeof(contents), key);
+        } else {
+            keys[i + 1] = hash_bytes(params, (entry->cmd).keySize, key);
+        }
+    }
+
+    uint64_t output[] = {keys[stageCount], userInput->convert,
+            (uint64_t)userInput->outputFormat, userInput->encode,
+            userInput->encodeBits, 0};
+    if (userInput->encode
+            && (is_stream_path(userInput->encodeFilePath)
+                    || (hash_path(userInput->encodeFilePath, &(output[5]))
+                            == -1))) {
+        goto uncacheable;
+    }
+    keys[stageCount + 1] = hash_bytes(output, sizeof(output), 0);
+    return keys;
+
+uncacheable:
+    free(keys);
+    return NULL;
+}
+
+/* resume_from_cache()
+ * -------------------
+ * Loads the image after the last checkpoint stage found in the cache.
+ *
+ * Returns: Index of the stage to resume from, or 0 if none were found.
+ */
+static uint32_t resume_from_cache(BMP* bmpImage, const uint64_t* keys)
+{
+    for (uint32_t i = stageCount; i > 0; i--) {
+        const Command* cmd = &((CmdRegistry[stages[i - 1].entry]).cmd);
+
+        if (cmd->checkpoint
+                && (fetch_cached_image(&(userInput->cache), keys[i], bmpImage)
+                        == EXIT_SUCCESS)) {
+            return i;
+        }
+    }
+
+    return 0;
+}
+
+/* run_decode()
+ * ------------
+ * Extracts the payload hidden in the pixel data of the opened file, then
+ * writes it to the decode path.
+ *
+ * Returns: EXIT_SUCCESS, or the exit code of the failure.
+ */
+static int run_decode(BMP* bmpImage)
+{
+    Secret secret;
+    if (extract_bmp_secret(bmpImage, &secret) == -1) {
+        return EXIT_FILE_CANNOT_BE_READ;
+    }
+
+    const int result = write_secret(&secret, userInput->decodeFilePath);
+    free_secret(&secret);
+    return (result == -1) ? EXIT_OUTPUT_FILE_ERROR : EXIT_SUCCESS;
+}
+
+int handle_commands(Timings* timings)
 {
+    Timings unused;
+    if (timings == NULL) {
+        timings = &unused;
+    }
+    *timings = (Timings){0};
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
     // An input file is required all non-help commands
     if (!(userInput->input)) {
         fprintf(stderr, "signals: no input file provided. ");
@@ -1243,65 +3092,159 @@ int handle_commands(void)
         return EXIT_MISSING_INPUT_FILE;
     }
 
-    // Check the file type of supplied file path
-    if (check_valid_file_type(fileType, userInput->inputFilePath) == -1) {
-        return EXIT_INVALID_FILE_TYPE;
+    // Text written to stdout would be interleaved with a streamed image
+    if (userInput->output && is_stream_path(userInput->outputFilePath)) {
+        const char* conflict = (userInput->header) ? "dump" : NULL;
+        if ((userInput->onAnomaly == ANOMALY_EXTRACT)
+                && ((userInput->extractFilePath == NULL)
+                        || is_stream_path(userInput->extractFilePath))) {
+            conflict = "on-anomaly";
+        }
+        if (userInput->decode && is_stream_path(userInput->decodeFilePath)) {
+            conflict = "decode";
+        }
+        if (userInput->histogramToStdout) {
+            conflict = "histogram";
+        }
+#ifndef ENABLE_SDL
+        if (userInput->print) {
+            conflict = "print";
+        }
+#endif
+        if (conflict != NULL) {
+            fprintf(stderr, streamOutputMessage, conflict);
+            return EXIT_INVALID_ARG;
+        }
     }
 
+    // Intermediate images reuse pooled buffers for the duration of the run,
+    // unless the caller has bound a longer lived pool (see server.c)
+    ImagePool runPool = {0};
+    const bool ownsPool = (bound_image_pool() == NULL);
+    if (ownsPool) {
+        bind_image_pool(&runPool);
+    }
+    set_huge_pages(userInput->hugePages);
+    set_anomaly_policy(userInput->onAnomaly);
+
     // Initialise struct to store BMP data
     BMP bmpImage;
     initialise_bmp(&bmpImage);
+    bmpImage.layout = userInput->layout;
+    bmpImage.format = userInput->inputFormat;
+    bmpImage.rawWidth = userInput->rawWidth;
+    bmpImage.rawHeight = userInput->rawHeight;
+    uint64_t* keys = NULL;
 
-    // Attempt to open the BMP and read file headers
+    // Attempt to open the image and read its headers
     status = open_bmp(&bmpImage, userInput->inputFilePath);
     if (status != EXIT_SUCCESS) {
         goto cleanup;
     }
 
     if (userInput->header) {
-        Dump.run(&bmpImage);
+        Dump.run(&bmpImage, NULL);
     }
 
-    // Attempt to load pixel data from file into bmpImage struct
-    status = handle_bmp_loading(&bmpImage);
-    if (status != EXIT_SUCCESS) {
-        goto cleanup;
-    }
+    if (userInput->decode) {
+        status = run_decode(&bmpImage);
 
-    for (uint32_t i = 0; i < cmdCount; i++) {
-        if (cmdOrder[i] == INVALID) {
+        // Nothing else uses the pixels, so they need not be loaded
+        if ((status != EXIT_SUCCESS)
+                || !(userInput->output || userInput->print
+                        || userInput->histogram
+                        || (userInput->onAnomaly == ANOMALY_EXTRACT))) {
             goto cleanup;
         }
+    }
 
-        const Command* cmd = &((CmdRegistry[cmdOrder[i]]).cmd);
-        const char* const name = (cmd->help).name;
-        if (!strcmp(name, "dump") || !strcmp(name, "input")
-                || !strcmp(name, "output") || !strcmp(name, "print")) {
-            fprintf(stderr, "Ignoring \'%s\'\n", name);
-            continue;
+    // The preview needs the image before each stage, so always runs them all,
+    // as do histograms, and padding can only be extracted by loading the file
+    uint32_t first = 0;
+    if (userInput->cache.directory != NULL) {
+        keys = cache_keys(&bmpImage);
+    }
+
+    if ((keys != NULL) && !(userInput->print) && !(userInput->histogram)
+            && (userInput->onAnomaly != ANOMALY_EXTRACT)) {
+        if (userInput->output
+                && (fetch_cached_output(&(userInput->cache),
+                            keys[stageCount + 1], userInput->outputFilePath)
+                        == EXIT_SUCCESS)) {
+            timings->loadMs = elapsed_ms(&start);
+            goto cleanup;
         }
+        first = resume_from_cache(&bmpImage, keys);
+    }
 
-        status = cmd->run(&bmpImage);
-        if (status != EXIT_SUCCESS) {
+    if (first == 0) {
+        // Only the cropped region of the file needs to be read
+        const Params* crop = leading_crop();
+        if ((crop != NULL)
+                && (stored_region(
+                            &bmpImage, &(crop->region), &(bmpImage.region))
+                        == -1)) {
+            status = EXIT_OUT_OF_BOUNDS;
             goto cleanup;
         }
+
+        // Attempt to load pixel data from file into bmpImage struct
+        status = handle_bmp_loading(&bmpImage);
+    }
+    timings->loadMs = elapsed_ms(&start);
+    if (status != EXIT_SUCCESS) {
+        goto cleanup;
+    }
+
+    if ((userInput->onAnomaly == ANOMALY_EXTRACT)
+            && (write_extracted_padding((userInput->extractFilePath)
+                               ? userInput->extractFilePath
+                               : STREAM_PATH)
+                    == -1)) {
+        status = EXIT_OUTPUT_FILE_ERROR;
+        goto cleanup;
+    }
+
+    cacheKeys = keys;
+    status = run_commands(&bmpImage, first);
+    cacheKeys = NULL;
+    timings->processMs = elapsed_ms(&start);
+    if (status != EXIT_SUCCESS) {
+        goto cleanup;
     }
 
     if (userInput->output) {
-        status = Output.run(&bmpImage);
+        status = Output.run(&bmpImage, NULL);
+        timings->writeMs = elapsed_ms(&start);
         if (status != EXIT_SUCCESS) {
             goto cleanup;
         }
+
+        if (keys != NULL) {
+            store_cached_output(&(userInput->cache), keys[stageCount + 1],
+                    userInput->outputFilePath);
+        }
     }
 
     if (userInput->print) {
-        status = Print.run(&bmpImage);
+        status = Print.run(&bmpImage, NULL);
         // goto cleanup
     }
 
 cleanup:
     // Cleanup and exit
+#ifdef ENABLE_SDL
+    free_preview();
+#endif
+    free(keys);
     free_image_resources(&bmpImage);
+
+    set_huge_pages(false);
+    set_anomaly_policy(ANOMALY_IGNORE);
+    if (ownsPool) {
+        bind_image_pool(NULL);
+        drain_image_pool(&runPool);
+    }
     return status;
 }
 
@@ -1,24 +1,74 @@
 #ifndef COMMANDS_H
 #define COMMANDS_H
 
-#define fileTypeMessage "Input must be a \'%s\' file.\n"
 #define invalidCmdMessage                                                      \
     "signals: \'%s\' is not a valid command. See \'signals help\'\n"
 
 #define userHelpPrompt "See \'signals help\'.\n"
 #define nonUniquePathsMessage                                                  \
     "signals: input and combine file paths must be unique!\n"
-#define fileType ".bmp"
 #define invalidVal "signals: invalid value \'%s\'\n"
+#define repeatedCmdMessage "signals: \'%s\' may only be specified once.\n"
 
 // Error messages
 #define unexpectedArgMessage "Got \'%s\', expected \'%s\'\n"
 #define gotStrMessage "    Got \'%s\'.\n"
+#define pipelineArgMessage "signals: \'%s\' %s an argument.\n"
+#define pipelineLineMessage "    In \'%s\', line %u.\n"
 #define invalidFilterColourMessage                                             \
     "signals: filter colour/s \'%s\' are invalid, must be RGB characters.\n"
+#define regionBoundsMessage                                                    \
+    "signals: region %zu,%zu,%zu,%zu is not within the image (%zux%zu).\n"
+#define encodeFormatMessage                                                    \
+    "signals: messages can only be encoded into BMP output.\n"
+#define streamOutputMessage                                                    \
+    "signals: output to stdout cannot be combined with '%s'.\n"
+#define regionDimensionsMessage                                                \
+    "signals: \'%s\' changes the dimensions of the region.\n"
+#define daemonStreamMessage                                                    \
+    "signals: \'%s\' cannot use stdin or stdout in a daemon job.\n"
 
+// Wall clock time spent in each stage of handle_commands()
+typedef struct {
+    double loadMs;
+    double processMs;
+    double writeMs;
+} Timings;
+
+/* parse_user_commands()
+ * ---------------------
+ * Parses and verifies the command line arguments, storing the commands to run
+ * for the calling thread. Any previously parsed commands are discarded.
+ *
+ * Note
+ * ----
+ * Uses getopt_long(), which is not thread safe. Callers running jobs on
+ * multiple threads must serialise calls (see server.c).
+ *
+ * Returns: EXIT_SUCCESS, or the exit code of the first invalid argument.
+ */
 int parse_user_commands(const int argc, char** argv);
-int handle_commands(void);
+
+/* verify_daemon_job()
+ * -------------------
+ * Checks that the commands parsed by the calling thread neither read stdin nor
+ * write to stdout, as these are shared by every job the daemon runs. Results
+ * must be written to named files instead.
+ *
+ * Returns: EXIT_SUCCESS, or EXIT_INVALID_ARG if any command uses either.
+ */
+int verify_daemon_job(void);
+
+/* handle_commands()
+ * -----------------
+ * Loads the input image, runs the commands parsed by the calling thread, and
+ * writes the output.
+ *
+ * timings: Optional struct to store the time spent in each stage, or NULL.
+ *
+ * Returns: EXIT_SUCCESS, or the exit code of the first command that failed.
+ */
+int handle_commands(Timings* timings);
 int command_list(const char* command);
 
 #endif
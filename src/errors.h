@@ -12,8 +12,12 @@
 #define EXIT_MELT_FAILURE 32
 #define EXIT_BLUR_FAILURE 33
 #define EXIT_ROTATION_FAILURE 35
+#define EXIT_LAYOUT_FAILURE 36
+#define EXIT_REGION_FAILURE 37
+#define EXIT_LUT_FAILURE 38
 #define EXIT_FILE_CANNOT_BE_READ 9
 #define EXIT_OUTPUT_FILE_ERROR 11
+#define EXIT_SOCKET_ERROR 12
 #define EXIT_NO_COMMAND 6
 #define EXIT_MISSING_INPUT_FILE 88
 #define EXIT_INVALID_FILE_TYPE 89
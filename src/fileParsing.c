@@ -1,10 +1,24 @@
+// fileno(), posix_fadvise(), preadv(), mmap() and memfd_create() are not
+// declared in strict C23 mode
+#define _GNU_SOURCE
+
 // Included Libraries
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
 #include "pixels.h"
 #include "fileParsing.h"
+#include "imagePool.h"
+#include "imageEditing.h"
+#include "bandIO.h"
+#include "interchange.h"
+#include "tiles.h"
 #include "utils.h"
 #include "errors.h"
 
@@ -23,6 +37,16 @@ constexpr char fileTooSmallMessage[]
         = "File size is too small, %ld less bytes than expected.\n";
 constexpr char fileCorruptionMessage[]
         = "File may be corrupted, or contain hidden data (%ld bytes).\n";
+constexpr char capacityMessage[]
+        = "Payload of %zu bytes, including its header, exceeds the capacity "
+          "of %zu bytes.\n";
+constexpr char indexedSecretMessage[]
+        = "Payloads cannot be embedded in the pixels of indexed images.\n";
+constexpr char unpackedSecretMessage[]
+        = "Payloads can only be extracted from uncompressed pixel data of 8 "
+          "or more bits.\n";
+constexpr char paddingMessage[] = "Non zero padding detected, file may be "
+                                  "corrupted, or contain hidden data.\n";
 constexpr char pixelOffsetInvalidMessage[]
         = "Pixel data offset invalid (%u).\n";
 constexpr char resettingIntValueMessage[] = "Resetting value to \'%d\'.\n";
@@ -40,6 +64,15 @@ constexpr char newlineChar = '\n';
 static const char* const bmpIdentifier[]
         = {"BM", "BA", "CI", "CP", "IC", "PT", NULL};
 
+// How anomalies are handled by the calling thread (see set_anomaly_policy())
+static thread_local AnomalyPolicy anomalyPolicy = ANOMALY_IGNORE;
+static thread_local bool paddingReported = false;
+
+// Non-zero padding bytes collected under ANOMALY_EXTRACT
+static thread_local uint8_t* extracted = NULL;
+static thread_local size_t extractedLength = 0;
+static thread_local size_t extractedCapacity = 0;
+
 // Assorted constant chars
 const char* const readMode = "rb";
 const char* const writeMode = "wb";
@@ -47,14 +80,81 @@ const char* const writeMode = "wb";
 // File constants
 constexpr int BMP_HEADER_SIZE = 14;
 constexpr int DIB_HEADER_SIZE = 40;
+constexpr int V2_HEADER_SIZE = 52; // Adds colour masks
+constexpr int V3_HEADER_SIZE = 56; // Adds an alpha mask
+constexpr int V4_HEADER_SIZE = 108; // Adds a colour space
+
+// Headers of 32-bit files are written as V4, which declares alpha
+constexpr uint32_t lcsSRGB = 0x73524742; // "sRGB"
+constexpr size_t v4ColourSpaceBytes = 48; // Endpoints and gamma
+
+// Reads and writes are batched into vectors (POSIX allows at least 16)
+constexpr int ioVectors = 512;
 
 // BMP compression modes, BI_RGB (none) is the default compression method
 constexpr int BI_RGB = 0;
+constexpr int BI_BITFIELDS = 3;
+constexpr int BI_ALPHABITFIELDS = 6;
+
+// Channel masks of 32-bit BGRA pixels
+constexpr uint32_t blueMaskBGRA = 0x000000FF;
+constexpr uint32_t greenMaskBGRA = 0x0000FF00;
+constexpr uint32_t redMaskBGRA = 0x00FF0000;
+constexpr uint32_t alphaMaskBGRA = 0xFF000000;
 constexpr int comprMax = 13; // (BMP standard allows values range from 0 <-> 13)
 
+// Resolution of images from formats which do not give one (72 DPI)
+constexpr int32_t pixelsPerMetre = 2835;
+
 constexpr size_t maxLenANSI = 32;
 constexpr size_t terminalBufferLen = 8192;
 
+/* advance_vectors()
+ * -----------------
+ * Skips the vectors transferred in full by a partial readv() or writev(), then
+ * adjusts the first vector which was only partially transferred.
+ */
+static void advance_vectors(struct iovec** vectors, int* count, size_t done)
+{
+    while ((*count > 0) && (done >= (*vectors)->iov_len)) {
+        done -= (*vectors)->iov_len;
+        (*vectors)++;
+        (*count)--;
+    }
+
+    if (*count > 0) {
+        (*vectors)->iov_base = (uint8_t*)((*vectors)->iov_base) + done;
+        (*vectors)->iov_len -= done;
+    }
+}
+
+/* file_row_size()
+ * ---------------
+ * Returns: The size of a row of pixel data in the file, including padding.
+ * Unlike the pixel size, this is well defined for 1 and 4-bit pixels.
+ */
+static inline size_t file_row_size(const BmpInfoHeader* info)
+{
+    const size_t bitsPerRow
+            = (size_t)info->bitsPerPixel * (size_t)abs(info->bitmapWidth);
+    return ((bitsPerRow + 31) >> 5) * sizeof(uint32_t);
+}
+
+/* palette_colours()
+ * -----------------
+ * Returns: The number of colours in the palette of an indexed image, or 0 if
+ * the pixels are not indexed. A count of 0 in the header is the maximum.
+ */
+static inline uint32_t palette_colours(const BmpInfoHeader* info)
+{
+    if (info->bitsPerPixel > 8) {
+        return 0;
+    }
+
+    return (info->coloursInPalette) ? info->coloursInPalette
+                                    : (1u << info->bitsPerPixel);
+}
+
 void initialise_bmp(BMP* bmpImage)
 {
     BmpHeader header;
@@ -70,15 +170,159 @@ void initialise_bmp(BMP* bmpImage)
     bmpImage->infoHeader = infoHeader;
 }
 
+/* spool_stream()
+ * --------------
+ * Copies the rest of a stream which cannot seek, such as a pipe, into an
+ * anonymous in-memory file in a single forward pass, so that it can be loaded
+ * with the same positioned and mapped reads as any other file. Streams which
+ * can already seek, such as redirected files, are used directly.
+ *
+ * Returns: A new stream reading from the start of the data, or NULL on error.
+ */
+static FILE* spool_stream(const int fd)
+{
+    if (lseek(fd, 0, SEEK_CUR) != -1) {
+        const int copy = dup(fd);
+        return (copy < 0) ? NULL : fdopen(copy, readMode);
+    }
+
+#ifdef MFD_CLOEXEC
+    const int spool = memfd_create("signals-input", MFD_CLOEXEC);
+    FILE* file = (spool < 0) ? NULL : fdopen(spool, "w+b");
+#else
+    FILE* file = tmpfile();
+#endif
+
+    uint8_t* buffer = malloc(BAND_BYTES);
+    if ((file == NULL) || (buffer == NULL)) {
+        free(buffer);
+        safely_close_file(file);
+        return NULL;
+    }
+
+    while (1) {
+        const ssize_t nRead = read(fd, buffer, BAND_BYTES);
+
+        if ((nRead < 0) && (errno == EINTR)) {
+            continue;
+        }
+
+        if ((nRead <= 0)
+                || (fwrite(buffer, 1, (size_t)nRead, file) != (size_t)nRead)) {
+            if (nRead < 0) {
+                perror("signals: could not read input stream");
+                safely_close_file(file);
+                file = NULL;
+            }
+            break;
+        }
+    }
+
+    free(buffer);
+    if ((file != NULL)
+            && ((fflush(file) != 0) || (fseek(file, 0L, SEEK_SET) != 0))) {
+        safely_close_file(file);
+        return NULL;
+    }
+    return file;
+}
+
+int open_output(const char* const filePath)
+{
+    if (is_stream_path(filePath)) {
+        return dup(STDOUT_FILENO);
+    }
+
+    return open(filePath, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+}
+
+int map_span(FileSpan* span, FILE* file, const size_t offset, size_t length,
+        const bool sequential)
+{
+    *span = (FileSpan){0};
+
+    if (fseek(file, 0L, SEEK_END) != 0) {
+        return -1;
+    }
+
+    // Mapping past the end of the file would fault on access
+    const long end = ftell(file);
+    if ((end < 0) || ((size_t)end <= offset)) {
+        return -1;
+    }
+
+    if (length == SPAN_TO_END) {
+        length = (size_t)end - offset;
+    }
+    if ((length == 0) || (length > (size_t)end - offset)) {
+        return -1;
+    }
+
+    // Mappings must begin on a page boundary
+    const size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    const size_t skip = offset % pageSize;
+    uint8_t* mapping = mmap(NULL, length + skip, PROT_READ, MAP_PRIVATE,
+            fileno(file), (off_t)(offset - skip));
+
+    if (mapping != MAP_FAILED) {
+        if (sequential) {
+            (void)madvise(mapping, length + skip, MADV_SEQUENTIAL);
+        }
+
+        *span = (FileSpan){.data = mapping + skip,
+                .length = length,
+                .base = mapping,
+                .baseLength = length + skip,
+                .mapped = true};
+        return EXIT_SUCCESS;
+    }
+
+    uint8_t* data = malloc(length);
+    if ((data == NULL) || (fseek(file, (long)offset, SEEK_SET) != 0)
+            || (fread(data, 1, length, file) != length)) {
+        free(data);
+        return -1;
+    }
+
+    *span = (FileSpan){
+            .data = data, .length = length, .base = data, .baseLength = length};
+    return EXIT_SUCCESS;
+}
+
+void release_span(FileSpan* span)
+{
+    if (span->mapped) {
+        munmap(span->base, span->baseLength);
+    } else {
+        free(span->base);
+    }
+    *span = (FileSpan){0};
+}
+
 [[nodiscard]] int open_bmp(BMP* bmpImage, const char* const filePath)
 {
-    bmpImage->file = fopen(filePath, readMode);
+    bmpImage->file = (is_stream_path(filePath)) ? spool_stream(STDIN_FILENO)
+                                                : fopen(filePath, readMode);
 
     if (check_file_opened(bmpImage->file, filePath) == -1) {
         return EXIT_FILE_CANNOT_BE_READ;
     }
 
-    if (read_headers(bmpImage) == -1) {
+    // Raw streams have no magic bytes to detect
+    if (bmpImage->format == FORMAT_BMP) {
+        bmpImage->format = detect_format(bmpImage->file);
+    }
+
+    int result;
+    if (bmpImage->format == FORMAT_BMP) {
+        result = read_headers(bmpImage);
+    } else if (bmpImage->format == FORMAT_SIG) {
+        result = read_tiled_header(bmpImage);
+    } else {
+        result = read_interchange_headers(bmpImage);
+    }
+
+    if (result == -1) {
         fprintf(stderr, "The header from \'%s\' could not be read.\n",
                 filePath);
         return EXIT_FILE_INTEGRITY;
@@ -87,20 +331,89 @@ void initialise_bmp(BMP* bmpImage)
     return EXIT_SUCCESS;
 }
 
-[[nodiscard]] int handle_bmp_loading(BMP* bmpImage)
+void describe_pixels(BMP* bmpImage, const size_t width, const size_t height,
+        const bool alpha, const size_t offset)
+{
+    const uint16_t bitsPerPixel = (alpha) ? 32 : 24;
+    const size_t pixelDataSize = width * height * (bitsPerPixel >> 3);
+
+    memcpy(&((bmpImage->bmpHeader).id), windowsBmpID,
+            sizeof((bmpImage->bmpHeader).id));
+    (bmpImage->bmpHeader).bmpSize = (uint32_t)(offset + pixelDataSize);
+    (bmpImage->bmpHeader).offset = (uint32_t)offset;
+
+    bmpImage->infoHeader = (BmpInfoHeader){
+            .headerSize = DIB_HEADER_SIZE,
+            .bitmapWidth = (int32_t)width,
+            .bitmapHeight = (int32_t)height,
+            .colourPlanes = 1,
+            .bitsPerPixel = bitsPerPixel,
+            .compression = (alpha) ? BI_BITFIELDS : BI_RGB,
+            .horzResolution = pixelsPerMetre,
+            .vertResolution = pixelsPerMetre,
+            .redMask = redMaskBGRA,
+            .greenMask = greenMaskBGRA,
+            .blueMask = blueMaskBGRA,
+            .alphaMask = (alpha) ? alphaMaskBGRA : 0,
+    };
+}
+
+/* advise_pixel_reads()
+ * --------------------
+ * Asks the kernel to begin reading the rows which will be loaded in the
+ * background, so that disk reads overlap with the remaining setup.
+ */
+static void advise_pixel_reads(const BMP* bmpImage, const Region* region)
 {
-    if (header_safety_checks(bmpImage) == -1) {
-        return EXIT_HEADER_SAFETY;
+#ifdef POSIX_FADV_WILLNEED
+    const size_t fileRowSize = file_row_size(&(bmpImage->infoHeader));
+
+    off_t start = (off_t)((bmpImage->bmpHeader).offset);
+    off_t length = 0; // Until the end of the file
+
+    if (region != NULL) {
+        start += (off_t)(region->y * fileRowSize);
+        length = (off_t)(region->height * fileRowSize);
     }
 
-    bmpImage->image = load_bmp(
-            bmpImage->file, &(bmpImage->bmpHeader), &(bmpImage->infoHeader));
+    const int fd = fileno(bmpImage->file);
+    (void)posix_fadvise(fd, start, length, POSIX_FADV_SEQUENTIAL);
+    (void)posix_fadvise(fd, start, length, POSIX_FADV_WILLNEED);
+#else
+    (void)bmpImage;
+    (void)region;
+#endif
+}
+
+[[nodiscard]] int handle_bmp_loading(BMP* bmpImage)
+{
+    const Region* region
+            = ((bmpImage->region).width) ? &(bmpImage->region) : NULL;
+
+    // Headers of other formats are checked as they are read
+    if (bmpImage->format == FORMAT_SIG) {
+        bmpImage->image = load_tiles(bmpImage, region);
+
+    } else if (bmpImage->format != FORMAT_BMP) {
+        bmpImage->image = load_interchange(bmpImage, region);
+
+    } else {
+        if (header_safety_checks(bmpImage) == -1) {
+            return EXIT_HEADER_SAFETY;
+        }
+
+        advise_pixel_reads(bmpImage, region);
+        bmpImage->image = load_bmp(bmpImage->file, &(bmpImage->bmpHeader),
+                &(bmpImage->infoHeader), bmpImage->layout, region);
+    }
 
     if (bmpImage->image == NULL) {
         safely_close_file(bmpImage->file);
+        bmpImage->file = NULL; // Not closed again when freeing resources
         return EXIT_FILE_INTEGRITY;
     }
 
+    bmpImage->regionLoaded = (region != NULL);
     return EXIT_SUCCESS;
 }
 
@@ -144,6 +457,45 @@ void initialise_bmp(BMP* bmpImage)
     return EXIT_SUCCESS;
 }
 
+/* parse_channel_masks()
+ * ---------------------
+ * Reads the channel masks of BI_BITFIELDS images, which are part of V2 and
+ * later headers, and otherwise follow the 40 byte header. The masks of BI_RGB
+ * images are implied, with 32-bit pixels assumed to store alpha.
+ *
+ * Returns: 0 on success, -1 on read error.
+ */
+static int parse_channel_masks(FILE* file, BmpInfoHeader* info)
+{
+    const bool bitfields = (info->compression == BI_BITFIELDS)
+            || (info->compression == BI_ALPHABITFIELDS);
+
+    if (bitfields || (info->headerSize >= V2_HEADER_SIZE)) {
+        READ_HEADER_SAFE(
+                &(info->redMask), sizeof(info->redMask), file, "Red mask");
+        READ_HEADER_SAFE(&(info->greenMask), sizeof(info->greenMask), file,
+                "Green mask");
+        READ_HEADER_SAFE(
+                &(info->blueMask), sizeof(info->blueMask), file, "Blue mask");
+    }
+
+    if ((info->headerSize >= V3_HEADER_SIZE)
+            || (info->compression == BI_ALPHABITFIELDS)) {
+        READ_HEADER_SAFE(&(info->alphaMask), sizeof(info->alphaMask), file,
+                "Alpha mask");
+    }
+
+    // The masks of larger headers are only meaningful for BI_BITFIELDS
+    if (!bitfields) {
+        info->blueMask = blueMaskBGRA;
+        info->greenMask = greenMaskBGRA;
+        info->redMask = redMaskBGRA;
+        info->alphaMask = (info->bitsPerPixel == 32) ? alphaMaskBGRA : 0;
+    }
+
+    return EXIT_SUCCESS;
+}
+
 [[nodiscard]] int parse_bmp_info_header(BMP* bmpImage)
 {
     FILE* file = bmpImage->file;
@@ -191,27 +543,7 @@ void initialise_bmp(BMP* bmpImage)
     READ_HEADER_SAFE(&(info->importantColours), sizeof(info->importantColours),
             file, "Important colours");
 
-    return EXIT_SUCCESS;
-}
-
-[[nodiscard]] int confirm_choice(const char* const message)
-{
-    printf("%s [Y/n]\n", message);
-    printf(">> ");
-    char c;
-
-    while (1) {
-        c = (char)(fgetc(stdin));
-        if (c == EOF || c == 'n') {
-            return -1;
-        }
-
-        if (c == 'Y') {
-            break;
-        }
-    }
-
-    return EXIT_SUCCESS;
+    return parse_channel_masks(file, info);
 }
 
 static inline void u16_to_str_LE(const uint16_t val, char (*str)[3])
@@ -267,12 +599,54 @@ static inline void u16_to_str_LE(const uint16_t val, char (*str)[3])
         return -1;
     }
 
-    if (info->compression != BI_RGB) { // Could be updated in future
+    if (info->headerSize < DIB_HEADER_SIZE) {
+        fprintf(stderr, "DIB header size not supported (%u bytes).\n",
+                info->headerSize);
+        return -1;
+    }
+
+    if ((info->bitsPerPixel != 1) && (info->bitsPerPixel != 4)
+            && (info->bitsPerPixel != 8) && (info->bitsPerPixel != 24)
+            && (info->bitsPerPixel != 32)) {
+        fprintf(stderr, "Colour depth not supported (%u bits per pixel).\n",
+                info->bitsPerPixel);
+        return -1;
+    }
+
+    const uint32_t colours = palette_colours(info);
+
+    if ((info->bitsPerPixel <= 8) && (colours > (1u << info->bitsPerPixel))) {
+        fprintf(stderr, "Palette of %u colours too large for %u-bit pixels.\n",
+                colours, info->bitsPerPixel);
+        return -1;
+    }
+
+    const bool bitfields = (info->compression == BI_BITFIELDS)
+            || (info->compression == BI_ALPHABITFIELDS);
+    const bool rle = ((info->compression == BI_RLE8)
+                             && (info->bitsPerPixel == 8))
+            || ((info->compression == BI_RLE4) && (info->bitsPerPixel == 4));
+
+    // Bit fields are only supported for 32-bit pixels
+    if ((info->compression != BI_RGB) && !rle
+            && !(bitfields && (info->bitsPerPixel == 32))) {
         fprintf(stderr, "Compression method not supported (code: \'%u\').\n",
                 info->compression);
         return -1;
     }
 
+    if (!(info->redMask) || !(info->greenMask) || !(info->blueMask)) {
+        fputs("Colour channel masks must be non-zero.\n", stderr);
+        return -1;
+    }
+
+    // Compressed bitmaps are always stored bottom-up
+    if (rle && (info->bitmapHeight < 0)) {
+        fprintf(stderr, invalidDimensionMessage, info->bitmapWidth,
+                info->bitmapHeight);
+        return -1;
+    }
+
     // Seek to EOF and store offset
     fseek(bmpImage->file, 0L, SEEK_END);
     const long eofPos = ftell(bmpImage->file);
@@ -294,18 +668,16 @@ static inline void u16_to_str_LE(const uint16_t val, char (*str)[3])
         }
 
         fprintf(stderr, fileCorruptionMessage, -diff);
-        if (confirm_choice("Continue Anyway?") == -1) {
+        if (anomalyPolicy == ANOMALY_FAIL) {
             return -1;
         }
     }
 
+    // The size of compressed pixel data is not known until it is decoded
     const uint32_t offset = bmpHeader->offset;
-    const size_t padding = calc_row_byte_offset(
-            info->bitsPerPixel, (size_t)info->bitmapWidth);
-    const size_t bytesPerPixel = (info->bitsPerPixel >> 3);
-    const size_t minRequiredBytes
-            = (((size_t)abs(info->bitmapWidth) * bytesPerPixel + padding)
-                    * (size_t)abs(info->bitmapHeight));
+    const size_t minRequiredBytes = (rle)
+            ? 0
+            : file_row_size(info) * (size_t)abs(info->bitmapHeight);
 
     if ((info->imageSize < minRequiredBytes) && (info->imageSize != 0)) {
         fprintf(stderr, "Image size error, minimum is: %zu.\n",
@@ -313,13 +685,39 @@ static inline void u16_to_str_LE(const uint16_t val, char (*str)[3])
         return -1;
     }
 
+    // Masks follow a 40 byte header, rather than being part of it
+    size_t headerBytes = BMP_HEADER_SIZE + info->headerSize;
+    if (bitfields && (info->headerSize == DIB_HEADER_SIZE)) {
+        headerBytes += (info->compression == BI_ALPHABITFIELDS)
+                ? (4 * sizeof(uint32_t))
+                : (3 * sizeof(uint32_t));
+    }
+
+    // Followed by the palette of indexed images
+    headerBytes += colours * sizeof(PixelX);
+
     // Cast to size_t safe give earlier check to see if < 0
     if ((offset + minRequiredBytes > (size_t)eofPos)
-            || (offset < (BMP_HEADER_SIZE + DIB_HEADER_SIZE))) {
+            || (offset < headerBytes)) {
         fprintf(stderr, pixelOffsetInvalidMessage, offset);
         return -1;
     }
 
+    // Each 2 byte code decodes at most RLE_MAX_RUN pixels, so the compressed
+    // data bounds the dimensions it can describe. Without this a small file
+    // could claim an image needing gigabytes of memory.
+    if (rle) {
+        const size_t codes = ((size_t)eofPos - offset) / 2;
+        const size_t pixels = (size_t)info->bitmapWidth
+                * (size_t)info->bitmapHeight;
+
+        if (pixels > codes * RLE_MAX_RUN) {
+            fprintf(stderr, invalidDimensionMessage, info->bitmapWidth,
+                    info->bitmapHeight);
+            return -1;
+        }
+    }
+
     check_image_resolution(&(bmpImage->infoHeader));
 
     return EXIT_SUCCESS;
@@ -382,99 +780,695 @@ void print_bmp_info_header(const BmpInfoHeader* bmp)
             bmp->coloursInPalette);
     printf(suXFormat, "Important Colours", bmp->importantColours,
             bmp->importantColours);
+
+    if ((bmp->compression == BI_BITFIELDS)
+            || (bmp->compression == BI_ALPHABITFIELDS)) {
+        printf(suXFormat, "Red Mask", bmp->redMask, bmp->redMask);
+        printf(suXFormat, "Green Mask", bmp->greenMask, bmp->greenMask);
+        printf(suXFormat, "Blue Mask", bmp->blueMask, bmp->blueMask);
+        printf(suXFormat, "Alpha Mask", bmp->alphaMask, bmp->alphaMask);
+    }
     fputs(lineSeparator, stdout);
 }
 
-int globalDecode = 0;
+void set_anomaly_policy(const AnomalyPolicy policy)
+{
+    anomalyPolicy = policy;
+    paddingReported = false;
 
-[[nodiscard]] int read_pixel_row(FILE* file, Image* image,
-        const size_t rowNumber, const size_t byteOffset)
+    free(extracted);
+    extracted = NULL;
+    extractedLength = 0;
+    extractedCapacity = 0;
+}
+
+int write_extracted_padding(const char* filePath)
+{
+    const int fd = open_output(filePath);
+    int result = (fd < 0) ? -1 : EXIT_SUCCESS;
+
+    if (result == EXIT_SUCCESS) {
+        BandTransfer transfer;
+        start_band_write(&transfer, fd, extracted, extractedLength);
+        result = (finish_band_transfer(&transfer) == extractedLength)
+                ? EXIT_SUCCESS
+                : -1;
+    }
+
+    if ((fd >= 0) && (close(fd) != 0)) {
+        result = -1;
+    }
+
+    if (result == -1) {
+        fprintf(stderr, "Error writing padding to \"%s\".\n", filePath);
+    }
+
+    set_anomaly_policy(anomalyPolicy);
+    return result;
+}
+
+/* padding_is_zero()
+ * -----------------
+ * Scans padding gathered from many rows at once, as almost every file has
+ * none set.
+ */
+static bool padding_is_zero(const uint8_t* padding, const size_t length)
 {
-    const size_t numPixels = image->width;
+    uint8_t set = 0;
+
+#pragma omp simd reduction(| : set)
+    for (size_t i = 0; i < length; i++) {
+        set |= padding[i];
+    }
+
+    return !set;
+}
+
+/* extract_padding()
+ * -----------------
+ * Appends the non-zero bytes of the padding to those extracted so far.
+ *
+ * Returns: 0 on success, -1 if out of memory.
+ */
+static int extract_padding(const uint8_t* padding, const size_t length)
+{
+    if (extractedLength + length > extractedCapacity) {
+        const size_t capacity = (extractedCapacity)
+                ? (2 * (extractedLength + length))
+                : ((length < BUFSIZ) ? BUFSIZ : length);
+
+        uint8_t* resized = realloc(extracted, capacity);
+        if (resized == NULL) {
+            perror("realloc failed while extracting padding");
+            return -1;
+        }
+
+        extracted = resized;
+        extractedCapacity = capacity;
+    }
+
+    for (size_t i = 0; i < length; i++) {
+        extracted[extractedLength] = padding[i];
+        extractedLength += (padding[i] != 0);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/* check_padding()
+ * ---------------
+ * Applies the anomaly policy to the padding of one or more rows, reporting the
+ * first padding found to be non-zero.
+ *
+ * Returns: 0 if the file may still be read, otherwise -1.
+ */
+static int check_padding(const uint8_t* padding, const size_t length)
+{
+    if (padding_is_zero(padding, length)) {
+        return EXIT_SUCCESS;
+    }
+
+    if (!paddingReported) {
+        fputs(paddingMessage, stderr);
+        paddingReported = true;
+    }
+
+    if (anomalyPolicy == ANOMALY_FAIL) {
+        return -1;
+    }
 
+    return (anomalyPolicy == ANOMALY_EXTRACT)
+            ? extract_padding(padding, length)
+            : EXIT_SUCCESS;
+}
+
+[[nodiscard]] int read_pixel_row(FILE* file, Pixel* row, const size_t numPixels,
+        const size_t rowNumber, const size_t byteOffset)
+{
     // Read row of pixels
-    if (fread(&((image->pixelData)[rowNumber * image->width]), sizeof(Pixel),
-                numPixels, file)
-            != numPixels) {
+    if (fread(row, sizeof(Pixel), numPixels, file) != numPixels) {
 
         // Print message upon read error
         fprintf(stderr, errorReadingPixelsMessage, rowNumber);
         return -1;
     }
 
-    if (byteOffset) { // If offset non-zero update file pointer
-        char c = 0;
+    if (byteOffset) { // If offset non-zero check the padding
+        uint8_t padding[sizeof(uint32_t)];
+        return check_padding(padding, fread(padding, 1, byteOffset, file));
+    }
 
-        for (size_t i = 0; i < byteOffset; i++) {
-            c = (char)fgetc(file);
+    return EXIT_SUCCESS;
+}
 
-            if ((c != 0) && (globalDecode == 0)) {
+/* load_padded_rows()
+ * ------------------
+ * Loads padded BGR or 8-bit index rows directly into the image with vectored
+ * reads, scattering each row and its padding without an intermediate copy.
+ * There is nothing to decode, so there is no work to overlap the reads with.
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+static int load_padded_rows(FILE* file, Image* image, const size_t offset,
+        const size_t byteOffset)
+{
+    constexpr size_t batchRows = ioVectors / 2;
+    const size_t rowSize = image->width * pixel_size(image->layout);
+    const int fd = fileno(file);
+
+    // Bytes past the padding of each row are never read, so stay zero, and the
+    // padding of the whole batch is checked at once
+    uint8_t padding[batchRows][sizeof(uint32_t)];
+    struct iovec batch[ioVectors];
+    memset(padding, 0, sizeof(padding));
+    off_t position = (off_t)offset;
+
+    for (size_t first = 0; first < image->height; first += batchRows) {
+        const size_t nRows = ((image->height - first) < batchRows)
+                ? (image->height - first)
+                : batchRows;
+
+        for (size_t i = 0; i < nRows; i++) {
+            batch[2 * i] = (struct iovec){
+                    .iov_base = image_row(image, first + i),
+                    .iov_len = rowSize};
+            batch[(2 * i) + 1] = (struct iovec){
+                    .iov_base = padding[i], .iov_len = byteOffset};
+        }
 
-                fprintf(stderr,
-                        "Non zero padding detected, file may be corrupted, or "
-                        "contain hidden data.\n");
-                if (confirm_choice("Would you like to view the data as text?")
-                        == -1) {
-                    globalDecode = -1;
+        struct iovec* vectors = batch;
+        int count = (int)(2 * nRows);
 
-                    fprintf(stderr, "Ignoring padding...\n");
-                    fseek(file, (long)(byteOffset - 1), SEEK_CUR);
-                    return EXIT_SUCCESS;
-                }
+        while (count > 0) {
+            const ssize_t nRead = preadv(fd, vectors, count, position);
 
-                globalDecode = 1;
+            if ((nRead < 0) && (errno == EINTR)) {
+                continue;
+            }
 
-                printf("Reading data...\n");
-                printf(lineSeparator);
-                printf("\n");
+            if (nRead <= 0) {
+                fprintf(stderr, errorReadingPixelsMessage, first);
+                return -1;
             }
 
-            if (c == 0) {
-                continue;
+            position += nRead;
+            advance_vectors(&vectors, &count, (size_t)nRead);
+        }
+
+        if (check_padding(padding[0], nRows * sizeof(padding[0])) == -1) {
+            return -1;
+        }
+    }
+
+    // Leave the stream at the end of the pixel data, as a read would
+    return fseek(file, (long)position, SEEK_SET);
+}
+
+/* decode_band()
+ * -------------
+ * Expands a band of rows read from the file into a BGRX image, while scanning
+ * the padding of each row. Rows are only checked individually once padding
+ * has been found to be set.
+ *
+ * Returns: 0 on success, -1 if the padding is rejected.
+ */
+static int decode_band(Image* image, const uint8_t* band, const size_t first,
+        const size_t nRows, const size_t byteOffset)
+{
+    const size_t rowSize = image->width * sizeof(Pixel);
+    const size_t fileRowSize = rowSize + byteOffset;
+    uint8_t set = 0;
+
+#pragma omp parallel for schedule(static) reduction(| : set)
+    for (size_t i = 0; i < nRows; i++) {
+        const uint8_t* row = band + (i * fileRowSize);
+        expand_pixel_row(
+                image_row(image, first + i), (const Pixel*)row, image->width);
+
+        for (size_t j = 0; j < byteOffset; j++) {
+            set |= row[rowSize + j];
+        }
+    }
+
+    for (size_t i = 0; (i < nRows) && set; i++) {
+        if (check_padding(band + (i * fileRowSize) + rowSize, byteOffset)
+                == -1) {
+            return -1;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/* load_bands()
+ * ------------
+ * Loads the pixel array into a BGRX image in bands, double buffered so that the
+ * next band is read by a helper thread while the current band is expanded.
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+static int load_bands(FILE* file, Image* image, const size_t byteOffset)
+{
+    const size_t fileRowSize = (image->width * sizeof(Pixel)) + byteOffset;
+    const size_t bandRows = (fileRowSize < BAND_BYTES)
+            ? (BAND_BYTES / fileRowSize)
+            : 1;
+    const size_t nBandRows
+            = (bandRows < image->height) ? bandRows : image->height;
+
+    uint8_t* bands[2] = {malloc(nBandRows * fileRowSize), NULL};
+    if ((nBandRows < image->height) && (bands[0] != NULL)) {
+        bands[1] = malloc(nBandRows * fileRowSize);
+    }
+
+    if ((bands[0] == NULL) || ((nBandRows < image->height) && !bands[1])) {
+        free(bands[0]);
+        free(bands[1]);
+        return -1;
+    }
+
+    BandTransfer transfer;
+    start_band_read(&transfer, file, bands[0], nBandRows * fileRowSize);
+
+    int result = EXIT_SUCCESS;
+    size_t band = 0;
+
+    for (size_t first = 0; first < image->height; first += nBandRows) {
+        const size_t nRows = ((image->height - first) < nBandRows)
+                ? (image->height - first)
+                : nBandRows;
+        const size_t next = first + nRows;
+
+        if (finish_band_transfer(&transfer) != nRows * fileRowSize) {
+            fprintf(stderr, errorReadingPixelsMessage, first);
+            result = -1;
+            break;
+        }
+
+        // Read the next band while this one is decoded
+        if (next < image->height) {
+            const size_t nextRows = ((image->height - next) < nBandRows)
+                    ? (image->height - next)
+                    : nBandRows;
+            start_band_read(&transfer, file, bands[band ^ 1],
+                    nextRows * fileRowSize);
+        }
+
+        if (decode_band(image, bands[band], first, nRows, byteOffset) == -1) {
+            // The band being read must complete before it is freed
+            if (next < image->height) {
+                (void)finish_band_transfer(&transfer);
             }
+            result = -1;
+            break;
+        }
+        band ^= 1;
+    }
+
+    free(bands[0]);
+    free(bands[1]);
+    return result;
+}
+
+/* load_region()
+ * -------------
+ * Loads a rectangle of the pixel array, skipping the rows above and below it.
+ * Narrow regions seek directly to each row, so that the rest of the file is
+ * never read, while wider regions read whole rows sequentially, as seeking
+ * discards the buffered contents of the stream.
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+static int load_region(FILE* file, Image* image, const size_t offset,
+        const size_t fileRowSize, const size_t pixelBytes,
+        const Region* region)
+{
+    const size_t regionRowSize = image->width * pixelBytes;
+    const bool seekRows = (regionRowSize * 2) < fileRowSize;
+    const bool expand = (pixelBytes != pixel_size(image->layout));
+
+    uint8_t* row = NULL;
+    if (!seekRows || expand) {
+        row = malloc(fileRowSize);
+
+        if (row == NULL) {
+            return -1;
+        }
+    }
+
+    if (!seekRows
+            && (fseek(file, (long)(offset + (region->y * fileRowSize)),
+                        SEEK_SET)
+                    != 0)) {
+        free(row);
+        return -1;
+    }
 
-            if (globalDecode == 1) {
-                printf("%c", c);
+    for (size_t y = 0; y < image->height; y++) {
+        void* dest = (row != NULL) ? row : image_row(image, y);
+        const uint8_t* pixels = (const uint8_t*)dest;
+        size_t nRead = 0;
+
+        if (seekRows) {
+            const size_t position = offset
+                    + ((region->y + y) * fileRowSize)
+                    + (region->x * pixelBytes);
+
+            if (fseek(file, (long)position, SEEK_SET) == 0) {
+                nRead = fread(dest, 1, regionRowSize, file);
             }
+        } else {
+            // Padding of the final row is not needed
+            nRead = fread(dest, 1, fileRowSize, file);
+            nRead = (nRead >= (region->x * pixelBytes) + regionRowSize)
+                    ? regionRowSize
+                    : 0;
+            pixels += region->x * pixelBytes;
+        }
+
+        if (nRead != regionRowSize) {
+            fprintf(stderr, errorReadingPixelsMessage, region->y + y);
+            free(row);
+            return -1;
+        }
+
+        if (expand) {
+            expand_pixel_row(
+                    image_row(image, y), (const Pixel*)pixels, image->width);
+        } else if (row != NULL) {
+            memcpy(image_row(image, y), pixels, regionRowSize);
+        }
+    }
+
+    free(row);
+    return EXIT_SUCCESS;
+}
+
+/* load_palette()
+ * --------------
+ * Reads the palette following the DIB header into the indexed image. The
+ * fourth byte of each entry is reserved, so every colour is opaque, and any
+ * entries beyond the palette of the file are black.
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+static int load_palette(
+        FILE* file, Image* image, const BmpInfoHeader* restrict info)
+{
+    const uint32_t colours = palette_colours(info);
+
+    if ((fseek(file, (long)(BMP_HEADER_SIZE + info->headerSize), SEEK_SET)
+                != 0)
+            || (fread(image->palette, sizeof(PixelX), colours, file)
+                    != colours)) {
+        fputs("Error reading palette.\n", stderr);
+        return -1;
+    }
+
+    for (size_t i = 0; i < PALETTE_ENTRIES; i++) {
+        (image->palette)[i].alpha = UINT8_MAX;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/* load_packed_indices()
+ * ---------------------
+ * Loads 1 or 4-bit pixel data, unpacking the indices of each row (most
+ * significant bits first) to a byte per pixel. Only the rows and columns of
+ * the region are kept, if one is given.
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+static int load_packed_indices(FILE* file, Image* image, const size_t offset,
+        const BmpInfoHeader* restrict info, const Region* region)
+{
+    const size_t fileRowSize = file_row_size(info);
+    const size_t bits = info->bitsPerPixel;
+    const size_t left = (region != NULL) ? region->x : 0;
+    const size_t top = (region != NULL) ? region->y : 0;
+    const uint8_t mask = (uint8_t)((1u << bits) - 1);
+
+    uint8_t* row = malloc(fileRowSize);
+    if (row == NULL) {
+        return -1;
+    }
+
+    if (fseek(file, (long)(offset + (top * fileRowSize)), SEEK_SET) != 0) {
+        free(row);
+        return -1;
+    }
+
+    for (size_t y = 0; y < image->height; y++) {
+        if (fread(row, 1, fileRowSize, file) != fileRowSize) {
+            fprintf(stderr, errorReadingPixelsMessage, top + y);
+            free(row);
+            return -1;
+        }
+
+        uint8_t* indices = image_row(image, y);
+
+        for (size_t x = 0; x < image->width; x++) {
+            const size_t bit = (left + x) * bits;
+            const size_t shift = 8 - bits - (bit & 7);
+            indices[x] = (uint8_t)((row[bit >> 3] >> shift) & mask);
         }
-        // fseek(file, (long)byteOffset, SEEK_CUR);
     }
 
+    free(row);
     return EXIT_SUCCESS;
 }
 
+/* load_rle()
+ * ----------
+ * Decodes RLE8 or RLE4 compressed pixel data, streaming it from a mapping of
+ * the file rather than copying it, unless the file cannot be mapped. Only the
+ * rows and columns of the region are kept, if one is given.
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+static int load_rle(FILE* file, Image* image, const size_t offset,
+        const BmpInfoHeader* restrict info, const Region* region)
+{
+    const size_t left = (region != NULL) ? region->x : 0;
+    const size_t top = (region != NULL) ? region->y : 0;
+
+    FileSpan span;
+    if (map_span(&span, file, offset, SPAN_TO_END, true) == -1) {
+        return -1;
+    }
+
+    // The image size, if given, is the length of the compressed data
+    const size_t length = (info->imageSize && (info->imageSize < span.length))
+            ? info->imageSize
+            : span.length;
+
+    const int result = decode_rle(
+            span.data, length, info->compression, image, left, top);
+    release_span(&span);
+    return result;
+}
+
+/* ChannelField
+ * ------------
+ * Position and maximum value of a colour channel within a 32-bit pixel, as
+ * given by its mask.
+ */
+typedef struct {
+    uint32_t mask;
+    uint32_t shift;
+    uint32_t max;
+} ChannelField;
+
+static ChannelField channel_field(const uint32_t mask)
+{
+    ChannelField field = {.mask = mask};
+
+    while (mask && !((mask >> field.shift) & 1u)) {
+        field.shift++;
+    }
+
+    field.max = mask >> field.shift;
+    return field;
+}
+
+/* channel_value()
+ * ---------------
+ * Returns: The channel of the pixel, scaled to [0, 255]. Channels without a
+ * mask are fully set, so that missing alpha is opaque.
+ */
+static inline uint8_t channel_value(
+        const uint32_t lane, const ChannelField field)
+{
+    if (field.max == 0) {
+        return UINT8_MAX;
+    }
+
+    const uint64_t value = (lane & field.mask) >> field.shift;
+    return (uint8_t)(((value * UINT8_MAX) + (field.max / 2)) / field.max);
+}
+
+/* decode_channel_masks()
+ * ----------------------
+ * Rearranges 32-bit pixels loaded from the file into BGRA, as described by the
+ * channel masks of the header. Pixels without an alpha channel are made
+ * opaque, as are BI_RGB images whose fourth byte is zero throughout, since most
+ * applications leave it unused. Images loaded from 24-bit files are unchanged.
+ */
+static void decode_channel_masks(Image* image, const BmpInfoHeader* info)
+{
+    if (info->bitsPerPixel != 32) {
+        return;
+    }
+
+    const size_t width = image->width;
+
+    const bool standard = (info->blueMask == blueMaskBGRA)
+            && (info->greenMask == greenMaskBGRA)
+            && (info->redMask == redMaskBGRA)
+            && ((info->alphaMask == alphaMaskBGRA) || !(info->alphaMask));
+
+    if (!standard) {
+        const ChannelField blue = channel_field(info->blueMask);
+        const ChannelField green = channel_field(info->greenMask);
+        const ChannelField red = channel_field(info->redMask);
+        const ChannelField alpha = channel_field(info->alphaMask);
+
+#pragma omp parallel for schedule(static)
+        for (size_t y = 0; y < image->height; y++) {
+            uint32_t* lanes = image_row(image, y);
+
+            for (size_t x = 0; x < width; x++) {
+                const uint32_t lane = lanes[x];
+                lanes[x] = (uint32_t)channel_value(lane, blue)
+                        | ((uint32_t)channel_value(lane, green) << 8)
+                        | ((uint32_t)channel_value(lane, red) << 16)
+                        | ((uint32_t)channel_value(lane, alpha) << 24);
+            }
+        }
+        return;
+    }
+
+    uint32_t alpha = 0;
+    if (info->alphaMask && (info->compression == BI_RGB)) {
+#pragma omp parallel for reduction(| : alpha)
+        for (size_t y = 0; y < image->height; y++) {
+            const uint32_t* lanes = image_row(image, y);
+
+#pragma omp simd reduction(| : alpha)
+            for (size_t x = 0; x < width; x++) {
+                alpha |= lanes[x];
+            }
+        }
+        alpha &= alphaMaskBGRA;
+    }
+
+    if (!(info->alphaMask) || ((info->compression == BI_RGB) && !alpha)) {
+#pragma omp parallel for
+        for (size_t y = 0; y < image->height; y++) {
+            uint32_t* lanes = image_row(image, y);
+
+#pragma omp simd
+            for (size_t x = 0; x < width; x++) {
+                lanes[x] |= alphaMaskBGRA;
+            }
+        }
+    }
+}
+
 Image* load_bmp(FILE* file, const BmpHeader* restrict header,
-        const BmpInfoHeader* restrict bmp)
+        const BmpInfoHeader* restrict bmp, const PixelLayout layout,
+        const Region* region)
 {
+    // 32-bit files are always loaded as BGRX, retaining their alpha, while
+    // palettised files keep their indices
+    const bool indexed = (bmp->bitsPerPixel <= 8);
+    PixelLayout imageLayout = layout;
+
+    if (indexed) {
+        imageLayout = LAYOUT_INDEX8;
+    } else if (bmp->bitsPerPixel == 32) {
+        imageLayout = LAYOUT_BGRX;
+    }
+
+    const size_t pixelBytes = bmp->bitsPerPixel >> 3;
+
     // Initialise pixel array
-    Image* image = create_image(bmp->bitmapWidth, bmp->bitmapHeight);
+    Image* image = (region == NULL)
+            ? create_image_with_layout(
+                      bmp->bitmapWidth, bmp->bitmapHeight, imageLayout)
+            : create_image_with_layout((int32_t)region->width,
+                      (int32_t)region->height, imageLayout);
 
     if (image == NULL) {
         fputs(bmpLoadFailMessage, stderr);
         return NULL;
     }
 
+    if (indexed && (load_palette(file, image, bmp) == -1)) {
+        free_image(&image);
+        fputs(bmpLoadFailMessage, stderr);
+        return NULL;
+    }
+
+    if ((bmp->compression == BI_RLE8) || (bmp->compression == BI_RLE4)) {
+        if (load_rle(file, image, header->offset, bmp, region) == -1) {
+            free_image(&image);
+            fputs(bmpLoadFailMessage, stderr);
+            return NULL;
+        }
+        return image;
+    }
+
+    // Pixels smaller than a byte are unpacked, including for regions
+    if (bmp->bitsPerPixel < 8) {
+        if (load_packed_indices(file, image, header->offset, bmp, region)
+                == -1) {
+            free_image(&image);
+            fputs(bmpLoadFailMessage, stderr);
+            return NULL;
+        }
+        return image;
+    }
+
     // Calculate offset required due to row padding (32-bit DWORD length)
     const size_t byteOffset
             = calc_row_byte_offset(bmp->bitsPerPixel, bmp->bitmapWidth);
 
+    if (region != NULL) {
+        const size_t fileRowSize = file_row_size(bmp);
+
+        if (load_region(file, image, header->offset, fileRowSize, pixelBytes,
+                    region)
+                == -1) {
+            free_image(&image);
+            fputs(bmpLoadFailMessage, stderr);
+            return NULL;
+        }
+        decode_channel_masks(image, bmp);
+        return image;
+    }
+
     // Seek to start of pixel data
     fseek(file, header->offset, SEEK_SET);
 
-    if (byteOffset) {
-        // For each row of pixels
-        for (size_t height = 0; height < (size_t)abs(bmp->bitmapHeight);
-                height++) {
-            if (read_pixel_row(file, image, height, byteOffset) == -1) {
-                free_image(&image);
-                fputs(bmpLoadFailMessage, stderr);
-                return NULL;
-            }
+    if (pixelBytes != pixel_size(imageLayout)) {
+        if (load_bands(file, image, byteOffset) == -1) {
+            free_image(&image);
+            fputs(bmpLoadFailMessage, stderr);
+            return NULL;
+        }
+
+    } else if (byteOffset || !is_contiguous(image)) {
+        if (load_padded_rows(file, image, header->offset, byteOffset) == -1) {
+            free_image(&image);
+            fputs(bmpLoadFailMessage, stderr);
+            return NULL;
         }
 
     } else {
         size_t nmemb = image->height * image->width;
-        size_t result = fread(image->pixelData, sizeof(Pixel), nmemb, file);
+        size_t result = fread(image->pixelData, pixelBytes, nmemb, file);
         if (result != nmemb) {
             free_image(&image);
             fputs(bmpLoadFailMessage, stderr);
@@ -490,6 +1484,7 @@ Image* load_bmp(FILE* file, const BmpHeader* restrict header,
         // return NULL; // Could add error return value
     }
 
+    decode_channel_masks(image, bmp);
     return image;
 }
 
@@ -508,7 +1503,7 @@ void print_image_to_terminal(const Image* image)
 
     // For each pixel (RGB)
     for (size_t y = 0; y < image->height; y++) {
-        size_t rowOffset = image->width * y;
+        size_t rowOffset = image->stride * y;
 
         for (size_t x = 0; x < image->width; x++) {
 
@@ -571,6 +1566,12 @@ size_t calc_row_byte_offset(
 }
 
 Image* create_image(const int32_t width, const int32_t height)
+{
+    return create_image_with_layout(width, height, LAYOUT_BGR);
+}
+
+Image* create_image_with_layout(
+        const int32_t width, const int32_t height, const PixelLayout layout)
 {
     Image* img = malloc(sizeof(Image));
 
@@ -582,11 +1583,26 @@ Image* create_image(const int32_t width, const int32_t height)
     // FIX issue with INT32_MIN
     img->width = (size_t)abs(width);
     img->height = (size_t)abs(height);
+    img->stride = row_stride(img->width, layout);
+    img->layout = layout;
+    img->isView = false;
+    img->palette = NULL;
 
-    // Allocate memory for all pixel data
-    img->pixelData = malloc(img->height * img->width * sizeof(Pixel));
+    if (layout == LAYOUT_INDEX8) {
+        img->palette = calloc(PALETTE_ENTRIES, sizeof(PixelX));
+
+        if (img->palette == NULL) {
+            free(img);
+            return NULL;
+        }
+    }
+
+    // Allocate memory for all pixel data, reusing a pooled buffer if possible
+    img->pixelData = acquire_pixels(
+            img->height * img->stride * pixel_size(layout));
 
     if (img->pixelData == NULL) { // If malloc fails
+        free(img->palette);
         free(img);
         return NULL;
     }
@@ -594,46 +1610,35 @@ Image* create_image(const int32_t width, const int32_t height)
     return img;
 }
 
-[[nodiscard]] bool write_padding_message(FILE* dest, FILE* src, size_t gapSize)
+void copy_palette(Image* restrict dest, const Image* restrict src)
 {
-    if (src == NULL) {
-        write_padding_zeros(dest, gapSize);
-        return true;
-    }
-
-    char* buffer = malloc(sizeof(char) * gapSize);
-    size_t bytesRead = fread(buffer, sizeof(char), gapSize, src);
-
-    if (bytesRead <= 0) {
-        free(buffer);
-        write_padding_zeros(dest, gapSize);
-        return true;
+    if ((src->layout == LAYOUT_INDEX8) && (dest->layout == LAYOUT_INDEX8)) {
+        memcpy(dest->palette, src->palette, PALETTE_ENTRIES * sizeof(PixelX));
     }
+}
 
-    if (bytesRead < gapSize) {
-        fwrite(buffer, sizeof(char), bytesRead, dest);
-        write_padding_zeros(dest, gapSize - bytesRead);
-        free(buffer);
-        return true;
+Image* create_view(Image* parent, const size_t x, const size_t y,
+        const size_t width, const size_t height)
+{
+    if ((x > parent->width) || (width > parent->width - x)
+            || (y > parent->height) || (height > parent->height - y)) {
+        return NULL;
     }
 
-    fwrite(buffer, sizeof(char), gapSize, dest);
-    free(buffer);
+    Image* view = malloc(sizeof(Image));
 
-    return false;
-}
+    if (view == NULL) {
+        return NULL;
+    }
 
-void write_padding_zeros(FILE* file, size_t gapSize)
-{
-    static const uint8_t zeros[32] = {0};
+    *view = *parent;
+    view->width = width;
+    view->height = height;
+    view->pixelData = (Pixel*)((uint8_t*)image_row(parent, y)
+            + (x * pixel_size(parent->layout)));
+    view->isView = true;
 
-    while (gapSize > 32) {
-        fwrite(zeros, 1, 32, file);
-        gapSize -= 32;
-    }
-    if (gapSize > 0) {
-        fwrite(zeros, 1, gapSize, file);
-    }
+    return view;
 }
 
 static inline void update_bmp_size(
@@ -665,114 +1670,462 @@ static inline void update_image_size_tag(BmpInfoHeader* info)
     info->imageSize = pixelDataSize;
 }
 
+/* put_u16_le()
+ * ------------
+ * Stores a value in little endian byte order.
+ *
+ * Returns: Pointer to the byte following the value.
+ */
+static inline uint8_t* put_u16_le(uint8_t* dest, const uint16_t val)
+{
+    dest[0] = (uint8_t)(val & 0xFF);
+    dest[1] = (uint8_t)(val >> 8);
+    return dest + sizeof(val);
+}
+
+static inline uint8_t* put_u32_le(uint8_t* dest, const uint32_t val)
+{
+    dest = put_u16_le(dest, (uint16_t)(val & 0xFFFF));
+    return put_u16_le(dest, (uint16_t)(val >> 16));
+}
+
+/* normalise_headers()
+ * -------------------
+ * Describes the pixel data as it is written, which is either 24-bit with a 40
+ * byte header, 32-bit BGRA with a V4 header giving the channel masks, or 8-bit
+ * indices followed by a full palette if the image is still indexed. Indexed
+ * input which has been expanded is written as 24-bit. Indexed images read from
+ * compressed files are compressed as RLE8 if allowed. The colour space of the
+ * input is not carried over.
+ */
+static void normalise_headers(BmpHeader* bmpHeader, BmpInfoHeader* info,
+        const Image* image, const bool compress)
+{
+    if (image->layout == LAYOUT_INDEX8) {
+        info->bitsPerPixel = 8;
+    } else if (info->bitsPerPixel != 32) {
+        info->bitsPerPixel = 24;
+    }
+
+    const bool alpha = (info->bitsPerPixel == 32);
+    const bool indexed = (info->bitsPerPixel == 8);
+    const bool rle = indexed && compress
+            && ((info->compression == BI_RLE8)
+                    || (info->compression == BI_RLE4));
+
+    info->headerSize = alpha ? V4_HEADER_SIZE : DIB_HEADER_SIZE;
+    info->compression = alpha ? BI_BITFIELDS : BI_RGB;
+    if (rle) {
+        info->compression = BI_RLE8;
+    }
+    info->coloursInPalette = indexed ? PALETTE_ENTRIES : 0;
+    info->importantColours = 0;
+    info->blueMask = blueMaskBGRA;
+    info->greenMask = greenMaskBGRA;
+    info->redMask = redMaskBGRA;
+    info->alphaMask = alpha ? alphaMaskBGRA : 0;
+
+    bmpHeader->offset = BMP_HEADER_SIZE + info->headerSize
+            + (info->coloursInPalette * (uint32_t)sizeof(PixelX));
+}
+
+/* serialise_headers()
+ * -------------------
+ * Packs the BMP and DIB headers, followed by the palette of indexed images,
+ * into their on-disk representation, so they can be written in a single call.
+ * V4 headers describe sRGB pixel data.
+ *
+ * Returns: The number of bytes written to dest.
+ */
+static size_t serialise_headers(uint8_t* dest, const BmpHeader* bmpHeader,
+        const BmpInfoHeader* info, const Image* image)
+{
+    uint8_t* const start = dest;
+
+    dest = put_u16_le(dest, bmpHeader->id);
+    dest = put_u32_le(dest, bmpHeader->bmpSize);
+    dest = put_u16_le(dest, bmpHeader->reserved1);
+    dest = put_u16_le(dest, bmpHeader->reserved2);
+    dest = put_u32_le(dest, bmpHeader->offset);
+
+    dest = put_u32_le(dest, info->headerSize);
+    dest = put_u32_le(dest, (uint32_t)info->bitmapWidth);
+    dest = put_u32_le(dest, (uint32_t)info->bitmapHeight);
+    dest = put_u16_le(dest, info->colourPlanes);
+    dest = put_u16_le(dest, info->bitsPerPixel);
+    dest = put_u32_le(dest, info->compression);
+    dest = put_u32_le(dest, info->imageSize);
+    dest = put_u32_le(dest, (uint32_t)info->horzResolution);
+    dest = put_u32_le(dest, (uint32_t)info->vertResolution);
+    dest = put_u32_le(dest, info->coloursInPalette);
+    dest = put_u32_le(dest, info->importantColours);
+
+    if (info->headerSize == V4_HEADER_SIZE) {
+        dest = put_u32_le(dest, info->redMask);
+        dest = put_u32_le(dest, info->greenMask);
+        dest = put_u32_le(dest, info->blueMask);
+        dest = put_u32_le(dest, info->alphaMask);
+        dest = put_u32_le(dest, lcsSRGB);
+        memset(dest, 0, v4ColourSpaceBytes); // Unused for sRGB
+        dest += v4ColourSpaceBytes;
+    }
+
+    // The fourth byte of each palette entry is reserved
+    for (size_t i = 0; i < info->coloursInPalette; i++) {
+        const PixelX colour = (image->palette)[i];
+        *dest++ = colour.blue;
+        *dest++ = colour.green;
+        *dest++ = colour.red;
+        *dest++ = 0;
+    }
+
+    return (size_t)(dest - start);
+}
+
+/* embed_secret()
+ * --------------
+ * Checks that the framed payload fits in the image as it is written, reporting
+ * the capacity if not, then embeds it in the low bits of each colour channel,
+ * or lays it out as the padding of each row.
+ *
+ * padding: Set to the padding of every row, or NULL if the payload is embedded
+ *          in the pixels.
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+static int embed_secret(const BmpInfoHeader* info, Image* image,
+        const Secret* secret, uint8_t** padding)
+{
+    const size_t byteOffset
+            = calc_row_byte_offset(info->bitsPerPixel, info->bitmapWidth);
+    const bool lsb = (secret->bits != 0);
+    const size_t capacity = (lsb) ? lsb_capacity(image, secret->bits)
+                                  : (byteOffset * image->height);
+    *padding = NULL;
+
+    if (lsb && (image->layout == LAYOUT_INDEX8)) {
+        fputs(indexedSecretMessage, stderr);
+        return -1;
+    }
+
+    if (secret->length > capacity) {
+        fprintf(stderr, capacityMessage, secret->length, capacity);
+        return -1;
+    }
+
+    if (lsb) {
+        embed_lsb(image, secret);
+        return EXIT_SUCCESS;
+    }
+
+    *padding = calloc(capacity, 1);
+    if (*padding == NULL) {
+        perror("calloc failed while embedding payload");
+        return -1;
+    }
+
+    memcpy(*padding, secret->data, secret->length);
+    return EXIT_SUCCESS;
+}
+
+int extract_bmp_secret(BMP* bmpImage, Secret* secret)
+{
+    const BmpInfoHeader* info = &(bmpImage->infoHeader);
+    const size_t offset = bmpImage->bmpHeader.offset;
+
+    if ((bmpImage->format != FORMAT_BMP) || (info->bitsPerPixel < 8)
+            || (info->compression == BI_RLE8)
+            || (info->compression == BI_RLE4)) {
+        fputs(unpackedSecretMessage, stderr);
+        return -1;
+    }
+
+    const StoredPixels pixels = {
+            .width = (size_t)abs(info->bitmapWidth),
+            .height = (size_t)abs(info->bitmapHeight),
+            .pixelBytes = (size_t)(info->bitsPerPixel >> 3),
+            .rowSize = file_row_size(info),
+    };
+    const size_t length = pixels.rowSize * pixels.height;
+
+    FileSpan span;
+    if (map_span(&span, bmpImage->file, offset, length, true) == -1) {
+        fputs(bmpLoadFailMessage, stderr);
+        return -1;
+    }
+
+    StoredPixels stored = pixels;
+    stored.data = span.data;
+
+    const int result = extract_secret(secret, &stored);
+    release_span(&span);
+    return result;
+}
+
 int write_bmp_with_header_provided(
-        BMP* bmpImage, const char* filename, const char* messagePath)
+        BMP* bmpImage, const char* filename, const Secret* secret)
 {
     BmpHeader* bmpHeader = &(bmpImage->bmpHeader);
     BmpInfoHeader* info = &(bmpImage->infoHeader);
     Image* image = bmpImage->image;
 
-    FILE* output = fopen(filename, writeMode);
-    if (check_file_opened(output, filename) == -1) {
+    // Payloads are hidden in row padding or the low bits of each channel,
+    // both of which compression would lose
+    normalise_headers(bmpHeader, info, image, (secret == NULL));
+    update_bmp_size(bmpHeader, info);
+    update_image_size_tag(info);
+
+    uint8_t* padding = NULL;
+    if ((secret != NULL)
+            && (embed_secret(info, image, secret, &padding) == -1)) {
         return -1;
     }
 
-    update_bmp_size(bmpHeader, info);
-    update_image_size_tag(info);
+    // The size of compressed data is only known once encoded
+    EncodedRows encoded = {0};
+    if (info->compression == BI_RLE8) {
+        if (encode_rle8_image(&encoded, image) == -1) {
+            perror("malloc failed while compressing");
+            return -1;
+        }
+
+        info->imageSize = (uint32_t)encoded.size;
+        bmpHeader->bmpSize = bmpHeader->offset + info->imageSize;
+    }
+
+    uint8_t headers[BMP_HEADER_SIZE + V4_HEADER_SIZE
+            + (PALETTE_ENTRIES * sizeof(PixelX))];
+    const size_t headerSize
+            = serialise_headers(headers, bmpHeader, info, image);
+
+    const int output = open_output(filename);
+    if (output < 0) {
+        fprintf(stderr, "Error opening file \"%s\" for writing.\n",
+                filename);
+        free_encoded_rows(&encoded);
+        free(padding);
+        return -1;
+    }
 
-    // Write BmpHeader
-    fwrite(&bmpHeader->id, sizeof(bmpHeader->id), 1, output);
-    fwrite(&bmpHeader->bmpSize, sizeof(bmpHeader->bmpSize), 1, output);
-    fwrite(&bmpHeader->reserved1, sizeof(bmpHeader->reserved1), 1, output);
-    fwrite(&bmpHeader->reserved2, sizeof(bmpHeader->reserved2), 1, output);
-    fwrite(&bmpHeader->offset, sizeof(bmpHeader->offset), 1, output);
-
-    // Write BmpInfoHeader
-    fwrite(&info->headerSize, sizeof(info->headerSize), 1, output);
-    fwrite(&info->bitmapWidth, sizeof(info->bitmapWidth), 1, output);
-    fwrite(&info->bitmapHeight, sizeof(info->bitmapHeight), 1, output);
-    fwrite(&info->colourPlanes, sizeof(info->colourPlanes), 1, output);
-    fwrite(&info->bitsPerPixel, sizeof(info->bitsPerPixel), 1, output);
-    fwrite(&info->compression, sizeof(info->compression), 1, output);
-    fwrite(&info->imageSize, sizeof(info->imageSize), 1, output);
-    fwrite(&info->horzResolution, sizeof(info->horzResolution), 1, output);
-    fwrite(&info->vertResolution, sizeof(info->vertResolution), 1, output);
-    fwrite(&info->coloursInPalette, sizeof(info->coloursInPalette), 1, output);
-    fwrite(&info->importantColours, sizeof(info->importantColours), 1, output);
-
-    if (messagePath == NULL) {
-        write_pixel_data(output, bmpHeader, info, image);
+    const int result = write_pixel_data(output, headers, headerSize, info,
+            image, (encoded.data != NULL) ? &encoded : NULL, padding);
+    free_encoded_rows(&encoded);
+    free(padding);
+
+    if ((close(output) != 0) || (result == -1)) {
+        perror("signals: could not write output");
+        return -1;
+    }
+    return EXIT_SUCCESS;
+}
+
+/* convert_row()
+ * -------------
+ * Converts a row of the image to pixels of the given size, as written to the
+ * file, packing BGRX rows or expanding BGR rows with opaque alpha.
+ */
+static inline void convert_row(void* dest, const Image* image,
+        const size_t row, const size_t pixelBytes)
+{
+    if (pixelBytes == sizeof(Pixel)) {
+        pack_pixel_row(dest, image_row(image, row), image->width);
     } else {
-        if (write_pixel_data_secret(output, bmpHeader, info, image, messagePath)
-                == -1) {
-            safely_close_file(output);
+        expand_pixel_row(dest, image_row(image, row), image->width);
+    }
+}
+
+/* output_row()
+ * ------------
+ * Returns: The given row of the image as pixels of the given size, converting
+ * it into the scratch row if the layout of the image differs.
+ */
+static inline const void* output_row(const Image* image, const size_t row,
+        const size_t pixelBytes, void* scratch)
+{
+    if (pixelBytes != pixel_size(image->layout)) {
+        convert_row(scratch, image, row, pixelBytes);
+        return scratch;
+    }
+
+    return image_row(image, row);
+}
+
+/* WriteBatch
+ * ----------
+ * Buffers pending writes to a file descriptor as an array of vectors, so that
+ * many rows are written with a single system call.
+ */
+typedef struct {
+    int fd;
+    int count;
+    struct iovec vectors[ioVectors];
+} WriteBatch;
+
+/* flush_writes()
+ * --------------
+ * Writes every pending vector, resuming after partial writes.
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+static int flush_writes(WriteBatch* batch)
+{
+    struct iovec* vectors = batch->vectors;
+    int count = batch->count;
+    batch->count = 0;
+
+    while (count > 0) {
+        ssize_t written = writev(batch->fd, vectors, count);
+
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
             return -1;
         }
+
+        advance_vectors(&vectors, &count, (size_t)written);
     }
-    safely_close_file(output);
+
     return EXIT_SUCCESS;
 }
 
-[[nodiscard]] int write_pixel_data_secret(FILE* output, BmpHeader* bmpHeader,
-        BmpInfoHeader* info, Image* image, const char* messagePath)
+/* queue_write()
+ * -------------
+ * Adds a write to the batch, flushing the batch first if it is full. The data
+ * must remain valid until the batch is flushed.
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+static int queue_write(WriteBatch* batch, const void* data, const size_t len)
 {
-    FILE* message = fopen(messagePath, readMode);
-    if (check_file_opened(message, messagePath) == -1) {
+    if (len == 0) {
+        return EXIT_SUCCESS;
+    }
+
+    if ((batch->count == ioVectors) && (flush_writes(batch) == -1)) {
         return -1;
     }
 
-    const long currentPosition = ftell(output);
-    const size_t byteOffset
-            = calc_row_byte_offset(info->bitsPerPixel, info->bitmapWidth);
-    const size_t writeSize = image->width * sizeof(Pixel);
+    batch->vectors[batch->count++]
+            = (struct iovec){.iov_base = (void*)data, .iov_len = len};
+    return EXIT_SUCCESS;
+}
 
-    if (!(currentPosition < 0) && (currentPosition < bmpHeader->offset)) {
-        size_t gapSize = (size_t)(bmpHeader->offset - currentPosition);
-        write_padding_zeros(output, gapSize);
+/* write_staged_rows()
+ * -------------------
+ * Writes an image whose layout differs from the file by converting bands of
+ * rows, along with their padding, into staging buffers in parallel. Each band
+ * is written by a helper thread while the next is converted.
+ *
+ * padding: Padding of every row, or NULL to pad with zeros.
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+static int write_staged_rows(WriteBatch* batch, const Image* image,
+        const size_t pixelBytes, const size_t byteOffset,
+        const uint8_t* padding)
+{
+    const size_t rowSize = (image->width * pixelBytes) + byteOffset;
+    const size_t bandRows
+            = (rowSize < BAND_BYTES) ? (BAND_BYTES / rowSize) : 1;
+    const size_t stagedRows
+            = (bandRows < image->height) ? bandRows : image->height;
+
+    uint8_t* staging[2] = {malloc(stagedRows * rowSize), NULL};
+    if ((stagedRows < image->height) && (staging[0] != NULL)) {
+        staging[1] = malloc(stagedRows * rowSize);
     }
 
-    if (byteOffset) {
+    // Any headers still queued must precede the pixel data
+    if ((staging[0] == NULL) || ((stagedRows < image->height) && !staging[1])
+            || (flush_writes(batch) == -1)) {
+        free(staging[0]);
+        free(staging[1]);
+        return -1;
+    }
 
-        bool flag = false;
-        for (size_t row = 0; row < image->height; row++) {
-            fwrite(&((image->pixelData)[row * image->width]), writeSize, 1,
-                    output);
-            if (flag) {
-                write_padding_zeros(output, byteOffset);
+    BandTransfer transfer = {0};
+    size_t pending = 0; // Bytes being written by the transfer
+    size_t band = 0;
+    int result = EXIT_SUCCESS;
+
+    for (size_t first = 0; first < image->height; first += stagedRows) {
+        const size_t nRows = ((image->height - first) < stagedRows)
+                ? (image->height - first)
+                : stagedRows;
+        uint8_t* rows = staging[band];
+
+#pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < nRows; i++) {
+            uint8_t* row = rows + (i * rowSize);
+
+            convert_row(row, image, first + i, pixelBytes);
+            if (padding != NULL) {
+                memcpy(row + (rowSize - byteOffset),
+                        padding + ((first + i) * byteOffset), byteOffset);
             } else {
-                flag = write_padding_message(output, message, byteOffset);
+                memset(row + (rowSize - byteOffset), 0, byteOffset);
             }
         }
-    } else {
-        fwrite(image->pixelData, writeSize, image->height, output);
+
+        if (pending && (finish_band_transfer(&transfer) != pending)) {
+            pending = 0;
+            result = -1;
+            break;
+        }
+
+        pending = nRows * rowSize;
+        start_band_write(&transfer, batch->fd, rows, pending);
+        band ^= 1;
     }
 
-    safely_close_file(message);
-    return EXIT_SUCCESS;
+    if (pending && (finish_band_transfer(&transfer) != pending)) {
+        result = -1;
+    }
+
+    free(staging[0]);
+    free(staging[1]);
+    return result;
 }
 
-void write_pixel_data(
-        FILE* output, BmpHeader* bmpHeader, BmpInfoHeader* info, Image* image)
+[[nodiscard]] int write_pixel_data(const int output, const uint8_t* headers,
+        const size_t headerSize, const BmpInfoHeader* info,
+        const Image* image, const EncodedRows* encoded, const uint8_t* padding)
 {
-    const long currentPosition = ftell(output);
+    static const uint8_t zeros[4] = {0};
+
     const size_t byteOffset
             = calc_row_byte_offset(info->bitsPerPixel, info->bitmapWidth);
-    const size_t writeSize = image->width * sizeof(Pixel);
+    const size_t pixelBytes = info->bitsPerPixel >> 3;
+    const size_t writeSize = image->width * pixelBytes;
 
-    if (!(currentPosition < 0) && (currentPosition < bmpHeader->offset)) {
-        size_t gapSize = (size_t)(bmpHeader->offset - currentPosition);
-        write_padding_zeros(output, gapSize);
-    }
+    WriteBatch batch = {.fd = output};
 
-    if (byteOffset) {
-        for (size_t row = 0; row < image->height; row++) {
-            fwrite(&((image->pixelData)[row * image->width]), writeSize, 1,
-                    output);
-            write_padding_zeros(output, byteOffset);
+    int result = queue_write(&batch, headers, headerSize);
+
+    if (encoded != NULL) {
+        for (size_t row = 0; (row < image->height) && (result == 0); row++) {
+            result |= queue_write(&batch,
+                    encoded->data + (row * encoded->stride),
+                    (encoded->lengths)[row]);
         }
+    } else if (pixelBytes != pixel_size(image->layout)) {
+        result |= write_staged_rows(
+                &batch, image, pixelBytes, byteOffset, padding);
+    } else if ((byteOffset == 0) && is_contiguous(image)) {
+        result |= queue_write(
+                &batch, image->pixelData, writeSize * image->height);
     } else {
-        fwrite(image->pixelData, writeSize, image->height, output);
+        for (size_t row = 0; (row < image->height) && (result == 0); row++) {
+            result |= queue_write(&batch, image_row(image, row), writeSize);
+            result |= queue_write(&batch,
+                    (padding != NULL) ? padding + (row * byteOffset) : zeros,
+                    byteOffset);
+        }
     }
+
+    result |= flush_writes(&batch);
+    return result;
 }
 
 [[nodiscard]] int check_file_opened(FILE* file, const char* const filePath)
@@ -795,10 +2148,12 @@ void safely_close_file(FILE* file)
 
 void free_image_resources(BMP* bmpImage)
 {
-    // Safely free allocated memory for storing pixel data
+    // Safely free allocated memory for storing pixel data, freeing any views
+    // before the image they refer to
     if (bmpImage->image != NULL) {
         free_image(&(bmpImage->image));
     }
+    free_image(&(bmpImage->base));
 
     // Safely close the BMP image file stream
     safely_close_file(bmpImage->file);
@@ -810,9 +2165,14 @@ void free_image(Image** image)
         return;
     }
 
-    if ((*image)->pixelData != NULL) {
-        free((*image)->pixelData);
+    // Views do not own their pixel data, or palette
+    if (((*image)->pixelData != NULL) && !((*image)->isView)) {
+        release_pixels((*image)->pixelData,
+                (*image)->stride * (*image)->height
+                        * pixel_size((*image)->layout));
+        free((*image)->palette);
         (*image)->pixelData = NULL;
+        (*image)->palette = NULL;
     }
 
     free(*image);
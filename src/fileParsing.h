@@ -4,7 +4,10 @@
 // Included Libraries
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include "pixels.h"
+#include "rle.h"
+#include "stego.h"
 
 // Exit codes
 #define EXIT_FILE_INTEGRITY 7
@@ -36,7 +39,7 @@ typedef struct { // 14 bytes
 } BmpHeader;
 
 // DIB header (bitmap information header)
-typedef struct { // 40 bytes
+typedef struct { // 40 bytes, followed by the masks of V2 and later headers
     uint32_t headerSize;
     int32_t bitmapWidth;
     int32_t bitmapHeight;
@@ -48,6 +51,12 @@ typedef struct { // 40 bytes
     int32_t vertResolution;
     uint32_t coloursInPalette;
     uint32_t importantColours;
+
+    // Channels of 32-bit pixels, given by BI_BITFIELDS or implied by BI_RGB
+    uint32_t redMask;
+    uint32_t greenMask;
+    uint32_t blueMask;
+    uint32_t alphaMask; // No alpha if zero
 } BmpInfoHeader;
 
 static inline Pixel* get_pixel_fast(
@@ -58,14 +67,42 @@ static inline Pixel* get_pixel_fast(
 
 static inline Pixel* get_pixel(Image* image, const size_t x, const size_t y)
 {
-    return &((image->pixelData)[y * image->width + x]);
+    return &((image->pixelData)[y * image->stride + x]);
 }
 
+// Formats images are read from and written to. Netpbm and tiled files are
+// detected by their magic bytes, while raw streams have no header, so must be
+// given their dimensions.
+typedef enum {
+    FORMAT_BMP,
+    FORMAT_PPM, // Binary portable pixmap (P6)
+    FORMAT_PAM, // Portable arbitrary map (P7) of RGB or RGB_ALPHA tuples
+    FORMAT_RGB, // Headerless 24-bit RGB
+    FORMAT_BGR, // Headerless 24-bit BGR
+    FORMAT_SIG, // Tiles compressed individually, for partial reads (tiles.h)
+} FileFormat;
+
+// How a BMP which is readable, but differs from its headers, is handled. Files
+// may have trailing bytes beyond their stated size, or non-zero row padding,
+// either of which may hide data (see --encode).
+typedef enum {
+    ANOMALY_IGNORE, // Warn once, then read the file regardless
+    ANOMALY_FAIL, // Reject the file
+    ANOMALY_EXTRACT, // As for ignore, collecting the non-zero padding bytes
+} AnomalyPolicy;
+
 typedef struct {
     FILE* file;
     BmpHeader bmpHeader;
     BmpInfoHeader infoHeader;
     Image* image;
+    Image* base; // Image viewed by image after a crop, freed with the BMP
+    PixelLayout layout; // Layout the pixel data is loaded into
+    Region region; // Stored rows and columns to load, or all if empty
+    bool regionLoaded; // Only the region was loaded, pending its crop
+    FileFormat format; // Format of the file, detected unless raw
+    size_t rawWidth; // Dimensions of raw input, which has no header
+    size_t rawHeight;
 } BMP;
 
 /* initialise_bmp()
@@ -88,8 +125,95 @@ void free_image(Image** image);
  */
 void free_image_resources(BMP* bmpImage);
 
+// Path given in place of a file to read from stdin or write to stdout
+#define STREAM_PATH "-"
+
+/* is_stream_path()
+ * ----------------
+ * Returns: true if the path refers to stdin or stdout, rather than a file.
+ */
+static inline bool is_stream_path(const char* const filePath)
+{
+    return !strcmp(filePath, STREAM_PATH);
+}
+
+/* open_output()
+ * -------------
+ * Opens a file for writing, truncating it if it exists, or duplicates stdout
+ * if given STREAM_PATH, so that the descriptor can always be closed.
+ *
+ * Returns: The file descriptor, or -1 on error.
+ */
+int open_output(const char* const filePath);
+
+/* FileSpan
+ * --------
+ * A range of bytes of a file, mapped into memory, or read into a buffer if the
+ * file cannot be mapped.
+ */
+typedef struct {
+    const uint8_t* data; // First byte of the range
+    size_t length;
+    void* base; // Mapping or buffer holding the range, freed by release_span()
+    size_t baseLength;
+    bool mapped;
+} FileSpan;
+
+// Length given to map_span() to include the rest of the file
+#define SPAN_TO_END SIZE_MAX
+
+/* map_span()
+ * ----------
+ * Maps length bytes of the file from offset into memory, or reads them if the
+ * file cannot be mapped. The file position is left unspecified.
+ *
+ * span: Destination for the range, released with release_span().
+ * file: File to read, which must be a regular file.
+ * offset: Position of the first byte.
+ * length: Number of bytes, or SPAN_TO_END for the rest of the file.
+ * sequential: Whether the range is read in order, so that the kernel may read
+ * ahead of accesses.
+ *
+ * Returns: 0 on success, -1 if the range is empty, extends past the end of the
+ * file, or cannot be read.
+ */
+[[nodiscard]] int map_span(FileSpan* span, FILE* file, const size_t offset,
+        size_t length, const bool sequential);
+
+/* release_span()
+ * --------------
+ * Unmaps or frees the range.
+ */
+void release_span(FileSpan* span);
+
+/* open_bmp()
+ * ----------
+ * Opens the file and reads its headers. BMP, netpbm and tiled files are told
+ * apart by their magic bytes, unless the format has been set to a raw format.
+ * Input from STREAM_PATH is read from stdin, which need not be able to seek.
+ *
+ * bmpImage: Initialised BMP, with the format and dimensions of raw input set.
+ * filePath: Path of the file to open.
+ *
+ * Returns: EXIT_SUCCESS, or the exit code of the error.
+ */
 int open_bmp(BMP* bmpImage, const char* const filePath);
 
+/* describe_pixels()
+ * -----------------
+ * Fills the headers of an image read from another format with those of the
+ * equivalent bottom up BMP, which is 32-bit if it has alpha and 24-bit
+ * otherwise, so that commands and BMP output treat it as any other image.
+ *
+ * bmpImage: Image to describe.
+ * width: Width of the image in pixels.
+ * height: Height of the image in pixels.
+ * alpha: Whether the pixels have an alpha channel.
+ * offset: Position of the pixel data in the file.
+ */
+void describe_pixels(BMP* bmpImage, const size_t width, const size_t height,
+        const bool alpha, const size_t offset);
+
 /* read_headers()
  * --------------
  * Reads and parses both the File Header and Info Header of a BMP file.
@@ -145,17 +269,52 @@ void print_bmp_info_header(const BmpInfoHeader* bmp);
 
 /* read_pixel_row()
  * ----------------
- * Reads a single row of pixels from the file into the Image struct.
+ * Reads a single row of packed pixels from the file.
  *
  * file: File stream to the open file.
- * image: The Image struct containing the pixel data.
+ * row: Destination for the row of pixels.
+ * numPixels: The number of pixels in the row.
  * rowNumber: The current row index (height) being read.
  * byteOffset: The number of padding bytes to skip after reading the row.
  *
- * Returns:
+ * Returns: 0 on success, -1 on read error, or if the padding is non-zero and
+ * anomalies are rejected.
  */
-int read_pixel_row(FILE* file, Image* image, const size_t rowNumber,
-        const size_t byteOffset);
+int read_pixel_row(FILE* file, Pixel* row, const size_t numPixels,
+        const size_t rowNumber, const size_t byteOffset);
+
+/* set_anomaly_policy()
+ * --------------------
+ * Sets how anomalies are handled by files read by the calling thread, and
+ * discards any padding bytes previously extracted.
+ *
+ * policy: Policy applied to each anomaly found.
+ */
+void set_anomaly_policy(const AnomalyPolicy policy);
+
+/* write_extracted_padding()
+ * -------------------------
+ * Writes the non-zero padding bytes collected under ANOMALY_EXTRACT, in the
+ * order they are stored in the file, then discards them (see
+ * set_anomaly_policy()).
+ *
+ * filePath: Path of the file to write, or STREAM_PATH for stdout.
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+[[nodiscard]] int write_extracted_padding(const char* filePath);
+
+/* extract_bmp_secret()
+ * --------------------
+ * Extracts a payload hidden by --encode from the pixel data of an opened BMP,
+ * which is read directly from the file, mapped where possible, rather than
+ * loaded into an image.
+ *
+ * secret: Destination for the framed payload, freed with free_secret().
+ *
+ * Returns: 0 on success, -1 if the file has no valid payload, or on error.
+ */
+[[nodiscard]] int extract_bmp_secret(BMP* bmpImage, Secret* secret);
 
 /* load_bmp()
  * -------------
@@ -164,11 +323,16 @@ int read_pixel_row(FILE* file, Image* image, const size_t rowNumber,
  * file: File stream to the open file.
  * header: Struct containing all parsed BMP Header metadata.
  * bmp: Pointer to struct containing all parsed BMP Info Header metadata.
+ * layout: In-memory layout to convert the pixel data to.
+ * region: Rectangle of the stored pixel data to load, with rows counted in the
+ *         order they are stored, or NULL to load the entire image. Rows and
+ *         columns outside of the region are skipped without being read.
  *
  * Returns: Pointer to the image struct containing the images pixel data.
  */
 Image* load_bmp(FILE* file, const BmpHeader* restrict header,
-        const BmpInfoHeader* restrict bmp);
+        const BmpInfoHeader* restrict bmp, const PixelLayout layout,
+        const Region* region);
 
 /* print_image_to_terminal()
  * -------------------------
@@ -203,16 +367,59 @@ size_t calc_row_byte_offset(
  */
 Image* create_image(const int32_t width, const int32_t height);
 
+/* create_image_with_layout()
+ * --------------------------
+ * Allocates memory for an Image struct and its pixel data, stored in the given
+ * layout. Indexed images are also given a palette, which is initially black.
+ *
+ * width: Image width in pixels.
+ * height: Image height in pixels.
+ * layout: In-memory pixel layout.
+ *
+ * Returns: Pointer to the newly allocated Image structure.
+ */
+Image* create_image_with_layout(
+        const int32_t width, const int32_t height, const PixelLayout layout);
+
+/* copy_palette()
+ * --------------
+ * Copies the palette of an indexed image to a new image of the same layout,
+ * such as its transpose. Does nothing for images which are not indexed.
+ *
+ * dest: Image to receive the palette.
+ * src: Image to copy the palette of.
+ */
+void copy_palette(Image* restrict dest, const Image* restrict src);
+
+/* create_view()
+ * -------------
+ * Creates an image referring to a rectangle of the parent image, sharing its
+ * pixel data rather than copying it. Changes made through the view are visible
+ * in the parent, and the view must be freed (with free_image()) before the
+ * parent is.
+ *
+ * parent: Image to create the view into.
+ * x: Column of the left edge of the rectangle.
+ * y: Row of the first row of the rectangle.
+ * width: Width of the rectangle in pixels.
+ * height: Height of the rectangle in pixels.
+ *
+ * Returns: Pointer to the view, or NULL if the rectangle is not within the
+ * parent or memory allocation fails.
+ */
+Image* create_view(Image* parent, const size_t x, const size_t y,
+        const size_t width, const size_t height);
+
 /* write_bmp_with_header_provided()
  * --------------------------------
- * bmp:
- * infoHeader:
- * image:
- * filename:
+ * bmpImage: Image to write, along with the headers describing it.
+ * filename: Path of the file to write.
+ * secret: Framed payload to embed in the image as it is written, or NULL.
  *
+ * Returns: 0 on success, -1 on error, including if the payload does not fit.
  */
 int write_bmp_with_header_provided(
-        BMP* bmpImage, const char* filename, const char* messagePath);
+        BMP* bmpImage, const char* filename, const Secret* secret);
 
 /* check_file_opened()
  * -------------------
@@ -232,10 +439,25 @@ int header_safety_checks(BMP* bmpImage);
 int handle_bmp_loading(BMP* bmpImage);
 void check_image_resolution(BmpInfoHeader* info);
 void safely_close_file(FILE* file);
-void write_pixel_data(
-        FILE* output, BmpHeader* bmpHeader, BmpInfoHeader* info, Image* image);
-[[nodiscard]] bool write_padding_message(FILE* dest, FILE* src, size_t gapSize);
-void write_padding_zeros(FILE* file, size_t gapSize);
-[[nodiscard]] int write_pixel_data_secret(FILE* output, BmpHeader* bmpHeader,
-        BmpInfoHeader* info, Image* image, const char* messagePath);
+
+/* write_pixel_data()
+ * ------------------
+ * Writes the serialised headers followed by the padded pixel data, batching
+ * rows into as few writev() calls as possible.
+ *
+ * output: File descriptor to write to.
+ * headers: The serialised BMP and DIB headers, immediately followed by the
+ * pixel data.
+ * headerSize: Length of the headers in bytes.
+ * info: Header giving the colour depth and row padding.
+ * image: Image to write, converted to the colour depth if required.
+ * encoded: Rows of the image compressed as RLE8, written instead of the image
+ * if not NULL.
+ * padding: Padding of every row, or NULL to pad with zeros.
+ *
+ * Returns: 0 on success, -1 if a write failed.
+ */
+[[nodiscard]] int write_pixel_data(const int output, const uint8_t* headers,
+        const size_t headerSize, const BmpInfoHeader* info,
+        const Image* image, const EncodedRows* encoded, const uint8_t* padding);
 #endif
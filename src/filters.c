@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include "filters.h"
 #include "imageEditing.h"
+#include "histogram.h"
 
 constexpr char fileDimensionMismatchMessage[]
         = "File dimension mismatch: \"%zux%zu\" is not \"%zux%zu\"\n";
@@ -169,8 +170,23 @@ void filter_green_blue(Image* image)
 
 void filter_all(Image* image)
 {
+    // Retain alpha, and the indices of indexed images
+    if (image->layout != LAYOUT_BGR) {
+        FX_TEMPLATE(image, { pixel->blue = pixel->green = pixel->red = 0; });
+        return;
+    }
+
+    const size_t rowSize = pixel_size(image->layout) * image->width;
+
     // Zero everything
-    memset(image->pixelData, 0, sizeof(Pixel) * image->width * image->height);
+    if (is_contiguous(image)) {
+        memset(image->pixelData, 0, rowSize * image->height);
+        return;
+    }
+
+    for (size_t y = 0; y < image->height; y++) {
+        memset(image_row(image, y), 0, rowSize);
+    }
 }
 
 void gray_filter(Image* image)
@@ -200,6 +216,127 @@ void brightness_cut_filter(Image* image, const uint8_t cutoff)
     });
 }
 
+/* composite_lane()
+ * ----------------
+ * Composites the blend of two BGRX pixels over the primary pixel, weighting
+ * the primary colour, secondary colour and blended colour by the coverage of
+ * each pixel alone and of both (source-over with a separable blend mode).
+ * Opaque pixels always result in the blended colour.
+ *
+ * p: Primary pixel lane.
+ * s: Secondary pixel lane.
+ * blended: Colour channels of the blended pixel.
+ *
+ * Returns: The composited pixel lane.
+ */
+static inline uint32_t composite_lane(
+        const uint32_t p, const uint32_t s, const uint32_t blended)
+{
+    const uint32_t pAlpha = p >> 24;
+    const uint32_t sAlpha = s >> 24;
+
+    const uint32_t pWeight = (UINT8_MAX - sAlpha) * pAlpha;
+    const uint32_t sWeight = (UINT8_MAX - pAlpha) * sAlpha;
+    const uint32_t bWeight = pAlpha * sAlpha;
+    const uint32_t total = pWeight + sWeight + bWeight; // Alpha * UINT8_MAX
+
+    if (total == 0) {
+        return 0;
+    }
+
+    uint32_t result = ((total + (UINT8_MAX / 2)) / UINT8_MAX) << 24;
+
+    for (uint32_t shift = 0; shift < 24; shift += 8) {
+        const uint32_t sum = (pWeight * ((p >> shift) & UINT8_MAX))
+                + (sWeight * ((s >> shift) & UINT8_MAX))
+                + (bWeight * ((blended >> shift) & UINT8_MAX));
+
+        result |= ((sum + (total / 2)) / total) << shift;
+    }
+
+    return result;
+}
+
+/* rows_opaque()
+ * -------------
+ * Returns: true if every pixel of both BGRX rows is opaque.
+ */
+static inline bool rows_opaque(
+        const uint32_t* a, const uint32_t* b, const size_t width)
+{
+    uint32_t alpha = ALPHA_LANE_MASK;
+
+#pragma omp simd reduction(& : alpha)
+    for (size_t x = 0; x < width; x++) {
+        alpha &= a[x] & b[x];
+    }
+
+    return (alpha == ALPHA_LANE_MASK);
+}
+
+/* BLEND_LANE
+ * ----------
+ * Macro to blend each colour channel of two 32-bit lanes.
+ */
+#define BLEND_LANE(blend, p, s)                                                \
+    ((uint32_t)blend((uint8_t)(p), (uint8_t)(s))                               \
+            | ((uint32_t)blend((uint8_t)((p) >> 8), (uint8_t)((s) >> 8)) << 8)\
+            | ((uint32_t)blend((uint8_t)((p) >> 16), (uint8_t)((s) >> 16))     \
+                    << 16))
+
+/* BLEND_TEMPLATE
+ * --------------
+ * Macro to combine each pixel of the secondary image into the primary image
+ * using the blend function, with the loop specialised for the layout of the
+ * primary image. Both images must share the same layout. Rows of BGRX images
+ * with any transparency are alpha composited.
+ */
+#define BLEND_TEMPLATE(primary, secondary, blend)                              \
+                                                                               \
+    if (primary->layout == LAYOUT_BGRX) {                                      \
+        for (size_t y = 0; y < height; y++) {                                  \
+            uint32_t* pRowPtr = image_row(primary, y);                         \
+            const uint32_t* sRowPtr = image_row(secondary, y);                 \
+                                                                               \
+            if (!rows_opaque(pRowPtr, sRowPtr, width)) {                       \
+                for (size_t x = 0; x < width; x++) {                           \
+                    const uint32_t p = pRowPtr[x];                             \
+                    const uint32_t s = sRowPtr[x];                             \
+                                                                               \
+                    pRowPtr[x] = composite_lane(p, s, BLEND_LANE(blend, p, s));\
+                }                                                              \
+                continue;                                                      \
+            }                                                                  \
+                                                                               \
+            /* Blend each channel of the 32-bit lanes */                       \
+            _Pragma("omp simd") for (size_t x = 0; x < width; x++)             \
+            {                                                                  \
+                const uint32_t p = pRowPtr[x];                                 \
+                const uint32_t s = sRowPtr[x];                                 \
+                                                                               \
+                pRowPtr[x] = BLEND_LANE(blend, p, s) | ALPHA_LANE_MASK;        \
+            }                                                                  \
+        }                                                                      \
+    } else {                                                                   \
+        for (size_t y = 0; y < height; y++) {                                  \
+            Pixel* pRowPtr = image_row(primary, y);                            \
+            const Pixel* sRowPtr = image_row(secondary, y);                    \
+                                                                               \
+            _Pragma("omp simd") for (size_t x = 0; x < width; x++)             \
+            {                                                                  \
+                /* For reduced cpu cycles */                                   \
+                Pixel* pPixel = pRowPtr + x;                                   \
+                const Pixel* sPixel = sRowPtr + x;                             \
+                                                                               \
+                /* Blend each colour value from each image and update          \
+                 * value in primary image. */                                  \
+                pPixel->blue = blend(pPixel->blue, sPixel->blue);              \
+                pPixel->green = blend(pPixel->green, sPixel->green);           \
+                pPixel->red = blend(pPixel->red, sPixel->red);                 \
+            }                                                                  \
+        }                                                                      \
+    }
+
 int combine_images(Image* restrict primary, const Image* restrict secondary)
 {
     const size_t height = primary->height;
@@ -215,27 +352,7 @@ int combine_images(Image* restrict primary, const Image* restrict secondary)
         return EXIT_OUT_OF_BOUNDS;
     }
 
-    // For each row
-    for (size_t y = 0; y < height; y++) {
-        const size_t rowOffset = y * width;
-
-        Pixel* pRowPtr = get_pixel_fast(primary, 0, rowOffset);
-        Pixel* sRowPtr = get_pixel_fast(secondary, 0, rowOffset);
-
-        // For each pixel in row
-        _Pragma("omp simd") for (size_t x = 0; x < width; x++)
-        {
-            // For reduced cpu cycles
-            Pixel* pPixel = pRowPtr + x;
-            Pixel* sPixel = sRowPtr + x;
-
-            // Average the each colour value from each image and update
-            // value in primary image.
-            pPixel->blue = ave_u8_2x(pPixel->blue, sPixel->blue);
-            pPixel->green = ave_u8_2x(pPixel->green, sPixel->green);
-            pPixel->red = ave_u8_2x(pPixel->red, sPixel->red);
-        }
-    }
+    BLEND_TEMPLATE(primary, secondary, ave_u8_2x);
 
     return EXIT_SUCCESS;
 }
@@ -255,32 +372,44 @@ int merge_images(Image* restrict primary, const Image* restrict secondary)
         return EXIT_OUT_OF_BOUNDS;
     }
 
-    // For each row
-    for (size_t y = 0; y < height; y++) {
-        const size_t rowOffset = y * width;
-
-        Pixel* pRowPtr = get_pixel_fast(primary, 0, rowOffset);
-        Pixel* sRowPtr = get_pixel_fast(secondary, 0, rowOffset);
-
-        // For each pixel in row
-        _Pragma("omp simd") for (size_t x = 0; x < width; x++)
-        {
-
-            // For reduced cpu cycles
-            Pixel* pPixel = pRowPtr + x;
-            Pixel* sPixel = sRowPtr + x;
-
-            // Average the each colour value from each image and update
-            // value in primary image.
-            pPixel->blue = clamp_ceil_u8(pPixel->blue, sPixel->blue);
-            pPixel->green = clamp_ceil_u8(pPixel->green, sPixel->green);
-            pPixel->red = clamp_ceil_u8(pPixel->red, sPixel->red);
-        }
-    }
+    BLEND_TEMPLATE(primary, secondary, clamp_ceil_u8);
 
     return EXIT_SUCCESS;
 }
 
+/* GLITCH_ROW_TEMPLATE
+ * -------------------
+ * Macro defining glitch_row() for a given pixel type, which shifts the red
+ * channel of a row left and the blue channel right by the offset. Pixel values
+ * are taken from a copy of the row, so that they are based on the original
+ * image appearance. Components shifted in from outside the row are unchanged.
+ *
+ * (The original glitch effect shifted red right, taking red from x - offset.)
+ */
+#define GLITCH_ROW_TEMPLATE(name, PixelType)                                   \
+    static inline void name(PixelType* row, PixelType* rowCopy,                \
+            const size_t width, const size_t glitchOffset)                     \
+    {                                                                          \
+        memcpy(rowCopy, row, width * sizeof(PixelType));                       \
+                                                                               \
+        for (size_t x = 0; x < width; x++) {                                   \
+            PixelType* pixel = row + x;                                        \
+                                                                               \
+            const size_t accessRedRegion = x + glitchOffset;                   \
+            (accessRedRegion < width)                                          \
+                    ? (pixel->red = rowCopy[accessRedRegion].red)              \
+                    : 0;                                                       \
+                                                                               \
+            const size_t accessBlueRegion = x - glitchOffset;                  \
+            (accessBlueRegion < width)                                         \
+                    ? (pixel->blue = rowCopy[accessBlueRegion].blue)           \
+                    : 0;                                                       \
+        }                                                                      \
+    }
+
+GLITCH_ROW_TEMPLATE(glitch_row, Pixel)
+GLITCH_ROW_TEMPLATE(glitch_row_x, PixelX)
+
 int glitch_effect(Image* image, const size_t glitchOffset)
 {
     // Check if offset is out of image bounds
@@ -288,9 +417,7 @@ int glitch_effect(Image* image, const size_t glitchOffset)
         return -1;
     }
 
-    const size_t rowSize = image->width * sizeof(Pixel);
-
-    Pixel* rowCopy = malloc(rowSize);
+    void* rowCopy = malloc(image->width * pixel_size(image->layout));
     if (rowCopy == NULL) {
         perror("Malloc failed");
         return -1;
@@ -298,36 +425,12 @@ int glitch_effect(Image* image, const size_t glitchOffset)
 
     // For each row
     for (size_t y = 0; y < image->height; y++) {
-        size_t rowOffset = image->width * y;
-        Pixel* row = &((image->pixelData)[rowOffset]);
-
-        // Copy data from the row to allow glitch pixel values to be
-        // calculated based on original image appearance.
-        memcpy(rowCopy, row, rowSize);
-
-        // For each pixel in row
-        for (size_t x = 0; x < image->width; x++) {
-            Pixel* pixel = get_pixel_fast(image, x, rowOffset);
-
-            // Update pixel value if data access region is within image
-            // bounds, else set component to zero.
-
-            /* Original GLITCH EFFECT
-            const size_t accessRedRegion = x - glitchOffset;
-            (accessRedRegion < image->width)
-                    ? (pixel->red = rowCopy[accessRedRegion].red)
-                    : 0;
-            */
-
-            const size_t accessRedRegion = x + glitchOffset;
-            (accessRedRegion < image->width)
-                    ? (pixel->red = rowCopy[accessRedRegion].red)
-                    : 0;
-
-            const size_t accessBlueRegion = x - glitchOffset;
-            (accessBlueRegion < image->width)
-                    ? (pixel->blue = rowCopy[accessBlueRegion].blue)
-                    : 0;
+        if (image->layout == LAYOUT_BGRX) {
+            glitch_row_x(image_row(image, y), rowCopy, image->width,
+                    glitchOffset);
+        } else {
+            glitch_row(image_row(image, y), rowCopy, image->width,
+                    glitchOffset);
         }
     }
 
@@ -373,6 +476,21 @@ static inline uint8_t contrast_effect_val(
     return (uint8_t)(new);
 }
 
+/* apply_lookup_table()
+ * --------------------
+ * Maps each colour channel of every pixel through the table, leaving alpha
+ * unchanged.
+ */
+static void apply_lookup_table(
+        Image* image, const uint8_t lookupTable[UINT8_MAX + 1])
+{
+    FX_TEMPLATE(image, {
+        pixel->blue = lookupTable[pixel->blue];
+        pixel->green = lookupTable[pixel->green];
+        pixel->red = lookupTable[pixel->red];
+    });
+}
+
 void contrast_effect(Image* image, const float contrastFactor)
 {
     // Create a lookup table mapping input -> output pixels based on the
@@ -383,11 +501,86 @@ void contrast_effect(Image* image, const float contrastFactor)
         lookupTable[i] = contrast_effect_val((uint8_t)i, contrastFactor);
     }
 
-    FX_TEMPLATE(image, { // Apply contrast filter to each colour
-        pixel->blue = lookupTable[pixel->blue];
-        pixel->green = lookupTable[pixel->green];
-        pixel->red = lookupTable[pixel->red];
-    });
+    apply_lookup_table(image, lookupTable);
+}
+
+void equalize_histogram(Image* image)
+{
+    Histogram histogram;
+    compute_histogram(&histogram, image);
+
+    // The darkest level present maps to 0, so that the full range is used
+    uint64_t darkest = 0;
+    for (size_t i = 0; (i <= UINT8_MAX) && (darkest == 0); i++) {
+        darkest = histogram.luma[i];
+    }
+
+    // A single level cannot be spread out
+    const uint64_t range = histogram.pixels - darkest;
+    if (range == 0) {
+        return;
+    }
+
+    uint8_t lookupTable[UINT8_MAX + 1] = {0};
+    uint64_t cumulative = 0;
+
+    for (size_t i = 0; i <= UINT8_MAX; i++) {
+        cumulative += histogram.luma[i];
+        if (cumulative > darkest) {
+            lookupTable[i] = (uint8_t)((((cumulative - darkest) * UINT8_MAX)
+                                               + (range / 2))
+                    / range);
+        }
+    }
+
+    apply_lookup_table(image, lookupTable);
+}
+
+void auto_levels(Image* image, const float clipPercent)
+{
+    Histogram histogram;
+    compute_histogram(&histogram, image);
+
+    // Channels are counted together, so that their balance is kept
+    uint64_t counts[UINT8_MAX + 1];
+    for (size_t i = 0; i <= UINT8_MAX; i++) {
+        counts[i] = histogram.red[i] + histogram.green[i] + histogram.blue[i];
+    }
+
+    const uint64_t clipped = (uint64_t)((double)(histogram.pixels * 3)
+            * (double)clipPercent / 100.0);
+
+    // Find the levels beyond which no more than the clipped values lie. Less
+    // than half are clipped, so neither search passes the other end
+    size_t low = 0;
+    uint64_t below = counts[0];
+    while (below <= clipped) {
+        below += counts[++low];
+    }
+
+    size_t high = UINT8_MAX;
+    uint64_t above = counts[UINT8_MAX];
+    while (above <= clipped) {
+        above += counts[--high];
+    }
+
+    if (high <= low) {
+        return;
+    }
+
+    uint8_t lookupTable[UINT8_MAX + 1] = {0};
+    const size_t range = high - low;
+
+    for (size_t i = 0; i <= UINT8_MAX; i++) {
+        if (i >= high) {
+            lookupTable[i] = UINT8_MAX;
+        } else if (i > low) {
+            lookupTable[i] = (uint8_t)((((i - low) * UINT8_MAX) + (range / 2))
+                    / range);
+        }
+    }
+
+    apply_lookup_table(image, lookupTable);
 }
 
 static inline uint8_t sum_restrict_u8(const uint8_t val, const int add)
@@ -425,6 +618,21 @@ int cmp_pixels(const void* a, const void* b)
     return (s1 - s2);
 }
 
+/* cmp_pixels_x()
+ * --------------
+ * Compares BGRX pixels by the sum of their colour channels, as cmp_pixels().
+ */
+static int cmp_pixels_x(const void* a, const void* b)
+{
+    const PixelX* p1 = (const PixelX*)a;
+    const PixelX* p2 = (const PixelX*)b;
+
+    int s1 = p1->blue + p1->green + p1->red;
+    int s2 = p2->blue + p2->green + p2->red;
+
+    return (s1 - s2);
+}
+
 [[nodiscard]] int melt(BMP* bmp, const int32_t start)
 {
     Image* image = bmp->image;
@@ -459,12 +667,13 @@ int cmp_pixels(const void* a, const void* b)
     }
 
     const size_t nmembPix = rotated->width - norm;
+    const size_t pixelSize = pixel_size(rotated->layout);
 
     for (size_t y = 0; y < rotated->height; y++) {
-        size_t rowOffset = y * rotated->width;
-        Pixel* rowPtr = get_pixel_fast(rotated, norm, rowOffset);
+        uint8_t* rowPtr = (uint8_t*)image_row(rotated, y) + (norm * pixelSize);
 
-        qsort(rowPtr, nmembPix, sizeof(Pixel), cmp_pixels);
+        qsort(rowPtr, nmembPix, pixelSize,
+                (rotated->layout == LAYOUT_BGRX) ? cmp_pixels_x : cmp_pixels);
     }
 
     Image* unRotated = NULL;
@@ -526,10 +735,10 @@ void colour_scaler(
     });
 }
 
-/* blurred_pixel_row()
- * -------------------
- * Applies a horizontal box blur to a single row of an image using a sliding
- * window.
+/* BLURRED_PIXEL_ROW_TEMPLATE
+ * --------------------------
+ * Macro defining blurred_pixel_row() for a given pixel type, which applies a
+ * horizontal box blur to a single row of an image using a sliding window.
  *
  * image: Destination image to store the blurred row.
  * buffer: Source array containing the original pixel row data.
@@ -537,92 +746,108 @@ void colour_scaler(
  * radius: The radius of the blur.
  * perimeter: The total width of the blur effect (radius * 2 + 1).
  */
-static inline void blurred_pixel_row(Image* image, const Pixel* buffer,
-        const size_t rNumber, const size_t radius, const size_t perimeter,
-        size_t* lookup)
-{
-    const size_t rOffset = rNumber * image->width;
-    size_t blueSum = 0;
-    size_t greenSum = 0;
-    size_t redSum = 0;
-
-    // Initial average generation (equivilent to -1 index)
-    for (size_t i = 0; i < radius; i++) {
-        blueSum += (size_t)((buffer[i]).blue);
-        greenSum += (size_t)((buffer[i]).green);
-        redSum += (size_t)((buffer[i]).red);
-    }
-
-    for (size_t x = 0; x < image->width; x++) {
-        Pixel* p = get_pixel_fast(image, x, rOffset);
-
-        if (x <= radius) { // Just adding
-            Pixel last = buffer[x + radius];
-            blueSum += (size_t)(last.blue);
-            greenSum += (size_t)(last.green);
-            redSum += (size_t)(last.red);
-
-            const size_t nmemb = x + 1 + radius;
-            const size_t scaleFactor = lookup[nmemb];
-            p->blue = (uint8_t)((blueSum * scaleFactor) >> 16);
-            p->green = (uint8_t)((greenSum * scaleFactor) >> 16);
-            p->red = (uint8_t)((redSum * scaleFactor) >> 16);
-
-        } else if (x + radius + 1 > image->width) { // Just subtracting
-            Pixel first = buffer[x - radius - 1];
-            blueSum -= (size_t)(first.blue);
-            greenSum -= (size_t)(first.green);
-            redSum -= (size_t)(first.red);
-
-            const size_t nmemb = image->width - x + radius;
-            const size_t scaleFactor = lookup[nmemb];
-
-            p->blue = (uint8_t)((blueSum * scaleFactor) >> 16);
-            p->green = (uint8_t)((greenSum * scaleFactor) >> 16);
-            p->red = (uint8_t)((redSum * scaleFactor) >> 16);
-
-        } else { // Adding and subtracting
-            Pixel first = buffer[x - radius - 1];
-            Pixel last = buffer[x + radius];
-
-            blueSum += (size_t)(last.blue) - (size_t)(first.blue);
-            greenSum += (size_t)(last.green) - (size_t)(first.green);
-            redSum += (size_t)(last.red) - (size_t)(first.red);
-
-            const size_t scaleFactor = lookup[perimeter];
-
-            p->blue = (uint8_t)((blueSum * scaleFactor) >> 16);
-            p->green = (uint8_t)((greenSum * scaleFactor) >> 16);
-            p->red = (uint8_t)((redSum * scaleFactor) >> 16);
+#define BLURRED_PIXEL_ROW_TEMPLATE(name, PixelType)                            \
+    static inline void name(Image* image, const PixelType* buffer,             \
+            const size_t rNumber, const size_t radius, const size_t perimeter, \
+            size_t* lookup)                                                    \
+    {                                                                          \
+        PixelType* row = image_row(image, rNumber);                            \
+        size_t blueSum = 0;                                                    \
+        size_t greenSum = 0;                                                   \
+        size_t redSum = 0;                                                     \
+                                                                               \
+        /* Initial average generation (equivilent to -1 index) */              \
+        for (size_t i = 0; i < radius; i++) {                                  \
+            blueSum += (size_t)((buffer[i]).blue);                             \
+            greenSum += (size_t)((buffer[i]).green);                           \
+            redSum += (size_t)((buffer[i]).red);                               \
+        }                                                                      \
+                                                                               \
+        for (size_t x = 0; x < image->width; x++) {                            \
+            PixelType* p = row + x;                                            \
+            size_t nmemb = perimeter;                                          \
+                                                                               \
+            if (x <= radius) { /* Just adding */                               \
+                PixelType last = buffer[x + radius];                           \
+                blueSum += (size_t)(last.blue);                                \
+                greenSum += (size_t)(last.green);                              \
+                redSum += (size_t)(last.red);                                  \
+                nmemb = x + 1 + radius;                                        \
+                                                                               \
+            } else if (x + radius + 1 > image->width) { /* Just subtracting */ \
+                PixelType first = buffer[x - radius - 1];                      \
+                blueSum -= (size_t)(first.blue);                               \
+                greenSum -= (size_t)(first.green);                             \
+                redSum -= (size_t)(first.red);                                 \
+                nmemb = image->width - x + radius;                             \
+                                                                               \
+            } else { /* Adding and subtracting */                              \
+                PixelType first = buffer[x - radius - 1];                      \
+                PixelType last = buffer[x + radius];                           \
+                                                                               \
+                blueSum += (size_t)(last.blue) - (size_t)(first.blue);         \
+                greenSum += (size_t)(last.green) - (size_t)(first.green);      \
+                redSum += (size_t)(last.red) - (size_t)(first.red);            \
+            }                                                                  \
+                                                                               \
+            const size_t scaleFactor = lookup[nmemb];                          \
+            p->blue = (uint8_t)((blueSum * scaleFactor) >> 16);                \
+            p->green = (uint8_t)((greenSum * scaleFactor) >> 16);              \
+            p->red = (uint8_t)((redSum * scaleFactor) >> 16);                  \
+        }                                                                      \
+    }
+
+BLURRED_PIXEL_ROW_TEMPLATE(blurred_pixel_row, Pixel)
+BLURRED_PIXEL_ROW_TEMPLATE(blurred_pixel_row_x, PixelX)
+
+/* blur_rows()
+ * -----------
+ * Blurs each row of the image horizontally, copying each row into the buffer
+ * before it is overwritten.
+ */
+static void blur_rows(Image* image, void* buffer, const size_t radius,
+        const size_t perimeter, size_t* lookup)
+{
+    const size_t rSize = image->width * pixel_size(image->layout);
+
+    for (size_t y = 0; y < image->height; y++) {
+        memcpy(buffer, image_row(image, y), rSize);
+
+        if (image->layout == LAYOUT_BGRX) {
+            blurred_pixel_row_x(image, buffer, y, radius, perimeter, lookup);
+        } else {
+            blurred_pixel_row(image, buffer, y, radius, perimeter, lookup);
         }
     }
 }
 
 // O(1)
-Image* even_faster_image_blur(const Image* restrict image, const size_t radius)
+int even_faster_image_blur(Image* restrict image, const size_t radius)
 {
-    Image* t1 = create_image((int32_t)image->width, (int32_t)image->height);
-    if (t1 == NULL) {
-        return NULL;
+    // Only a single scratch image is required, as each pass reads a row into
+    // the row buffer before overwriting it
+    Image* scratch = create_image_with_layout(
+            (int32_t)image->height, (int32_t)image->width, image->layout);
+    if (scratch == NULL) {
+        return -1;
     }
 
     const size_t nPixelsMax
             = (image->width > image->height) ? (image->width) : (image->height);
 
-    Pixel* buffer = malloc(nPixelsMax * sizeof(Pixel));
+    void* buffer = malloc(nPixelsMax * pixel_size(image->layout));
     if (!buffer) {
-        free_image(&t1);
-        return NULL;
+        free_image(&scratch);
+        return -1;
     }
 
     const size_t perimeter = (radius << 1) + 1;
-    const size_t rSizeT1 = image->width * sizeof(Pixel);
 
     size_t* lookupBuffer = malloc((perimeter + 1) * sizeof(size_t));
     if (!lookupBuffer) {
         free(buffer);
-        free_image(&t1);
-        return NULL;
+        free_image(&scratch);
+        return -1;
     }
 
     lookupBuffer[0] = 0;
@@ -630,34 +855,14 @@ Image* even_faster_image_blur(const Image* restrict image, const size_t radius)
         lookupBuffer[l] = (1 << 16) / l;
     }
 
-    for (size_t y = 0; y < image->height; y++) {
-        Pixel* p = get_pixel_fast(image, 0, y * image->width);
-        memcpy(buffer, p, rSizeT1);
-        blurred_pixel_row(t1, buffer, y, radius, perimeter, lookupBuffer);
-    }
-
-    Image* t2 = transpose_image(t1);
-    free_image(&t1);
-
-    if (!t2) {
-        free(buffer);
-        free(lookupBuffer);
-        return NULL;
-    }
-
-    const size_t rSizeT2 = t2->width * sizeof(Pixel);
-
-    for (size_t y = 0; y < t2->height; y++) {
-        Pixel* p = get_pixel_fast(t2, 0, y * t2->width);
-        memcpy(buffer, p, rSizeT2);
-        blurred_pixel_row(t2, buffer, y, radius, perimeter, lookupBuffer);
-    }
-
-    Image* final = transpose_image(t2);
+    blur_rows(image, buffer, radius, perimeter, lookupBuffer);
+    transpose_image_into(scratch, image);
+    blur_rows(scratch, buffer, radius, perimeter, lookupBuffer);
+    transpose_image_into(image, scratch);
     free(buffer);
     free(lookupBuffer);
-    free_image(&t2);
-    return final;
+    free_image(&scratch);
+    return EXIT_SUCCESS;
 }
 
 // O(R)
@@ -699,7 +904,7 @@ Image* even_faster_image_blur(const Image* restrict image, const size_t radius)
         // Populate row pointer
         size_t start = row - radius;
         for (size_t i = 0; i < perimeter; i++) {
-            lookup[i] = image->width * (start++);
+            lookup[i] = image->stride * (start++);
         }
 
         for (size_t x = 0; x < image->width; x++) {
@@ -738,7 +943,7 @@ Image* even_faster_image_blur(const Image* restrict image, const size_t radius)
 void edge_detection(Image* image, const int threshold)
 {
     for (size_t y = 0; y < image->height; y++) {
-        size_t rowOffset = y * image->width;
+        size_t rowOffset = y * image->stride;
         Pixel* rowPtr = get_pixel_fast(image, 0, rowOffset);
 
         for (size_t x = 0; x < image->width - 1; x++) {
@@ -5,18 +5,21 @@
 #include <pthread.h>
 #include "fileParsing.h"
 
-/* FX_TEMPLATE
- * -----------
- * Macro to iterate over every pixel in an image with SIMD optimisation.
+// Clipping at least half of the values would leave no levels to stretch
+#define AUTO_LEVELS_MAX_CLIP 50.0f
+
+/* FX_LOOP
+ * -------
+ * Macro to iterate over every pixel in a packed BGR image with SIMD
+ * optimisation.
  */
-#define FX_TEMPLATE(image, function)                                           \
+#define FX_LOOP(image, function)                                               \
                                                                                \
     const size_t _height = image->height;                                      \
     const size_t _width = image->width;                                        \
                                                                                \
     for (size_t y = 0; y < _height; y++) {                                     \
-        const size_t rowOffset = y * _width;                                   \
-        Pixel* rowPtr = get_pixel_fast(image, 0, rowOffset);                   \
+        Pixel* rowPtr = image_row(image, y);                                   \
                                                                                \
         _Pragma("omp simd") for (size_t x = 0; x < _width; x++)                \
         {                                                                      \
@@ -25,6 +28,51 @@
         }                                                                      \
     }
 
+/* FX_LOOP_X
+ * ---------
+ * Macro to iterate over every pixel in a padded BGRX image with SIMD
+ * optimisation. Each pixel is loaded and stored as a single 32-bit lane, with
+ * the function applied to its unpacked colour channels, leaving alpha intact.
+ */
+#define FX_LOOP_X(image, function)                                             \
+                                                                               \
+    const size_t _height = image->height;                                      \
+    const size_t _width = image->width;                                        \
+                                                                               \
+    for (size_t y = 0; y < _height; y++) {                                     \
+        uint32_t* rowPtr = image_row(image, y);                                \
+                                                                               \
+        _Pragma("omp simd") for (size_t x = 0; x < _width; x++)                \
+        {                                                                      \
+            const uint32_t _lane = rowPtr[x];                                  \
+            Pixel _channels = {(uint8_t)_lane, (uint8_t)(_lane >> 8),          \
+                    (uint8_t)(_lane >> 16)};                                   \
+            Pixel* pixel = &_channels;                                         \
+            function;                                                          \
+            rowPtr[x] = (uint32_t)(pixel->blue)                                \
+                    | ((uint32_t)(pixel->green) << 8)                          \
+                    | ((uint32_t)(pixel->red) << 16)                           \
+                    | (_lane & ALPHA_LANE_MASK);                               \
+        }                                                                      \
+    }
+
+/* FX_TEMPLATE
+ * -----------
+ * Macro to iterate over every pixel in an image with SIMD optimisation, with
+ * the loop specialised for the layout of the image. Indexed images only have
+ * their palette modified.
+ */
+#define FX_TEMPLATE(image, function)                                           \
+                                                                               \
+    if (image->layout == LAYOUT_INDEX8) {                                      \
+        const Image _palette = palette_image(image);                           \
+        FX_LOOP_X((&_palette), function)                                       \
+    } else if (image->layout == LAYOUT_BGRX) {                                 \
+        FX_LOOP_X(image, function)                                             \
+    } else {                                                                   \
+        FX_LOOP(image, function)                                               \
+    }
+
 /* invert_colours()
  * ----------------
  * Inverts the colour of each pixel of an Image (creates a negative).
@@ -181,6 +229,28 @@ void brightness_cut_filter(Image* image, const uint8_t cutoff);
  */
 void contrast_effect(Image* image, const float contrastFactor);
 
+/* equalize_histogram()
+ * --------------------
+ * Spreads the levels of the image evenly over the full range. The histogram
+ * of its luma is computed first, then its cumulative counts give a lookup
+ * table, which is applied to each colour channel so that hues are kept.
+ *
+ * image: Pointer to struct containing the pixel data.
+ */
+void equalize_histogram(Image* image);
+
+/* auto_levels()
+ * -------------
+ * Stretches the levels of the image to the full range. The histogram of the
+ * image is computed first, then the darkest and brightest levels across all
+ * channels are mapped to 0 and 255 with a lookup table.
+ *
+ * image: Pointer to struct containing the pixel data.
+ * clipPercent: Percentage of values at each end which may be clipped, so that
+ * a few outliers do not limit the stretch (0 to below 50).
+ */
+void auto_levels(Image* image, const float clipPercent);
+
 /* swap_red_blue()
  * ---------------
  * Swaps the red and blue components of each pixel in an Image.
@@ -241,8 +311,9 @@ void colour_scaler(
 
 /* even_faster_image_blur()
  * ------------------------
- * Applies a separable box blur to the image. It blurs rows, transposes the
- * image, blurs the new rows (original columns), and transposes back.
+ * Applies a separable box blur to the image in-place. It blurs rows, transposes
+ * the image into a scratch image, blurs the new rows (original columns), and
+ * transposes back. Only two full size buffers are live at any time.
  *
  * Algorithm complexity is O(1) (relative to radius). This blurring algorithm is
  * better suited for blurring with a large radii, as the overhead from
@@ -252,9 +323,10 @@ void colour_scaler(
  * image: Pointer to struct containing the pixel data.
  * radius: The radius of the blur.
  *
- * Returns: A pointer to the new blurred Image, or NULL on failure.
+ * Returns: 0 on success, or -1 if memory allocation fails.
  */
-Image* even_faster_image_blur(const Image* restrict image, const size_t radius);
+[[nodiscard]] int even_faster_image_blur(
+        Image* restrict image, const size_t radius);
 
 /* faster_image_blur()
  * -------------------
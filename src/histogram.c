@@ -0,0 +1,204 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "histogram.h"
+
+// Luma coefficients of gray_filter(), each multiplied by 1024
+constexpr uint32_t lumaRed = 306; // 0.299
+constexpr uint32_t lumaGreen = 601; // 0.587
+constexpr uint32_t lumaBlue = 117; // 0.114
+constexpr uint32_t lumaShift = 10;
+
+// Channels counted, in the order of their bins
+enum { CHANNEL_RED, CHANNEL_GREEN, CHANNEL_BLUE, CHANNEL_LUMA, CHANNELS };
+
+// Copies of the bins, which consecutive pixels are counted into in turn
+constexpr size_t binCopies = 4;
+
+typedef uint32_t Bins[CHANNELS][HISTOGRAM_BINS];
+
+/* pixel_luma()
+ * ------------
+ * Returns: The luma of a pixel stored as blue, green then red bytes.
+ */
+static inline uint8_t pixel_luma(const uint8_t* pixel)
+{
+    return (uint8_t)(((lumaRed * pixel[2]) + (lumaGreen * pixel[1])
+                             + (lumaBlue * pixel[0]))
+            >> lumaShift);
+}
+
+static inline void count_pixel(Bins bins, const uint8_t* pixel)
+{
+    bins[CHANNEL_RED][pixel[2]]++;
+    bins[CHANNEL_GREEN][pixel[1]]++;
+    bins[CHANNEL_BLUE][pixel[0]]++;
+    bins[CHANNEL_LUMA][pixel_luma(pixel)]++;
+}
+
+/* count_row()
+ * -----------
+ * Counts a row of BGR or BGRX pixels, 4 at a time into separate bins.
+ */
+static inline void count_row(Bins* bins, const uint8_t* row,
+        const size_t width, const size_t pixelBytes)
+{
+    size_t x = 0;
+
+    for (; x + binCopies <= width; x += binCopies) {
+        count_pixel(bins[0], row + (x * pixelBytes));
+        count_pixel(bins[1], row + ((x + 1) * pixelBytes));
+        count_pixel(bins[2], row + ((x + 2) * pixelBytes));
+        count_pixel(bins[3], row + ((x + 3) * pixelBytes));
+    }
+
+    for (; x < width; x++) {
+        count_pixel(bins[0], row + (x * pixelBytes));
+    }
+}
+
+/* count_indices()
+ * ---------------
+ * Counts a row of palette indices into the first channel of the bins, 4 at a
+ * time into separate bins.
+ */
+static inline void count_indices(
+        Bins* bins, const uint8_t* row, const size_t width)
+{
+    size_t x = 0;
+
+    for (; x + binCopies <= width; x += binCopies) {
+        bins[0][0][row[x]]++;
+        bins[1][0][row[x + 1]]++;
+        bins[2][0][row[x + 2]]++;
+        bins[3][0][row[x + 3]]++;
+    }
+
+    for (; x < width; x++) {
+        bins[0][0][row[x]]++;
+    }
+}
+
+/* flush_bins()
+ * ------------
+ * Adds every copy of the bins to the totals, then clears them.
+ */
+static void flush_bins(uint64_t (*totals)[HISTOGRAM_BINS], Bins* bins)
+{
+    for (size_t copy = 0; copy < binCopies; copy++) {
+        for (size_t c = 0; c < CHANNELS; c++) {
+#pragma omp simd
+            for (size_t v = 0; v < HISTOGRAM_BINS; v++) {
+                totals[c][v] += bins[copy][c][v];
+            }
+        }
+    }
+
+    memset(bins, 0, binCopies * sizeof(Bins));
+}
+
+void compute_histogram(Histogram* histogram, const Image* image)
+{
+    *histogram = (Histogram){.pixels = image->width * image->height};
+
+    const size_t width = image->width;
+    const bool indexed = (image->layout == LAYOUT_INDEX8);
+    uint64_t merged[CHANNELS][HISTOGRAM_BINS] = {0};
+
+    // Bins are flushed to 64-bit totals before they could overflow
+    const size_t flushRows
+            = ((width != 0) && (width < UINT32_MAX)) ? (UINT32_MAX / width) : 1;
+
+#pragma omp parallel
+    {
+        Bins bins[binCopies];
+        uint64_t totals[CHANNELS][HISTOGRAM_BINS];
+        memset(bins, 0, sizeof(bins));
+        memset(totals, 0, sizeof(totals));
+        size_t rows = 0;
+
+#pragma omp for schedule(static) nowait
+        for (size_t y = 0; y < image->height; y++) {
+            const uint8_t* row = image_row(image, y);
+
+            if (indexed) {
+                count_indices(bins, row, width);
+            } else {
+                PIXEL_SIZE_TEMPLATE(image->layout, pixelBytes,
+                        count_row(bins, row, width, pixelBytes));
+            }
+
+            if (++rows == flushRows) {
+                flush_bins(totals, bins);
+                rows = 0;
+            }
+        }
+        flush_bins(totals, bins);
+
+#pragma omp critical
+        for (size_t c = 0; c < CHANNELS; c++) {
+            for (size_t v = 0; v < HISTOGRAM_BINS; v++) {
+                merged[c][v] += totals[c][v];
+            }
+        }
+    }
+
+    if (!indexed) {
+        memcpy(histogram->red, merged[CHANNEL_RED], sizeof(histogram->red));
+        memcpy(histogram->green, merged[CHANNEL_GREEN],
+                sizeof(histogram->green));
+        memcpy(histogram->blue, merged[CHANNEL_BLUE], sizeof(histogram->blue));
+        memcpy(histogram->luma, merged[CHANNEL_LUMA], sizeof(histogram->luma));
+        return;
+    }
+
+    // Each index counts towards the channels of its colour
+    for (size_t i = 0; i < PALETTE_ENTRIES; i++) {
+        const PixelX colour = image->palette[i];
+        const uint64_t count = merged[0][i];
+
+        histogram->red[colour.red] += count;
+        histogram->green[colour.green] += count;
+        histogram->blue[colour.blue] += count;
+        histogram->luma[pixel_luma((const uint8_t*)&colour)] += count;
+    }
+}
+
+/* write_json_bins()
+ * -----------------
+ * Writes the bins of a channel as a named JSON array.
+ */
+static void write_json_bins(
+        FILE* file, const char* name, const uint64_t* bins, const bool last)
+{
+    fprintf(file, "\"%s\":[", name);
+    for (size_t v = 0; v < HISTOGRAM_BINS; v++) {
+        fprintf(file, (v == 0) ? "%" PRIu64 : ",%" PRIu64, bins[v]);
+    }
+    fputs((last) ? "]" : "],", file);
+}
+
+int write_histogram(
+        FILE* file, const Histogram* histogram, const HistogramFormat format)
+{
+    if (format == HISTOGRAM_JSON) {
+        fprintf(file, "{\"pixels\":%" PRIu64 ",", histogram->pixels);
+        write_json_bins(file, "red", histogram->red, false);
+        write_json_bins(file, "green", histogram->green, false);
+        write_json_bins(file, "blue", histogram->blue, false);
+        write_json_bins(file, "luma", histogram->luma, true);
+        fputs("}\n", file);
+    } else {
+        fprintf(file, "pixels %" PRIu64 "\nvalue red green blue luma\n",
+                histogram->pixels);
+        for (size_t v = 0; v < HISTOGRAM_BINS; v++) {
+            fprintf(file,
+                    "%zu %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 "\n", v,
+                    histogram->red[v], histogram->green[v],
+                    histogram->blue[v], histogram->luma[v]);
+        }
+    }
+
+    return ((fflush(file) == 0) && !ferror(file)) ? EXIT_SUCCESS : -1;
+}
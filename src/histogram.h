@@ -0,0 +1,52 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "pixels.h"
+
+// Bins of each channel, one per 8-bit value
+#define HISTOGRAM_BINS 256
+
+typedef enum {
+    HISTOGRAM_TEXT, // Table of the count of each value, one row per value
+    HISTOGRAM_JSON, // Single line JSON object, so runs give JSON Lines
+} HistogramFormat;
+
+/* Histogram
+ * ---------
+ * Number of pixels with each value of red, green, blue, and luma (as given by
+ * gray_filter()).
+ */
+typedef struct {
+    uint64_t red[HISTOGRAM_BINS];
+    uint64_t green[HISTOGRAM_BINS];
+    uint64_t blue[HISTOGRAM_BINS];
+    uint64_t luma[HISTOGRAM_BINS];
+    uint64_t pixels;
+} Histogram;
+
+/* compute_histogram()
+ * -------------------
+ * Counts every channel of the image in a single pass. Each thread counts its
+ * rows into private bins, which are merged once all rows are counted.
+ * Consecutive pixels are counted into 4 separate copies of the bins, so that
+ * repeated values do not wait on the previous increment of the same bin.
+ * Indexed images count each index, then expand the counts through the
+ * palette.
+ *
+ * histogram: Destination for the counts.
+ * image: Pointer to struct containing the pixel data.
+ */
+void compute_histogram(Histogram* histogram, const Image* image);
+
+/* write_histogram()
+ * -----------------
+ * Writes the counts of each channel in the format given.
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+[[nodiscard]] int write_histogram(
+        FILE* file, const Histogram* histogram, const HistogramFormat format);
+
+#endif
@@ -2,8 +2,17 @@
 #include <string.h>
 #include <stdint.h>
 #include "imageEditing.h"
+#include "imagePool.h"
 #include "filters.h"
 
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
 int flip_image(Image* image)
 {
     if (image == NULL) {
@@ -13,8 +22,8 @@ int flip_image(Image* image)
     const size_t width = image->width;
     const size_t height = image->height;
 
-    const size_t rowSize = width * sizeof(Pixel);
-    Pixel* restrict rowBuffer = malloc(rowSize);
+    const size_t rowSize = width * pixel_size(image->layout);
+    uint8_t* restrict rowBuffer = malloc(rowSize);
 
     if (rowBuffer == NULL) {
         perror("malloc failed while flipping..");
@@ -23,13 +32,11 @@ int flip_image(Image* image)
 
     const size_t last = height >> 1;
 
-    Pixel* restrict pixelData = image->pixelData;
-
     for (size_t y = 0; y < last; y++) {
 
         // Calculate offsets for starting index of current top/bottom rows
-        Pixel* topRow = pixelData + (width * y);
-        Pixel* bottomRow = pixelData + ((height - y - 1) * width);
+        uint8_t* topRow = image_row(image, y);
+        uint8_t* bottomRow = image_row(image, height - y - 1);
 
         // Swap top and bottom rows, via a buffer
         memcpy(rowBuffer, topRow, rowSize);
@@ -41,80 +48,116 @@ int flip_image(Image* image)
     return EXIT_SUCCESS;
 }
 
+/* REVERSE_TEMPLATE
+ * ----------------
+ * Macro to reverse each row of an image in place, instantiated for each pixel
+ * layout.
+ */
+#define REVERSE_TEMPLATE(image, PixelType)                                     \
+                                                                               \
+    const size_t width = image->width;                                         \
+    const size_t height = image->height;                                       \
+                                                                               \
+    /* Only need to iterate throgh half the width */                           \
+    const size_t iterBound = width >> 1;                                       \
+                                                                               \
+    /* For each row in the image */                                            \
+    for (size_t y = 0; y < height; y++) {                                      \
+        PixelType* row = image_row(image, y);                                  \
+        size_t last = width - 1;                                               \
+                                                                               \
+        /* For each pixel in row, get current pair of start/end pixels         \
+         * (working inwards towards centre) and swap the pixels in place. */   \
+        for (size_t x = 0; x < iterBound; x++) {                               \
+            PixelType temp = row[x];                                           \
+            row[x] = row[last];                                                \
+            row[last] = temp;                                                  \
+            --last;                                                            \
+        }                                                                      \
+    }
+
 void reverse_image(Image* image)
 {
-    const size_t width = image->width;
-    const size_t height = image->height;
-
-    // Only need to iterate throgh half the width
-    const size_t iterBound = width >> 1;
-
-    // For each row in the image
-    for (size_t y = 0; y < height; y++) {
-        size_t rowOffset = width * y;
-        size_t last = width - 1;
-
-        // For each pixel in row, get current pair of start/end pixels (working
-        // inwards towards centre) and swap the pixels in place.
-        for (size_t x = 0; x < iterBound; x++) {
+    if (image->layout == LAYOUT_INDEX8) {
+        REVERSE_TEMPLATE(image, uint8_t);
+    } else if (image->layout == LAYOUT_BGRX) {
+        REVERSE_TEMPLATE(image, PixelX);
+    } else {
+        REVERSE_TEMPLATE(image, Pixel);
+    }
+}
 
-            Pixel* pixel1 = get_pixel_fast(image, x, rowOffset);
-            Pixel* pixel2 = get_pixel_fast(image, last, rowOffset);
+/* TRANSPOSE_TEMPLATE
+ * ------------------
+ * Macro to transpose an image in 16x16 pixel blocks, instantiated for each
+ * pixel layout.
+ */
+#define TRANSPOSE_TEMPLATE(transpose, image, PixelType)                        \
+                                                                               \
+    constexpr size_t blockSize = 16;                                           \
+    PixelType buffer[blockSize * blockSize];                                   \
+    memset(buffer, 0, sizeof(buffer));                                         \
+                                                                               \
+    const size_t xHeight = image->height;                                      \
+    const size_t xWidth = image->width;                                        \
+                                                                               \
+    for (size_t y = 0; y < xHeight; y += blockSize) {                          \
+        for (size_t x = 0; x < xWidth; x += blockSize) {                       \
+                                                                               \
+            const size_t xDiff = xWidth - x;                                   \
+            const size_t currentBlockW                                         \
+                    = (blockSize < xDiff) ? (blockSize) : (xDiff);             \
+                                                                               \
+            const size_t yDiff = xHeight - y;                                  \
+            const size_t currentBlockH                                         \
+                    = (blockSize < yDiff) ? (blockSize) : (yDiff);             \
+                                                                               \
+            for (size_t row = 0; row < currentBlockH; row++) {                 \
+                const PixelType* restrict rowPtr                               \
+                        = (const PixelType*)image_row(image, y + row) + x;     \
+                                                                               \
+                for (size_t col = 0; col < currentBlockW; col++) {             \
+                    buffer[(col * blockSize) + row] = rowPtr[col];             \
+                }                                                              \
+            }                                                                  \
+                                                                               \
+            for (size_t row = 0; row < currentBlockW; row++) {                 \
+                PixelType* restrict destPtr                                    \
+                        = (PixelType*)image_row(transpose, x + row) + y;       \
+                                                                               \
+                for (size_t col = 0; col < currentBlockH; col++) {             \
+                    destPtr[col] = buffer[(row * blockSize) + col];            \
+                }                                                              \
+            }                                                                  \
+        }                                                                      \
+    }
 
-            Pixel temp = *pixel1;
-            *pixel1 = *pixel2;
-            *pixel2 = temp;
-            --last;
-        }
+void transpose_image_into(
+        Image* restrict transpose, const Image* restrict image)
+{
+    if (image->layout == LAYOUT_INDEX8) {
+        TRANSPOSE_TEMPLATE(transpose, image, uint8_t);
+    } else if (image->layout == LAYOUT_BGRX) {
+        TRANSPOSE_TEMPLATE(transpose, image, PixelX);
+    } else {
+        TRANSPOSE_TEMPLATE(transpose, image, Pixel);
     }
 }
 
 Image* transpose_image(const Image* restrict image)
 {
-    const size_t xHeight = image->height;
-    const size_t xWidth = image->width;
-
     // Involves casting size_t to int32_t, this is safe provided the input image
     // was generated using create_image, which converts the size read from the
     // file header to a size_t. So no overflow can occur
-    Image* transpose = create_image((int32_t)xHeight, (int32_t)xWidth);
-
-    constexpr size_t blockSize = 16;
-    Pixel buffer[blockSize * blockSize];
-    memset(buffer, 0, sizeof(buffer));
-
-    for (size_t y = 0; y < xHeight; y += blockSize) {
-        for (size_t x = 0; x < xWidth; x += blockSize) {
-
-            const size_t xDiff = xWidth - x;
-            const size_t currentBlockW
-                    = (blockSize < xDiff) ? (blockSize) : (xDiff);
-
-            const size_t yDiff = xHeight - y;
-            const size_t currentBlockH
-                    = (blockSize < yDiff) ? (blockSize) : (yDiff);
-
-            for (size_t row = 0; row < currentBlockH; row++) {
-                const size_t sourceRowOffset = (y + row) * xWidth;
-                const Pixel* restrict rowPtr
-                        = get_pixel_fast(image, x, sourceRowOffset);
-
-                for (size_t col = 0; col < currentBlockW; col++) {
-                    buffer[(col * blockSize) + row] = rowPtr[col];
-                }
-            }
-
-            for (size_t row = 0; row < currentBlockW; row++) {
-                const size_t destRowOffset = (x + row) * xHeight;
-                Pixel* restrict destPtr
-                        = get_pixel_fast(transpose, y, destRowOffset);
-
-                for (size_t col = 0; col < currentBlockH; col++) {
-                    destPtr[col] = buffer[(row * blockSize) + col];
-                }
-            }
-        }
+    Image* transpose = create_image_with_layout(
+            (int32_t)image->height, (int32_t)image->width, image->layout);
+
+    if (transpose == NULL) {
+        return NULL;
     }
+
+    copy_palette(transpose, image);
+    transpose_image_into(transpose, image);
     return transpose;
 }
 
@@ -145,3 +188,174 @@ Image* rotate_image_anticlockwise(const Image* restrict image)
     reverse_image(output);
     return output;
 }
+
+Image* duplicate_image(const Image* restrict image)
+{
+    Image* copy = create_image_with_layout(
+            (int32_t)image->width, (int32_t)image->height, image->layout);
+
+    if (copy == NULL) {
+        return NULL;
+    }
+
+    copy_palette(copy, image);
+    const size_t rowSize = image->width * pixel_size(image->layout);
+
+    if (is_contiguous(image)) {
+        memcpy(copy->pixelData, image->pixelData, rowSize * image->height);
+        return copy;
+    }
+
+    // Views share the stride of their parent, so may differ from the copy
+    for (size_t y = 0; y < image->height; y++) {
+        memcpy(image_row(copy, y), image_row(image, y), rowSize);
+    }
+    return copy;
+}
+
+void expand_pixel_row(
+        PixelX* restrict dest, const Pixel* restrict src, const size_t n)
+{
+    size_t x = 0;
+
+#ifdef __SSSE3__
+    // Spread 4 packed pixels (12 bytes) into 16 bytes, then set them opaque
+    const __m128i expand = _mm_setr_epi8(
+            0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i opaque = _mm_set1_epi32((int)ALPHA_LANE_MASK);
+
+    // Each 16 byte load reads 4 bytes past the pixels used
+    for (; x + 6 <= n; x += 4) {
+        const __m128i packed = _mm_loadu_si128((const __m128i*)(src + x));
+        _mm_storeu_si128((__m128i*)(dest + x),
+                _mm_or_si128(_mm_shuffle_epi8(packed, expand), opaque));
+    }
+#endif
+
+    for (; x < n; x++) {
+        dest[x] = (PixelX){src[x].blue, src[x].green, src[x].red, UINT8_MAX};
+    }
+}
+
+void pack_pixel_row(
+        Pixel* restrict dest, const PixelX* restrict src, const size_t n)
+{
+    size_t x = 0;
+
+#ifdef __SSSE3__
+    // Gather the 12 colour bytes of 4 padded pixels into the low 12 bytes
+    const __m128i pack = _mm_setr_epi8(
+            0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+    // Each 16 byte store writes 4 bytes past the pixels packed, which are
+    // overwritten by the following iteration
+    for (; x + 6 <= n; x += 4) {
+        const __m128i padded = _mm_loadu_si128((const __m128i*)(src + x));
+        _mm_storeu_si128(
+                (__m128i*)(dest + x), _mm_shuffle_epi8(padded, pack));
+    }
+#endif
+
+    for (; x < n; x++) {
+        dest[x] = (Pixel){src[x].blue, src[x].green, src[x].red};
+    }
+}
+
+void decode_index_row(void* restrict dest, const PixelLayout layout,
+        const uint8_t* restrict src, const PixelX* restrict palette,
+        const size_t n)
+{
+    size_t x = 0;
+
+#ifdef __AVX2__
+    const int* table = (const int*)(const void*)palette;
+
+    if (layout == LAYOUT_BGRX) {
+        for (; x + 8 <= n; x += 8) {
+            const __m256i indices = _mm256_cvtepu8_epi32(
+                    _mm_loadl_epi64((const __m128i*)(src + x)));
+            _mm256_storeu_si256((__m256i*)((PixelX*)dest + x),
+                    _mm256_i32gather_epi32(table, indices, 4));
+        }
+    } else {
+        // Gather the 12 colour bytes of each group of 4 entries
+        const __m256i pack = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12,
+                13, 14, -1, -1, -1, -1, 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14,
+                -1, -1, -1, -1);
+
+        // Each 16 byte store writes 4 bytes past the pixels decoded, which
+        // are overwritten by the following store
+        for (; x + 10 <= n; x += 8) {
+            const __m256i indices = _mm256_cvtepu8_epi32(
+                    _mm_loadl_epi64((const __m128i*)(src + x)));
+            const __m256i packed = _mm256_shuffle_epi8(
+                    _mm256_i32gather_epi32(table, indices, 4), pack);
+
+            _mm_storeu_si128((__m128i*)((Pixel*)dest + x),
+                    _mm256_castsi256_si128(packed));
+            _mm_storeu_si128((__m128i*)((Pixel*)dest + x + 4),
+                    _mm256_extracti128_si256(packed, 1));
+        }
+    }
+#endif
+
+    if (layout == LAYOUT_BGRX) {
+        for (; x < n; x++) {
+            ((PixelX*)dest)[x] = palette[src[x]];
+        }
+        return;
+    }
+
+    for (; x < n; x++) {
+        const PixelX colour = palette[src[x]];
+        ((Pixel*)dest)[x] = (Pixel){colour.blue, colour.green, colour.red};
+    }
+}
+
+int convert_image_layout(Image* image, const PixelLayout layout)
+{
+    if (image->layout == layout) {
+        return EXIT_SUCCESS;
+    }
+
+    // Quantising colours to a palette is not supported
+    if (layout == LAYOUT_INDEX8) {
+        fputs("Images cannot be converted to an indexed layout.\n", stderr);
+        return -1;
+    }
+
+    Image converted = *image;
+    converted.stride = row_stride(image->width, layout);
+    converted.layout = layout;
+    converted.isView = false;
+    converted.palette = NULL;
+    converted.pixelData = acquire_pixels(
+            converted.stride * image->height * pixel_size(layout));
+
+    if (converted.pixelData == NULL) {
+        perror("malloc failed while converting pixel layout");
+        return -1;
+    }
+
+    for (size_t y = 0; y < image->height; y++) {
+        void* dest = image_row(&converted, y);
+        const void* src = image_row(image, y);
+
+        if (image->layout == LAYOUT_INDEX8) {
+            decode_index_row(dest, layout, src, image->palette, image->width);
+        } else if (layout == LAYOUT_BGRX) {
+            expand_pixel_row(dest, src, image->width);
+        } else {
+            pack_pixel_row(dest, src, image->width);
+        }
+    }
+
+    // The pixel data of a view belongs to its parent
+    if (!(image->isView)) {
+        release_pixels(image->pixelData,
+                image->stride * image->height * pixel_size(image->layout));
+        free(image->palette);
+    }
+    *image = converted;
+    return EXIT_SUCCESS;
+}
@@ -50,6 +50,18 @@ void reverse_image(Image* image);
  */
 Image* transpose_image(const Image* restrict image);
 
+/* transpose_image_into()
+ * ----------------------
+ * Transposes an image into an existing image, allowing callers to alternate
+ * between two buffers rather than allocating a new image for each transpose.
+ *
+ * transpose: Destination image, with the width and height of the source image
+ *            swapped.
+ * image: Pointer to the source Image.
+ */
+void transpose_image_into(
+        Image* restrict transpose, const Image* restrict image);
+
 /* rotate_image_clockwise()
  * ------------------------
  * Creates a new image rotated 90° clockwise.
@@ -78,4 +90,71 @@ Image* rotate_image_clockwise(const Image* restrict image);
  */
 Image* rotate_image_anticlockwise(const Image* restrict image);
 
+/* duplicate_image()
+ * -----------------
+ * Creates a new image containing a copy of the input images pixel data.
+ *
+ * image: Pointer to the source Image.
+ *
+ * Returns: Pointer to the new Image, or NULL if memory allocation fails. The
+ *          caller is responsible for freeing the returned image.
+ */
+Image* duplicate_image(const Image* restrict image);
+
+/* expand_pixel_row()
+ * ------------------
+ * Converts packed BGR pixels to padded BGRX pixels, using SSSE3 shuffles where
+ * available. Each pixel is made opaque.
+ *
+ * dest: Destination for n padded pixels.
+ * src: Source of n packed pixels.
+ * n: Number of pixels to convert.
+ */
+void expand_pixel_row(
+        PixelX* restrict dest, const Pixel* restrict src, const size_t n);
+
+/* pack_pixel_row()
+ * ----------------
+ * Converts padded BGRX pixels to packed BGR pixels, using SSSE3 shuffles where
+ * available, discarding alpha.
+ *
+ * dest: Destination for n packed pixels.
+ * src: Source of n padded pixels.
+ * n: Number of pixels to convert.
+ */
+void pack_pixel_row(
+        Pixel* restrict dest, const PixelX* restrict src, const size_t n);
+
+/* decode_index_row()
+ * ------------------
+ * Looks up each palette index of a row, writing the colours as packed BGR or
+ * padded BGRX pixels. Uses AVX2 gathers of eight palette entries at a time
+ * where available.
+ *
+ * dest: Destination for n pixels in the given layout.
+ * layout: LAYOUT_BGR or LAYOUT_BGRX.
+ * src: Source of n palette indices.
+ * palette: PALETTE_ENTRIES colours.
+ * n: Number of pixels to convert.
+ */
+void decode_index_row(void* restrict dest, const PixelLayout layout,
+        const uint8_t* restrict src, const PixelX* restrict palette,
+        const size_t n);
+
+/* convert_image_layout()
+ * ----------------------
+ * Converts the pixel data of an image to the requested layout, replacing its
+ * pixel buffer. Does nothing if the image already uses the layout. Views (see
+ * create_view()) are converted into an image of their own, which no longer
+ * shares the pixel data of the parent. Indexed images are expanded through
+ * their palette, however images cannot be converted to LAYOUT_INDEX8.
+ *
+ * image: Pointer to the Image to convert.
+ * layout: The layout to convert to.
+ *
+ * Returns: 0 on success, or -1 if memory allocation fails or the conversion
+ * is not supported.
+ */
+[[nodiscard]] int convert_image_layout(Image* image, const PixelLayout layout);
+
 #endif
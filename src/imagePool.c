@@ -0,0 +1,124 @@
+// MADV_HUGEPAGE is not declared in strict C23 mode
+#define _DEFAULT_SOURCE
+
+#include <stdlib.h>
+#include <sys/mman.h>
+#include "imagePool.h"
+
+static thread_local ImagePool* boundPool = NULL;
+static thread_local bool hugePages = false;
+
+/* aligned_size()
+ * --------------
+ * Rounds a size up to a multiple of POOL_ALIGNMENT, as required by
+ * aligned_alloc().
+ */
+static inline size_t aligned_size(const size_t bytes)
+{
+    return (bytes + (POOL_ALIGNMENT - 1)) & ~((size_t)POOL_ALIGNMENT - 1);
+}
+
+/* allocate_pixels()
+ * -----------------
+ * Allocates a new buffer, which is aligned to and advised to use huge pages if
+ * enabled and large enough. The buffer is always released with free().
+ */
+static Pixel* allocate_pixels(const size_t size)
+{
+    if (!hugePages || (size < HUGE_PAGE_SIZE)) {
+        return aligned_alloc(POOL_ALIGNMENT, (size) ? size : POOL_ALIGNMENT);
+    }
+
+    const size_t hugeSize = (size + (HUGE_PAGE_SIZE - 1))
+            & ~((size_t)HUGE_PAGE_SIZE - 1);
+
+    Pixel* data = aligned_alloc(HUGE_PAGE_SIZE, hugeSize);
+#ifdef MADV_HUGEPAGE
+    if (data != NULL) {
+        (void)madvise(data, hugeSize, MADV_HUGEPAGE); // Advisory only
+    }
+#endif
+    return data;
+}
+
+void set_huge_pages(const bool enable)
+{
+    hugePages = enable;
+}
+
+void bind_image_pool(ImagePool* pool)
+{
+    boundPool = pool;
+}
+
+ImagePool* bound_image_pool(void)
+{
+    return boundPool;
+}
+
+void drain_image_pool(ImagePool* pool)
+{
+    for (size_t i = 0; i < POOL_CAPACITY; i++) {
+        free((pool->buffers)[i].data);
+        (pool->buffers)[i] = (PooledBuffer){0};
+    }
+}
+
+Pixel* acquire_pixels(const size_t bytes)
+{
+    const size_t size = aligned_size(bytes);
+
+    if (boundPool != NULL) {
+        PooledBuffer* best = NULL;
+
+        for (size_t i = 0; i < POOL_CAPACITY; i++) {
+            PooledBuffer* buffer = &((boundPool->buffers)[i]);
+
+            if ((buffer->data != NULL) && (buffer->bytes >= size)
+                    && ((best == NULL) || (buffer->bytes < best->bytes))) {
+                best = buffer;
+            }
+        }
+
+        if (best != NULL) {
+            Pixel* data = best->data;
+            *best = (PooledBuffer){0};
+            return data;
+        }
+    }
+
+    return allocate_pixels(size);
+}
+
+void release_pixels(Pixel* data, const size_t bytes)
+{
+    if (boundPool == NULL) {
+        free(data);
+        return;
+    }
+
+    const size_t size = aligned_size(bytes);
+    PooledBuffer* slot = &((boundPool->buffers)[0]);
+
+    // Prefer an empty slot, otherwise the smallest retained buffer
+    for (size_t i = 0; i < POOL_CAPACITY; i++) {
+        PooledBuffer* buffer = &((boundPool->buffers)[i]);
+
+        if (buffer->data == NULL) {
+            slot = buffer;
+            break;
+        }
+
+        if (buffer->bytes < slot->bytes) {
+            slot = buffer;
+        }
+    }
+
+    if ((slot->data != NULL) && (slot->bytes >= size)) {
+        free(data); // Every retained buffer is at least as large
+        return;
+    }
+
+    free(slot->data);
+    *slot = (PooledBuffer){.data = data, .bytes = size};
+}
@@ -0,0 +1,91 @@
+#ifndef IMAGE_POOL_H
+#define IMAGE_POOL_H
+
+#include <stddef.h>
+#include "pixels.h"
+
+// Pixel buffers are aligned to the cache line size
+#define POOL_ALIGNMENT 64
+
+// Maximum number of released buffers retained by a pool
+#define POOL_CAPACITY 4
+
+// Buffers of at least this size may be backed by transparent huge pages
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+typedef struct {
+    Pixel* data;
+    size_t bytes;
+} PooledBuffer;
+
+/* ImagePool
+ * ---------
+ * Retains pixel buffers released by free_image(), so that subsequent calls to
+ * create_image() on the same thread reuse memory which has already been
+ * faulted in, rather than mapping fresh pages.
+ *
+ * Commands which produce a new image from an old one (transpose, rotate, blur)
+ * naturally ping-pong between two retained buffers of the same size.
+ */
+typedef struct {
+    PooledBuffer buffers[POOL_CAPACITY];
+} ImagePool;
+
+/* bind_image_pool()
+ * -----------------
+ * Sets the pool used by create_image() and free_image() on the calling thread.
+ * Other threads are unaffected.
+ *
+ * pool: The pool to bind, or NULL to allocate and free buffers directly.
+ */
+void bind_image_pool(ImagePool* pool);
+
+/* bound_image_pool()
+ * ------------------
+ * Returns: The pool bound to the calling thread, or NULL if none is bound.
+ */
+ImagePool* bound_image_pool(void);
+
+/* set_huge_pages()
+ * ----------------
+ * Enables or disables huge page backing for new pixel buffers allocated by the
+ * calling thread. While enabled, buffers of at least HUGE_PAGE_SIZE are aligned
+ * to HUGE_PAGE_SIZE and advised to use transparent huge pages, reducing TLB
+ * misses for column-wise access patterns. Falls back silently to regular pages
+ * if the kernel does not support or has disabled transparent huge pages.
+ *
+ * enable: Whether huge pages should be used.
+ */
+void set_huge_pages(const bool enable);
+
+/* drain_image_pool()
+ * ------------------
+ * Frees every buffer retained by the pool.
+ *
+ * pool: The pool to drain.
+ */
+void drain_image_pool(ImagePool* pool);
+
+/* acquire_pixels()
+ * ----------------
+ * Returns a buffer of at least the requested size, aligned to POOL_ALIGNMENT.
+ * The smallest sufficiently large buffer retained by the bound pool is reused
+ * if available, otherwise a new buffer is allocated (see set_huge_pages()).
+ *
+ * bytes: Minimum size of the buffer.
+ *
+ * Returns: Pointer to the buffer, or NULL if allocation failed.
+ */
+Pixel* acquire_pixels(const size_t bytes);
+
+/* release_pixels()
+ * ----------------
+ * Returns a buffer to the bound pool, replacing the smallest retained buffer if
+ * the pool is full. Buffers are freed immediately if no pool is bound.
+ *
+ * data: Buffer previously returned by acquire_pixels().
+ * bytes: Size requested when the buffer was acquired.
+ */
+void release_pixels(Pixel* data, const size_t bytes);
+
+#endif
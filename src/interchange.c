@@ -0,0 +1,607 @@
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "interchange.h"
+#include "bandIO.h"
+#include "imageEditing.h"
+#include "tiles.h"
+
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
+// Error messages
+constexpr char invalidHeaderMessage[] = "Invalid %s header.\n";
+constexpr char sampleDepthMessage[]
+        = "Only 8-bit samples are supported (maximum value %u).\n";
+constexpr char pamDepthMessage[]
+        = "PAM depth %u not supported, expected 3 (RGB) or 4 (RGB_ALPHA).\n";
+constexpr char dimensionsMessage[] = "Invalid image dimensions \"%zux%zu\".\n";
+constexpr char pixelDataMessage[]
+        = "File is too small, expected %zu bytes of pixel data.\n";
+constexpr char readingRowsMessage[] = "Error reading pixels: (row %zu)\n";
+
+// Magic bytes of netpbm files
+constexpr char ppmMagic[] = "P6";
+constexpr char pamMagic[] = "P7";
+constexpr size_t magicLength = 2;
+
+// Samples are stored in a single byte
+constexpr uint32_t sampleMax = 255;
+
+// Channels of RGB and RGB_ALPHA tuples
+constexpr size_t rgbChannels = 3;
+constexpr size_t rgbaChannels = 4;
+
+// Headers which are written, or the lines of PAM headers which are read, are
+// no longer than this
+constexpr size_t headerMax = 128;
+
+FileFormat detect_format(FILE* file)
+{
+    char magic[TILED_MAGIC_LENGTH];
+    const size_t nRead = fread(magic, 1, TILED_MAGIC_LENGTH, file);
+    rewind(file);
+
+    if ((nRead == TILED_MAGIC_LENGTH)
+            && !memcmp(magic, TILED_MAGIC, TILED_MAGIC_LENGTH)) {
+        return FORMAT_SIG;
+    }
+
+    if (nRead >= magicLength) {
+        if (!memcmp(magic, ppmMagic, magicLength)) {
+            return FORMAT_PPM;
+        }
+
+        if (!memcmp(magic, pamMagic, magicLength)) {
+            return FORMAT_PAM;
+        }
+    }
+
+    return FORMAT_BMP;
+}
+
+/* read_ppm_value()
+ * ----------------
+ * Reads a decimal value from a PPM header, skipping the whitespace and comments
+ * before it, along with the single whitespace character which ends it.
+ *
+ * Returns: 0 on success, -1 if there is no value or it exceeds max.
+ */
+static int read_ppm_value(FILE* file, uint32_t* value, const uint32_t max)
+{
+    int c = getc(file);
+
+    while ((c == '#') || isspace(c)) {
+        if (c == '#') { // Comments run to the end of the line
+            while ((c != '\n') && (c != EOF)) {
+                c = getc(file);
+            }
+        }
+        c = getc(file);
+    }
+
+    if (!isdigit(c)) {
+        return -1;
+    }
+
+    uint64_t result = 0;
+    while (isdigit(c)) {
+        result = (result * 10) + (uint64_t)(c - '0');
+
+        if (result > max) {
+            return -1;
+        }
+        c = getc(file);
+    }
+
+    if (!isspace(c)) {
+        return -1;
+    }
+
+    *value = (uint32_t)result;
+    return EXIT_SUCCESS;
+}
+
+/* read_ppm_header()
+ * -----------------
+ * Reads the dimensions and maximum value of a P6 header, leaving the file at
+ * the start of the pixel data.
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+static int read_ppm_header(FILE* file, size_t* width, size_t* height)
+{
+    char magic[magicLength];
+    uint32_t values[3]; // Width, height and maximum value
+
+    if ((fread(magic, 1, magicLength, file) != magicLength)
+            || (read_ppm_value(file, &(values[0]), INT32_MAX) == -1)
+            || (read_ppm_value(file, &(values[1]), INT32_MAX) == -1)
+            || (read_ppm_value(file, &(values[2]), UINT16_MAX) == -1)) {
+        fprintf(stderr, invalidHeaderMessage, "PPM");
+        return -1;
+    }
+
+    if (values[2] != sampleMax) {
+        fprintf(stderr, sampleDepthMessage, values[2]);
+        return -1;
+    }
+
+    *width = values[0];
+    *height = values[1];
+    return EXIT_SUCCESS;
+}
+
+/* read_pam_header()
+ * -----------------
+ * Reads the lines of a P7 header up to and including ENDHDR, leaving the file
+ * at the start of the pixel data. The tuple type is implied by the depth.
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+static int read_pam_header(
+        FILE* file, size_t* width, size_t* height, size_t* channels)
+{
+    static const char* const keys[] = {"WIDTH", "HEIGHT", "DEPTH", "MAXVAL"};
+    constexpr size_t nKeys = sizeof(keys) / sizeof(keys[0]);
+
+    uint32_t values[sizeof(keys) / sizeof(keys[0])] = {0};
+    char line[headerMax];
+    bool ended = false;
+
+    // The magic bytes are on a line of their own
+    if (fgets(line, sizeof(line), file) == NULL) {
+        fprintf(stderr, invalidHeaderMessage, "PAM");
+        return -1;
+    }
+
+    while (!ended && (fgets(line, sizeof(line), file) != NULL)) {
+        char key[16];
+        char value[32];
+        const int nFields = sscanf(line, "%15s %31s", key, value);
+
+        if ((nFields < 1) || (key[0] == '#')) {
+            continue;
+        }
+
+        if (!strcmp(key, "ENDHDR")) {
+            ended = true;
+            continue;
+        }
+
+        for (size_t i = 0; (i < nKeys) && (nFields == 2); i++) {
+            if (!strcmp(key, keys[i])) {
+                char* end;
+                const unsigned long parsed = strtoul(value, &end, 10);
+                values[i] = ((*end == '\0') && (parsed <= INT32_MAX))
+                        ? (uint32_t)parsed
+                        : 0;
+            }
+        }
+    }
+
+    if (!ended || !values[0] || !values[1]) {
+        fprintf(stderr, invalidHeaderMessage, "PAM");
+        return -1;
+    }
+
+    if ((values[2] != rgbChannels) && (values[2] != rgbaChannels)) {
+        fprintf(stderr, pamDepthMessage, values[2]);
+        return -1;
+    }
+
+    if (values[3] != sampleMax) {
+        fprintf(stderr, sampleDepthMessage, values[3]);
+        return -1;
+    }
+
+    *width = values[0];
+    *height = values[1];
+    *channels = values[2];
+    return EXIT_SUCCESS;
+}
+
+int read_interchange_headers(BMP* bmpImage)
+{
+    FILE* file = bmpImage->file;
+    size_t width = bmpImage->rawWidth;
+    size_t height = bmpImage->rawHeight;
+    size_t channels = rgbChannels;
+
+    if ((bmpImage->format == FORMAT_PPM)
+            && (read_ppm_header(file, &width, &height) == -1)) {
+        return -1;
+    }
+
+    if ((bmpImage->format == FORMAT_PAM)
+            && (read_pam_header(file, &width, &height, &channels) == -1)) {
+        return -1;
+    }
+
+    if (!width || !height || (width > INT32_MAX) || (height > INT32_MAX)
+            || (height > (SIZE_MAX / channels) / width)) {
+        fprintf(stderr, dimensionsMessage, width, height);
+        return -1;
+    }
+
+    const long offset = ftell(file);
+    if (offset < 0) {
+        perror("ftell failed");
+        return -1;
+    }
+
+    const bool alpha = (channels == rgbaChannels);
+    describe_pixels(bmpImage, width, height, alpha, (size_t)offset);
+    return EXIT_SUCCESS;
+}
+
+/* Swizzle
+ * -------
+ * Reordering of the bytes of each pixel, giving the source byte of each
+ * destination byte, or -1 for opaque alpha.
+ */
+typedef struct {
+    size_t srcBytes;
+    size_t destBytes;
+    int8_t order[4];
+} Swizzle;
+
+static const Swizzle rgbToBgr = {3, 3, {2, 1, 0, -1}};
+static const Swizzle rgbToBgrx = {3, 4, {2, 1, 0, -1}};
+static const Swizzle rgbaToBgra = {4, 4, {2, 1, 0, 3}};
+static const Swizzle bgrxToRgb = {4, 3, {2, 1, 0, -1}};
+
+/* swizzle_row()
+ * -------------
+ * Reorders the bytes of n pixels, 4 pixels at a time with SSSE3 shuffles where
+ * available. Swapping red and blue is its own inverse, so the same swizzles
+ * convert to and from the file.
+ */
+static void swizzle_row(uint8_t* restrict dest, const uint8_t* restrict src,
+        const size_t n, const Swizzle* swizzle)
+{
+    const size_t srcBytes = swizzle->srcBytes;
+    const size_t destBytes = swizzle->destBytes;
+    size_t x = 0;
+
+#ifdef __SSSE3__
+    int8_t indices[16];
+    uint8_t fill[16];
+
+    for (size_t i = 0; i < 16; i++) {
+        const size_t pixel = i / destBytes;
+        const int8_t from = (pixel < 4) ? (swizzle->order)[i % destBytes] : -1;
+
+        indices[i] = (from < 0)
+                ? -1
+                : (int8_t)((pixel * srcBytes) + (size_t)from);
+        fill[i] = ((from < 0) && (pixel < 4)) ? UINT8_MAX : 0;
+    }
+
+    const __m128i shuffle = _mm_loadu_si128((const __m128i*)indices);
+    const __m128i opaque = _mm_loadu_si128((const __m128i*)fill);
+
+    // Loads and stores of 16 bytes may pass the 4 pixels converted, so stop
+    // while they remain within the row. Bytes stored past the pixels are
+    // overwritten by the following iteration.
+    for (; ((x * srcBytes) + 16 <= n * srcBytes)
+            && ((x * destBytes) + 16 <= n * destBytes);
+            x += 4) {
+        const __m128i pixels
+                = _mm_loadu_si128((const __m128i*)(src + (x * srcBytes)));
+        _mm_storeu_si128((__m128i*)(dest + (x * destBytes)),
+                _mm_or_si128(_mm_shuffle_epi8(pixels, shuffle), opaque));
+    }
+#endif
+
+    for (; x < n; x++) {
+        for (size_t i = 0; i < destBytes; i++) {
+            const int8_t from = (swizzle->order)[i];
+            dest[(x * destBytes) + i] = (from < 0)
+                    ? UINT8_MAX
+                    : src[(x * srcBytes) + (size_t)from];
+        }
+    }
+}
+
+/* convert_samples()
+ * -----------------
+ * Converts a row of samples read from the file into pixels of the layout.
+ * Pixels without alpha are made opaque.
+ */
+static void convert_samples(void* restrict dest, const PixelLayout layout,
+        const uint8_t* restrict src, const size_t n, const FileFormat format,
+        const size_t channels)
+{
+    if (format == FORMAT_BGR) {
+        if (layout == LAYOUT_BGRX) {
+            expand_pixel_row(dest, (const Pixel*)src, n);
+        } else {
+            memcpy(dest, src, n * sizeof(Pixel));
+        }
+        return;
+    }
+
+    if (layout == LAYOUT_BGR) {
+        swizzle_row(dest, src, n, &rgbToBgr);
+    } else {
+        swizzle_row(dest, src, n,
+                (channels == rgbaChannels) ? &rgbaToBgra : &rgbToBgrx);
+    }
+}
+
+/* check_pixel_data()
+ * ------------------
+ * Returns: 0 if the file holds at least size bytes of pixel data from offset,
+ * otherwise -1.
+ */
+static int check_pixel_data(FILE* file, const size_t offset, const size_t size)
+{
+    if (fseek(file, 0L, SEEK_END) != 0) {
+        return -1;
+    }
+
+    const long end = ftell(file);
+    if ((end < 0) || ((size_t)end < offset)
+            || (((size_t)end - offset) < size)) {
+        fprintf(stderr, pixelDataMessage, size);
+        return -1;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+Image* load_interchange(BMP* bmpImage, const Region* region)
+{
+    FILE* file = bmpImage->file;
+    const BmpInfoHeader* info = &(bmpImage->infoHeader);
+    const bool alpha = (info->bitsPerPixel == 32);
+    const size_t channels = (alpha) ? rgbaChannels : rgbChannels;
+    const size_t width = (size_t)info->bitmapWidth;
+    const size_t height = (size_t)info->bitmapHeight;
+    const size_t offset = (bmpImage->bmpHeader).offset;
+    const size_t fileRowSize = width * channels;
+
+    const Region whole = {.width = width, .height = height};
+    if (region == NULL) {
+        region = &whole;
+    }
+
+    if (check_pixel_data(file, offset, fileRowSize * height) == -1) {
+        return NULL;
+    }
+
+    // The file is stored top down, so the region begins this many rows down
+    const size_t top = height - (region->y + region->height);
+    if (fseek(file, (long)(offset + (top * fileRowSize)), SEEK_SET) != 0) {
+        return NULL;
+    }
+
+    Image* image = create_image_with_layout((int32_t)region->width,
+            (int32_t)region->height,
+            (alpha) ? LAYOUT_BGRX : bmpImage->layout);
+    if (image == NULL) {
+        return NULL;
+    }
+
+    const size_t bandRows = (fileRowSize < BAND_BYTES)
+            ? (BAND_BYTES / fileRowSize)
+            : 1;
+    const size_t nBandRows
+            = (bandRows < image->height) ? bandRows : image->height;
+
+    uint8_t* bands[2] = {malloc(nBandRows * fileRowSize), NULL};
+    if ((nBandRows < image->height) && (bands[0] != NULL)) {
+        bands[1] = malloc(nBandRows * fileRowSize);
+    }
+
+    if ((bands[0] == NULL) || ((nBandRows < image->height) && !bands[1])) {
+        free(bands[0]);
+        free(bands[1]);
+        free_image(&image);
+        return NULL;
+    }
+
+    BandTransfer transfer;
+    start_band_read(&transfer, file, bands[0], nBandRows * fileRowSize);
+    size_t band = 0;
+
+    for (size_t first = 0; first < image->height; first += nBandRows) {
+        const size_t nRows = ((image->height - first) < nBandRows)
+                ? (image->height - first)
+                : nBandRows;
+        const size_t next = first + nRows;
+
+        if (finish_band_transfer(&transfer) != nRows * fileRowSize) {
+            fprintf(stderr, readingRowsMessage, top + first);
+            free_image(&image);
+            break;
+        }
+
+        // Read the next band while this one is converted
+        if (next < image->height) {
+            const size_t nextRows = ((image->height - next) < nBandRows)
+                    ? (image->height - next)
+                    : nBandRows;
+            start_band_read(&transfer, file, bands[band ^ 1],
+                    nextRows * fileRowSize);
+        }
+
+        const uint8_t* rows = bands[band] + (region->x * channels);
+
+#pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < nRows; i++) {
+            convert_samples(image_row(image, image->height - 1 - (first + i)),
+                    image->layout, rows + (i * fileRowSize), image->width,
+                    bmpImage->format, channels);
+        }
+        band ^= 1;
+    }
+
+    free(bands[0]);
+    free(bands[1]);
+    return image;
+}
+
+/* encode_samples()
+ * ----------------
+ * Converts a row of the image into samples of the file, in RGB order unless the
+ * format is FORMAT_BGR. Indexed pixels are looked up in a palette which is
+ * already in the order of the file.
+ */
+static void encode_samples(uint8_t* restrict dest, const Image* image,
+        const size_t row, const FileFormat format, const size_t channels,
+        const uint8_t (*colours)[rgbChannels])
+{
+    const size_t n = image->width;
+    const bool bgr = (format == FORMAT_BGR);
+    const void* src = image_row(image, row);
+
+    if (image->layout == LAYOUT_INDEX8) {
+        const uint8_t* indices = src;
+
+        for (size_t i = 0; i < n; i++) {
+            memcpy(dest + (i * rgbChannels), colours[indices[i]], rgbChannels);
+        }
+
+    } else if (image->layout == LAYOUT_BGR) {
+        if (bgr) {
+            memcpy(dest, src, n * sizeof(Pixel));
+        } else {
+            swizzle_row(dest, src, n, &rgbToBgr);
+        }
+
+    } else if (bgr) {
+        pack_pixel_row((Pixel*)dest, src, n);
+
+    } else {
+        swizzle_row(dest, src, n,
+                (channels == rgbaChannels) ? &rgbaToBgra : &bgrxToRgb);
+    }
+}
+
+/* format_header()
+ * ---------------
+ * Writes the header of a netpbm file, of which raw streams have none.
+ *
+ * Returns: The length of the header in bytes.
+ */
+static size_t format_header(char* dest, const Image* image,
+        const FileFormat format, const size_t channels)
+{
+    int length = 0;
+
+    if (format == FORMAT_PPM) {
+        length = snprintf(dest, headerMax, "%s\n%zu %zu\n%u\n", ppmMagic,
+                image->width, image->height, sampleMax);
+    } else if (format == FORMAT_PAM) {
+        length = snprintf(dest, headerMax,
+                "%s\nWIDTH %zu\nHEIGHT %zu\nDEPTH %zu\nMAXVAL %u\n"
+                "TUPLTYPE %s\nENDHDR\n",
+                pamMagic, image->width, image->height, channels, sampleMax,
+                (channels == rgbaChannels) ? "RGB_ALPHA" : "RGB");
+    }
+
+    return (length > 0) ? (size_t)length : 0;
+}
+
+int write_interchange(
+        const BMP* bmpImage, const char* filename, const FileFormat format)
+{
+    const Image* image = bmpImage->image;
+    const bool alpha = (format == FORMAT_PAM)
+            && (image->layout == LAYOUT_BGRX)
+            && ((bmpImage->infoHeader).bitsPerPixel == 32);
+    const size_t channels = (alpha) ? rgbaChannels : rgbChannels;
+
+    // Images are stored bottom up unless the height is negative
+    const bool bottomUp = ((bmpImage->infoHeader).bitmapHeight > 0);
+
+    // Palette in the channel order of the file
+    uint8_t colours[PALETTE_ENTRIES][rgbChannels];
+    for (size_t i = 0; (i < PALETTE_ENTRIES) && (image->palette != NULL);
+            i++) {
+        const PixelX colour = (image->palette)[i];
+        const bool bgr = (format == FORMAT_BGR);
+
+        colours[i][0] = (bgr) ? colour.blue : colour.red;
+        colours[i][1] = colour.green;
+        colours[i][2] = (bgr) ? colour.red : colour.blue;
+    }
+
+    char header[headerMax];
+    const size_t headerSize = format_header(header, image, format, channels);
+
+    const size_t rowSize = image->width * channels;
+    const size_t bandRows
+            = (rowSize < BAND_BYTES) ? (BAND_BYTES / rowSize) : 1;
+    const size_t stagedRows
+            = (bandRows < image->height) ? bandRows : image->height;
+
+    uint8_t* staging[2] = {malloc(stagedRows * rowSize), NULL};
+    if ((stagedRows < image->height) && (staging[0] != NULL)) {
+        staging[1] = malloc(stagedRows * rowSize);
+    }
+
+    if ((staging[0] == NULL) || ((stagedRows < image->height) && !staging[1])) {
+        free(staging[0]);
+        free(staging[1]);
+        return -1;
+    }
+
+    const int output = open_output(filename);
+    if (output < 0) {
+        fprintf(stderr, "Error opening file \"%s\" for writing.\n", filename);
+        free(staging[0]);
+        free(staging[1]);
+        return -1;
+    }
+
+    BandTransfer transfer;
+    start_band_write(&transfer, output, header, headerSize);
+    size_t pending = headerSize; // Bytes being written by the transfer
+    size_t band = 0;
+    int result = EXIT_SUCCESS;
+
+    for (size_t first = 0; first < image->height; first += stagedRows) {
+        const size_t nRows = ((image->height - first) < stagedRows)
+                ? (image->height - first)
+                : stagedRows;
+        uint8_t* rows = staging[band];
+
+#pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < nRows; i++) {
+            const size_t row = (bottomUp) ? (image->height - 1 - (first + i))
+                                          : (first + i);
+            encode_samples(rows + (i * rowSize), image, row, format, channels,
+                    (const uint8_t(*)[rgbChannels])colours);
+        }
+
+        if (finish_band_transfer(&transfer) != pending) {
+            pending = 0;
+            result = -1;
+            break;
+        }
+
+        pending = nRows * rowSize;
+        start_band_write(&transfer, output, rows, pending);
+        band ^= 1;
+    }
+
+    if (pending && (finish_band_transfer(&transfer) != pending)) {
+        result = -1;
+    }
+
+    free(staging[0]);
+    free(staging[1]);
+
+    if ((close(output) != 0) || (result == -1)) {
+        perror("signals: could not write output");
+        return -1;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,61 @@
+#ifndef INTERCHANGE_H
+#define INTERCHANGE_H
+
+#include <stdio.h>
+#include "fileParsing.h"
+#include "pixels.h"
+
+/* detect_format()
+ * ---------------
+ * Reads the magic bytes at the start of the file, then returns to the start.
+ *
+ * Returns: FORMAT_PPM or FORMAT_PAM for netpbm files, FORMAT_SIG for tiled
+ * files, otherwise FORMAT_BMP, whose header is checked once it has been read.
+ */
+FileFormat detect_format(FILE* file);
+
+/* read_interchange_headers()
+ * --------------------------
+ * Parses the header of a netpbm file, or takes the dimensions of a raw stream,
+ * then describes the pixel data with the headers of the equivalent BMP (see
+ * describe_pixels()). Only 8-bit samples (a maximum value of 255) are
+ * supported.
+ *
+ * bmpImage: Opened image, whose format is not FORMAT_BMP.
+ *
+ * Returns: 0 on success, -1 if the header is invalid or unsupported.
+ */
+[[nodiscard]] int read_interchange_headers(BMP* bmpImage);
+
+/* load_interchange()
+ * ------------------
+ * Loads the pixel data of a netpbm file or raw stream. Rows are stored bottom
+ * up, as for a BMP, and images with alpha are always loaded as LAYOUT_BGRX.
+ * The next band of rows is read by a helper thread while the current band is
+ * converted.
+ *
+ * bmpImage: Image whose headers have been read.
+ * region: Rectangle of the stored pixel data to load, with rows counted bottom
+ *         up, or NULL to load the entire image.
+ *
+ * Returns: The loaded image, or NULL on error.
+ */
+[[nodiscard]] Image* load_interchange(BMP* bmpImage, const Region* region);
+
+/* write_interchange()
+ * -------------------
+ * Writes the image as a netpbm file or raw stream, top row first. PAM output
+ * retains alpha if the image has it, while other formats discard it. Bands of
+ * rows are converted in parallel, and written by a helper thread while the
+ * next band is converted.
+ *
+ * bmpImage: Image to write, along with the headers describing it.
+ * filename: Path of the file to write.
+ * format: Format to write, which is not FORMAT_BMP.
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+[[nodiscard]] int write_interchange(
+        const BMP* bmpImage, const char* filename, const FileFormat format);
+
+#endif
@@ -0,0 +1,469 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lut3d.h"
+#include "filters.h"
+
+// Lines longer than this are only expected of titles and comments, which are
+// skipped regardless
+constexpr size_t cubeLineLength = 256;
+
+// Rows mapped by each thread at a time
+constexpr size_t bandRows = 32;
+
+// Nodes are held with 8 fractional bits, and cells are divided into 256ths
+constexpr int32_t nodeMax = 255 << 8;
+constexpr int32_t fractionOne = 1 << 8;
+constexpr int32_t mapShift = 16;
+constexpr int32_t mapHalf = 1 << (mapShift - 1);
+
+// Error messages
+constexpr char cubeLineMessage[] = "%s:%zu: %s\n";
+constexpr char cubeSizeMessage[] = "Invalid LUT_3D_SIZE, expected 2 to 256";
+constexpr char cubeDomainMessage[] = "Invalid domain";
+constexpr char cubeOneDimensionMessage[] = "1D LUTs are not supported";
+constexpr char cubeValueMessage[] = "Expected 3 values";
+constexpr char cubeOrderMessage[] = "Values given before LUT_3D_SIZE";
+constexpr char cubeExtraMessage[] = "More values than LUT_3D_SIZE allows";
+constexpr char cubeCountMessage[]
+        = "%s: %zu of the %zu values of the LUT were given\n";
+
+// Fixed-point outputs of a node are packed into a single 64-bit word, with
+// blue, green then red from the lowest bits, so that nodes can be gathered
+constexpr uint32_t nodeBits = 16;
+constexpr uint64_t nodeMask = 0xFFFF;
+
+/* LutKernel
+ * ---------
+ * Fixed-point copy of a LUT, with the cell and position within it of each
+ * input value precomputed for each channel.
+ */
+typedef struct {
+    uint64_t* nodes;
+    uint32_t stride[3]; // Nodes between neighbours along red, green and blue
+    uint32_t offset[3][UINT8_MAX + 1]; // First node of the cell of each value
+    int32_t fraction[3][UINT8_MAX + 1]; // Position within the cell, in 256ths
+} LutKernel;
+
+/* keyword()
+ * ---------
+ * Returns: true if the line begins with the keyword, setting args to the text
+ * after it.
+ */
+static bool keyword(char* line, const char* name, char** args)
+{
+    const size_t length = strlen(name);
+
+    if (strncmp(line, name, length)
+            || !((line[length] == '\0')
+                    || isspace((unsigned char)line[length]))) {
+        return false;
+    }
+
+    *args = line + length;
+    return true;
+}
+
+/* parse_floats()
+ * --------------
+ * Parses exactly count whitespace separated values.
+ *
+ * Returns: 0 on success, -1 if there are more or fewer values.
+ */
+static int parse_floats(char* text, float* values, const size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        char* end;
+        values[i] = strtof(text, &end);
+        if (end == text) {
+            return -1;
+        }
+        text = end;
+    }
+
+    while (isspace((unsigned char)*text)) {
+        text++;
+    }
+    return (*text == '\0') ? EXIT_SUCCESS : -1;
+}
+
+/* parse_keyword()
+ * ---------------
+ * Applies a keyword line of a .cube file to the LUT, ignoring unknown
+ * keywords.
+ *
+ * Returns: NULL on success, otherwise a description of the error.
+ */
+static const char* parse_keyword(Lut3D* lut, char* line)
+{
+    char* args;
+
+    if (keyword(line, "LUT_3D_SIZE", &args)) {
+        char* end;
+        const long size = strtol(args, &end, 10);
+        float unused;
+
+        if ((lut->data != NULL) || (size < LUT3D_MIN_SIZE)
+                || (size > LUT3D_MAX_SIZE)
+                || (parse_floats(end, &unused, 0) == -1)) {
+            return cubeSizeMessage;
+        }
+
+        lut->size = (uint32_t)size;
+        lut->data = malloc((size_t)size * (size_t)size * (size_t)size * 3
+                * sizeof(float));
+        return (lut->data == NULL) ? "Out of memory" : NULL;
+    }
+
+    if (keyword(line, "DOMAIN_MIN", &args)) {
+        return (parse_floats(args, lut->domainMin, 3) == -1)
+                ? cubeDomainMessage
+                : NULL;
+    }
+
+    if (keyword(line, "DOMAIN_MAX", &args)) {
+        return (parse_floats(args, lut->domainMax, 3) == -1)
+                ? cubeDomainMessage
+                : NULL;
+    }
+
+    // Resolve gives a single range for every channel
+    if (keyword(line, "LUT_3D_INPUT_RANGE", &args)) {
+        float range[2];
+        if (parse_floats(args, range, 2) == -1) {
+            return cubeDomainMessage;
+        }
+
+        for (size_t c = 0; c < 3; c++) {
+            lut->domainMin[c] = range[0];
+            lut->domainMax[c] = range[1];
+        }
+        return NULL;
+    }
+
+    if (keyword(line, "LUT_1D_SIZE", &args)) {
+        return cubeOneDimensionMessage;
+    }
+
+    return NULL;
+}
+
+int load_cube(Lut3D* lut, const char* filePath)
+{
+    *lut = (Lut3D){.domainMax = {1.0f, 1.0f, 1.0f}};
+
+    FILE* file = fopen(filePath, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Error opening file \"%s\" for reading.\n", filePath);
+        return -1;
+    }
+
+    char line[cubeLineLength];
+    size_t lineNumber = 0;
+    size_t count = 0;
+    const char* error = NULL;
+
+    while ((error == NULL) && (fgets(line, sizeof(line), file) != NULL)) {
+        lineNumber++;
+
+        // The rest of an overlong line is discarded
+        if ((strchr(line, '\n') == NULL) && !feof(file)) {
+            int c;
+            while (((c = getc(file)) != EOF) && (c != '\n')) { }
+        }
+
+        char* text = line;
+        while (isspace((unsigned char)*text)) {
+            text++;
+        }
+
+        if ((*text == '\0') || (*text == '#')) {
+            continue;
+        }
+
+        if (isalpha((unsigned char)*text)) {
+            error = parse_keyword(lut, text);
+            continue;
+        }
+
+        if (lut->data == NULL) {
+            error = cubeOrderMessage;
+        } else if (count == (size_t)lut->size * lut->size * lut->size) {
+            error = cubeExtraMessage;
+        } else if (parse_floats(text, lut->data + (count * 3), 3) == -1) {
+            error = cubeValueMessage;
+        } else {
+            count++;
+        }
+    }
+
+    const bool failed = ferror(file);
+    fclose(file);
+
+    if ((error == NULL) && !failed) {
+        for (size_t c = 0; c < 3; c++) {
+            if (!(lut->domainMax[c] > lut->domainMin[c])) {
+                error = cubeDomainMessage;
+            }
+        }
+    }
+
+    if (error != NULL) {
+        fprintf(stderr, cubeLineMessage, filePath, lineNumber, error);
+    } else if (failed) {
+        fprintf(stderr, "Error reading \"%s\".\n", filePath);
+    } else if ((lut->data == NULL)
+            || (count != (size_t)lut->size * lut->size * lut->size)) {
+        fprintf(stderr, cubeCountMessage, filePath, count * 3,
+                (size_t)lut->size * lut->size * lut->size * 3);
+    } else {
+        return EXIT_SUCCESS;
+    }
+
+    free_lut3d(lut);
+    return -1;
+}
+
+/* sample()
+ * --------
+ * Interpolates the LUT at a position given in nodes along each axis, using
+ * the tetrahedron of the cell which contains it.
+ */
+static void sample(const Lut3D* lut, const float position[3], float* out)
+{
+    const size_t n = lut->size;
+    const size_t stride[3] = {1, n, n * n};
+    float fraction[3];
+    size_t base = 0;
+
+    for (size_t c = 0; c < 3; c++) {
+        size_t index = (size_t)position[c];
+        if (index > n - 2) {
+            index = n - 2;
+        }
+        fraction[c] = position[c] - (float)index;
+        base += index * stride[c];
+    }
+
+    // Axes in order of their fraction, largest first
+    size_t order[3] = {0, 1, 2};
+    for (size_t i = 1; i < 3; i++) {
+        for (size_t j = i;
+                (j > 0) && (fraction[order[j]] > fraction[order[j - 1]]); j--) {
+            const size_t swap = order[j];
+            order[j] = order[j - 1];
+            order[j - 1] = swap;
+        }
+    }
+
+    const size_t corners[4] = {base, base + stride[order[0]],
+            base + stride[order[0]] + stride[order[1]],
+            base + stride[0] + stride[1] + stride[2]};
+    const float weights[4] = {1.0f - fraction[order[0]],
+            fraction[order[0]] - fraction[order[1]],
+            fraction[order[1]] - fraction[order[2]], fraction[order[2]]};
+
+    for (size_t c = 0; c < 3; c++) {
+        out[c] = 0.0f;
+        for (size_t k = 0; k < 4; k++) {
+            out[c] += weights[k] * lut->data[(corners[k] * 3) + c];
+        }
+    }
+}
+
+int bake_lut3d(Lut3D* lut, const uint32_t size)
+{
+    if (size == lut->size) {
+        return EXIT_SUCCESS;
+    }
+
+    const size_t n = size;
+    float* data = malloc(n * n * n * 3 * sizeof(float));
+    if (data == NULL) {
+        perror("malloc failed while baking LUT");
+        return -1;
+    }
+
+    const float scale = (float)(lut->size - 1) / (float)(size - 1);
+
+#pragma omp parallel for schedule(static)
+    for (size_t b = 0; b < n; b++) {
+        for (size_t g = 0; g < n; g++) {
+            for (size_t r = 0; r < n; r++) {
+                const float position[3] = {
+                        (float)r * scale, (float)g * scale, (float)b * scale};
+                sample(lut, position, data + ((r + (n * (g + (n * b)))) * 3));
+            }
+        }
+    }
+
+    free(lut->data);
+    lut->data = data;
+    lut->size = size;
+    return EXIT_SUCCESS;
+}
+
+/* to_node()
+ * ---------
+ * Returns: The output value in fixed point, clamped to the range of a channel.
+ */
+static inline uint16_t to_node(const float value)
+{
+    if (!(value > 0.0f)) {
+        return 0;
+    }
+    return (value >= 1.0f) ? (uint16_t)nodeMax
+                           : (uint16_t)((value * (float)nodeMax) + 0.5f);
+}
+
+/* make_kernel()
+ * -------------
+ * Builds the fixed-point copy of the LUT, and the cell of each input value.
+ *
+ * Returns: 0 on success, -1 if memory allocation fails.
+ */
+static int make_kernel(LutKernel* kernel, const Lut3D* lut)
+{
+    const size_t n = lut->size;
+    const size_t nNodes = n * n * n;
+
+    kernel->nodes = malloc(nNodes * sizeof(uint64_t));
+    if (kernel->nodes == NULL) {
+        perror("malloc failed while applying LUT");
+        return -1;
+    }
+
+#pragma omp parallel for simd
+    for (size_t i = 0; i < nNodes; i++) {
+        kernel->nodes[i] = (uint64_t)to_node(lut->data[(i * 3) + 2])
+                | ((uint64_t)to_node(lut->data[(i * 3) + 1]) << nodeBits)
+                | ((uint64_t)to_node(lut->data[i * 3]) << (2 * nodeBits));
+    }
+
+    // Inputs outside of the domain take the nearest edge of the LUT
+    for (size_t c = 0; c < 3; c++) {
+        kernel->stride[c] = (uint32_t)((c == 0) ? 1 : (c == 1) ? n : n * n);
+        const float range = lut->domainMax[c] - lut->domainMin[c];
+
+        for (size_t v = 0; v <= UINT8_MAX; v++) {
+            float position = (((float)v / (float)UINT8_MAX) - lut->domainMin[c])
+                    / range * (float)(n - 1);
+            position = (position > 0.0f) ? position : 0.0f;
+            position = (position < (float)(n - 1)) ? position : (float)(n - 1);
+
+            size_t index = (size_t)position;
+            if (index > n - 2) {
+                index = n - 2;
+            }
+
+            kernel->offset[c][v] = (uint32_t)index * kernel->stride[c];
+            kernel->fraction[c][v] = (int32_t)(((position - (float)index)
+                                                       * (float)fractionOne)
+                    + 0.5f);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/* blend_nodes()
+ * -------------
+ * Returns: The weighted sum of a channel of 4 nodes, as a channel value.
+ */
+static inline uint8_t blend_nodes(const uint64_t c0, const uint64_t c1,
+        const uint64_t c2, const uint64_t c3, const int32_t w0,
+        const int32_t w1, const int32_t w2, const int32_t w3,
+        const uint32_t shift)
+{
+    return (uint8_t)(((w0 * (int32_t)((c0 >> shift) & nodeMask))
+                             + (w1 * (int32_t)((c1 >> shift) & nodeMask))
+                             + (w2 * (int32_t)((c2 >> shift) & nodeMask))
+                             + (w3 * (int32_t)((c3 >> shift) & nodeMask))
+                             + mapHalf)
+            >> mapShift);
+}
+
+/* map_pixel()
+ * -----------
+ * Maps a pixel through the LUT, interpolating between the 4 nodes of the
+ * tetrahedron containing it. The axes with the largest and smallest fraction
+ * give the tetrahedron, with ties broken so that they always differ.
+ */
+static inline void map_pixel(Pixel* pixel, const LutKernel* kernel)
+{
+    const int32_t fr = kernel->fraction[0][pixel->red];
+    const int32_t fg = kernel->fraction[1][pixel->green];
+    const int32_t fb = kernel->fraction[2][pixel->blue];
+    const uint32_t base = kernel->offset[0][pixel->red]
+            + kernel->offset[1][pixel->green] + kernel->offset[2][pixel->blue];
+
+    const uint32_t* stride = kernel->stride;
+    const uint32_t largest = ((fr >= fg) && (fr >= fb)) ? stride[0]
+            : (fg >= fb)                                ? stride[1]
+                                                        : stride[2];
+    const uint32_t smallest = ((fb <= fr) && (fb <= fg)) ? stride[2]
+            : (fg <= fr)                                 ? stride[1]
+                                                         : stride[0];
+    const uint32_t opposite = stride[0] + stride[1] + stride[2];
+
+    const int32_t high = (fr > fg) ? ((fr > fb) ? fr : fb)
+                                   : ((fg > fb) ? fg : fb);
+    const int32_t low = (fr < fg) ? ((fr < fb) ? fr : fb)
+                                  : ((fg < fb) ? fg : fb);
+    const int32_t middle = fr + fg + fb - high - low;
+
+    const uint64_t* nodes = kernel->nodes + base;
+    const uint64_t c0 = nodes[0];
+    const uint64_t c1 = nodes[largest];
+    const uint64_t c2 = nodes[opposite - smallest];
+    const uint64_t c3 = nodes[opposite];
+    const int32_t w0 = fractionOne - high;
+    const int32_t w1 = high - middle;
+    const int32_t w2 = middle - low;
+    const int32_t w3 = low;
+
+    pixel->blue = blend_nodes(c0, c1, c2, c3, w0, w1, w2, w3, 0);
+    pixel->green = blend_nodes(c0, c1, c2, c3, w0, w1, w2, w3, nodeBits);
+    pixel->red = blend_nodes(c0, c1, c2, c3, w0, w1, w2, w3, 2 * nodeBits);
+}
+
+int apply_lut3d(Image* image, const Lut3D* lut)
+{
+    LutKernel kernel;
+    if (make_kernel(&kernel, lut) == -1) {
+        return -1;
+    }
+
+    if (image->layout == LAYOUT_INDEX8) {
+        FX_TEMPLATE(image, map_pixel(pixel, &kernel));
+        free(kernel.nodes);
+        return EXIT_SUCCESS;
+    }
+
+    // Each band is a view of its rows, traversed as any other image
+    const size_t nBands = (image->height + bandRows - 1) / bandRows;
+
+#pragma omp parallel for schedule(static)
+    for (size_t band = 0; band < nBands; band++) {
+        const size_t first = band * bandRows;
+        Image rows = *image;
+        rows.height = ((image->height - first) < bandRows)
+                ? (image->height - first)
+                : bandRows;
+        rows.pixelData = image_row(image, first);
+        rows.isView = true;
+
+        FX_TEMPLATE((&rows), map_pixel(pixel, &kernel));
+    }
+
+    free(kernel.nodes);
+    return EXIT_SUCCESS;
+}
+
+void free_lut3d(Lut3D* lut)
+{
+    free(lut->data);
+    lut->data = NULL;
+    lut->size = 0;
+}
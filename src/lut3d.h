@@ -0,0 +1,63 @@
+#ifndef LUT3D_H
+#define LUT3D_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "pixels.h"
+
+// Limits of the number of nodes along each axis of a 3D LUT
+#define LUT3D_MIN_SIZE 2
+#define LUT3D_MAX_SIZE 256
+
+/* Lut3D
+ * -----
+ * A 3D colour lookup table, as read from an Adobe/Resolve .cube file. Nodes
+ * hold red, green and blue outputs, with red varying fastest, then green,
+ * then blue. Inputs are mapped from the domain onto the nodes.
+ */
+typedef struct {
+    float* data; // 3 values per node
+    uint32_t size; // Nodes along each axis
+    float domainMin[3]; // Red, green, blue
+    float domainMax[3];
+} Lut3D;
+
+/* load_cube()
+ * -----------
+ * Parses a .cube file containing a 3D LUT. Comments, titles and unknown
+ * keywords are skipped, while 1D LUTs are rejected.
+ *
+ * lut: Destination for the LUT, freed with free_lut3d().
+ * filePath: Path of the .cube file.
+ *
+ * Returns: 0 on success, -1 if the file cannot be read or is invalid.
+ */
+[[nodiscard]] int load_cube(Lut3D* lut, const char* filePath);
+
+/* bake_lut3d()
+ * ------------
+ * Resamples the LUT onto a grid of the given size, such as 33 or 65 nodes
+ * along each axis, interpolating tetrahedrally between the original nodes.
+ * The domain is unchanged.
+ *
+ * Returns: 0 on success, -1 if memory allocation fails.
+ */
+[[nodiscard]] int bake_lut3d(Lut3D* lut, const uint32_t size);
+
+/* apply_lut3d()
+ * -------------
+ * Maps each pixel of the image through the LUT with tetrahedral
+ * interpolation, from a fixed-point copy of the nodes. Bands of rows are
+ * mapped in parallel, and indexed images only have their palette mapped.
+ *
+ * Returns: 0 on success, -1 if memory allocation fails.
+ */
+[[nodiscard]] int apply_lut3d(Image* image, const Lut3D* lut);
+
+/* free_lut3d()
+ * ------------
+ * Frees the nodes of the LUT.
+ */
+void free_lut3d(Lut3D* lut);
+
+#endif
@@ -0,0 +1,214 @@
+#include <stdlib.h>
+#include <string.h>
+#include "lz.h"
+
+// Matches are at least this long, and are found by hashing this many bytes
+constexpr size_t lzMinMatch = 4;
+
+// Blocks end with literals, and matches may not start too close to the end
+constexpr size_t lzLastLiterals = 5;
+constexpr size_t lzMatchLimit = 12;
+
+// Offsets are stored in 16 bits
+constexpr size_t lzMaxOffset = 65535;
+
+// Lengths of 15 or more are continued in the bytes which follow the token
+constexpr size_t lzRunMask = 15;
+
+// Positions of recently seen sequences, indexed by their hash
+constexpr uint32_t lzHashBits = 13;
+
+// Misses before the step taken through incompressible bytes increases
+constexpr uint32_t lzSkipShift = 6;
+
+static inline uint32_t read_u32(const uint8_t* src)
+{
+    uint32_t value;
+    memcpy(&value, src, sizeof(value));
+    return value;
+}
+
+static inline uint32_t hash_sequence(const uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - lzHashBits);
+}
+
+/* put_length()
+ * ------------
+ * Writes the part of a length which does not fit in its token.
+ */
+static uint8_t* put_length(uint8_t* out, size_t length)
+{
+    while (length >= UINT8_MAX) {
+        *out++ = UINT8_MAX;
+        length -= UINT8_MAX;
+    }
+    *out++ = (uint8_t)length;
+    return out;
+}
+
+/* put_sequence()
+ * --------------
+ * Writes the literals before a match followed by the match, or only the
+ * literals if the length of the match is zero, which ends the block.
+ */
+static uint8_t* put_sequence(uint8_t* out, const uint8_t* literals,
+        const size_t nLiterals, const size_t offset, const size_t length)
+{
+    const size_t matchCode = (length) ? (length - lzMinMatch) : 0;
+    uint8_t* token = out++;
+
+    *token = (uint8_t)((((nLiterals < lzRunMask) ? nLiterals : lzRunMask) << 4)
+            | ((matchCode < lzRunMask) ? matchCode : lzRunMask));
+
+    if (nLiterals >= lzRunMask) {
+        out = put_length(out, nLiterals - lzRunMask);
+    }
+
+    memcpy(out, literals, nLiterals);
+    out += nLiterals;
+
+    if (length) {
+        *out++ = (uint8_t)(offset & UINT8_MAX);
+        *out++ = (uint8_t)(offset >> 8);
+
+        if (matchCode >= lzRunMask) {
+            out = put_length(out, matchCode - lzRunMask);
+        }
+    }
+    return out;
+}
+
+size_t lz_compress(uint8_t* restrict dest, const uint8_t* restrict src,
+        const size_t n)
+{
+    uint8_t* out = dest;
+    const uint8_t* anchor = src; // Start of the literals not yet written
+
+    if (n > lzMatchLimit) {
+        uint32_t positions[1u << lzHashBits] = {0};
+        const uint8_t* const limit = src + n - lzMatchLimit;
+        const uint8_t* const matchEnd = src + n - lzLastLiterals;
+        const uint8_t* ip = src + 1;
+        uint32_t misses = 0;
+
+        while (ip < limit) {
+            const uint32_t sequence = read_u32(ip);
+            const uint32_t hash = hash_sequence(sequence);
+            const uint8_t* ref = src + positions[hash];
+            positions[hash] = (uint32_t)(ip - src);
+
+            if (((size_t)(ip - ref) > lzMaxOffset)
+                    || (read_u32(ref) != sequence)) {
+                ip += 1 + (misses++ >> lzSkipShift);
+                continue;
+            }
+            misses = 0;
+
+            // Extend the match backwards into the literals, then forwards
+            while ((ip > anchor) && (ref > src) && (ip[-1] == ref[-1])) {
+                ip--;
+                ref--;
+            }
+
+            size_t length = lzMinMatch;
+            while ((ip + length < matchEnd) && (ip[length] == ref[length])) {
+                length++;
+            }
+
+            out = put_sequence(out, anchor, (size_t)(ip - anchor),
+                    (size_t)(ip - ref), length);
+            ip += length;
+            anchor = ip;
+        }
+    }
+
+    return (size_t)(put_sequence(out, anchor, (size_t)(src + n - anchor), 0, 0)
+            - dest);
+}
+
+/* get_length()
+ * ------------
+ * Adds the continuation bytes of a length to its value from the token.
+ *
+ * Returns: 0 on success, or -1 if the block ends within the length.
+ */
+static int get_length(const uint8_t* restrict src, const size_t length,
+        size_t* restrict pos, size_t* restrict value)
+{
+    uint8_t byte;
+
+    do {
+        if (*pos >= length) {
+            return -1;
+        }
+        byte = src[(*pos)++];
+        *value += byte;
+    } while (byte == UINT8_MAX);
+
+    return EXIT_SUCCESS;
+}
+
+int lz_decompress(uint8_t* restrict dest, const size_t n,
+        const uint8_t* restrict src, const size_t length)
+{
+    size_t pos = 0;
+    size_t written = 0;
+
+    while (pos < length) {
+        const uint8_t token = src[pos++];
+        size_t nLiterals = token >> 4;
+
+        if ((nLiterals == lzRunMask)
+                && (get_length(src, length, &pos, &nLiterals) == -1)) {
+            return -1;
+        }
+
+        if ((nLiterals > length - pos) || (nLiterals > n - written)) {
+            return -1;
+        }
+
+        memcpy(dest + written, src + pos, nLiterals);
+        pos += nLiterals;
+        written += nLiterals;
+
+        // The last sequence has no match
+        if (pos == length) {
+            break;
+        }
+
+        if (length - pos < 2) {
+            return -1;
+        }
+
+        size_t distance = (size_t)src[pos] | ((size_t)src[pos + 1] << 8);
+        size_t matchLength = (token & lzRunMask);
+        pos += 2;
+
+        if ((matchLength == lzRunMask)
+                && (get_length(src, length, &pos, &matchLength) == -1)) {
+            return -1;
+        }
+        matchLength += lzMinMatch;
+
+        if (!distance || (distance > written)
+                || (matchLength > n - written)) {
+            return -1;
+        }
+
+        // Overlapping matches repeat the bytes before them, so the distance
+        // which can be copied at once doubles with each copy
+        uint8_t* out = dest + written;
+        written += matchLength;
+
+        while (matchLength > distance) {
+            memcpy(out, out - distance, distance);
+            out += distance;
+            matchLength -= distance;
+            distance *= 2;
+        }
+        memcpy(out, out - distance, matchLength);
+    }
+
+    return (written == n) ? EXIT_SUCCESS : -1;
+}
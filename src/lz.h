@@ -0,0 +1,42 @@
+#ifndef LZ_H
+#define LZ_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Upper bound on the size of n bytes once compressed
+#define LZ_BOUND(n) ((n) + ((n) / 255) + 16)
+
+/* lz_compress()
+ * -------------
+ * Compresses a block of bytes in the LZ4 block format: sequences of literals
+ * followed by a match of at least 4 bytes within the previous 64 KiB. Runs of
+ * incompressible bytes are skipped over with an increasing step, so that they
+ * cost little more than a copy.
+ *
+ * dest: Destination of at least LZ_BOUND(n) bytes.
+ * src: The bytes to compress.
+ * n: Number of bytes to compress.
+ *
+ * Returns: The number of bytes written to dest.
+ */
+size_t lz_compress(uint8_t* restrict dest, const uint8_t* restrict src,
+        const size_t n);
+
+/* lz_decompress()
+ * ---------------
+ * Decompresses a block written by lz_compress(), checking every length and
+ * offset against the bounds of both buffers.
+ *
+ * dest: Destination for the decompressed bytes.
+ * n: Expected number of decompressed bytes.
+ * src: The compressed block.
+ * length: Length of the compressed block in bytes.
+ *
+ * Returns: 0 on success, or -1 if the block is corrupt or does not decompress
+ * to exactly n bytes.
+ */
+[[nodiscard]] int lz_decompress(uint8_t* restrict dest, const size_t n,
+        const uint8_t* restrict src, const size_t length);
+
+#endif
@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include "commands.h"
+#include "server.h"
 #include "errors.h"
 
 // Program constant strings
@@ -24,6 +25,12 @@ constexpr char helpMessage[]
           "  -p, --print                 - Render image to terminal (ANSI)\n"
           "  -e, --encode <file>         - Reads contents of <file>, and "
           "embeds into image\n"
+          "  -D, --decode <file>         - Extracts a file embedded with "
+          "--encode into <file>\n"
+          "  -Y, --histogram <format>    - Write R, G, B and luma "
+          "histograms as text or json\n"
+          "  -P, --pipeline <file>       - Run the commands listed in "
+          "<file>\n"
           "\n"
           "Colours & Channels:\n"
           "  -f, --filter <channels>     - Isolate specific channels (e.g. "
@@ -35,6 +42,9 @@ constexpr char helpMessage[]
           "Intensity)\n"
           "  -v, --invert                - Invert image colours\n"
           "  -s, --swap                  - Swap Red and Blue color channels\n"
+          "  -u, --hue-rotate <degrees>  - Rotate hue, preserving luma\n"
+          "  -U, --saturation <factor>   - Scale saturation (0 <-> 16)\n"
+          "  -Q, --lut3d <file.cube>     - Colour grade with a 3D LUT\n"
           "\n"
           "Geometry & Orientation:\n"
           "  -r, --rotate <N>            - Rotate image 90° clockwise N "
@@ -42,6 +52,9 @@ constexpr char helpMessage[]
           "  -t, --transpose             - Transposes the image\n"
           "  -R, --reverse               - Reverse image horizontally\n"
           "  -F, --flip                  - Flip image vertically times\n"
+          "  -K, --crop <x,y,w,h>        - Crop image to a region\n"
+          "  -I, --roi <x,y,w,h>         - Apply following commands to a "
+          "region only\n"
           "\n"
 
           "Brightness & Contrast:\n"
@@ -50,6 +63,12 @@ constexpr char helpMessage[]
           "exceeds cutoff (0-255)\n"
           "  -T, --scale-strict <val>    - Scale colour intensity "
           "(multiplier)\n"
+          "  -l, --lightness <percent>   - Blend towards white, or black if "
+          "negative\n"
+          "  -q, --equalize              - Equalise the histogram of the "
+          "image\n"
+          "  -w, --auto-levels[=<clip%>] - Stretch levels to the full "
+          "range\n"
           "\n"
 
           "Advanced Effects:\n"
@@ -61,6 +80,22 @@ constexpr char helpMessage[]
           "  -S, --scale <val>           - Scale colour intensity (overflow "
           "allowed)\n"
           "  -E, --experimental          - Try out an experimental feature!\n"
+          "  -H, --hugepages             - Back large images with huge "
+          "pages\n"
+          "  -L, --layout <bgr|bgrx>     - Set the in-memory pixel layout\n"
+          "  -k, --cache <dir>[, <MiB>]  - Cache results in a directory\n"
+          "  -A, --on-anomaly <policy>   - Fail, ignore or extract hidden "
+          "data\n"
+          "\n"
+          "Commands other than I/O may be repeated, and run in the order "
+          "given.\n"
+          "\n"
+          "Daemon:\n"
+          "  serve --socket <path> [--threads <N>]\n"
+          "                              - Run jobs received over a Unix "
+          "socket\n"
+          "  submit --socket <path> <options>...\n"
+          "                              - Submit a job to a running daemon\n"
           "\n"
           "See \'signals help <command>\' to read about a specific command.\n";
 
@@ -119,11 +154,19 @@ int main(const int argc, char* argv[])
         return EXIT_SUCCESS;
     }
 
+    if (!(strcmp(argv[1], "serve"))) {
+        return serve(argc, argv);
+    }
+
+    if (!(strcmp(argv[1], "submit"))) {
+        return submit(argc, argv);
+    }
+
     int status = parse_user_commands(argc, argv);
     if (status != EXIT_SUCCESS) {
         exit(status);
     }
 
-    status = handle_commands();
+    status = handle_commands(NULL);
     return status;
 }
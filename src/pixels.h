@@ -10,10 +10,136 @@ typedef struct __attribute__((packed)) {
     uint8_t red;
 } Pixel;
 
+// Pixel padded to 4 bytes, so that kernels operate on aligned 32-bit lanes. The
+// fourth byte holds alpha, which is opaque for images loaded from 24-bit files.
+typedef struct {
+    uint8_t blue;
+    uint8_t green;
+    uint8_t red;
+    uint8_t alpha;
+} PixelX;
+
+// Alpha of an opaque PixelX, when loaded as a 32-bit lane
+#define ALPHA_LANE_MASK 0xFF000000u
+
+// Colours in the palette of an indexed image, as addressed by an 8-bit index
+#define PALETTE_ENTRIES 256
+
+// Bytes each row of a LAYOUT_BGRX image is aligned to, a cache line
+#define ROW_ALIGNMENT 64
+
+// In-memory representation of pixel data. Files are converted at the I/O
+// boundary, with 32-bit files always loaded as LAYOUT_BGRX to retain alpha,
+// and palettised files always loaded as LAYOUT_INDEX8.
+typedef enum {
+    LAYOUT_BGR, // Packed 3 byte Pixel, matching 24-bit BMP pixel data
+    LAYOUT_BGRX, // 4 byte PixelX, matching 32-bit BMP pixel data
+    LAYOUT_INDEX8, // 1 byte index into the palette, matching 8-bit BMP data
+} PixelLayout;
+
 typedef struct {
     size_t width;
     size_t height;
-    Pixel* pixelData;
+    size_t stride; // Pixels between the starts of consecutive rows
+    union {
+        Pixel* pixelData; // LAYOUT_BGR
+        PixelX* pixelDataX; // LAYOUT_BGRX
+        uint8_t* indexData; // LAYOUT_INDEX8
+    };
+    PixelX* palette; // PALETTE_ENTRIES opaque colours, for LAYOUT_INDEX8
+    PixelLayout layout;
+    bool isView; // Pixel data is borrowed from another image (see create_view)
 } Image;
 
+// Rectangle of an image, in pixels
+typedef struct {
+    size_t x;
+    size_t y;
+    size_t width;
+    size_t height;
+} Region;
+
+/* pixel_size()
+ * ------------
+ * Returns: The number of bytes used to store a single pixel in the layout.
+ */
+static inline size_t pixel_size(const PixelLayout layout)
+{
+    if (layout == LAYOUT_INDEX8) {
+        return sizeof(uint8_t);
+    }
+
+    return (layout == LAYOUT_BGRX) ? sizeof(PixelX) : sizeof(Pixel);
+}
+
+/* PIXEL_SIZE_TEMPLATE
+ * -------------------
+ * Macro to run the function with size declared as the constant size of a
+ * pixel in a BGRX or BGR image. Each branch is compiled separately, so that
+ * loops over the bytes of a row are specialised for the size.
+ */
+#define PIXEL_SIZE_TEMPLATE(layout, size, function)                            \
+                                                                               \
+    if ((layout) == LAYOUT_BGRX) {                                             \
+        constexpr size_t size = sizeof(PixelX);                                \
+        function;                                                              \
+    } else {                                                                   \
+        constexpr size_t size = sizeof(Pixel);                                 \
+        function;                                                              \
+    }
+
+/* row_stride()
+ * ------------
+ * Returns: The stride of a new image in the layout. Rows of LAYOUT_BGRX images
+ * are padded to a multiple of ROW_ALIGNMENT bytes, so that each begins on a
+ * cache line and vector loads never split one. Packed layouts are unpadded.
+ */
+static inline size_t row_stride(const size_t width, const PixelLayout layout)
+{
+    if (layout != LAYOUT_BGRX) {
+        return width;
+    }
+
+    constexpr size_t rowPixels = ROW_ALIGNMENT / sizeof(PixelX);
+    return (width + (rowPixels - 1)) & ~(rowPixels - 1);
+}
+
+/* image_row()
+ * -----------
+ * Returns: Pointer to the first pixel of row y, in the layout of the image.
+ */
+static inline void* image_row(const Image* image, const size_t y)
+{
+    return (uint8_t*)(image->pixelData)
+            + (y * image->stride * pixel_size(image->layout));
+}
+
+/* is_contiguous()
+ * ---------------
+ * Returns: true if the rows of the image are stored back to back, allowing the
+ * pixel data to be treated as a single array.
+ */
+static inline bool is_contiguous(const Image* image)
+{
+    return (image->stride == image->width);
+}
+
+/* palette_image()
+ * --------------
+ * Returns: The palette of an indexed image as a single row BGRX image, so that
+ * point operations apply to each colour rather than to each pixel. The palette
+ * remains owned by the indexed image.
+ */
+static inline Image palette_image(const Image* image)
+{
+    return (Image){
+            .width = PALETTE_ENTRIES,
+            .height = 1,
+            .stride = PALETTE_ENTRIES,
+            .pixelDataX = image->palette,
+            .layout = LAYOUT_BGRX,
+            .isView = true,
+    };
+}
+
 #endif
@@ -1,14 +1,523 @@
+#ifdef ENABLE_SDL
+
+#include <stdio.h>
+#include <string.h>
+#include <SDL2/SDL.h>
 #include "renderSDL.h"
+#include "fileParsing.h"
+
+// Default window size
+constexpr int winWidth = 600;
+constexpr int winHeight = 400;
+
+constexpr size_t titleLen = 128;
+constexpr char defaultTitle[] = "SIGNALS";
+
+// Tiles are uploaded on demand into a fixed pool of textures, so images larger
+// than the GPU texture limit can still be displayed.
+constexpr size_t tileSize = 512;
+constexpr size_t maxTiles = 160;
+constexpr size_t maxLevels = 24;
+
+// Zoom limits, the minimum is relative to the zoom which fits the window
+constexpr float zoomStep = 1.25f;
+constexpr float minZoomFit = 0.25f;
+constexpr float maxZoom = 32.0f;
+
+typedef struct {
+    SDL_Texture* texture;
+    size_t level;
+    size_t tx;
+    size_t ty;
+    uint64_t lastUsed;
+    bool valid;
+} Tile;
+
+/* Viewer
+ * ------
+ * levels: Mip pyramid, level 0 is the displayed image (not owned), and each
+ *         subsequent level is half the size of the previous.
+ * width, height: Dimensions of level 0.
+ * zoom: Screen pixels per level 0 pixel.
+ * x, y: Level 0 pixel (top-down) displayed at the top left of the window.
+ */
+typedef struct {
+    SDL_Renderer* renderer;
+    const Image* levels[maxLevels];
+    size_t nLevels;
+    size_t width;
+    size_t height;
+    Tile tiles[maxTiles];
+    uint64_t frame;
+    float zoom;
+    float x;
+    float y;
+} Viewer;
+
+/* display_row()
+ * -------------
+ * Image rows are stored bottom-up, returns a pointer to the start of a row
+ * counted from the top of the image.
+ */
+static inline Pixel* display_row(const Image* image, const size_t row)
+{
+    return image_row(image, image->height - 1 - row);
+}
+
+static inline uint8_t box_u8_4x(
+        const uint8_t a, const uint8_t b, const uint8_t c, const uint8_t d)
+{
+    return (uint8_t)((a + b + c + d + 2) >> 2);
+}
+
+/* downsample_rows()
+ * -----------------
+ * Generates rows of a mip level by averaging 2x2 blocks of the level above.
+ * Edge pixels of odd dimensioned images are repeated. Rows are processed in
+ * parallel.
+ *
+ * src: The larger level.
+ * dest: The level to generate.
+ * first: First row (top-down) of dest to generate.
+ * last: One past the last row (top-down) of dest to generate.
+ */
+static void downsample_rows(const Image* restrict src,
+        const Image* restrict dest, const size_t first, const size_t last)
+{
+    const size_t lastX = src->width - 1;
+    const size_t lastY = src->height - 1;
+
+#pragma omp parallel for schedule(static)
+    for (size_t y = first; y < last; y++) {
+        const size_t y0 = y << 1;
+        const size_t y1 = (y0 + 1 > lastY) ? (lastY) : (y0 + 1);
+
+        const Pixel* restrict top = display_row(src, y0);
+        const Pixel* restrict bottom = display_row(src, y1);
+        Pixel* restrict out = display_row(dest, y);
+
+        for (size_t x = 0; x < dest->width; x++) {
+            const size_t x0 = x << 1;
+            const size_t x1 = (x0 + 1 > lastX) ? (lastX) : (x0 + 1);
+
+            out[x].blue = box_u8_4x(top[x0].blue, top[x1].blue,
+                    bottom[x0].blue, bottom[x1].blue);
+            out[x].green = box_u8_4x(top[x0].green, top[x1].green,
+                    bottom[x0].green, bottom[x1].green);
+            out[x].red = box_u8_4x(top[x0].red, top[x1].red,
+                    bottom[x0].red, bottom[x1].red);
+        }
+    }
+}
+
+static void free_pyramid(Viewer* viewer)
+{
+    for (size_t level = 1; level < viewer->nLevels; level++) {
+        Image* owned = (Image*)(viewer->levels[level]);
+        free_image(&owned);
+    }
+    viewer->nLevels = 0;
+}
+
+static void invalidate_tiles(Viewer* viewer)
+{
+    for (size_t i = 0; i < maxTiles; i++) {
+        (viewer->tiles[i]).valid = false;
+    }
+}
+
+/* build_pyramid()
+ * ---------------
+ * Generates mip levels until the entire image fits within a single tile.
+ *
+ * Returns: 0 on success, -1 if memory allocation fails.
+ */
+static int build_pyramid(Viewer* viewer, const Image* image)
+{
+    free_pyramid(viewer);
+    invalidate_tiles(viewer);
+
+    viewer->levels[0] = image;
+    viewer->nLevels = 1;
+    viewer->width = image->width;
+    viewer->height = image->height;
+
+    while (viewer->nLevels < maxLevels) {
+        const Image* src = viewer->levels[viewer->nLevels - 1];
+        if ((src->width <= tileSize) && (src->height <= tileSize)) {
+            break;
+        }
+
+        Image* dest = create_image((int32_t)((src->width + 1) >> 1),
+                (int32_t)((src->height + 1) >> 1));
+        if (dest == NULL) {
+            free_pyramid(viewer);
+            return -1;
+        }
+
+        downsample_rows(src, dest, 0, dest->height);
+        viewer->levels[viewer->nLevels++] = dest;
+    }
+
+    return 0;
+}
+
+/* update_pyramid()
+ * ----------------
+ * Regenerates only the rows of each mip level affected by a change in the
+ * displayed image, and discards any cached tiles covering those rows.
+ *
+ * Returns: 0 on success, -1 if memory allocation fails.
+ */
+static int update_pyramid(
+        Viewer* viewer, const Image* image, const DirtyRows* dirty)
+{
+    if ((viewer->width != image->width) || (viewer->height != image->height)) {
+        return build_pyramid(viewer, image);
+    }
+
+    viewer->levels[0] = image;
+
+    if (dirty->y0 >= dirty->y1) {
+        return 0;
+    }
+
+    // Convert to rows counted from the top of the image
+    size_t first = image->height - dirty->y1;
+    size_t last = image->height - dirty->y0;
+
+    for (size_t level = 0; level < viewer->nLevels; level++) {
+        if (level) {
+            first >>= 1;
+            last = ((last - 1) >> 1) + 1;
+            downsample_rows(viewer->levels[level - 1], viewer->levels[level],
+                    first, last);
+        }
+
+        for (size_t i = 0; i < maxTiles; i++) {
+            Tile* tile = &(viewer->tiles[i]);
+            const size_t top = tile->ty * tileSize;
+
+            if (tile->valid && (tile->level == level) && (top < last)
+                    && (top + tileSize > first)) {
+                tile->valid = false;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/* upload_tile()
+ * -------------
+ * Copies a tile of a mip level into a streaming texture.
+ *
+ * Returns: 0 on success, -1 if the texture could not be locked.
+ */
+static int upload_tile(SDL_Texture* texture, const Image* level,
+        const size_t tx, const size_t ty)
+{
+    const size_t x0 = tx * tileSize;
+    const size_t y0 = ty * tileSize;
+    const size_t width
+            = (level->width - x0 < tileSize) ? (level->width - x0) : tileSize;
+    const size_t height
+            = (level->height - y0 < tileSize) ? (level->height - y0) : tileSize;
+
+    const SDL_Rect rect = {.x = 0, .y = 0, .w = (int)width, .h = (int)height};
+
+    void* pixels = NULL;
+    int pitch = 0;
+
+    if (SDL_LockTexture(texture, &rect, &pixels, &pitch) < 0) {
+        fprintf(stderr, "Texture could not be locked! SDL_Error: %s\n",
+                SDL_GetError());
+        return -1;
+    }
+
+    uint8_t* dest = pixels;
+    for (size_t y = 0; y < height; y++) {
+        memcpy(dest, display_row(level, y0 + y) + x0, width * sizeof(Pixel));
+        dest += pitch;
+    }
+
+    SDL_UnlockTexture(texture);
+    return 0;
+}
+
+/* fetch_tile()
+ * ------------
+ * Returns the cached tile, or uploads it into an unused slot (or the least
+ * recently used slot if all are in use).
+ *
+ * Returns: Pointer to the tile, or NULL if the tile could not be uploaded.
+ */
+static Tile* fetch_tile(Viewer* viewer, const size_t level, const size_t tx,
+        const size_t ty)
+{
+    Tile* victim = NULL;
+
+    for (size_t i = 0; i < maxTiles; i++) {
+        Tile* tile = &(viewer->tiles[i]);
+
+        if (!(tile->valid)) {
+            if ((victim == NULL) || victim->valid) {
+                victim = tile;
+            }
+            continue;
+        }
+
+        if ((tile->level == level) && (tile->tx == tx) && (tile->ty == ty)) {
+            tile->lastUsed = viewer->frame;
+            return tile;
+        }
+
+        if ((victim == NULL)
+                || (victim->valid && (tile->lastUsed < victim->lastUsed))) {
+            victim = tile;
+        }
+    }
+
+    if (victim->texture == NULL) {
+        victim->texture = SDL_CreateTexture(viewer->renderer,
+                SDL_PIXELFORMAT_BGR24, SDL_TEXTUREACCESS_STREAMING,
+                (int)tileSize, (int)tileSize);
+        if (victim->texture == NULL) {
+            fprintf(stderr, "Texture could not be created! SDL_Error: %s\n",
+                    SDL_GetError());
+            return NULL;
+        }
+    }
+
+    victim->valid = false;
+    if (upload_tile(victim->texture, viewer->levels[level], tx, ty) == -1) {
+        return NULL;
+    }
+
+    victim->level = level;
+    victim->tx = tx;
+    victim->ty = ty;
+    victim->lastUsed = viewer->frame;
+    victim->valid = true;
+    return victim;
+}
 
-int render_image(Image* image)
+/* select_level()
+ * --------------
+ * Picks the smallest mip level which still provides at least one pixel per
+ * screen pixel at the current zoom.
+ */
+static size_t select_level(const Viewer* viewer)
 {
-    // Default window size
-    int winWidth = 600;
-    int winHeight = 400;
+    size_t level = 0;
+    float scale = viewer->zoom;
 
-    const int WIDTH = (int)(image->width);
-    const int HEIGHT = (int)(image->height);
+    while ((level + 1 < viewer->nLevels) && (scale * 2.0f <= 1.0f)) {
+        scale *= 2.0f;
+        level++;
+    }
+
+    return level;
+}
+
+/* draw()
+ * ------
+ * Draws the tiles of the selected mip level which intersect the window,
+ * uploading any tiles which are not already cached.
+ */
+static void draw(Viewer* viewer)
+{
+    int screenW = 0;
+    int screenH = 0;
+    SDL_GetRendererOutputSize(viewer->renderer, &screenW, &screenH);
+
+    SDL_RenderClear(viewer->renderer);
+    viewer->frame++;
+
+    const size_t level = select_level(viewer);
+    const Image* image = viewer->levels[level];
+
+    // Screen pixels per pixel of the selected level
+    const float levelScale = (float)((size_t)1 << level);
+    const float scale = viewer->zoom * levelScale;
+    const float left = viewer->x / levelScale;
+    const float top = viewer->y / levelScale;
+    const float right = left + ((float)screenW / scale);
+    const float bottom = top + ((float)screenH / scale);
+
+    const size_t nTilesX = (image->width + tileSize - 1) / tileSize;
+    const size_t nTilesY = (image->height + tileSize - 1) / tileSize;
+
+    // Range of tiles which intersect the window
+    const size_t tx0 = (left > 0.0f) ? ((size_t)left / tileSize) : 0;
+    const size_t ty0 = (top > 0.0f) ? ((size_t)top / tileSize) : 0;
+    const size_t tx1 = (right > 0.0f) ? (((size_t)right / tileSize) + 1) : 0;
+    const size_t ty1 = (bottom > 0.0f) ? (((size_t)bottom / tileSize) + 1) : 0;
+
+    for (size_t ty = ty0; (ty < ty1) && (ty < nTilesY); ty++) {
+        for (size_t tx = tx0; (tx < tx1) && (tx < nTilesX); tx++) {
+            const Tile* tile = fetch_tile(viewer, level, tx, ty);
+            if (tile == NULL) {
+                continue;
+            }
+
+            const size_t x0 = tx * tileSize;
+            const size_t y0 = ty * tileSize;
+            const size_t x1 = (x0 + tileSize < image->width) ? (x0 + tileSize)
+                                                              : image->width;
+            const size_t y1 = (y0 + tileSize < image->height)
+                    ? (y0 + tileSize)
+                    : image->height;
+
+            // Each edge is rounded independently to avoid seams between tiles
+            const int sx0 = (int)(((float)x0 - left) * scale);
+            const int sy0 = (int)(((float)y0 - top) * scale);
+            const int sx1 = (int)(((float)x1 - left) * scale);
+            const int sy1 = (int)(((float)y1 - top) * scale);
+
+            const SDL_Rect src = {
+                    .x = 0, .y = 0, .w = (int)(x1 - x0), .h = (int)(y1 - y0)};
+            const SDL_Rect dest
+                    = {.x = sx0, .y = sy0, .w = sx1 - sx0, .h = sy1 - sy0};
+
+            SDL_RenderCopy(viewer->renderer, tile->texture, &src, &dest);
+        }
+    }
+
+    SDL_RenderPresent(viewer->renderer);
+}
+
+static float fit_zoom(const Viewer* viewer)
+{
+    int screenW = 0;
+    int screenH = 0;
+    SDL_GetRendererOutputSize(viewer->renderer, &screenW, &screenH);
+
+    const float zoomW = (float)screenW / (float)(viewer->width);
+    const float zoomH = (float)screenH / (float)(viewer->height);
 
+    return (zoomW < zoomH) ? zoomW : zoomH;
+}
+
+/* fit_to_window()
+ * ---------------
+ * Scales the image to fit within the window, centering it.
+ */
+static void fit_to_window(Viewer* viewer)
+{
+    int screenW = 0;
+    int screenH = 0;
+    SDL_GetRendererOutputSize(viewer->renderer, &screenW, &screenH);
+
+    viewer->zoom = fit_zoom(viewer);
+    viewer->x = ((float)(viewer->width) - ((float)screenW / viewer->zoom)) / 2;
+    viewer->y = ((float)(viewer->height) - ((float)screenH / viewer->zoom)) / 2;
+}
+
+/* zoom_about()
+ * ------------
+ * Zooms in or out, keeping the image pixel under the screen point fixed.
+ */
+static void zoom_about(
+        Viewer* viewer, const float factor, const int sx, const int sy)
+{
+    const float minZoom = fit_zoom(viewer) * minZoomFit;
+    float zoom = viewer->zoom * factor;
+
+    zoom = (zoom > maxZoom) ? maxZoom : zoom;
+    zoom = (zoom < minZoom) ? minZoom : zoom;
+
+    viewer->x += ((float)sx / viewer->zoom) - ((float)sx / zoom);
+    viewer->y += ((float)sy / viewer->zoom) - ((float)sy / zoom);
+    viewer->zoom = zoom;
+}
+
+static void update_title(SDL_Window* window, const PreviewHooks* hooks)
+{
+    if ((hooks == NULL) || (hooks->title == NULL)) {
+        SDL_SetWindowTitle(window, defaultTitle);
+        return;
+    }
+
+    char title[titleLen];
+    hooks->title(hooks->ctx, title, sizeof(title));
+    SDL_SetWindowTitle(window, title);
+}
+
+/* key_to_action()
+ * ---------------
+ * Maps a key press to a preview action.
+ *
+ * Returns: true if the key is bound to an action, false otherwise.
+ */
+static bool key_to_action(const SDL_Keycode key, PreviewAction* action)
+{
+    switch (key) {
+    case SDLK_TAB:
+    case SDLK_RIGHT:
+        *action = PREVIEW_NEXT_STAGE;
+        return true;
+
+    case SDLK_LEFT:
+        *action = PREVIEW_PREV_STAGE;
+        return true;
+
+    case SDLK_UP:
+        *action = PREVIEW_INCREASE;
+        return true;
+
+    case SDLK_DOWN:
+        *action = PREVIEW_DECREASE;
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+/* handle_key()
+ * ------------
+ * Handles key presses, forwarding preview actions to the hooks.
+ *
+ * Returns: true if the window needs to be redrawn.
+ */
+static bool handle_key(
+        Viewer* viewer, const SDL_Keycode key, const PreviewHooks* hooks)
+{
+    if (key == SDLK_f) {
+        fit_to_window(viewer);
+        return true;
+    }
+
+    PreviewAction action;
+    if ((hooks == NULL) || (hooks->update == NULL)
+            || !key_to_action(key, &action)) {
+        return false;
+    }
+
+    DirtyRows dirty = {0};
+    if (!(hooks->update(hooks->ctx, action, &dirty))) {
+        return false;
+    }
+
+    const Image* updated = hooks->image(hooks->ctx);
+    const bool resized = (updated->width != viewer->width)
+            || (updated->height != viewer->height);
+
+    if (update_pyramid(viewer, updated, &dirty) == -1) {
+        fprintf(stderr, "Preview could not be updated (out of memory)\n");
+        return false;
+    }
+
+    if (resized) {
+        fit_to_window(viewer);
+    }
+
+    return true;
+}
+
+static int run_viewer(const Image* image, const PreviewHooks* hooks)
+{
     // Initialize SDL
     if (SDL_Init(SDL_INIT_VIDEO) < 0) {
         printf("SDL could not initialize! SDL_Error: %s\n", SDL_GetError());
@@ -16,62 +525,126 @@ int render_image(Image* image)
     }
 
     // Create a window
-    SDL_Window* window = SDL_CreateWindow("SIGNALS", SDL_WINDOWPOS_UNDEFINED,
-            SDL_WINDOWPOS_UNDEFINED, winWidth, winHeight,
-            SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
+    SDL_Window* window = SDL_CreateWindow(defaultTitle,
+            SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, winWidth,
+            winHeight, SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
 
     if (!window) {
         printf("Window could not be created! SDL_Error: %s\n", SDL_GetError());
+        SDL_Quit();
         return -1;
     }
 
-    SDL_Renderer* renderer
-            = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+    Viewer viewer;
+    memset(&viewer, 0, sizeof(viewer));
 
-    // Auto scales image to aspect ratio of image
-    SDL_RenderSetLogicalSize(renderer, WIDTH, HEIGHT);
+    viewer.renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
 
-    // Create a texture
-    SDL_Texture* texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_BGR24,
-            SDL_TEXTUREACCESS_STATIC, WIDTH, HEIGHT);
+    int result = 0;
+    if ((viewer.renderer == NULL) || (build_pyramid(&viewer, image) == -1)) {
+        fprintf(stderr, "Viewer could not be created.\n");
+        result = -1;
+        goto cleanup;
+    }
 
-    // Upload pixels to the GPU
-    SDL_UpdateTexture(texture, NULL, image->pixelData, WIDTH * 3);
+    fit_to_window(&viewer);
+    update_title(window, hooks);
 
-    // Run the main event loop
-    int running = 1;
+    // Run the main event loop, blocking until an event requires a redraw
+    bool running = true;
+    bool redraw = true;
     SDL_Event event;
+
     while (running) {
+        if (redraw) {
+            draw(&viewer);
+            redraw = false;
+        }
+
+        if (!SDL_WaitEvent(&event)) {
+            break;
+        }
 
-        // Handle events
-        while (SDL_PollEvent(&event)) {
-            if (event.type == SDL_QUIT) {
-                running = 0;
+        do {
+            switch (event.type) {
+            case SDL_QUIT:
+                running = false;
+                break;
+
+            case SDL_WINDOWEVENT:
+                redraw = true;
+                break;
+
+            case SDL_MOUSEWHEEL: {
+                int mouseX = 0;
+                int mouseY = 0;
+                SDL_GetMouseState(&mouseX, &mouseY);
+
+                const float factor
+                        = (event.wheel.y > 0) ? zoomStep : (1.0f / zoomStep);
+                zoom_about(&viewer, factor, mouseX, mouseY);
+                redraw = true;
+                break;
             }
 
-            // Close the window if user presses ESC
-            if (event.type == SDL_KEYDOWN) {
+            case SDL_MOUSEMOTION:
+                // Pan while the left mouse button is held
+                if (event.motion.state & SDL_BUTTON_LMASK) {
+                    viewer.x -= (float)(event.motion.xrel) / viewer.zoom;
+                    viewer.y -= (float)(event.motion.yrel) / viewer.zoom;
+                    redraw = true;
+                }
+                break;
+
+            case SDL_KEYDOWN:
+                // Close the window if user presses ESC
                 if (event.key.keysym.sym == SDLK_ESCAPE) {
-                    running = 0;
+                    running = false;
+                    break;
                 }
-            }
-        }
 
-        // Clear screen
-        SDL_RenderClear(renderer);
+                if (handle_key(&viewer, event.key.keysym.sym, hooks)) {
+                    redraw = true;
+                }
+                update_title(window, hooks);
+                break;
 
-        // Copy texture to renderer
-        SDL_RenderCopy(renderer, texture, NULL, NULL);
+            default:
+                break;
+            }
+        } while (SDL_PollEvent(&event));
+    }
 
-        // Show result
-        SDL_RenderPresent(renderer);
+cleanup:
+    for (size_t i = 0; i < maxTiles; i++) {
+        if ((viewer.tiles[i]).texture) {
+            SDL_DestroyTexture((viewer.tiles[i]).texture);
+        }
     }
+    free_pyramid(&viewer);
 
-    // Cleanup
-    SDL_DestroyTexture(texture);
-    SDL_DestroyRenderer(renderer);
+    if (viewer.renderer) {
+        SDL_DestroyRenderer(viewer.renderer);
+    }
     SDL_DestroyWindow(window);
     SDL_Quit();
 
-    return 0;
+    return result;
+}
+
+int render_image(const Image* image)
+{
+    return run_viewer(image, NULL);
 }
+
+int preview_image(const PreviewHooks* hooks)
+{
+    return run_viewer(hooks->image(hooks->ctx), hooks);
+}
+
+#else
+
+// Prevents an empty translation unit when SDL is not enabled
+typedef int make_compiler_happy;
+
+#endif
@@ -1,9 +1,72 @@
 #ifndef RENDER_SDL_H
 #define RENDER_SDL_H
 
-#include <SDL2/SDL.h>
+#include <stddef.h>
 #include "pixels.h"
 
-int render_image(Image* image);
+// Parameter changes requested by the user from within the preview window
+typedef enum {
+    PREVIEW_NEXT_STAGE,
+    PREVIEW_PREV_STAGE,
+    PREVIEW_INCREASE,
+    PREVIEW_DECREASE,
+} PreviewAction;
+
+// Range of image rows [y0, y1) which differ from the last displayed frame
+typedef struct {
+    size_t y0;
+    size_t y1;
+} DirtyRows;
+
+/* PreviewHooks
+ * ------------
+ * Callbacks used by the preview window to re-run a pipeline.
+ *
+ * ctx: Opaque pointer passed to each callback.
+ * update: Applies an action, returning true if the displayed image changed.
+ *         The rows which changed are stored in the DirtyRows struct.
+ * image: Returns the image to display.
+ * title: Writes a description of the selected stage into the buffer.
+ */
+typedef struct {
+    void* ctx;
+    bool (*update)(void* ctx, const PreviewAction action, DirtyRows* dirty);
+    const Image* (*image)(void* ctx);
+    void (*title)(void* ctx, char* buffer, const size_t len);
+} PreviewHooks;
+
+/* render_image()
+ * --------------
+ * Displays a static image in an SDL window until it is closed. The image is
+ * displayed as tiles drawn from a mip pyramid, so images larger than the GPU
+ * texture limit can be inspected at full resolution.
+ *
+ *   Mouse wheel - Zoom about the cursor
+ *   Left drag   - Pan
+ *   F           - Fit the image to the window
+ *
+ * image: The image to display (rows stored bottom-up, as read from file).
+ *
+ * Returns: 0 on success, -1 if SDL could not be initialised.
+ */
+int render_image(const Image* image);
+
+/* preview_image()
+ * ---------------
+ * Opens an interactive SDL window which blocks on events rather than
+ * continuously redrawing. Key presses are forwarded to the hooks, and only the
+ * rows reported as dirty are regenerated in the mip pyramid and re-uploaded.
+ * Supports the same zoom and pan controls as render_image().
+ *
+ *   Tab/Right - Select next tunable stage
+ *   Left      - Select previous tunable stage
+ *   Up/Down   - Increase/decrease the selected stage parameter
+ *   Escape    - Close the window
+ *
+ * hooks: Callbacks used to update and fetch the displayed image.
+ *
+ * Returns: 0 on success, -1 if SDL could not be initialised.
+ */
+int preview_image(const PreviewHooks* hooks);
 
 #endif
@@ -0,0 +1,260 @@
+#include <stdlib.h>
+#include <string.h>
+#include "rle.h"
+
+// Escapes following a zero count
+constexpr uint8_t rleEndOfLine = 0;
+constexpr uint8_t rleEndOfBitmap = 1;
+constexpr uint8_t rleDelta = 2;
+
+constexpr size_t rleMaxRun = RLE_MAX_RUN;
+
+// Absolute runs shorter than this are encoded as runs of a single index
+constexpr size_t rleMinAbsolute = 3;
+
+/* RleCursor
+ * ---------
+ * Position of the decoder within the file, along with the window of the file
+ * which is kept in the image.
+ */
+typedef struct {
+    Image* image;
+    size_t x;
+    size_t y;
+    size_t left;
+    size_t top;
+} RleCursor;
+
+/* clip_run()
+ * ----------
+ * Finds the part of a run of n pixels at the cursor which lies within the
+ * image.
+ *
+ * Returns: Pointer to the first index of the run within the image, or NULL if
+ * none of it is. first and count are set to the offset within the run and the
+ * number of pixels kept.
+ */
+static uint8_t* clip_run(const RleCursor* cursor, const size_t n,
+        size_t* first, size_t* count)
+{
+    const Image* image = cursor->image;
+
+    if ((cursor->y < cursor->top)
+            || (cursor->y - cursor->top >= image->height)) {
+        return NULL;
+    }
+
+    const size_t start = (cursor->x < cursor->left) ? cursor->left : cursor->x;
+    const size_t end = ((cursor->x + n) < (cursor->left + image->width))
+            ? (cursor->x + n)
+            : (cursor->left + image->width);
+
+    if (start >= end) {
+        return NULL;
+    }
+
+    *first = start - cursor->x;
+    *count = end - start;
+    return (uint8_t*)image_row(image, cursor->y - cursor->top)
+            + (start - cursor->left);
+}
+
+/* put_encoded_run()
+ * -----------------
+ * Writes a run of n repeated pixels. RLE4 runs alternate between the high and
+ * low nibbles of the value.
+ */
+static void put_encoded_run(const RleCursor* cursor, const size_t n,
+        const uint8_t value, const bool rle4)
+{
+    size_t first;
+    size_t count;
+    uint8_t* dest = clip_run(cursor, n, &first, &count);
+
+    if (dest == NULL) {
+        return;
+    }
+
+    if (!rle4) {
+        memset(dest, value, count);
+        return;
+    }
+
+    const uint8_t pair[2] = {(uint8_t)(value >> 4), (uint8_t)(value & 0x0F)};
+    for (size_t i = 0; i < count; i++) {
+        dest[i] = pair[(first + i) & 1];
+    }
+}
+
+/* put_absolute_run()
+ * ------------------
+ * Writes a run of n pixels given individually, as bytes or packed nibbles.
+ */
+static void put_absolute_run(const RleCursor* cursor, const size_t n,
+        const uint8_t* restrict src, const bool rle4)
+{
+    size_t first;
+    size_t count;
+    uint8_t* dest = clip_run(cursor, n, &first, &count);
+
+    if (dest == NULL) {
+        return;
+    }
+
+    if (!rle4) {
+        memcpy(dest, src + first, count);
+        return;
+    }
+
+    for (size_t i = first; i < first + count; i++) {
+        dest[i - first] = (uint8_t)((src[i >> 1] >> ((i & 1) ? 0 : 4)) & 0x0F);
+    }
+}
+
+int decode_rle(const uint8_t* restrict data, const size_t length,
+        const uint32_t compression, Image* restrict image, const size_t left,
+        const size_t top)
+{
+    const bool rle4 = (compression == BI_RLE4);
+    RleCursor cursor = {.image = image, .left = left, .top = top};
+
+    // Pixels which are never written default to the first colour
+    for (size_t y = 0; y < image->height; y++) {
+        memset(image_row(image, y), 0, image->width);
+    }
+
+    size_t pos = 0;
+
+    // Decoding stops once the rows kept have been passed
+    while ((pos + 1 < length) && (cursor.y < top + image->height)) {
+        const uint8_t count = data[pos];
+        const uint8_t value = data[pos + 1];
+        pos += 2;
+
+        if (count) {
+            put_encoded_run(&cursor, count, value, rle4);
+            cursor.x += count;
+            continue;
+        }
+
+        if (value == rleEndOfLine) {
+            cursor.x = 0;
+            cursor.y++;
+
+        } else if (value == rleEndOfBitmap) {
+            return EXIT_SUCCESS;
+
+        } else if (value == rleDelta) {
+            if (pos + 1 >= length) {
+                return -1;
+            }
+
+            cursor.x += data[pos];
+            cursor.y += data[pos + 1];
+            pos += 2;
+
+        } else {
+            // Absolute runs are padded to a 16-bit boundary
+            const size_t bytes = (rle4) ? ((value + 1u) >> 1) : value;
+
+            if (pos + bytes > length) {
+                return -1;
+            }
+
+            put_absolute_run(&cursor, value, data + pos, rle4);
+            cursor.x += value;
+            pos += bytes + (bytes & 1);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+size_t encode_rle8_row(uint8_t* restrict dest, const uint8_t* restrict row,
+        const size_t width, const bool last)
+{
+    uint8_t* out = dest;
+    size_t x = 0;
+
+    while (x < width) {
+        size_t run = 1;
+        while ((x + run < width) && (run < rleMaxRun)
+                && (row[x + run] == row[x])) {
+            run++;
+        }
+
+        if (run > 1) {
+            *out++ = (uint8_t)run;
+            *out++ = row[x];
+            x += run;
+            continue;
+        }
+
+        // Gather indices up to the start of the next run worth encoding
+        size_t n = 1;
+        while ((x + n < width) && (n < rleMaxRun)
+                && !((x + n + 2 < width) && (row[x + n] == row[x + n + 1])
+                        && (row[x + n] == row[x + n + 2]))) {
+            n++;
+        }
+
+        if (n < rleMinAbsolute) {
+            for (size_t i = 0; i < n; i++) {
+                *out++ = 1;
+                *out++ = row[x + i];
+            }
+        } else {
+            *out++ = 0;
+            *out++ = (uint8_t)n;
+            memcpy(out, row + x, n);
+            out += n;
+
+            if (n & 1) {
+                *out++ = 0;
+            }
+        }
+        x += n;
+    }
+
+    *out++ = 0;
+    *out++ = (last) ? rleEndOfBitmap : rleEndOfLine;
+    return (size_t)(out - dest);
+}
+
+int encode_rle8_image(
+        EncodedRows* restrict encoded, const Image* restrict image)
+{
+    *encoded = (EncodedRows){
+            .data = malloc(RLE8_ROW_BOUND(image->width) * image->height),
+            .stride = RLE8_ROW_BOUND(image->width),
+            .lengths = malloc(image->height * sizeof(size_t)),
+    };
+
+    if ((encoded->data == NULL) || (encoded->lengths == NULL)) {
+        free_encoded_rows(encoded);
+        return -1;
+    }
+
+    const size_t last = image->height - 1;
+    size_t size = 0;
+
+#pragma omp parallel for schedule(static) reduction(+ : size)
+    for (size_t y = 0; y < image->height; y++) {
+        const size_t length
+                = encode_rle8_row(encoded->data + (y * encoded->stride),
+                        image_row(image, y), image->width, (y == last));
+
+        (encoded->lengths)[y] = length;
+        size += length;
+    }
+
+    encoded->size = size;
+    return EXIT_SUCCESS;
+}
+
+void free_encoded_rows(EncodedRows* encoded)
+{
+    free(encoded->data);
+    free(encoded->lengths);
+    *encoded = (EncodedRows){0};
+}
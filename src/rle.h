@@ -0,0 +1,85 @@
+#ifndef RLE_H
+#define RLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "pixels.h"
+
+// BMP compression modes using run length encoding of palette indices
+#define BI_RLE8 1
+#define BI_RLE4 2
+
+// Pixels decoded by a single code at most, as runs have an 8-bit count
+#define RLE_MAX_RUN 255
+
+// Upper bound on the size of a row of n indices once encoded as RLE8
+#define RLE8_ROW_BOUND(n) ((2 * (n)) + 2)
+
+/* decode_rle()
+ * ------------
+ * Decodes RLE8 or RLE4 compressed pixel data into an indexed image. Pixels
+ * skipped by the encoding (with deltas or early ends of line) are set to index
+ * zero, and runs extending past the edge of a row are clipped.
+ *
+ * data: The compressed pixel data.
+ * length: Length of the compressed data in bytes.
+ * compression: BI_RLE8 or BI_RLE4.
+ * image: LAYOUT_INDEX8 image to decode into.
+ * left: Column of the file at which the image begins.
+ * top: Row of the file (counted from the first row stored) at which the image
+ * begins. Rows before and after the image are decoded but discarded.
+ *
+ * Returns: 0 on success, or -1 if the data ends within a run.
+ */
+[[nodiscard]] int decode_rle(const uint8_t* restrict data, const size_t length,
+        const uint32_t compression, Image* restrict image, const size_t left,
+        const size_t top);
+
+/* EncodedRows
+ * -----------
+ * Rows of an image encoded as RLE8, each at a fixed stride so that they can be
+ * encoded in parallel, then written with a single batch of vectors.
+ */
+typedef struct {
+    uint8_t* data;
+    size_t stride; // Bytes between the starts of consecutive rows
+    size_t* lengths; // Encoded length of each row
+    size_t size; // Total encoded length
+} EncodedRows;
+
+/* encode_rle8_row()
+ * -----------------
+ * Encodes a row of palette indices as RLE8, using encoded runs for repeated
+ * indices and absolute runs for the indices between them.
+ *
+ * dest: Destination of at least RLE8_ROW_BOUND(width) bytes.
+ * row: The indices to encode.
+ * width: Number of indices in the row.
+ * last: Whether the row is the last of the image, which ends the bitmap
+ * rather than the line.
+ *
+ * Returns: The number of bytes written to dest.
+ */
+size_t encode_rle8_row(uint8_t* restrict dest, const uint8_t* restrict row,
+        const size_t width, const bool last);
+
+/* encode_rle8_image()
+ * -------------------
+ * Encodes every row of an indexed image as RLE8 in parallel.
+ *
+ * encoded: Destination for the encoded rows, which must later be freed with
+ * free_encoded_rows().
+ * image: LAYOUT_INDEX8 image to encode.
+ *
+ * Returns: 0 on success, or -1 if memory allocation fails.
+ */
+[[nodiscard]] int encode_rle8_image(
+        EncodedRows* restrict encoded, const Image* restrict image);
+
+/* free_encoded_rows()
+ * -------------------
+ * Frees the rows encoded by encode_rle8_image(), if any.
+ */
+void free_encoded_rows(EncodedRows* encoded);
+
+#endif
@@ -0,0 +1,535 @@
+// lstat() and S_ISSOCK() are not declared in strict C23 mode
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <limits.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include "server.h"
+#include "commands.h"
+#include "imagePool.h"
+#include "utils.h"
+#include "errors.h"
+
+constexpr char serveUsageMessage[]
+        = "Usage: signals serve --socket <path> [--threads <N>]\n";
+constexpr char submitUsageMessage[]
+        = "Usage: signals submit --socket <path> <options>...\n";
+constexpr char socketPathMessage[]
+        = "signals: socket path \'%s\' is too long.\n";
+constexpr char responseFormat[]
+        = "status=%d load_ms=%.3f process_ms=%.3f write_ms=%.3f "
+          "total_ms=%.3f\n";
+
+constexpr char socketFlag[] = "--socket";
+constexpr char threadsFlag[] = "--threads";
+
+constexpr size_t maxRequestLen = 65536;
+constexpr size_t maxJobArgs = 256;
+constexpr size_t maxResponseLen = 256;
+constexpr long maxThreads = 256;
+constexpr int listenBacklog = 128;
+constexpr time_t requestTimeout = 10; // Seconds to receive a whole request
+
+// Accepted connections waiting for a worker
+typedef struct Job {
+    int client;
+    struct Job* next;
+} Job;
+
+static Job* queueHead = NULL;
+static Job* queueTail = NULL;
+static pthread_mutex_t queueLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queueReady = PTHREAD_COND_INITIALIZER;
+
+// getopt_long() uses global state, so parsing is serialised between workers
+static pthread_mutex_t parseLock = PTHREAD_MUTEX_INITIALIZER;
+
+static volatile sig_atomic_t stopServer = 0;
+
+static void handle_stop_signal(const int signal)
+{
+    (void)signal;
+    stopServer = 1;
+}
+
+static void enqueue_job(Job* job)
+{
+    pthread_mutex_lock(&queueLock);
+
+    job->next = NULL;
+    if (queueTail) {
+        queueTail->next = job;
+    } else {
+        queueHead = job;
+    }
+    queueTail = job;
+
+    pthread_cond_signal(&queueReady);
+    pthread_mutex_unlock(&queueLock);
+}
+
+static Job* dequeue_job(void)
+{
+    pthread_mutex_lock(&queueLock);
+
+    while (queueHead == NULL) {
+        pthread_cond_wait(&queueReady, &queueLock);
+    }
+
+    Job* job = queueHead;
+    queueHead = job->next;
+    if (queueHead == NULL) {
+        queueTail = NULL;
+    }
+
+    pthread_mutex_unlock(&queueLock);
+    return job;
+}
+
+/* write_all()
+ * -----------
+ * Writes the entire buffer to a file descriptor, retrying partial writes.
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+static int write_all(const int fd, const char* buffer, size_t len)
+{
+    while (len) {
+        const ssize_t written = write(fd, buffer, len);
+
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+
+        buffer += written;
+        len -= (size_t)written;
+    }
+
+    return 0;
+}
+
+static double ms_since(const struct timespec* start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((double)(now.tv_sec - start->tv_sec) * 1e3)
+            + ((double)(now.tv_nsec - start->tv_nsec) / 1e6);
+}
+
+/* read_all()
+ * ----------
+ * Reads exactly len bytes from the client, which must arrive within
+ * requestTimeout seconds of the start time. Reads on the client socket time
+ * out, so that a stalled client cannot block the worker past the deadline.
+ *
+ * Returns: 0 on success, -1 on error, timeout or if the client disconnects.
+ */
+static int read_all(const int client, void* buffer, size_t len,
+        const struct timespec* start)
+{
+    char* bytes = buffer;
+
+    while (len) {
+        if (ms_since(start) > (double)requestTimeout * 1e3) {
+            return -1;
+        }
+
+        const ssize_t nRead = read(client, bytes, len);
+
+        if (nRead < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+
+        if (nRead == 0) {
+            return -1;
+        }
+
+        bytes += nRead;
+        len -= (size_t)nRead;
+    }
+
+    return 0;
+}
+
+/* read_request()
+ * --------------
+ * Reads a request into the buffer. Requests start with the length of their
+ * arguments as a uint32_t, followed by the arguments themselves.
+ *
+ * Returns: The length of the arguments, or -1 if the request is too long,
+ * incomplete or timed out.
+ */
+static ssize_t read_request(
+        const int client, char* buffer, const struct timespec* start)
+{
+    const struct timeval timeout = {.tv_sec = requestTimeout};
+    if (setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout))
+            < 0) {
+        return -1;
+    }
+
+    uint32_t len;
+    if ((read_all(client, &len, sizeof(len), start) == -1)
+            || (len > maxRequestLen)
+            || (read_all(client, buffer, len, start) == -1)) {
+        return -1;
+    }
+
+    return (ssize_t)len;
+}
+
+/* split_request()
+ * ---------------
+ * Splits a request into an argument vector, with "signals" as argv[0]. Every
+ * argument is NUL terminated, including empty arguments.
+ *
+ * Returns: The number of arguments, or -1 if there are too many or the last
+ * argument is not terminated.
+ */
+static int split_request(char* request, const size_t len, char** argv)
+{
+    static char programName[] = "signals";
+
+    if ((len > 0) && (request[len - 1] != '\0')) {
+        return -1;
+    }
+
+    int argc = 0;
+    argv[argc++] = programName;
+
+    size_t i = 0;
+    while (i < len) {
+        if ((size_t)argc >= maxJobArgs - 1) {
+            return -1;
+        }
+
+        argv[argc++] = &(request[i]);
+        i += strlen(&(request[i])) + 1;
+    }
+
+    argv[argc] = NULL;
+    return argc;
+}
+
+static int run_job(const int argc, char** argv, Timings* timings)
+{
+    // Empty arguments are framed unambiguously, but rejected as they are on
+    // the command line
+    for (int i = 1; i < argc; i++) {
+        if (*(argv[i]) == '\0') {
+            return EXIT_EMPTY_ARG;
+        }
+    }
+
+    pthread_mutex_lock(&parseLock);
+    optind = 0; // Forces getopt to reinitialise
+    int result = parse_user_commands(argc, argv);
+    pthread_mutex_unlock(&parseLock);
+
+    if (result == EXIT_SUCCESS) {
+        result = verify_daemon_job();
+    }
+
+    if (result != EXIT_SUCCESS) {
+        return result;
+    }
+
+    return handle_commands(timings);
+}
+
+static void handle_client(const int client, char* request, char** argv)
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    Timings timings = {0};
+    int result = EXIT_INVALID_ARG;
+
+    const ssize_t len = read_request(client, request, &start);
+    const int argc
+            = (len >= 0) ? split_request(request, (size_t)len, argv) : -1;
+
+    if (argc > 1) {
+        result = run_job(argc, argv, &timings);
+    } else if (argc == 1) {
+        result = EXIT_NO_ARGUMENTS;
+    }
+
+    char response[maxResponseLen];
+    const int responseLen = snprintf(response, sizeof(response),
+            responseFormat, result, timings.loadMs, timings.processMs,
+            timings.writeMs, ms_since(&start));
+
+    if (responseLen > 0) {
+        (void)write_all(client, response, (size_t)responseLen);
+    }
+}
+
+static void* worker(void* arg)
+{
+    (void)arg;
+
+    char* request = malloc(maxRequestLen);
+    char** argv = malloc(maxJobArgs * sizeof(char*));
+
+    if ((request == NULL) || (argv == NULL)) {
+        perror("malloc failed while starting worker");
+        free(request);
+        free(argv);
+        return NULL;
+    }
+
+    // Retain pixel buffers between jobs
+    ImagePool pool = {0};
+    bind_image_pool(&pool);
+
+    while (1) {
+        Job* job = dequeue_job();
+        handle_client(job->client, request, argv);
+        close(job->client);
+        free(job);
+    }
+
+    return NULL;
+}
+
+/* parse_socket_path()
+ * -------------------
+ * Stores the socket path in the address, provided argv[2] is "--socket".
+ *
+ * Returns: 0 on success, -1 if the path is missing or too long.
+ */
+static int parse_socket_path(
+        const int argc, char** argv, struct sockaddr_un* address)
+{
+    if ((argc < 4) || strcmp(argv[2], socketFlag)) {
+        return -1;
+    }
+
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+
+    if (strlen(argv[3]) >= sizeof(address->sun_path)) {
+        fprintf(stderr, socketPathMessage, argv[3]);
+        return -1;
+    }
+
+    strcpy(address->sun_path, argv[3]);
+    return 0;
+}
+
+/* open_listener()
+ * ---------------
+ * Binds and listens on the socket path. A stale socket left by a previous
+ * daemon is removed, but any other existing file is left untouched.
+ *
+ * Returns: The listening socket, or -1 on error.
+ */
+static int open_listener(const struct sockaddr_un* address)
+{
+    struct stat info;
+    if ((lstat(address->sun_path, &info) == 0) && S_ISSOCK(info.st_mode)) {
+        unlink(address->sun_path);
+    }
+
+    const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    if (bind(listener, (const struct sockaddr*)address, sizeof(*address))
+            < 0) {
+        perror("bind");
+        close(listener);
+        return -1;
+    }
+
+    if (listen(listener, listenBacklog) < 0) {
+        perror("listen");
+        close(listener);
+        unlink(address->sun_path);
+        return -1;
+    }
+
+    return listener;
+}
+
+int serve(const int argc, char** argv)
+{
+    struct sockaddr_un address;
+    long nThreads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (parse_socket_path(argc, argv, &address) == -1) {
+        fputs(serveUsageMessage, stderr);
+        return EXIT_INVALID_ARG;
+    }
+
+    if (argc == 6 && !strcmp(argv[4], threadsFlag)) {
+        if (!(vlongB(&nThreads, argv[5], 1, maxThreads, long))) {
+            fprintf(stderr, invalidVal, argv[5]);
+            fputs(serveUsageMessage, stderr);
+            return EXIT_INVALID_PARAMETER;
+        }
+    } else if (argc != 4) {
+        fputs(serveUsageMessage, stderr);
+        return EXIT_TOO_MANY_ARGS;
+    }
+
+    nThreads = (nThreads < 1) ? 1 : nThreads;
+
+    // Clients may disconnect before reading their response
+    signal(SIGPIPE, SIG_IGN);
+
+    // Interrupt accept() rather than restarting it, so the socket is removed
+    struct sigaction stop;
+    memset(&stop, 0, sizeof(stop));
+    stop.sa_handler = handle_stop_signal;
+    sigaction(SIGINT, &stop, NULL);
+    sigaction(SIGTERM, &stop, NULL);
+
+    const int listener = open_listener(&address);
+    if (listener < 0) {
+        return EXIT_SOCKET_ERROR;
+    }
+
+    // Workers inherit the signal mask, so the stop signals are blocked while
+    // they are created. Only the main thread then receives them, interrupting
+    // accept().
+    sigset_t stopSignals;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stopSignals, NULL);
+
+    for (long i = 0; i < nThreads; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, worker, NULL) != 0) {
+            perror("pthread_create");
+            close(listener);
+            unlink(address.sun_path);
+            return EXIT_SOCKET_ERROR;
+        }
+        pthread_detach(thread);
+    }
+
+    pthread_sigmask(SIG_UNBLOCK, &stopSignals, NULL);
+
+    fprintf(stderr, "signals: serving on \'%s\' with %ld threads\n",
+            address.sun_path, nThreads);
+
+    while (!stopServer) {
+        const int client = accept(listener, NULL, NULL);
+
+        if (client < 0) {
+            if (errno != EINTR) {
+                perror("accept");
+            }
+            continue;
+        }
+
+        Job* job = malloc(sizeof(Job));
+        if (job == NULL) {
+            close(client);
+            continue;
+        }
+
+        job->client = client;
+        enqueue_job(job);
+    }
+
+    close(listener);
+    unlink(address.sun_path);
+    return EXIT_SUCCESS;
+}
+
+int submit(const int argc, char** argv)
+{
+    struct sockaddr_un address;
+
+    if ((parse_socket_path(argc, argv, &address) == -1) || (argc < 5)) {
+        fputs(submitUsageMessage, stderr);
+        return EXIT_INVALID_ARG;
+    }
+
+    // Serialise the job arguments as NUL terminated strings, after their
+    // total length
+    char* request = malloc(sizeof(uint32_t) + maxRequestLen);
+    if (request == NULL) {
+        perror("malloc failed while submitting");
+        return EXIT_SOCKET_ERROR;
+    }
+
+    size_t len = sizeof(uint32_t);
+    for (int i = 4; i < argc; i++) {
+        const size_t argLen = strlen(argv[i]) + 1;
+
+        if (len + argLen > sizeof(uint32_t) + maxRequestLen) {
+            fputs("signals: job arguments are too long.\n", stderr);
+            free(request);
+            return EXIT_TOO_MANY_ARGS;
+        }
+
+        memcpy(request + len, argv[i], argLen);
+        len += argLen;
+    }
+
+    const uint32_t argsLen = (uint32_t)(len - sizeof(uint32_t));
+    memcpy(request, &argsLen, sizeof(argsLen));
+
+    const int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if ((server < 0)
+            || (connect(server, (const struct sockaddr*)&address,
+                        sizeof(address))
+                    < 0)
+            || (write_all(server, request, len) < 0)) {
+        perror("signals: could not submit job");
+        free(request);
+        if (server >= 0) {
+            close(server);
+        }
+        return EXIT_SOCKET_ERROR;
+    }
+    free(request);
+
+    char response[maxResponseLen];
+    size_t responseLen = 0;
+    ssize_t nRead = 0;
+
+    while ((responseLen < sizeof(response) - 1)
+            && ((nRead = read(server, response + responseLen,
+                         sizeof(response) - 1 - responseLen))
+                    > 0)) {
+        responseLen += (size_t)nRead;
+    }
+    response[responseLen] = '\0';
+    close(server);
+
+    int result = EXIT_SOCKET_ERROR;
+    if (sscanf(response, "status=%d", &result) != 1) {
+        fputs("signals: no response from daemon.\n", stderr);
+        return EXIT_SOCKET_ERROR;
+    }
+
+    fputs(response, stdout);
+    return result;
+}
@@ -0,0 +1,44 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+/* serve()
+ * -------
+ * Runs signals as a persistent daemon, accepting jobs over a Unix domain
+ * socket and running them on a pool of worker threads. Each worker retains its
+ * pixel buffers between jobs.
+ *
+ * Usage: signals serve --socket <path> [--threads <N>]
+ *
+ * A job request is the list of options that would otherwise be passed on the
+ * command line (e.g. "-i in.bmp -C 1.2 -o out.bmp"), sent as consecutive NUL
+ * terminated strings after their total length in bytes, as a native uint32_t.
+ * The whole request must arrive within 10 seconds, and empty arguments are
+ * rejected as they are on the command line. Relative paths are resolved
+ * against the working directory of the daemon. Jobs may not read stdin or write
+ * to stdout, so options such as "-o -", --print and --dump are rejected, and
+ * results must be written to named files. The response is a single line:
+ *
+ *   status=<exit code> load_ms=<ms> process_ms=<ms> write_ms=<ms> total_ms=<ms>
+ *
+ * argc: Number of arguments.
+ * argv: Program arguments, where argv[1] is "serve".
+ *
+ * Returns: Only returns upon error, or after receiving SIGINT/SIGTERM.
+ */
+int serve(const int argc, char** argv);
+
+/* submit()
+ * --------
+ * Submits a single job to a running daemon, printing the response.
+ *
+ * Usage: signals submit --socket <path> <options>...
+ *
+ * argc: Number of arguments.
+ * argv: Program arguments, where argv[1] is "submit".
+ *
+ * Returns: The exit status of the job, or EXIT_SOCKET_ERROR if the daemon could
+ *          not be reached.
+ */
+int submit(const int argc, char** argv);
+
+#endif
@@ -0,0 +1,437 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "stego.h"
+#include "bandIO.h"
+#include "cache.h"
+#include "fileParsing.h"
+
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
+/* SecretHeader
+ * ------------
+ * Start of an embedded payload, so that it can be found, and checked once
+ * extracted. Values are little endian.
+ */
+typedef struct {
+    char magic[STEGO_MAGIC_LENGTH];
+    uint8_t bits; // Bits per colour channel, or 0 for row padding
+    uint8_t version;
+    uint16_t reserved;
+    uint64_t length; // Bytes of the payload
+    uint64_t checksum; // See hash_bytes()
+} SecretHeader;
+
+constexpr uint8_t secretVersion = 1;
+
+// Frames are followed by a word of zeros, as bits are read a word at a time
+constexpr size_t frameSlack = sizeof(uint64_t);
+
+// Size of the first read of a payload, doubled until the file is read
+constexpr size_t initialSecretCapacity = 1 << 16;
+
+// Rows are extracted in groups of 8, as their bits then end on a byte boundary
+constexpr size_t groupRows = 8;
+
+// Error messages
+constexpr char noSecretMessage[] = "No payload found.\n";
+constexpr char checksumMessage[]
+        = "Payload checksum mismatch, it may be corrupted.\n";
+
+// Low bit of every byte of a word, and the colour bytes of two BGRX pixels
+constexpr uint64_t lowBytes = 0x0101010101010101u;
+constexpr uint64_t colourBytesBGRX = 0x00FFFFFF00FFFFFFu;
+
+int read_secret(Secret* secret, const char* filePath, const uint32_t bits)
+{
+    *secret = (Secret){.bits = bits};
+
+    FILE* file = fopen(filePath, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Error opening file \"%s\" for reading.\n", filePath);
+        return -1;
+    }
+
+    // The payload is read after the space reserved for its header
+    size_t capacity = initialSecretCapacity;
+    size_t length = sizeof(SecretHeader);
+    uint8_t* data = malloc(capacity);
+
+    while (data != NULL) {
+        length += fread(data + length, 1, capacity - length - frameSlack, file);
+
+        if (length < capacity - frameSlack) {
+            break;
+        }
+
+        uint8_t* resized = realloc(data, capacity * 2);
+        if (resized == NULL) {
+            free(data);
+            data = NULL;
+            break;
+        }
+        data = resized;
+        capacity *= 2;
+    }
+
+    const bool failed = (data == NULL) || ferror(file);
+    fclose(file);
+
+    if (failed) {
+        fprintf(stderr, "Error reading \"%s\".\n", filePath);
+        free(data);
+        return -1;
+    }
+
+    SecretHeader header = {
+            .bits = (uint8_t)bits,
+            .version = secretVersion,
+            .length = length - sizeof(SecretHeader),
+    };
+    memcpy(header.magic, STEGO_MAGIC, sizeof(header.magic));
+    header.checksum = hash_bytes(
+            data + sizeof(SecretHeader), (size_t)header.length, 0);
+
+    memcpy(data, &header, sizeof(header));
+    memset(data + length, 0, frameSlack);
+
+    secret->data = data;
+    secret->length = length;
+    return EXIT_SUCCESS;
+}
+
+void free_secret(Secret* secret)
+{
+    free(secret->data);
+    secret->data = NULL;
+    secret->length = 0;
+}
+
+/* deposit_bits()
+ * --------------
+ * Scatters the low bits of the value to the set bits of the mask, in order.
+ */
+static inline uint64_t deposit_bits(uint64_t value, uint64_t mask)
+{
+#ifdef __BMI2__
+    return _pdep_u64(value, mask);
+#else
+    uint64_t result = 0;
+
+    for (; mask; mask &= mask - 1, value >>= 1) {
+        if (value & 1) {
+            result |= mask & (~mask + 1);
+        }
+    }
+    return result;
+#endif
+}
+
+/* gather_bits()
+ * -------------
+ * Packs the bits of the value at the set bits of the mask into the low bits of
+ * the result, in order.
+ */
+static inline uint64_t gather_bits(const uint64_t value, uint64_t mask)
+{
+#ifdef __BMI2__
+    return _pext_u64(value, mask);
+#else
+    uint64_t result = 0;
+
+    for (uint64_t bit = 1; mask; mask &= mask - 1, bit <<= 1) {
+        if (value & mask & (~mask + 1)) {
+            result |= bit;
+        }
+    }
+    return result;
+#endif
+}
+
+/* read_bits()
+ * -----------
+ * Returns: The count bits of the frame starting at the bit given, where count
+ * is at most 32.
+ */
+static inline uint64_t read_bits(
+        const uint8_t* frame, const size_t bit, const uint32_t count)
+{
+    uint64_t word;
+    memcpy(&word, frame + (bit >> 3), sizeof(word));
+    return (word >> (bit & 7)) & ((UINT64_C(1) << count) - 1);
+}
+
+/* channel_mask()
+ * --------------
+ * Returns: Mask of the bits replaced in each word of a row, which are the low
+ * bits of each colour byte.
+ */
+static uint64_t channel_mask(const PixelLayout layout, const uint32_t bits)
+{
+    const uint64_t mask = ((UINT64_C(1) << bits) - 1) * lowBytes;
+    return (layout == LAYOUT_BGRX) ? (mask & colourBytesBGRX) : mask;
+}
+
+size_t lsb_capacity(const Image* image, const uint32_t bits)
+{
+    return (image->width * image->height * 3 * bits) / 8;
+}
+
+/* embed_row()
+ * -----------
+ * Deposits the bits of the frame from first up to end into the row, a word at
+ * a time. The last word used is masked, so that channels past the end of the
+ * frame are unchanged.
+ */
+static void embed_row(uint8_t* row, const size_t rowBytes, const uint64_t mask,
+        const uint8_t* frame, size_t first, const size_t end)
+{
+    for (size_t x = 0; (x < rowBytes) && (first < end); x += sizeof(uint64_t)) {
+        const size_t n = ((rowBytes - x) < sizeof(uint64_t))
+                ? (rowBytes - x)
+                : sizeof(uint64_t);
+
+        // Bytes past the end of the row are excluded from the mask
+        uint64_t wordMask = mask;
+        if (n < sizeof(uint64_t)) {
+            wordMask &= (UINT64_C(1) << (n * 8)) - 1;
+        }
+
+        uint32_t count = (uint32_t)__builtin_popcountll(wordMask);
+        if (count > end - first) {
+            count = (uint32_t)(end - first);
+            wordMask = deposit_bits((UINT64_C(1) << count) - 1, wordMask);
+        }
+
+        uint64_t word = 0;
+        memcpy(&word, row + x, n);
+        word = (word & ~wordMask)
+                | deposit_bits(read_bits(frame, first, count), wordMask);
+        memcpy(row + x, &word, n);
+
+        first += count;
+    }
+}
+
+void embed_lsb(Image* image, const Secret* secret)
+{
+    const size_t rowBytes = image->width * pixel_size(image->layout);
+    const size_t rowBits = image->width * 3 * secret->bits;
+    const size_t end = secret->length * 8;
+    const size_t rows = (end + rowBits - 1) / rowBits;
+    const uint64_t mask = channel_mask(image->layout, secret->bits);
+
+#pragma omp parallel for schedule(static)
+    for (size_t y = 0; y < rows; y++) {
+        embed_row((uint8_t*)image_row(image, y), rowBytes, mask, secret->data,
+                y * rowBits, end);
+    }
+}
+
+/* extract_rows()
+ * --------------
+ * Gathers the bits of the rows first up to last selected by the mask, a word
+ * at a time, stopping once limit bytes have been written.
+ *
+ * Returns: The number of bytes written to out.
+ */
+static size_t extract_rows(uint8_t* out, const size_t limit,
+        const StoredPixels* pixels, const uint64_t mask, const size_t first,
+        const size_t last)
+{
+    const size_t rowBytes = pixels->width * pixels->pixelBytes;
+    uint64_t bits = 0;
+    uint32_t count = 0;
+    size_t written = 0;
+
+    for (size_t y = first; (y < last) && (written < limit); y++) {
+        const uint8_t* row = pixels->data + (y * pixels->rowSize);
+
+        for (size_t x = 0; (x < rowBytes) && (written < limit);
+                x += sizeof(uint64_t)) {
+            const size_t n = ((rowBytes - x) < sizeof(uint64_t))
+                    ? (rowBytes - x)
+                    : sizeof(uint64_t);
+
+            uint64_t wordMask = mask;
+            if (n < sizeof(uint64_t)) {
+                wordMask &= (UINT64_C(1) << (n * 8)) - 1;
+            }
+
+            uint64_t word = 0;
+            memcpy(&word, row + x, n);
+            bits |= gather_bits(word, wordMask) << count;
+            count += (uint32_t)__builtin_popcountll(wordMask);
+
+            for (; (count >= 8) && (written < limit); count -= 8) {
+                out[written++] = (uint8_t)bits;
+                bits >>= 8;
+            }
+        }
+    }
+
+    return written;
+}
+
+/* extract_padding_bytes()
+ * -----------------------
+ * Copies the padding of each row, from the first row, until limit bytes have
+ * been copied or the rows run out.
+ *
+ * Returns: The number of bytes copied.
+ */
+static size_t extract_padding_bytes(
+        uint8_t* out, const size_t limit, const StoredPixels* pixels)
+{
+    const size_t rowBytes = pixels->width * pixels->pixelBytes;
+    const size_t padding = pixels->rowSize - rowBytes;
+    const size_t rows = (padding) ? ((limit + padding - 1) / padding) : 0;
+    const size_t nRows = (rows < pixels->height) ? rows : pixels->height;
+
+#pragma omp parallel for schedule(static)
+    for (size_t y = 0; y < nRows; y++) {
+        const size_t n = ((limit - (y * padding)) < padding)
+                ? (limit - (y * padding))
+                : padding;
+        memcpy(out + (y * padding),
+                pixels->data + (y * pixels->rowSize) + rowBytes, n);
+    }
+
+    return ((nRows * padding) < limit) ? (nRows * padding) : limit;
+}
+
+/* extract_frame()
+ * ---------------
+ * Extracts the first length bytes embedded in the low bits of each channel,
+ * or in the row padding if bits is 0.
+ *
+ * Returns: The number of bytes extracted, which is less than the length if
+ * the pixels run out.
+ */
+static size_t extract_frame(uint8_t* out, const size_t length,
+        const StoredPixels* pixels, const uint32_t bits)
+{
+    if (bits == 0) {
+        return extract_padding_bytes(out, length, pixels);
+    }
+
+    const PixelLayout layout
+            = (pixels->pixelBytes == sizeof(PixelX)) ? LAYOUT_BGRX : LAYOUT_BGR;
+    const uint64_t mask = channel_mask(layout, bits);
+
+    // Each group of rows fills a whole number of bytes
+    const size_t groupBytes = pixels->width * 3 * bits;
+    const size_t groups = (length + groupBytes - 1) / groupBytes;
+    size_t extracted = 0;
+
+#pragma omp parallel for schedule(static) reduction(+ : extracted)
+    for (size_t g = 0; g < groups; g++) {
+        const size_t start = g * groupBytes;
+        const size_t first = g * groupRows;
+        const size_t last = ((first + groupRows) < pixels->height)
+                ? (first + groupRows)
+                : pixels->height;
+
+        if (first < last) {
+            const size_t limit = ((length - start) < groupBytes)
+                    ? (length - start)
+                    : groupBytes;
+            extracted += extract_rows(
+                    out + start, limit, pixels, mask, first, last);
+        }
+    }
+
+    return extracted;
+}
+
+/* find_header()
+ * -------------
+ * Searches the row padding, then the low bits of each channel, for the header
+ * of a payload which fits in the pixels.
+ *
+ * Returns: 0 if found, otherwise -1.
+ */
+static int find_header(SecretHeader* header, const StoredPixels* pixels)
+{
+    const bool colour = (pixels->pixelBytes >= 3);
+    const size_t nPixels = pixels->width * pixels->height;
+
+    for (uint32_t bits = 0; bits <= STEGO_MAX_BITS; bits++) {
+        if ((bits != 0) && !colour) {
+            break;
+        }
+
+        const size_t capacity = (bits) ? ((nPixels * 3 * bits) / 8)
+                : ((pixels->rowSize - (pixels->width * pixels->pixelBytes))
+                          * pixels->height);
+
+        if ((extract_frame((uint8_t*)header, sizeof(*header), pixels, bits)
+                    == sizeof(*header))
+                && !memcmp(header->magic, STEGO_MAGIC, sizeof(header->magic))
+                && (header->bits == bits) && (header->version == secretVersion)
+                && (header->length <= capacity - sizeof(*header))) {
+            return EXIT_SUCCESS;
+        }
+    }
+
+    return -1;
+}
+
+int extract_secret(Secret* secret, const StoredPixels* pixels)
+{
+    *secret = (Secret){0};
+
+    SecretHeader header;
+    if (find_header(&header, pixels) == -1) {
+        fputs(noSecretMessage, stderr);
+        return -1;
+    }
+
+    const size_t length = sizeof(header) + (size_t)header.length;
+    uint8_t* data = malloc(length + frameSlack);
+    if (data == NULL) {
+        perror("malloc failed while extracting payload");
+        return -1;
+    }
+
+    if ((extract_frame(data, length, pixels, header.bits) != length)
+            || (hash_bytes(data + sizeof(header), (size_t)header.length, 0)
+                    != header.checksum)) {
+        fputs(checksumMessage, stderr);
+        free(data);
+        return -1;
+    }
+
+    secret->data = data;
+    secret->length = length;
+    secret->bits = header.bits;
+    return EXIT_SUCCESS;
+}
+
+int write_secret(const Secret* secret, const char* filePath)
+{
+    const int fd = open_output(filePath);
+    if (fd < 0) {
+        fprintf(stderr, "Error opening file \"%s\" for writing.\n", filePath);
+        return -1;
+    }
+
+    const size_t length = secret->length - sizeof(SecretHeader);
+    BandTransfer transfer;
+    start_band_write(
+            &transfer, fd, secret->data + sizeof(SecretHeader), length);
+
+    int result = (finish_band_transfer(&transfer) == length) ? EXIT_SUCCESS
+                                                              : -1;
+    if (close(fd) != 0) {
+        result = -1;
+    }
+
+    if (result == -1) {
+        perror("signals: could not write payload");
+    }
+    return result;
+}
@@ -0,0 +1,104 @@
+#ifndef STEGO_H
+#define STEGO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "pixels.h"
+
+// Payloads replace at most this many low bits of each colour channel, while
+// 0 hides them in row padding instead, leaving the pixels unchanged
+#define STEGO_MAX_BITS 4
+
+// Magic bytes at the start of an embedded payload
+#define STEGO_MAGIC "SIGM"
+#define STEGO_MAGIC_LENGTH 4
+
+/* Secret
+ * ------
+ * A payload framed for embedding: a header giving its length, checksum and
+ * the bits it replaces, followed by the payload itself. The frame is followed
+ * in memory by zeros, so that it can be read a word at a time.
+ */
+typedef struct {
+    uint8_t* data;
+    size_t length; // Bytes of the header and payload
+    uint32_t bits; // Bits per colour channel, or 0 for row padding
+} Secret;
+
+/* StoredPixels
+ * ------------
+ * Pixel data as it is stored in a file, which payloads are extracted from
+ * without being loaded into an image. Rows are padded to rowSize bytes.
+ */
+typedef struct {
+    const uint8_t* data;
+    size_t width;
+    size_t height;
+    size_t pixelBytes; // 3 for BGR, 4 for BGRA, or 1 for palette indices
+    size_t rowSize;
+} StoredPixels;
+
+/* read_secret()
+ * -------------
+ * Reads the entire file to embed, then frames it.
+ *
+ * secret: Destination for the framed payload, freed with free_secret().
+ * filePath: Path of the file to embed.
+ * bits: Bits per colour channel to embed it in, or 0 for row padding.
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+[[nodiscard]] int read_secret(
+        Secret* secret, const char* filePath, const uint32_t bits);
+
+/* free_secret()
+ * -------------
+ * Frees the framed payload.
+ */
+void free_secret(Secret* secret);
+
+/* lsb_capacity()
+ * --------------
+ * Returns: The number of bytes, including the header, which can be embedded
+ * in the colour channels of the image.
+ */
+size_t lsb_capacity(const Image* image, const uint32_t bits);
+
+/* embed_lsb()
+ * -----------
+ * Replaces the low bits of the colour channels of the image with the framed
+ * payload, starting from the first stored row, leaving any alpha unchanged.
+ * Bits are deposited into 8 bytes of each row at a time, with rows embedded
+ * in parallel.
+ *
+ * image: BGR or BGRX image, with at least lsb_capacity() of the frame.
+ * secret: Framed payload, with bits of 1 to STEGO_MAX_BITS.
+ */
+void embed_lsb(Image* image, const Secret* secret);
+
+/* extract_secret()
+ * ----------------
+ * Finds a payload embedded by embed_lsb() or in row padding, extracts it in a
+ * single pass over the rows it occupies, then checks its length and checksum.
+ * Bits are gathered from 8 bytes of each row at a time, with groups of rows
+ * extracted in parallel.
+ *
+ * secret: Destination for the framed payload, freed with free_secret().
+ * pixels: Stored pixel data to search.
+ *
+ * Returns: 0 on success, -1 if no valid payload is found.
+ */
+[[nodiscard]] int extract_secret(Secret* secret, const StoredPixels* pixels);
+
+/* write_secret()
+ * --------------
+ * Writes the payload of an extracted frame, without its header, in a single
+ * write.
+ *
+ * filePath: Path of the file to write, or STREAM_PATH for stdout.
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+[[nodiscard]] int write_secret(const Secret* secret, const char* filePath);
+
+#endif
@@ -0,0 +1,457 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "tiles.h"
+#include "bandIO.h"
+#include "imageEditing.h"
+#include "lz.h"
+
+/* TiledHeader
+ * -----------
+ * Start of a tiled file, followed by an index of the tiles, then the tiles
+ * themselves. Tiles are square, apart from those at the right and bottom
+ * edges, and are indexed row by row from the top left. The pixels of each tile
+ * are stored top down in BGR or BGRA order, so that they can be copied
+ * straight into an image. Values are little endian.
+ */
+typedef struct {
+    char magic[TILED_MAGIC_LENGTH];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t tileSize; // Width and height of each tile in pixels
+    uint32_t channels; // 3 for BGR, or 4 for BGRA
+} TiledHeader;
+
+// Entry of the index, giving where a tile is stored and how
+typedef struct {
+    uint64_t offset; // Position of the tile from the start of the file
+    uint32_t length; // Length of the stored tile in bytes
+    uint32_t codec;
+} TileEntry;
+
+// Codecs of stored tiles
+constexpr uint32_t tileUncompressed = 0;
+constexpr uint32_t tileCompressed = 1; // See lz_compress()
+
+constexpr uint32_t tiledVersion = 1;
+
+// Size of the tiles written, and the largest tiles which are read
+constexpr uint32_t tileSize = 256;
+constexpr uint32_t tileSizeMax = 4096;
+
+// Channels of BGR and BGRA pixels
+constexpr size_t bgrChannels = 3;
+constexpr size_t bgraChannels = 4;
+
+// Error messages
+constexpr char invalidTiledMessage[] = "Invalid tiled file, %s.\n";
+constexpr char corruptTilesMessage[] = "Tiled file has corrupt tiles.\n";
+
+/* TileGrid
+ * --------
+ * Dimensions of a tiled image, and the number of columns and rows of tiles
+ * needed to cover it.
+ */
+typedef struct {
+    size_t width;
+    size_t height;
+    size_t tileSize;
+    size_t channels;
+    size_t columns;
+    size_t rows;
+} TileGrid;
+
+static TileGrid tile_grid(const TiledHeader* header)
+{
+    const size_t size = header->tileSize;
+
+    return (TileGrid){
+            .width = header->width,
+            .height = header->height,
+            .tileSize = size,
+            .channels = header->channels,
+            .columns = (header->width + size - 1) / size,
+            .rows = (header->height + size - 1) / size,
+    };
+}
+
+/* check_tiled_header()
+ * --------------------
+ * Returns: 0 if the header describes an image which can be loaded, otherwise
+ * -1.
+ */
+static int check_tiled_header(const TiledHeader* header)
+{
+    const char* problem = NULL;
+
+    if (memcmp(header->magic, TILED_MAGIC, TILED_MAGIC_LENGTH)) {
+        problem = "missing magic bytes";
+    } else if (header->version != tiledVersion) {
+        problem = "unsupported version";
+    } else if (!header->width || !header->height
+            || (header->width > INT32_MAX) || (header->height > INT32_MAX)) {
+        problem = "invalid dimensions";
+    } else if (!header->tileSize || (header->tileSize > tileSizeMax)) {
+        problem = "invalid tile size";
+    } else if ((header->channels != bgrChannels)
+            && (header->channels != bgraChannels)) {
+        problem = "unsupported channels";
+    } else if (header->height
+            > (SIZE_MAX / header->channels) / header->width) {
+        problem = "image is too large";
+    }
+
+    if (problem != NULL) {
+        fprintf(stderr, invalidTiledMessage, problem);
+        return -1;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int read_tiled_header(BMP* bmpImage)
+{
+    TiledHeader header;
+
+    if ((fread(&header, sizeof(header), 1, bmpImage->file) != 1)
+            || (check_tiled_header(&header) == -1)) {
+        return -1;
+    }
+
+    const TileGrid grid = tile_grid(&header);
+    const size_t indexSize = grid.columns * grid.rows * sizeof(TileEntry);
+
+    describe_pixels(bmpImage, grid.width, grid.height,
+            (grid.channels == bgraChannels), sizeof(header) + indexSize);
+    return EXIT_SUCCESS;
+}
+
+/* load_tile()
+ * -----------
+ * Decompresses a tile, then copies the part of it which lies within the window
+ * into the image.
+ *
+ * data: Contents of the file.
+ * length: Length of the file in bytes.
+ * grid: Layout of the tiles.
+ * column: Column of the tile.
+ * row: Row of the tile.
+ * image: Destination, holding the window of the file bottom up.
+ * window: Rectangle of the file to load, with rows counted top down.
+ * scratch: Buffer large enough for a decompressed tile.
+ *
+ * Returns: 0 on success, -1 if the tile is corrupt.
+ */
+static int load_tile(const uint8_t* data, const size_t length,
+        const TileGrid* grid, const size_t column, const size_t row,
+        Image* image, const Region* window, uint8_t* scratch)
+{
+    const size_t channels = grid->channels;
+    const size_t left = column * grid->tileSize;
+    const size_t top = row * grid->tileSize;
+    const size_t width = ((grid->width - left) < grid->tileSize)
+            ? (grid->width - left)
+            : grid->tileSize;
+    const size_t height = ((grid->height - top) < grid->tileSize)
+            ? (grid->height - top)
+            : grid->tileSize;
+    const size_t rowSize = width * channels;
+
+    TileEntry entry;
+    memcpy(&entry,
+            data + sizeof(TiledHeader)
+                    + (((row * grid->columns) + column) * sizeof(entry)),
+            sizeof(entry));
+
+    if ((entry.offset > length) || (entry.length > length - entry.offset)) {
+        return -1;
+    }
+
+    const uint8_t* pixels = data + entry.offset;
+
+    if (entry.codec == tileCompressed) {
+        if (lz_decompress(scratch, rowSize * height, pixels, entry.length)
+                == -1) {
+            return -1;
+        }
+        pixels = scratch;
+
+    } else if ((entry.codec != tileUncompressed)
+            || (entry.length != rowSize * height)) {
+        return -1;
+    }
+
+    // Part of the tile within the window
+    const size_t startX = (left > window->x) ? left : window->x;
+    const size_t endX = ((left + width) < (window->x + window->width))
+            ? (left + width)
+            : (window->x + window->width);
+    const size_t startY = (top > window->y) ? top : window->y;
+    const size_t endY = ((top + height) < (window->y + window->height))
+            ? (top + height)
+            : (window->y + window->height);
+    const size_t bytesPerPixel = pixel_size(image->layout);
+
+    for (size_t y = startY; y < endY; y++) {
+        const size_t imageRow = image->height - 1 - (y - window->y);
+        const uint8_t* src
+                = pixels + ((y - top) * rowSize) + ((startX - left) * channels);
+        uint8_t* dest = (uint8_t*)image_row(image, imageRow)
+                + ((startX - window->x) * bytesPerPixel);
+
+        if ((channels == bgrChannels) && (image->layout == LAYOUT_BGRX)) {
+            expand_pixel_row((PixelX*)dest, (const Pixel*)src, endX - startX);
+        } else {
+            memcpy(dest, src, (endX - startX) * channels);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+Image* load_tiles(BMP* bmpImage, const Region* region)
+{
+    // Tiles are read out of order when only a region is loaded
+    FileSpan span;
+    if (map_span(&span, bmpImage->file, 0, SPAN_TO_END, false) == -1) {
+        fprintf(stderr, invalidTiledMessage, "could not be read");
+        return NULL;
+    }
+    const uint8_t* data = span.data;
+    const size_t length = span.length;
+
+    // The header was checked when read, however the file may since have been
+    // replaced
+    TiledHeader header;
+    if (length < sizeof(header)) {
+        fprintf(stderr, invalidTiledMessage, "header is truncated");
+        release_span(&span);
+        return NULL;
+    }
+
+    memcpy(&header, data, sizeof(header));
+    const TileGrid grid = tile_grid(&header);
+    if ((check_tiled_header(&header) == -1)
+            || ((int32_t)grid.width != (bmpImage->infoHeader).bitmapWidth)
+            || ((int32_t)grid.height != (bmpImage->infoHeader).bitmapHeight)) {
+        release_span(&span);
+        return NULL;
+    }
+
+    if ((length - sizeof(header)) / sizeof(TileEntry)
+            < grid.columns * grid.rows) {
+        fprintf(stderr, invalidTiledMessage, "index is truncated");
+        release_span(&span);
+        return NULL;
+    }
+
+    const Region whole = {.width = grid.width, .height = grid.height};
+    if (region == NULL) {
+        region = &whole;
+    }
+
+    Image* image = create_image_with_layout((int32_t)region->width,
+            (int32_t)region->height,
+            (grid.channels == bgraChannels) ? LAYOUT_BGRX : bmpImage->layout);
+    if (image == NULL) {
+        release_span(&span);
+        return NULL;
+    }
+
+    // Tiles are stored top down, so the region begins this many rows down
+    const Region window = {
+            .x = region->x,
+            .y = grid.height - (region->y + region->height),
+            .width = region->width,
+            .height = region->height,
+    };
+
+    // Only the tiles overlapping the window are decompressed
+    const size_t firstColumn = window.x / grid.tileSize;
+    const size_t firstRow = window.y / grid.tileSize;
+    const size_t nColumns
+            = ((window.x + window.width - 1) / grid.tileSize) - firstColumn + 1;
+    const size_t nRows
+            = ((window.y + window.height - 1) / grid.tileSize) - firstRow + 1;
+    const size_t tileBytes = grid.tileSize * grid.tileSize * grid.channels;
+    int failed = 0;
+
+#pragma omp parallel reduction(| : failed)
+    {
+        uint8_t* scratch = malloc(tileBytes);
+        failed |= (scratch == NULL);
+
+#pragma omp for schedule(dynamic)
+        for (size_t i = 0; i < nColumns * nRows; i++) {
+            if (scratch != NULL) {
+                failed |= (load_tile(data, length, &grid,
+                                   firstColumn + (i % nColumns),
+                                   firstRow + (i / nColumns), image, &window,
+                                   scratch)
+                        == -1);
+            }
+        }
+
+        free(scratch);
+    }
+
+    release_span(&span);
+
+    if (failed) {
+        fputs(corruptTilesMessage, stderr);
+        free_image(&image);
+    }
+    return image;
+}
+
+/* gather_tile()
+ * -------------
+ * Copies the pixels of a tile from the image, top row first, converting them
+ * to BGR or BGRA.
+ */
+static void gather_tile(uint8_t* restrict dest, const Image* image,
+        const TileGrid* grid, const size_t left, const size_t top,
+        const size_t width, const size_t height, const bool bottomUp)
+{
+    const size_t channels = grid->channels;
+
+    for (size_t y = top; y < top + height; y++) {
+        const size_t row = (bottomUp) ? (image->height - 1 - y) : y;
+        const uint8_t* src = (const uint8_t*)image_row(image, row)
+                + (left * pixel_size(image->layout));
+        uint8_t* out = dest + ((y - top) * width * channels);
+
+        if (image->layout == LAYOUT_INDEX8) {
+            decode_index_row(out, LAYOUT_BGR, src, image->palette, width);
+        } else if ((image->layout == LAYOUT_BGRX)
+                && (channels == bgrChannels)) {
+            pack_pixel_row((Pixel*)out, (const PixelX*)src, width);
+        } else {
+            memcpy(out, src, width * channels);
+        }
+    }
+}
+
+int write_tiles(const BMP* bmpImage, const char* filename)
+{
+    const Image* image = bmpImage->image;
+    const bool alpha = (image->layout == LAYOUT_BGRX)
+            && ((bmpImage->infoHeader).bitsPerPixel == 32);
+
+    // Images are stored bottom up unless the height is negative
+    const bool bottomUp = ((bmpImage->infoHeader).bitmapHeight > 0);
+
+    TiledHeader header = {
+            .version = tiledVersion,
+            .width = (uint32_t)image->width,
+            .height = (uint32_t)image->height,
+            .tileSize = tileSize,
+            .channels = (uint32_t)((alpha) ? bgraChannels : bgrChannels),
+    };
+    memcpy(header.magic, TILED_MAGIC, TILED_MAGIC_LENGTH);
+
+    const TileGrid grid = tile_grid(&header);
+    const size_t nTiles = grid.columns * grid.rows;
+    const size_t tileBytes = grid.tileSize * grid.tileSize * grid.channels;
+    const size_t stride = LZ_BOUND(tileBytes);
+
+    TileEntry* index = malloc(nTiles * sizeof(TileEntry));
+    uint8_t* tiles = malloc(nTiles * stride);
+    if ((index == NULL) || (tiles == NULL)) {
+        free(index);
+        free(tiles);
+        return -1;
+    }
+
+    int failed = 0;
+
+#pragma omp parallel reduction(| : failed)
+    {
+        uint8_t* scratch = malloc(tileBytes);
+        failed |= (scratch == NULL);
+
+#pragma omp for schedule(dynamic)
+        for (size_t i = 0; i < nTiles; i++) {
+            const size_t left = (i % grid.columns) * grid.tileSize;
+            const size_t top = (i / grid.columns) * grid.tileSize;
+            const size_t width = ((grid.width - left) < grid.tileSize)
+                    ? (grid.width - left)
+                    : grid.tileSize;
+            const size_t height = ((grid.height - top) < grid.tileSize)
+                    ? (grid.height - top)
+                    : grid.tileSize;
+            const size_t size = width * height * grid.channels;
+            uint8_t* dest = tiles + (i * stride);
+
+            if (scratch == NULL) {
+                continue;
+            }
+
+            gather_tile(scratch, image, &grid, left, top, width, height,
+                    bottomUp);
+
+            // Tiles which do not shrink are stored as they are
+            const size_t length = lz_compress(dest, scratch, size);
+            index[i].codec = (length < size) ? tileCompressed
+                                             : tileUncompressed;
+            index[i].length = (uint32_t)((length < size) ? length : size);
+
+            if (length >= size) {
+                memcpy(dest, scratch, size);
+            }
+        }
+
+        free(scratch);
+    }
+
+    if (failed) {
+        free(index);
+        free(tiles);
+        return -1;
+    }
+
+    // Tiles are packed together in the order of the index, which never moves
+    // a tile past the start of the next
+    const size_t indexSize = nTiles * sizeof(TileEntry);
+    size_t packed = 0;
+
+    for (size_t i = 0; i < nTiles; i++) {
+        index[i].offset = sizeof(header) + indexSize + packed;
+        memmove(tiles + packed, tiles + (i * stride), index[i].length);
+        packed += index[i].length;
+    }
+
+    const int output = open_output(filename);
+    if (output < 0) {
+        fprintf(stderr, "Error opening file \"%s\" for writing.\n", filename);
+        free(index);
+        free(tiles);
+        return -1;
+    }
+
+    const void* parts[] = {&header, index, tiles};
+    const size_t lengths[] = {sizeof(header), indexSize, packed};
+    int result = EXIT_SUCCESS;
+
+    for (size_t i = 0; (i < sizeof(parts) / sizeof(parts[0])) && !result;
+            i++) {
+        BandTransfer transfer;
+        start_band_write(&transfer, output, parts[i], lengths[i]);
+
+        if (finish_band_transfer(&transfer) != lengths[i]) {
+            result = -1;
+        }
+    }
+
+    free(index);
+    free(tiles);
+
+    if ((close(output) != 0) || (result == -1)) {
+        perror("signals: could not write output");
+        return -1;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,50 @@
+#ifndef TILES_H
+#define TILES_H
+
+#include "fileParsing.h"
+#include "pixels.h"
+
+// Magic bytes at the start of a tiled (.sig) file
+#define TILED_MAGIC "SIGT"
+#define TILED_MAGIC_LENGTH 4
+
+/* read_tiled_header()
+ * -------------------
+ * Reads the header of a tiled file, then describes the pixel data with the
+ * headers of the equivalent BMP (see describe_pixels()).
+ *
+ * bmpImage: Opened image, whose format is FORMAT_SIG.
+ *
+ * Returns: 0 on success, -1 if the header is invalid or unsupported.
+ */
+[[nodiscard]] int read_tiled_header(BMP* bmpImage);
+
+/* load_tiles()
+ * ------------
+ * Loads the pixel data of a tiled file, which is mapped into memory rather
+ * than read. Only the tiles overlapping the region are decompressed, in
+ * parallel. Rows are stored bottom up, as for a BMP, and images with alpha
+ * are always loaded as LAYOUT_BGRX.
+ *
+ * bmpImage: Image whose headers have been read.
+ * region: Rectangle of the stored pixel data to load, with rows counted bottom
+ *         up, or NULL to load the entire image.
+ *
+ * Returns: The loaded image, or NULL on error.
+ */
+[[nodiscard]] Image* load_tiles(BMP* bmpImage, const Region* region);
+
+/* write_tiles()
+ * -------------
+ * Writes the image as a tiled file, top row first. Tiles are compressed in
+ * parallel, and those which do not shrink are stored uncompressed. Alpha is
+ * retained if the image has it, while indexed images are expanded.
+ *
+ * bmpImage: Image to write, along with the headers describing it.
+ * filename: Path of the file to write.
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+[[nodiscard]] int write_tiles(const BMP* bmpImage, const char* filename);
+
+#endif